@@ -12,6 +12,13 @@
 # OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 # PERFORMANCE OF THIS SOFTWARE.
 
+option(YAGBE_ENABLE_SIMD
+       "Use SSE2 or NEON pixel kernels when the target supports them" ON)
+option(YAGBE_ENABLE_PROFILE
+       "Build the core with the hot-path profiler hooks" OFF)
+option(YAGBE_ENABLE_LAZY_FLAGS
+       "Work out the CPU flags only when something reads them" OFF)
+
 function(yagbe_configure_c_target TARGET_NAME)
   set_target_properties(${TARGET_NAME} PROPERTIES
                         C_STANDARD 90
@@ -37,4 +44,17 @@ function(yagbe_configure_c_target TARGET_NAME)
 
   target_compile_options(${TARGET_NAME} PRIVATE ${MAIN_COMPILER_FLAGS})
   target_compile_definitions(${TARGET_NAME} PRIVATE -D_CRT_SECURE_NO_WARNINGS)
+
+  if (NOT YAGBE_ENABLE_SIMD)
+    target_compile_definitions(${TARGET_NAME} PRIVATE -DLIBYAGBE_NO_SIMD)
+  endif()
+
+  if (YAGBE_ENABLE_PROFILE)
+    target_compile_definitions(${TARGET_NAME} PRIVATE -DLIBYAGBE_ENABLE_PROFILE)
+  endif()
+
+  if (YAGBE_ENABLE_LAZY_FLAGS)
+    target_compile_definitions(${TARGET_NAME} PRIVATE
+                               -DLIBYAGBE_ENABLE_LAZY_FLAGS)
+  endif()
 endfunction()
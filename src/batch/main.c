@@ -0,0 +1,564 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* yagbebatch runs every ROM listed in a manifest for a fixed budget, spreading
+ * the work across all processors, and writes one JSON record per ROM.
+ *
+ * Each manifest line names a ROM file, optionally followed by its own budget
+ * as either "cycles=N" or "frames=N". Blank lines and lines starting with '#'
+ * are ignored.
+ *
+ * Every worker thread owns a queue of jobs. A worker takes jobs from the back
+ * of its own queue and, once that runs dry, steals from the front of the
+ * others' queues, so a handful of long-running ROMs can't leave the remaining
+ * processors idle.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "exec_memory.h"
+#include "format.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/rom.h"
+#include "thread.h"
+
+/** The number of T-cycles in one frame. */
+#define CYCLES_PER_FRAME 70224UL
+
+/** The budget used for manifest lines which don't specify their own. */
+#define DEFAULT_BUDGET (CYCLES_PER_FRAME * 3600UL)
+
+/** The most serial output kept per ROM; anything beyond it is dropped. */
+#define MAX_SERIAL_OUTPUT 65536
+
+/** How many bytes of host code each worker's JIT can compile. */
+#define JIT_CODE_SIZE (4UL * 1024UL * 1024UL)
+
+/** How many compiled blocks each worker's JIT can look up at once. */
+#define JIT_BLOCKS 16384
+
+/** Defines a single ROM to run and, once it has run, its results. */
+struct job {
+  char* rom_path;
+
+  /** How many T-cycles the ROM should be run for. */
+  unsigned long budget;
+
+  /** If the job could not be run, why not. */
+  const char* error;
+
+  char* serial;
+  size_t serial_length;
+  size_t serial_capacity;
+
+  struct libyagbe_cpu_registers reg;
+  uintmax_t cycles;
+
+  /** How many reads and writes nothing on the bus responded to. */
+  unsigned long unhandled[LIBYAGBE_DIAG_NUM_ACCESS_TYPES];
+};
+
+/** Defines the queue of jobs owned by a worker.
+ *
+ * The owner takes jobs from the tail while thieves take them from the head,
+ * which keeps the two sides from fighting over the same end.
+ */
+struct work_queue {
+  yagbe_mutex mutex;
+
+  size_t* jobs;
+  size_t head;
+  size_t tail;
+};
+
+struct batch;
+
+struct worker {
+  struct batch* batch;
+  size_t index;
+
+  struct work_queue queue;
+  yagbe_thread thread;
+
+  /** The JIT the worker's jobs execute from, or NULL to interpret. Each
+   * worker has its own, as compiled code is tied to a single ROM. */
+  struct libyagbe_jit* jit;
+  struct libyagbe_jit jit_storage;
+  struct libyagbe_jit_block* jit_blocks;
+  void* jit_code;
+};
+
+struct batch {
+  struct job* jobs;
+  size_t num_jobs;
+
+  struct worker* workers;
+  size_t num_workers;
+};
+
+static void* checked_malloc(const size_t size) {
+  void* const ptr = malloc(size);
+
+  if (ptr == NULL) {
+    fprintf(stderr, "malloc() failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+static void* checked_realloc(void* const ptr, const size_t size) {
+  void* const new_ptr = realloc(ptr, size);
+
+  if (new_ptr == NULL) {
+    fprintf(stderr, "realloc() failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return new_ptr;
+}
+
+static void handle_serial_output(void* const userdata, const uint8_t data) {
+  struct job* const job = (struct job*)userdata;
+
+  if (job->serial_length == MAX_SERIAL_OUTPUT) {
+    return;
+  }
+
+  if (job->serial_length == job->serial_capacity) {
+    job->serial_capacity = (job->serial_capacity == 0)
+                               ? 256
+                               : job->serial_capacity * 2;
+    job->serial = checked_realloc(job->serial, job->serial_capacity);
+  }
+  job->serial[job->serial_length++] = (char)data;
+}
+
+static void run_job(struct job* const job, struct libyagbe_jit* const jit) {
+  struct libyagbe_system* gb;
+  struct libyagbe_rom rom;
+
+  /* strerror() isn't guaranteed to be thread-safe, so don't bother. */
+  if (!libyagbe_rom_open(&rom, job->rom_path)) {
+    job->error = "unable to load ROM";
+    return;
+  }
+
+  gb = checked_malloc(sizeof(struct libyagbe_system));
+
+  if (!libyagbe_system_init(gb, rom.data, rom.size)) {
+    job->error = "unsupported cartridge";
+
+    free(gb);
+    libyagbe_rom_close(&rom);
+    return;
+  }
+  libyagbe_system_set_serial_cb(gb, &handle_serial_output, job);
+
+  /* Nothing here looks at the screen. */
+  libyagbe_system_set_render(gb, false);
+
+  if (jit != NULL) {
+    libyagbe_jit_clear(jit);
+    libyagbe_system_set_jit(gb, jit);
+  }
+
+  job->cycles = libyagbe_system_run(gb, job->budget);
+  job->reg = gb->cpu.reg;
+  memcpy(job->unhandled, gb->bus.diag.total_hits, sizeof(job->unhandled));
+
+  free(gb);
+  libyagbe_rom_close(&rom);
+}
+
+/** Takes the most recently queued job from a worker's own queue.
+ *
+ * @returns true if a job was taken, false if the queue is empty.
+ */
+static bool pop_job(struct work_queue* const queue, size_t* const job) {
+  bool found;
+
+  yagbe_mutex_lock(&queue->mutex);
+  found = queue->head != queue->tail;
+
+  if (found) {
+    *job = queue->jobs[--queue->tail];
+  }
+
+  yagbe_mutex_unlock(&queue->mutex);
+  return found;
+}
+
+/** Takes the oldest queued job from another worker's queue.
+ *
+ * @returns true if a job was taken, false if the queue is empty.
+ */
+static bool steal_job(struct work_queue* const queue, size_t* const job) {
+  bool found;
+
+  yagbe_mutex_lock(&queue->mutex);
+  found = queue->head != queue->tail;
+
+  if (found) {
+    *job = queue->jobs[queue->head++];
+  }
+
+  yagbe_mutex_unlock(&queue->mutex);
+  return found;
+}
+
+static void worker_main(void* const userdata) {
+  struct worker* const worker = (struct worker*)userdata;
+  struct batch* const batch = worker->batch;
+
+  for (;;) {
+    size_t job;
+    size_t victim;
+    bool found;
+
+    found = pop_job(&worker->queue, &job);
+
+    /* Nothing is ever queued once the workers have started, so if every
+     * queue is empty there's nothing left to do. */
+    for (victim = 1; !found && (victim < batch->num_workers); ++victim) {
+      const size_t index = (worker->index + victim) % batch->num_workers;
+      found = steal_job(&batch->workers[index].queue, &job);
+    }
+
+    if (!found) {
+      return;
+    }
+    run_job(&batch->jobs[job], worker->jit);
+  }
+}
+
+/** Parses a number of cycles or frames into a budget of T-cycles.
+ *
+ * @returns true if the number was parsed and the budget fits, false
+ * otherwise.
+ */
+static bool parse_count(const char* const number,
+                        const unsigned long multiplier,
+                        unsigned long* const budget) {
+  const char* sign = number;
+  unsigned long value;
+  char* end;
+
+  /* strtoul would otherwise take "-1" as a huge count. */
+  while (isspace((unsigned char)*sign)) {
+    ++sign;
+  }
+
+  if (*sign == '-') {
+    return false;
+  }
+
+  errno = 0;
+  value = strtoul(number, &end, 10);
+
+  if ((end == number) || (*end != '\0') || (errno != 0) ||
+      (value > (ULONG_MAX / multiplier))) {
+    return false;
+  }
+  *budget = value * multiplier;
+  return true;
+}
+
+/** Parses a budget of the form "cycles=N" or "frames=N".
+ *
+ * @returns true if the budget was parsed, false otherwise.
+ */
+static bool parse_budget(const char* const str, unsigned long* const budget) {
+  if (strncmp(str, "cycles=", 7) == 0) {
+    return parse_count(str + 7, 1, budget);
+  }
+
+  if (strncmp(str, "frames=", 7) == 0) {
+    return parse_count(str + 7, CYCLES_PER_FRAME, budget);
+  }
+  return false;
+}
+
+static char* duplicate_string(const char* const str) {
+  const size_t length = strlen(str);
+  char* const copy = checked_malloc(length + 1);
+
+  memcpy(copy, str, length + 1);
+  return copy;
+}
+
+static void read_manifest(struct batch* const batch, const char* const path,
+                          const unsigned long default_budget) {
+  FILE* const manifest = fopen(path, "r");
+  size_t capacity;
+  char line[4096];
+
+  if (manifest == NULL) {
+    fprintf(stderr, "unable to open manifest %s: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  capacity = 0;
+
+  while (fgets(line, sizeof(line), manifest) != NULL) {
+    char* start = line;
+    char* end = line + strlen(line);
+    char* budget_str;
+    struct job* job;
+
+    while ((end != start) && strchr(" \t\r\n", end[-1]) != NULL) {
+      *--end = '\0';
+    }
+
+    while ((*start == ' ') || (*start == '\t')) {
+      start++;
+    }
+
+    if ((*start == '\0') || (*start == '#')) {
+      continue;
+    }
+
+    if (batch->num_jobs == capacity) {
+      capacity = (capacity == 0) ? 64 : capacity * 2;
+      batch->jobs = checked_realloc(batch->jobs, capacity * sizeof(struct job));
+    }
+
+    job = &batch->jobs[batch->num_jobs++];
+    memset(job, 0, sizeof(struct job));
+
+    job->budget = default_budget;
+    budget_str = strrchr(start, ' ');
+
+    if (budget_str == NULL) {
+      budget_str = strrchr(start, '\t');
+    }
+
+    if ((budget_str != NULL) && parse_budget(budget_str + 1, &job->budget)) {
+      while ((budget_str != start) && strchr(" \t", budget_str[-1]) != NULL) {
+        budget_str--;
+      }
+      *budget_str = '\0';
+    }
+    job->rom_path = duplicate_string(start);
+  }
+  fclose(manifest);
+}
+
+static void write_json_string(FILE* const file, const char* const str,
+                              const size_t length) {
+  size_t i;
+
+  fputc('"', file);
+
+  for (i = 0; i < length; ++i) {
+    const unsigned char c = (unsigned char)str[i];
+
+    if ((c == '"') || (c == '\\')) {
+      fputc('\\', file);
+      fputc(c, file);
+    } else if (c == '\n') {
+      fputs("\\n", file);
+    } else if ((c < 0x20) || (c >= 0x7F)) {
+      fprintf(file, "\\u%04X", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+static void write_result(FILE* const file, const struct job* const job) {
+  char cycles[YAGBE_FORMAT_UINTMAX_SIZE];
+
+  fputs("{\"rom\":", file);
+  write_json_string(file, job->rom_path, strlen(job->rom_path));
+
+  if (job->error != NULL) {
+    fputs(",\"error\":", file);
+    write_json_string(file, job->error, strlen(job->error));
+    fputs("}\n", file);
+
+    return;
+  }
+
+  fprintf(file,
+          ",\"cycles\":%s,\"registers\":{\"af\":\"%04X\",\"bc\":\"%04X\","
+          "\"de\":\"%04X\",\"hl\":\"%04X\",\"sp\":\"%04X\",\"pc\":\"%04X\"},"
+          "\"serial\":",
+          yagbe_format_uintmax(cycles, job->cycles), job->reg.af.value,
+          job->reg.bc.value, job->reg.de.value, job->reg.hl.value,
+          job->reg.sp.value, job->reg.pc.value);
+
+  write_json_string(file, job->serial, job->serial_length);
+  fprintf(file, ",\"unhandled\":{\"reads\":%lu,\"writes\":%lu}}\n",
+          job->unhandled[LIBYAGBE_DIAG_ACCESS_READ],
+          job->unhandled[LIBYAGBE_DIAG_ACCESS_WRITE]);
+}
+
+static void usage(const char* const argv0) {
+  fprintf(stderr,
+          "%s: Syntax: %s [-j threads] [-o output] [-c cycles | -f frames] "
+          "[-J] manifest\n",
+          argv0, argv0);
+}
+
+int main(int argc, char* argv[]) {
+  struct batch batch;
+  unsigned long default_budget;
+  const char* output_path;
+  const char* manifest_path;
+  FILE* output;
+  size_t num_threads;
+  size_t i;
+  int arg;
+  bool use_jit;
+
+  default_budget = DEFAULT_BUDGET;
+  output_path = NULL;
+  manifest_path = NULL;
+  num_threads = yagbe_cpu_count();
+  use_jit = false;
+
+  for (arg = 1; arg < argc; ++arg) {
+    if ((strcmp(argv[arg], "-j") == 0) && (arg + 1 < argc)) {
+      num_threads = strtoul(argv[++arg], NULL, 10);
+    } else if ((strcmp(argv[arg], "-o") == 0) && (arg + 1 < argc)) {
+      output_path = argv[++arg];
+    } else if ((strcmp(argv[arg], "-c") == 0) && (arg + 1 < argc) &&
+               parse_count(argv[arg + 1], 1, &default_budget)) {
+      ++arg;
+    } else if ((strcmp(argv[arg], "-f") == 0) && (arg + 1 < argc) &&
+               parse_count(argv[arg + 1], CYCLES_PER_FRAME, &default_budget)) {
+      ++arg;
+    } else if (strcmp(argv[arg], "-J") == 0) {
+      use_jit = true;
+    } else if ((argv[arg][0] != '-') && (manifest_path == NULL)) {
+      manifest_path = argv[arg];
+    } else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (manifest_path == NULL) {
+    fprintf(stderr, "%s: missing required argument.\n", argv[0]);
+    usage(argv[0]);
+
+    return EXIT_FAILURE;
+  }
+
+  memset(&batch, 0, sizeof(batch));
+  read_manifest(&batch, manifest_path, default_budget);
+
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+
+  if (num_threads > batch.num_jobs) {
+    num_threads = (batch.num_jobs == 0) ? 1 : batch.num_jobs;
+  }
+
+  batch.num_workers = num_threads;
+  batch.workers = checked_malloc(num_threads * sizeof(struct worker));
+
+  for (i = 0; i < batch.num_workers; ++i) {
+    struct worker* const worker = &batch.workers[i];
+
+    worker->batch = &batch;
+    worker->index = i;
+
+    yagbe_mutex_init(&worker->queue.mutex);
+    worker->queue.jobs = checked_malloc(
+        ((batch.num_jobs / num_threads) + 1) * sizeof(size_t));
+    worker->queue.head = 0;
+    worker->queue.tail = 0;
+
+    worker->jit = NULL;
+    worker->jit_blocks = NULL;
+    worker->jit_code = NULL;
+
+    if (use_jit) {
+      worker->jit_code = yagbe_exec_memory_alloc(JIT_CODE_SIZE);
+      worker->jit_blocks =
+          checked_malloc(JIT_BLOCKS * sizeof(struct libyagbe_jit_block));
+
+      if ((worker->jit_code == NULL) ||
+          !libyagbe_jit_init(&worker->jit_storage, worker->jit_code,
+                             JIT_CODE_SIZE, worker->jit_blocks, JIT_BLOCKS)) {
+        fprintf(stderr, "%s: the JIT isn't supported on this host.\n",
+                argv[0]);
+        return EXIT_FAILURE;
+      }
+      worker->jit = &worker->jit_storage;
+    }
+  }
+
+  /* Deal the jobs out round-robin so every worker starts with a fair share. */
+  for (i = 0; i < batch.num_jobs; ++i) {
+    struct work_queue* const queue = &batch.workers[i % num_threads].queue;
+    queue->jobs[queue->tail++] = i;
+  }
+
+  for (i = 0; i < batch.num_workers; ++i) {
+    if (!yagbe_thread_create(&batch.workers[i].thread, &worker_main,
+                             &batch.workers[i])) {
+      fprintf(stderr, "unable to start worker thread\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (i = 0; i < batch.num_workers; ++i) {
+    yagbe_thread_join(&batch.workers[i].thread);
+  }
+
+  /* Other workers may still try to steal from a queue after its owner has
+   * finished, so nothing can be torn down until all of them are done. */
+  for (i = 0; i < batch.num_workers; ++i) {
+    yagbe_mutex_destroy(&batch.workers[i].queue.mutex);
+    free(batch.workers[i].queue.jobs);
+    free(batch.workers[i].jit_blocks);
+    yagbe_exec_memory_free(batch.workers[i].jit_code, JIT_CODE_SIZE);
+  }
+
+  output = (output_path != NULL) ? fopen(output_path, "w") : stdout;
+
+  if (output == NULL) {
+    fprintf(stderr, "unable to open output file %s: %s\n", output_path,
+            strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < batch.num_jobs; ++i) {
+    write_result(output, &batch.jobs[i]);
+
+    free(batch.jobs[i].rom_path);
+    free(batch.jobs[i].serial);
+  }
+
+  if (output != stdout) {
+    fclose(output);
+  }
+
+  free(batch.workers);
+  free(batch.jobs);
+
+  return EXIT_SUCCESS;
+}
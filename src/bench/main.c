@@ -0,0 +1,769 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* yagbebench measures how fast the core runs, so that changes can be checked
+ * for regressions before they land.
+ *
+ * Microbenchmarks time one part of the core in isolation: the CPU running a
+ * single kind of instruction, the bus accessing a single region of memory, and
+ * the scheduler queueing and dispatching events. Macrobenchmarks run whole
+ * programs for a fixed number of frames: a synthetic game which is always
+ * available, and any ROM files named on the command line.
+ *
+ * The CPU and program benchmarks can be run on the predecoded interpreter
+ * instead of the reference one, to compare the two.
+ *
+ * Every benchmark is run once to warm up and then a fixed number of times,
+ * each on a fresh instance, so results only vary with the machine. A summary
+ * is written to stderr, and one JSON record per benchmark to stdout.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "exec_memory.h"
+#include "format.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/rom.h"
+#include "libyagbe/sched.h"
+#include "programs.h"
+
+/** The number of T-cycles in one frame. */
+#define CYCLES_PER_FRAME 70224UL
+
+/** The number of T-cycles in one second of emulated time. */
+#define CYCLES_PER_SECOND 4194304.0
+
+/** The most times a benchmark can be repeated. */
+#define MAX_REPEATS 100
+
+/** How many operations each repeat of a microbenchmark performs. */
+#define MICRO_OPS 4000000UL
+
+/** How many ROM banks the code cache keeps decoded at once. */
+#define CODE_CACHE_BANKS 64
+
+/** How many bytes of host code the JIT can compile before it starts over. */
+#define JIT_CODE_SIZE (4UL * 1024UL * 1024UL)
+
+/** How many compiled blocks the JIT can look up at once. */
+#define JIT_BLOCKS 16384
+
+/** Defines the settings shared by every benchmark. */
+struct options {
+  /** How many timed runs to make of each benchmark. */
+  unsigned int repeats;
+
+  /** How many frames each macrobenchmark runs for. */
+  unsigned long frames;
+
+  /** Whether macrobenchmarks skip drawing. */
+  bool headless;
+
+  /** The buffers macrobenchmarks draw into, or both NULL to draw into the
+   * PPU's own framebuffer. */
+  void* video_buffers[2];
+
+  /** The pixel format macrobenchmarks draw into \ref video_buffers in. */
+  enum libyagbe_ppu_pixel_format video_format;
+
+  /** Only benchmarks whose names start with this are run, if not NULL. */
+  const char* filter;
+
+  /** The code cache instances execute from, or NULL to use the reference
+   * interpreter. */
+  struct libyagbe_code_cache* code_cache;
+
+  /** The JIT instances execute from, or NULL to interpret. */
+  struct libyagbe_jit* jit;
+};
+
+/** Defines the timings of each repeat of a benchmark. */
+struct samples {
+  double values[MAX_REPEATS];
+  unsigned int count;
+};
+
+struct summary {
+  double mean;
+  double stddev;
+  double min;
+  double max;
+};
+
+/** Defines a CPU microbenchmark: a pattern of instructions to repeat. */
+struct cpu_bench {
+  const char* name;
+  const uint8_t* pattern;
+  size_t size;
+};
+
+/** Defines a bus microbenchmark: a region of memory to read or write. */
+struct bus_bench {
+  const char* name;
+  uint16_t address;
+
+  /** How many consecutive addresses to cycle through. */
+  uint16_t span;
+};
+
+static const uint8_t pattern_nop[] = {0x00};
+
+/* LD B,C; LD C,D; LD D,E; LD E,H; LD H,L; LD A,B */
+static const uint8_t pattern_ld_r_r[] = {0x41, 0x4A, 0x53, 0x5C, 0x65, 0x78};
+
+/* ADD A,B; ADC A,C; SUB D; SBC A,E; AND H; XOR L; OR A; CP B */
+static const uint8_t pattern_alu_r[] = {0x80, 0x89, 0x92, 0x9B,
+                                        0xA4, 0xAD, 0xB7, 0xB8};
+
+/* LD BC,$1234; INC BC; ADD HL,BC; DEC DE */
+static const uint8_t pattern_alu16[] = {0x01, 0x34, 0x12, 0x03, 0x09, 0x1B};
+
+/* LD A,(HL); LD (HL),A */
+static const uint8_t pattern_ld_hl[] = {0x7E, 0x77};
+
+/* PUSH BC; POP DE */
+static const uint8_t pattern_push_pop[] = {0xC5, 0xD1};
+
+/* JR +0, which is always taken. */
+static const uint8_t pattern_jr[] = {0x18, 0x00};
+
+/* RST $08, which returns straight away. */
+static const uint8_t pattern_rst_ret[] = {0xCF};
+
+/* SWAP A; BIT 0,A; RL C; SET 7,B */
+static const uint8_t pattern_cb[] = {0xCB, 0x37, 0xCB, 0x47,
+                                     0xCB, 0x11, 0xCB, 0xF8};
+
+static const struct cpu_bench cpu_benches[] = {
+    {"cpu/nop", pattern_nop, sizeof(pattern_nop)},
+    {"cpu/ld_r_r", pattern_ld_r_r, sizeof(pattern_ld_r_r)},
+    {"cpu/alu_r", pattern_alu_r, sizeof(pattern_alu_r)},
+    {"cpu/alu16", pattern_alu16, sizeof(pattern_alu16)},
+    {"cpu/ld_hl", pattern_ld_hl, sizeof(pattern_ld_hl)},
+    {"cpu/push_pop", pattern_push_pop, sizeof(pattern_push_pop)},
+    {"cpu/jr", pattern_jr, sizeof(pattern_jr)},
+    {"cpu/rst_ret", pattern_rst_ret, sizeof(pattern_rst_ret)},
+    {"cpu/cb", pattern_cb, sizeof(pattern_cb)}};
+
+static const struct bus_bench bus_benches[] = {
+    {"rom0", 0x0000, 0x4000}, {"romx", 0x4000, 0x4000},
+    {"vram", 0x8000, 0x2000}, {"cart_ram", 0xA000, 0x2000},
+    {"wram", 0xC000, 0x2000}, {"echo", 0xE000, 0x1E00},
+    {"oam", 0xFE00, 0x00A0},  {"io", 0xFF40, 0x000C},
+    {"hram", 0xFF80, 0x007F}};
+
+static void* checked_malloc(const size_t size) {
+  void* const ptr = malloc(size);
+
+  if (ptr == NULL) {
+    fprintf(stderr, "malloc() failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+/** Receives each frame a macrobenchmark draws, and drops it. */
+static void discard_frame(void* const userdata, const void* const frame) {
+  (void)userdata;
+  (void)frame;
+}
+
+static bool is_selected(const struct options* const options,
+                        const char* const name) {
+  return (options->filter == NULL) ||
+         (strncmp(name, options->filter, strlen(options->filter)) == 0);
+}
+
+static double get_seconds_since(const uintmax_t start) {
+  return (double)(yagbe_clock_get_ns() - start) / 1e9;
+}
+
+static struct summary summarize(const struct samples* const samples) {
+  struct summary summary;
+  double sum = 0.0;
+  double squares = 0.0;
+  unsigned int i;
+
+  summary.min = samples->values[0];
+  summary.max = samples->values[0];
+
+  for (i = 0; i < samples->count; ++i) {
+    const double value = samples->values[i];
+
+    sum += value;
+    summary.min = (value < summary.min) ? value : summary.min;
+    summary.max = (value > summary.max) ? value : summary.max;
+  }
+  summary.mean = sum / samples->count;
+
+  for (i = 0; i < samples->count; ++i) {
+    const double delta = samples->values[i] - summary.mean;
+    squares += delta * delta;
+  }
+
+  /* The sample standard deviation, since the runs are a sample of what the
+   * machine can do. */
+  summary.stddev =
+      (samples->count > 1) ? sqrt(squares / (samples->count - 1)) : 0.0;
+
+  return summary;
+}
+
+static void write_json_string(FILE* const file, const char* const str) {
+  const char* c;
+
+  fputc('"', file);
+
+  for (c = str; *c != '\0'; ++c) {
+    if ((*c == '"') || (*c == '\\')) {
+      fputc('\\', file);
+    }
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+static void write_json_summary(FILE* const file, const char* const key,
+                               const struct samples* const samples) {
+  const struct summary summary = summarize(samples);
+
+  fprintf(file,
+          ",\"%s\":{\"mean\":%.4f,\"stddev\":%.4f,\"min\":%.4f,\"max\":%.4f}",
+          key, summary.mean, summary.stddev, summary.min, summary.max);
+}
+
+/** Reports the time per operation of a microbenchmark. */
+static void report_micro(const char* const name, const unsigned long ops,
+                         const struct samples* const ns_per_op) {
+  const struct summary summary = summarize(ns_per_op);
+
+  fprintf(stderr, "%-24s %9.3f ns/op  +- %6.3f\n", name, summary.mean,
+          summary.stddev);
+
+  fputs("{\"name\":", stdout);
+  write_json_string(stdout, name);
+  fprintf(stdout, ",\"kind\":\"micro\",\"ops\":%lu,\"repeats\":%u", ops,
+          ns_per_op->count);
+  write_json_summary(stdout, "ns_per_op", ns_per_op);
+  fputs("}\n", stdout);
+}
+
+/** Reports the speed of a macrobenchmark. */
+static void report_macro(const char* const name, const uintmax_t cycles,
+                         const uintmax_t instructions,
+                         const struct samples* const cycles_per_second,
+                         const struct samples* const ns_per_instruction) {
+  const struct summary speed = summarize(cycles_per_second);
+  const struct summary per_instruction = summarize(ns_per_instruction);
+  char cycles_text[YAGBE_FORMAT_UINTMAX_SIZE];
+  char instructions_text[YAGBE_FORMAT_UINTMAX_SIZE];
+
+  fprintf(stderr, "%-24s %9.1f MHz  +- %6.1f  %7.3f ns/instr  %6.1fx\n", name,
+          speed.mean / 1e6, speed.stddev / 1e6, per_instruction.mean,
+          speed.mean / CYCLES_PER_SECOND);
+
+  fputs("{\"name\":", stdout);
+  write_json_string(stdout, name);
+  fprintf(stdout,
+          ",\"kind\":\"macro\",\"cycles\":%s,\"instructions\":%s,"
+          "\"repeats\":%u",
+          yagbe_format_uintmax(cycles_text, cycles),
+          yagbe_format_uintmax(instructions_text, instructions),
+          cycles_per_second->count);
+  write_json_summary(stdout, "cycles_per_second", cycles_per_second);
+  write_json_summary(stdout, "ns_per_instruction", ns_per_instruction);
+  fputs("}\n", stdout);
+}
+
+/** Points an instance at the code cache and the JIT, if there are any. Both
+ * are cleared every time, as the benchmarks reuse the same buffer for
+ * different ROMs. */
+static void start_code_cache(struct libyagbe_system* const gb,
+                             const struct options* const options) {
+  if (options->code_cache != NULL) {
+    libyagbe_code_cache_clear(options->code_cache);
+    libyagbe_system_set_code_cache(gb, options->code_cache);
+  }
+
+  if (options->jit != NULL) {
+    libyagbe_jit_clear(options->jit);
+    libyagbe_system_set_jit(gb, options->jit);
+  }
+}
+
+/** Starts an instance running a pattern ROM, stopped at the start of the
+ * pattern. */
+static void start_pattern(struct libyagbe_system* const gb,
+                          const struct options* const options,
+                          const uint8_t* const rom) {
+  if (!libyagbe_system_init(gb, rom, BENCH_ROM_SIZE)) {
+    fprintf(stderr, "the benchmark ROM was rejected\n");
+    exit(EXIT_FAILURE);
+  }
+  libyagbe_system_set_render(gb, false);
+  start_code_cache(gb, options);
+
+  while (gb->cpu.reg.pc.value != BENCH_PATTERN_START) {
+    libyagbe_cpu_step(&gb->cpu, &gb->bus);
+  }
+}
+
+static void run_cpu_bench(const struct options* const options,
+                          const struct cpu_bench* const bench,
+                          struct libyagbe_system* const gb,
+                          uint8_t* const rom) {
+  struct samples samples;
+  unsigned int repeat;
+
+  bench_build_pattern_rom(rom, bench->pattern, bench->size);
+  samples.count = 0;
+
+  for (repeat = 0; repeat <= options->repeats; ++repeat) {
+    uintmax_t start;
+    unsigned long i;
+    double seconds;
+
+    start_pattern(gb, options, rom);
+    start = yagbe_clock_get_ns();
+
+    for (i = 0; i < MICRO_OPS; ++i) {
+      libyagbe_cpu_step(&gb->cpu, &gb->bus);
+    }
+    seconds = get_seconds_since(start);
+
+    /* The first run only warms up the caches. */
+    if (repeat != 0) {
+      samples.values[samples.count++] = (seconds * 1e9) / MICRO_OPS;
+    }
+  }
+  report_micro(bench->name, MICRO_OPS, &samples);
+}
+
+static void run_bus_bench(const struct options* const options,
+                          const struct bus_bench* const bench,
+                          const bool write, struct libyagbe_system* const gb,
+                          uint8_t* const rom) {
+  static const uint8_t pattern[] = {0x00};
+  struct samples samples;
+  unsigned int repeat;
+  char name[64];
+
+  sprintf(name, "bus/%s_%s", write ? "write" : "read", bench->name);
+
+  if (!is_selected(options, name)) {
+    return;
+  }
+
+  bench_build_pattern_rom(rom, pattern, sizeof(pattern));
+  samples.count = 0;
+
+  for (repeat = 0; repeat <= options->repeats; ++repeat) {
+    uintmax_t start;
+    unsigned long i;
+    double seconds;
+    unsigned int sum = 0;
+
+    start_pattern(gb, options, rom);
+
+    /* Enable cartridge RAM. */
+    libyagbe_bus_write_memory(&gb->bus, 0x0000, 0x0A);
+
+    start = yagbe_clock_get_ns();
+
+    if (write) {
+      for (i = 0; i < MICRO_OPS; ++i) {
+        libyagbe_bus_write_memory(
+            &gb->bus, (uint16_t)(bench->address + (i % bench->span)),
+            (uint8_t)i);
+      }
+    } else {
+      for (i = 0; i < MICRO_OPS; ++i) {
+        sum += libyagbe_bus_read_memory(
+            &gb->bus, (uint16_t)(bench->address + (i % bench->span)));
+      }
+    }
+    seconds = get_seconds_since(start);
+
+    /* Keep the reads from being optimized away. */
+    if (sum == 1) {
+      fputc('\0', stderr);
+    }
+
+    if (repeat != 0) {
+      samples.values[samples.count++] = (seconds * 1e9) / MICRO_OPS;
+    }
+  }
+  report_micro(name, MICRO_OPS, &samples);
+}
+
+/** Defines the state of the scheduler benchmarks. */
+struct sched_bench {
+  struct libyagbe_sched sched;
+  unsigned long seed;
+  unsigned long events;
+};
+
+struct sched_handler {
+  struct sched_bench* bench;
+  enum libyagbe_sched_event_type type;
+};
+
+static unsigned int next_delay(struct sched_bench* const bench) {
+  /* A fixed LCG, so every run sees the same sequence. */
+  bench->seed = (bench->seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+  return (unsigned int)(4 + ((bench->seed >> 16) & 0x1FF));
+}
+
+static void handle_sched_event(void* const userdata) {
+  struct sched_handler* const handler = (struct sched_handler*)userdata;
+  struct sched_bench* const bench = handler->bench;
+
+  bench->events++;
+  libyagbe_sched_schedule(&bench->sched, handler->type, next_delay(bench));
+}
+
+static void start_sched_bench(struct sched_bench* const bench,
+                              struct sched_handler* const handlers) {
+  size_t type;
+
+  bench->seed = 1;
+  bench->events = 0;
+
+  libyagbe_sched_reset(&bench->sched);
+
+  for (type = 0; type < LIBYAGBE_SCHED_NUM_EVENT_TYPES; ++type) {
+    handlers[type].bench = bench;
+    handlers[type].type = (enum libyagbe_sched_event_type)type;
+
+    libyagbe_sched_register(&bench->sched, handlers[type].type,
+                            &handle_sched_event, &handlers[type]);
+    libyagbe_sched_schedule(&bench->sched, handlers[type].type,
+                            next_delay(bench));
+  }
+}
+
+/* Times events being dispatched and requeued by their handlers, one m-cycle
+ * at a time like the CPU does. */
+static void run_sched_dispatch(const struct options* const options,
+                               struct sched_bench* const bench) {
+  struct sched_handler handlers[LIBYAGBE_SCHED_NUM_EVENT_TYPES];
+  struct samples samples;
+  unsigned int repeat;
+
+  samples.count = 0;
+
+  for (repeat = 0; repeat <= options->repeats; ++repeat) {
+    uintmax_t start;
+    double seconds;
+
+    start_sched_bench(bench, handlers);
+    start = yagbe_clock_get_ns();
+
+    while (bench->events < MICRO_OPS) {
+      libyagbe_sched_step(&bench->sched);
+    }
+    seconds = get_seconds_since(start);
+
+    if (repeat != 0) {
+      samples.values[samples.count++] = (seconds * 1e9) / MICRO_OPS;
+    }
+  }
+  report_micro("sched/dispatch", MICRO_OPS, &samples);
+}
+
+/* Times moving queued events around without any of them expiring. */
+static void run_sched_reschedule(const struct options* const options,
+                                 struct sched_bench* const bench) {
+  struct sched_handler handlers[LIBYAGBE_SCHED_NUM_EVENT_TYPES];
+  struct samples samples;
+  unsigned int repeat;
+
+  samples.count = 0;
+
+  for (repeat = 0; repeat <= options->repeats; ++repeat) {
+    uintmax_t start;
+    unsigned long i;
+    double seconds;
+
+    start_sched_bench(bench, handlers);
+    start = yagbe_clock_get_ns();
+
+    for (i = 0; i < MICRO_OPS; ++i) {
+      const enum libyagbe_sched_event_type type =
+          (enum libyagbe_sched_event_type)(i % LIBYAGBE_SCHED_NUM_EVENT_TYPES);
+
+      if ((i & 7) == 7) {
+        libyagbe_sched_cancel(&bench->sched, type);
+      } else {
+        libyagbe_sched_schedule(&bench->sched, type, next_delay(bench));
+      }
+    }
+    seconds = get_seconds_since(start);
+
+    if (repeat != 0) {
+      samples.values[samples.count++] = (seconds * 1e9) / MICRO_OPS;
+    }
+  }
+  report_micro("sched/reschedule", MICRO_OPS, &samples);
+}
+
+static void start_program(struct libyagbe_system* const gb,
+                          const struct options* const options,
+                          const uint8_t* const data, const size_t size) {
+  if (!libyagbe_system_init(gb, data, size)) {
+    fprintf(stderr, "unsupported cartridge\n");
+    exit(EXIT_FAILURE);
+  }
+  libyagbe_system_set_render(gb, !options->headless);
+  libyagbe_system_set_video_output(gb, options->video_format,
+                                   options->video_buffers[0],
+                                   options->video_buffers[1], &discard_frame,
+                                   NULL);
+  start_code_cache(gb, options);
+}
+
+/** Counts the instructions a program executes, which is done separately so
+ * that counting doesn't slow down the timed runs. */
+static uintmax_t count_instructions(struct libyagbe_system* const gb,
+                                    const uintmax_t cycles) {
+  const uintmax_t end = gb->sched.current_timestamp + cycles;
+  uintmax_t count = 0;
+
+  while (gb->sched.current_timestamp < end) {
+    if (gb->cpu.state == LIBYAGBE_CPU_STATE_RUNNING) {
+      count++;
+    }
+
+    if (libyagbe_system_step(gb) == 0) {
+      break;
+    }
+  }
+  return count;
+}
+
+static void run_program(const struct options* const options,
+                        const char* const name, const uint8_t* const data,
+                        const size_t size, struct libyagbe_system* const gb) {
+  const uintmax_t cycles = options->frames * CYCLES_PER_FRAME;
+  struct samples cycles_per_second;
+  struct samples ns_per_instruction;
+  uintmax_t instructions;
+  unsigned int repeat;
+
+  start_program(gb, options, data, size);
+  instructions = count_instructions(gb, cycles);
+
+  /* Guard against programs which never run an instruction. */
+  if (instructions == 0) {
+    instructions = 1;
+  }
+
+  cycles_per_second.count = 0;
+  ns_per_instruction.count = 0;
+
+  for (repeat = 0; repeat <= options->repeats; ++repeat) {
+    uintmax_t start;
+    uintmax_t ran;
+    double seconds;
+
+    start_program(gb, options, data, size);
+    start = yagbe_clock_get_ns();
+    ran = libyagbe_system_run(gb, cycles);
+    seconds = get_seconds_since(start);
+
+    if (repeat != 0) {
+      cycles_per_second.values[cycles_per_second.count++] = ran / seconds;
+      ns_per_instruction.values[ns_per_instruction.count++] =
+          (seconds * 1e9) / instructions;
+    }
+  }
+  report_macro(name, cycles, instructions, &cycles_per_second,
+               &ns_per_instruction);
+}
+
+/** Parses the name of a pixel format given to -P. */
+static bool parse_format(const char* const name,
+                         enum libyagbe_ppu_pixel_format* const format) {
+  if (strcmp(name, "index") == 0) {
+    *format = LIBYAGBE_PPU_PIXEL_FORMAT_INDEX;
+  } else if (strcmp(name, "rgb565") == 0) {
+    *format = LIBYAGBE_PPU_PIXEL_FORMAT_RGB565;
+  } else if (strcmp(name, "rgba8888") == 0) {
+    *format = LIBYAGBE_PPU_PIXEL_FORMAT_RGBA8888;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static void usage(const char* const argv0) {
+  fprintf(stderr,
+          "%s: Syntax: %s [-r repeats] [-f frames] [-b prefix] [-H] [-c] "
+          "[-J] [-P index|rgb565|rgba8888] [rom...]\n",
+          argv0, argv0);
+}
+
+int main(int argc, char* argv[]) {
+  struct options options;
+  struct libyagbe_code_cache code_cache;
+  struct libyagbe_code_cache_bank* code_cache_banks = NULL;
+  struct libyagbe_jit jit;
+  struct libyagbe_jit_block* jit_blocks = NULL;
+  void* jit_code = NULL;
+  struct libyagbe_system* gb;
+  struct sched_bench* sched;
+  uint8_t* rom;
+  size_t i;
+  bool video = false;
+  int arg;
+  int first_rom;
+
+  options.repeats = 5;
+  options.frames = 600;
+  options.headless = false;
+  options.filter = NULL;
+  options.code_cache = NULL;
+  options.jit = NULL;
+  options.video_buffers[0] = NULL;
+  options.video_buffers[1] = NULL;
+  options.video_format = LIBYAGBE_PPU_PIXEL_FORMAT_INDEX;
+
+  for (arg = 1; arg < argc; ++arg) {
+    if ((strcmp(argv[arg], "-r") == 0) && (arg + 1 < argc)) {
+      options.repeats = (unsigned int)strtoul(argv[++arg], NULL, 10);
+    } else if ((strcmp(argv[arg], "-f") == 0) && (arg + 1 < argc)) {
+      options.frames = strtoul(argv[++arg], NULL, 10);
+    } else if ((strcmp(argv[arg], "-b") == 0) && (arg + 1 < argc)) {
+      options.filter = argv[++arg];
+    } else if (strcmp(argv[arg], "-H") == 0) {
+      options.headless = true;
+    } else if (strcmp(argv[arg], "-c") == 0) {
+      options.code_cache = &code_cache;
+    } else if (strcmp(argv[arg], "-J") == 0) {
+      options.jit = &jit;
+    } else if ((strcmp(argv[arg], "-P") == 0) && (arg + 1 < argc) &&
+               parse_format(argv[arg + 1], &options.video_format)) {
+      video = true;
+      ++arg;
+    } else if (argv[arg][0] != '-') {
+      break;
+    } else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  first_rom = arg;
+
+  if ((options.repeats == 0) || (options.repeats > MAX_REPEATS)) {
+    fprintf(stderr, "%s: repeats must be between 1 and %d.\n", argv[0],
+            MAX_REPEATS);
+    return EXIT_FAILURE;
+  }
+
+  if (options.code_cache != NULL) {
+    code_cache_banks = checked_malloc(CODE_CACHE_BANKS *
+                                      sizeof(struct libyagbe_code_cache_bank));
+    libyagbe_code_cache_init(&code_cache, code_cache_banks, CODE_CACHE_BANKS);
+  }
+
+  if (options.jit != NULL) {
+    jit_code = yagbe_exec_memory_alloc(JIT_CODE_SIZE);
+    jit_blocks = checked_malloc(JIT_BLOCKS * sizeof(struct libyagbe_jit_block));
+
+    if ((jit_code == NULL) ||
+        !libyagbe_jit_init(&jit, jit_code, JIT_CODE_SIZE, jit_blocks,
+                           JIT_BLOCKS)) {
+      fprintf(stderr, "%s: the JIT isn't supported on this host.\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (video) {
+    for (i = 0; i < 2; ++i) {
+      options.video_buffers[i] =
+          checked_malloc(libyagbe_ppu_get_frame_size(options.video_format));
+    }
+  }
+
+  gb = checked_malloc(sizeof(struct libyagbe_system));
+  sched = checked_malloc(sizeof(struct sched_bench));
+  rom = checked_malloc(BENCH_ROM_SIZE);
+
+  for (i = 0; i < sizeof(cpu_benches) / sizeof(cpu_benches[0]); ++i) {
+    if (is_selected(&options, cpu_benches[i].name)) {
+      run_cpu_bench(&options, &cpu_benches[i], gb, rom);
+    }
+  }
+
+  for (i = 0; i < sizeof(bus_benches) / sizeof(bus_benches[0]); ++i) {
+    run_bus_bench(&options, &bus_benches[i], false, gb, rom);
+    run_bus_bench(&options, &bus_benches[i], true, gb, rom);
+  }
+
+  if (is_selected(&options, "sched/dispatch")) {
+    run_sched_dispatch(&options, sched);
+  }
+
+  if (is_selected(&options, "sched/reschedule")) {
+    run_sched_reschedule(&options, sched);
+  }
+
+  if (is_selected(&options, "rom/synthetic_game")) {
+    bench_build_game_rom(rom);
+    run_program(&options, "rom/synthetic_game", rom, BENCH_ROM_SIZE, gb);
+  }
+
+  for (arg = first_rom; arg < argc; ++arg) {
+    struct libyagbe_rom file;
+    char* name;
+
+    name = checked_malloc(strlen(argv[arg]) + 5);
+    sprintf(name, "rom/%s", argv[arg]);
+
+    if (!is_selected(&options, name)) {
+      free(name);
+      continue;
+    }
+
+    if (!libyagbe_rom_open(&file, argv[arg])) {
+      fprintf(stderr, "unable to load ROM %s\n", argv[arg]);
+      return EXIT_FAILURE;
+    }
+    run_program(&options, name, file.data, file.size, gb);
+
+    libyagbe_rom_close(&file);
+    free(name);
+  }
+
+  free(rom);
+  free(sched);
+  free(gb);
+  free(code_cache_banks);
+  free(jit_blocks);
+  free(options.video_buffers[0]);
+  free(options.video_buffers[1]);
+  yagbe_exec_memory_free(jit_code, JIT_CODE_SIZE);
+
+  return EXIT_SUCCESS;
+}
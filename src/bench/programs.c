@@ -0,0 +1,201 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "programs.h"
+
+#include <assert.h>
+#include <string.h>
+
+enum {
+  HEADER_ENTRY = 0x0100,
+  HEADER_CART_TYPE = 0x0147,
+  HEADER_RAM_SIZE = 0x0149,
+  PROGRAM_START = 0x0150
+};
+
+/* The values written to the header to make the cartridge an MBC1 with 8 KiB of
+ * RAM. */
+enum { CART_TYPE_MBC1_RAM = 0x02, RAM_SIZE_8K = 0x02 };
+
+static void put(uint8_t* const rom, const size_t address,
+                const uint8_t* const code, const size_t size) {
+  assert((address + size) <= BENCH_ROM_SIZE);
+  memcpy(&rom[address], code, size);
+}
+
+/* Starts a ROM image which jumps to $0150. */
+static void begin_rom(uint8_t* const rom) {
+  static const uint8_t entry[] = {
+      0x00,            /* NOP */
+      0xC3, 0x50, 0x01 /* JP $0150 */
+  };
+
+  memset(rom, 0xFF, BENCH_ROM_SIZE);
+  put(rom, HEADER_ENTRY, entry, sizeof(entry));
+
+  rom[HEADER_CART_TYPE] = CART_TYPE_MBC1_RAM;
+  rom[HEADER_RAM_SIZE] = RAM_SIZE_8K;
+}
+
+void bench_build_pattern_rom(uint8_t* const rom, const uint8_t* const pattern,
+                             const size_t size) {
+  static const uint8_t prologue[] = {
+      0xF3,             /* DI */
+      0x31, 0xF0, 0xDF, /* LD SP, $DFF0 */
+      0x21, 0x00, 0xC0, /* LD HL, $C000 */
+      0xAF,             /* XOR A */
+      0xE0, 0x40,       /* LDH ($40), A */
+      0xC3, BENCH_PATTERN_START & 0xFF, BENCH_PATTERN_START >> 8 /* JP */
+  };
+  static const uint8_t rst_08[] = {0xC9}; /* RET */
+  static const uint8_t loop[] = {
+      0xC3, BENCH_PATTERN_START & 0xFF, BENCH_PATTERN_START >> 8 /* JP */
+  };
+  size_t address;
+
+  assert(rom != NULL);
+  assert(pattern != NULL);
+  assert(size != 0);
+
+  begin_rom(rom);
+  put(rom, 0x0008, rst_08, sizeof(rst_08));
+  put(rom, PROGRAM_START, prologue, sizeof(prologue));
+
+  /* Jumping back costs one instruction in every few thousand. */
+  for (address = BENCH_PATTERN_START;
+       (address + size + sizeof(loop)) <= BENCH_ROM_SIZE; address += size) {
+    put(rom, address, pattern, size);
+  }
+  put(rom, address, loop, sizeof(loop));
+}
+
+void bench_build_game_rom(uint8_t* const rom) {
+  static const uint8_t vblank_vector[] = {0xC3, 0x00, 0x02}; /* JP $0200 */
+  static const uint8_t timer_vector[] = {0xC3, 0x20, 0x02};  /* JP $0220 */
+  static const uint8_t setup[] = {
+      0xF3,             /* DI */
+      0x31, 0xFF, 0xDF, /* LD SP, $DFFF */
+
+      /* Fill the first 128 tiles with a pattern. */
+      0x21, 0x00, 0x80, /* LD HL, $8000 */
+      0x01, 0x00, 0x08, /* LD BC, $0800 */
+      0x7D,             /* .tiles: LD A, L */
+      0x22,             /* LD (HL+), A */
+      0x0B,             /* DEC BC */
+      0x78,             /* LD A, B */
+      0xB1,             /* OR C */
+      0x20, 0xF9,       /* JR NZ, .tiles */
+
+      /* Fill both tile maps. */
+      0x21, 0x00, 0x98, /* LD HL, $9800 */
+      0x01, 0x00, 0x08, /* LD BC, $0800 */
+      0x7D,             /* .maps: LD A, L */
+      0xE6, 0x7F,       /* AND $7F */
+      0x22,             /* LD (HL+), A */
+      0x0B,             /* DEC BC */
+      0x78,             /* LD A, B */
+      0xB1,             /* OR C */
+      0x20, 0xF7,       /* JR NZ, .maps */
+
+      /* Spread 40 objects over the screen. */
+      0x21, 0x00, 0xFE, /* LD HL, $FE00 */
+      0x06, 0xA0,       /* LD B, 160 */
+      0x7D,             /* .objs: LD A, L */
+      0x22,             /* LD (HL+), A */
+      0x05,             /* DEC B */
+      0x20, 0xFB,       /* JR NZ, .objs */
+
+      /* Palettes, window and LCD. */
+      0x3E, 0xE4,       /* LD A, $E4 */
+      0xE0, 0x47,       /* LDH ($47), A */
+      0xE0, 0x48,       /* LDH ($48), A */
+      0xE0, 0x49,       /* LDH ($49), A */
+      0x3E, 0x50,       /* LD A, $50 */
+      0xE0, 0x4A,       /* LDH ($4A), A */
+      0x3E, 0x57,       /* LD A, $57 */
+      0xE0, 0x4B,       /* LDH ($4B), A */
+      0x3E, 0xF3,       /* LD A, $F3 */
+      0xE0, 0x40,       /* LDH ($40), A */
+
+      /* A square wave on both sides. */
+      0x3E, 0x80,       /* LD A, $80 */
+      0xE0, 0x26,       /* LDH ($26), A */
+      0x3E, 0x77,       /* LD A, $77 */
+      0xE0, 0x24,       /* LDH ($24), A */
+      0x3E, 0xFF,       /* LD A, $FF */
+      0xE0, 0x25,       /* LDH ($25), A */
+      0x3E, 0x80,       /* LD A, $80 */
+      0xE0, 0x11,       /* LDH ($11), A */
+      0x3E, 0xF0,       /* LD A, $F0 */
+      0xE0, 0x12,       /* LDH ($12), A */
+      0x3E, 0x00,       /* LD A, $00 */
+      0xE0, 0x13,       /* LDH ($13), A */
+      0x3E, 0x87,       /* LD A, $87 */
+      0xE0, 0x14,       /* LDH ($14), A */
+
+      /* The timer overflows every 256 * 16 cycles. */
+      0xAF,             /* XOR A */
+      0xE0, 0x06,       /* LDH ($06), A */
+      0x3E, 0x05,       /* LD A, $05 */
+      0xE0, 0x07,       /* LDH ($07), A */
+
+      /* VBlank and timer interrupts. */
+      0x3E, 0x05,       /* LD A, $05 */
+      0xE0, 0xFF,       /* LDH ($FF), A */
+      0xFB,             /* EI */
+
+      /* Copy $C000-$C0FF to $C100-$C1FF forever. */
+      0x21, 0x00, 0xC0, /* .copy: LD HL, $C000 */
+      0x11, 0x00, 0xC1, /* LD DE, $C100 */
+      0x06, 0x00,       /* LD B, 0 */
+      0x2A,             /* .byte: LD A, (HL+) */
+      0x12,             /* LD (DE), A */
+      0x13,             /* INC DE */
+      0x05,             /* DEC B */
+      0x20, 0xFA,       /* JR NZ, .byte */
+      0x18, 0xF0        /* JR .copy */
+  };
+  static const uint8_t vblank_handler[] = {
+      0xF5,       /* PUSH AF */
+      0xF0, 0x43, /* LDH A, ($43) */
+      0x3C,       /* INC A */
+      0xE0, 0x43, /* LDH ($43), A */
+      0xF0, 0x42, /* LDH A, ($42) */
+      0x3D,       /* DEC A */
+      0xE0, 0x42, /* LDH ($42), A */
+      0xF1,       /* POP AF */
+      0xD9        /* RETI */
+  };
+  static const uint8_t timer_handler[] = {
+      0xF5,             /* PUSH AF */
+      0xFA, 0x00, 0xC2, /* LD A, ($C200) */
+      0x3C,             /* INC A */
+      0xEA, 0x00, 0xC2, /* LD ($C200), A */
+      0xF1,             /* POP AF */
+      0xD9              /* RETI */
+  };
+
+  assert(rom != NULL);
+
+  begin_rom(rom);
+  put(rom, 0x0040, vblank_vector, sizeof(vblank_vector));
+  put(rom, 0x0050, timer_vector, sizeof(timer_vector));
+  put(rom, PROGRAM_START, setup, sizeof(setup));
+  put(rom, 0x0200, vblank_handler, sizeof(vblank_handler));
+  put(rom, 0x0220, timer_handler, sizeof(timer_handler));
+}
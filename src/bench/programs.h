@@ -0,0 +1,58 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Builds the synthetic programs the benchmarks run, so that every build
+ * measures exactly the same code without any ROMs having to be shipped. */
+
+#ifndef YAGBE_BENCH_PROGRAMS_H
+#define YAGBE_BENCH_PROGRAMS_H
+
+#include <stddef.h>
+
+#include "libyagbe/compat/compat_stdint.h"
+
+/** The size of every synthetic ROM image, which is the smallest cartridge. */
+#define BENCH_ROM_SIZE 0x8000
+
+/** Where the repeated code of a pattern ROM starts. */
+#define BENCH_PATTERN_START 0x0160
+
+/** Builds a ROM which turns the LCD off and then runs a pattern of
+ * instructions over and over, for measuring them in isolation.
+ *
+ * The pattern runs with interrupts disabled, HL pointing to $C000 and SP
+ * pointing to $DFF0. `RST $08` returns straight away. The cartridge has 8 KiB
+ * of RAM behind an MBC1.
+ *
+ * @param rom Receives the ROM image, which must be \ref BENCH_ROM_SIZE bytes.
+ * @param pattern The instructions to repeat.
+ * @param size The size of the pattern in bytes.
+ */
+void bench_build_pattern_rom(uint8_t* const rom, const uint8_t* const pattern,
+                             const size_t size);
+
+/** Builds a ROM which keeps every part of the system busy the way a game
+ * would: the background scrolls, the window and 40 objects are displayed, a
+ * square wave plays, the timer interrupts every 4096 cycles, and the rest of
+ * the time is spent copying memory.
+ *
+ * @param rom Receives the ROM image, which must be \ref BENCH_ROM_SIZE bytes.
+ */
+void bench_build_game_rom(uint8_t* const rom);
+
+#endif /* YAGBE_BENCH_PROGRAMS_H */
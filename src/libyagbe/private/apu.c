@@ -17,3 +17,762 @@
  */
 
 #include "libyagbe/apu.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/sched.h"
+#include "utility.h"
+
+/* The system clock runs at 2^22 Hz. */
+enum apu_clock {
+  CLOCK_RATE_SHIFT = 22,
+  FRAME_SEQ_PERIOD = LIBYAGBE_APU_FRAME_SEQ_PERIOD
+};
+
+enum blip_params {
+  /* Each step is placed to within 1/32 of a sample. */
+  BLIP_PHASE_SHIFT = 5,
+  BLIP_NUM_PHASES = 1 << BLIP_PHASE_SHIFT,
+
+  /* Every kernel adds up to 2^15. */
+  BLIP_KERNEL_SHIFT = 15,
+
+  /* Scales the loudest possible mix, 4 channels at 15 times a volume of 8, to
+   * just under the range of a 16-bit sample. */
+  BLIP_OUTPUT_SHIFT = BLIP_KERNEL_SHIFT - 6,
+
+  /* Sets the cutoff of the filter which removes the DC level, like the
+   * capacitor on the real output does. */
+  BLIP_HIGHPASS_SHIFT = 8
+};
+
+enum nrx4_bits { NRX4_LENGTH_ENABLE = 1 << 6, NRX4_TRIGGER = 1 << 7 };
+enum nr52_bits { NR52_POWER = 1 << 7 };
+
+/* Band-limited steps, as a windowed sinc, for each phase of a sample the step
+ * can start at. */
+static const short blep[BLIP_NUM_PHASES][LIBYAGBE_APU_BLIP_WIDTH] = {
+  {18, -110, 359, -843, 1561, -2371, 3025, 29490, 3025, -2371, 1561, -843, 359,
+   -110, 18, 0},
+  {17, -108, 347, -795, 1421, -2025, 2117, 29452, 3974, -2714, 1693, -887, 369,
+   -111, 18, 0},
+  {17, -105, 332, -742, 1276, -1679, 1252, 29332, 4960, -3051, 1818, -925, 376,
+   -110, 17, 0},
+  {16, -102, 315, -686, 1128, -1335, 434, 29131, 5981, -3378, 1932, -956, 380,
+   -109, 17, 0},
+  {16, -98, 297, -627, 977, -997, -336, 28853, 7031, -3693, 2036, -982, 381,
+   -106, 16, 0},
+  {15, -93, 277, -566, 824, -665, -1055, 28499, 8106, -3992, 2127, -999, 378,
+   -103, 15, 0},
+  {14, -87, 256, -503, 672, -343, -1721, 28067, 9203, -4273, 2204, -1009, 372,
+   -97, 13, 0},
+  {13, -82, 234, -439, 522, -34, -2334, 27565, 10317, -4531, 2266, -1011, 362,
+   -91, 11, 0},
+  {12, -76, 211, -375, 374, 262, -2891, 26992, 11444, -4765, 2311, -1004, 348,
+   -83, 8, 0},
+  {10, -69, 188, -311, 229, 543, -3394, 26350, 12577, -4970, 2339, -987, 330,
+   -73, 6, 0},
+  {9, -63, 165, -248, 90, 807, -3840, 25646, 13712, -5144, 2348, -962, 308,
+   -62, 2, 0},
+  {8, -56, 142, -186, -44, 1052, -4231, 24877, 14845, -5283, 2338, -926, 282,
+   -50, -1, 1},
+  {7, -50, 119, -126, -171, 1277, -4566, 24057, 15970, -5386, 2307, -881, 251,
+   -36, -5, 1},
+  {6, -44, 96, -68, -291, 1482, -4846, 23182, 17081, -5448, 2255, -825, 217,
+   -21, -10, 2},
+  {5, -37, 74, -12, -403, 1666, -5072, 22257, 18174, -5467, 2182, -760, 178,
+   -4, -15, 2},
+  {4, -31, 53, 41, -506, 1828, -5246, 21289, 19243, -5441, 2086, -685, 136, 14,
+   -20, 3},
+  {3, -25, 33, 90, -600, 1968, -5368, 20283, 20283, -5368, 1968, -600, 90, 33,
+   -25, 3},
+  {3, -20, 14, 136, -685, 2086, -5441, 19243, 21289, -5246, 1828, -506, 41, 53,
+   -31, 4},
+  {2, -15, -4, 178, -760, 2182, -5467, 18174, 22257, -5072, 1666, -403, -12,
+   74, -37, 5},
+  {2, -10, -21, 217, -825, 2255, -5448, 17081, 23182, -4846, 1482, -291, -68,
+   96, -44, 6},
+  {1, -5, -36, 251, -881, 2307, -5386, 15970, 24057, -4566, 1277, -171, -126,
+   119, -50, 7},
+  {1, -1, -50, 282, -926, 2338, -5283, 14845, 24877, -4231, 1052, -44, -186,
+   142, -56, 8},
+  {0, 2, -62, 308, -962, 2348, -5144, 13712, 25646, -3840, 807, 90, -248, 165,
+   -63, 9},
+  {0, 6, -73, 330, -987, 2339, -4970, 12577, 26350, -3394, 543, 229, -311, 188,
+   -69, 10},
+  {0, 8, -83, 348, -1004, 2311, -4765, 11444, 26992, -2891, 262, 374, -375,
+   211, -76, 12},
+  {0, 11, -91, 362, -1011, 2266, -4531, 10317, 27565, -2334, -34, 522, -439,
+   234, -82, 13},
+  {0, 13, -97, 372, -1009, 2204, -4273, 9203, 28067, -1721, -343, 672, -503,
+   256, -87, 14},
+  {0, 15, -103, 378, -999, 2127, -3992, 8106, 28499, -1055, -665, 824, -566,
+   277, -93, 15},
+  {0, 16, -106, 381, -982, 2036, -3693, 7031, 28853, -336, -997, 977, -627,
+   297, -98, 16},
+  {0, 17, -109, 380, -956, 1932, -3378, 5981, 29131, 434, -1335, 1128, -686,
+   315, -102, 16},
+  {0, 17, -110, 376, -925, 1818, -3051, 4960, 29332, 1252, -1679, 1276, -742,
+   332, -105, 17},
+  {0, 18, -111, 369, -887, 1693, -2714, 3974, 29452, 2117, -2025, 1421, -795,
+   347, -108, 17}
+};
+
+/* The offset of each channel's first register from $FF10. Square channel 2
+ * and the noise channel have nothing at that offset. */
+static const uint8_t channel_base[LIBYAGBE_APU_NUM_CHANNELS] = {0x00, 0x05,
+                                                                0x0A, 0x0F};
+
+/* The bits of each register from $FF10 to $FF2F which always read as 1. */
+static const uint8_t read_masks[LIBYAGBE_APU_IO_WAVE_RAM] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F,
+    0xFF, 0x9F, 0xFF, 0xBF, 0xFF, 0xFF, 0x00, 0x00, 0xBF, 0x00, 0x00,
+    0x70, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+/* The steps of each duty cycle which are high, one bit per step. */
+static const uint8_t duty_patterns[4] = {0x01, 0x81, 0x87, 0x7E};
+
+static const uint8_t wave_shifts[4] = {4, 0, 1, 2};
+static const uint8_t noise_divisors[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+
+static uint8_t* get_reg(struct libyagbe_apu* const apu, const unsigned int ch,
+                        const unsigned int reg) {
+  return &apu->io[channel_base[ch] + reg];
+}
+
+static bool dac_enabled(struct libyagbe_apu* const apu, const unsigned int ch) {
+  if (ch == LIBYAGBE_APU_CHANNEL_WAVE) {
+    return (apu->io[LIBYAGBE_APU_IO_NR30] & 0x80) != 0;
+  }
+  return (*get_reg(apu, ch, 2) & 0xF8) != 0;
+}
+
+static unsigned int get_frequency(struct libyagbe_apu* const apu,
+                                  const unsigned int ch) {
+  return *get_reg(apu, ch, 3) | ((*get_reg(apu, ch, 4) & 0x07) << 8);
+}
+
+/* Returns the number of T-cycles between steps of a channel's waveform. */
+static unsigned long get_period(struct libyagbe_apu* const apu,
+                                const unsigned int ch) {
+  const uint8_t nr43 = apu->io[LIBYAGBE_APU_IO_NR43];
+
+  switch (ch) {
+    case LIBYAGBE_APU_CHANNEL_WAVE:
+      return (2048 - get_frequency(apu, ch)) * 2;
+
+    case LIBYAGBE_APU_CHANNEL_NOISE:
+      return (unsigned long)noise_divisors[nr43 & 0x07] << (nr43 >> 4);
+
+    default:
+      return (2048 - get_frequency(apu, ch)) * 4;
+  }
+}
+
+static uint8_t get_waveform_level(struct libyagbe_apu* const apu,
+                                  const unsigned int ch) {
+  const struct libyagbe_apu_channel* const c = &apu->channels[ch];
+  uint8_t sample;
+
+  switch (ch) {
+    case LIBYAGBE_APU_CHANNEL_WAVE:
+      sample = apu->io[LIBYAGBE_APU_IO_WAVE_RAM + (c->position / 2)];
+      sample = (c->position & 1) ? (sample & 0x0F) : (sample >> 4);
+
+      return sample >> wave_shifts[(apu->io[LIBYAGBE_APU_IO_NR32] >> 5) & 3];
+
+    case LIBYAGBE_APU_CHANNEL_NOISE:
+      return (c->lfsr & 1) ? 0 : c->volume;
+
+    default:
+      return ((duty_patterns[*get_reg(apu, ch, 1) >> 6] >> c->position) & 1)
+                 ? c->volume
+                 : 0;
+  }
+}
+
+/* Returns how loud a channel is on the left (side 0) or right (side 1)
+ * output, from 0 if it isn't panned there up to 8. */
+static long get_gain(const struct libyagbe_apu* const apu,
+                     const unsigned int ch, const unsigned int side) {
+  const uint8_t nr50 = apu->io[LIBYAGBE_APU_IO_NR50];
+  const uint8_t nr51 = apu->io[LIBYAGBE_APU_IO_NR51];
+
+  if (side == 0) {
+    return ((nr51 >> (ch + 4)) & 1) ? ((nr50 >> 4) & 0x07) + 1 : 0;
+  }
+  return ((nr51 >> ch) & 1) ? (nr50 & 0x07) + 1 : 0;
+}
+
+/* Adds a band-limited step to one side of the output, some number of
+ * T-cycles after the time the channels have been caught up to. */
+static void add_delta(struct libyagbe_apu* const apu, const unsigned int side,
+                      const unsigned long offset, const long delta) {
+  /* The span being caught up to is never longer than one frame sequencer
+   * step, so this can't overflow 32 bits. */
+  const unsigned long position =
+      apu->sample_fraction + (offset * apu->sample_rate);
+  const short* const kernel =
+      blep[(position >> (CLOCK_RATE_SHIFT - BLIP_PHASE_SHIFT)) &
+           (BLIP_NUM_PHASES - 1)];
+  long* const deltas = &apu->deltas[side][position >> CLOCK_RATE_SHIFT];
+  unsigned int i;
+
+  for (i = 0; i < LIBYAGBE_APU_BLIP_WIDTH; ++i) {
+    deltas[i] += delta * kernel[i];
+  }
+}
+
+/* Adds or removes the output of a channel to or from the mix. */
+static void mix_channel(struct libyagbe_apu* const apu, const unsigned int ch,
+                        const unsigned long offset, const long amount) {
+  unsigned int side;
+
+  if ((apu->ring == NULL) || (amount == 0)) {
+    return;
+  }
+
+  for (side = 0; side < 2; ++side) {
+    const long gain = get_gain(apu, ch, side);
+
+    if (gain != 0) {
+      add_delta(apu, side, offset, amount * gain);
+    }
+  }
+}
+
+/* Works out what a channel is putting out after its state has changed, some
+ * number of T-cycles after the time the channels have been caught up to. */
+static void update_output(struct libyagbe_apu* const apu,
+                          const unsigned int ch, const unsigned long offset) {
+  struct libyagbe_apu_channel* const c = &apu->channels[ch];
+  const uint8_t output = (c->enabled && dac_enabled(apu, ch))
+                             ? get_waveform_level(apu, ch)
+                             : 0;
+
+  if (output != c->output) {
+    mix_channel(apu, ch, offset, (long)output - c->output);
+    c->output = output;
+  }
+}
+
+static void step_waveform(struct libyagbe_apu* const apu,
+                          const unsigned int ch) {
+  struct libyagbe_apu_channel* const c = &apu->channels[ch];
+  unsigned int bit;
+
+  switch (ch) {
+    case LIBYAGBE_APU_CHANNEL_WAVE:
+      c->position = (c->position + 1) & 31;
+      return;
+
+    case LIBYAGBE_APU_CHANNEL_NOISE:
+      bit = (c->lfsr ^ (c->lfsr >> 1)) & 1;
+      c->lfsr = (uint16_t)((c->lfsr >> 1) | (bit << 14));
+
+      /* 7-bit mode feeds the bit back in at bit 6 as well. */
+      if (apu->io[LIBYAGBE_APU_IO_NR43] & 0x08) {
+        c->lfsr = (uint16_t)((c->lfsr & ~0x40) | (bit << 6));
+      }
+      return;
+
+    default:
+      c->position = (c->position + 1) & 7;
+      return;
+  }
+}
+
+/* Steps a channel's waveform through some number of T-cycles. This is only
+ * done while audio is being put out, since nothing else can observe it. */
+static void run_channel(struct libyagbe_apu* const apu, const unsigned int ch,
+                        const unsigned long cycles) {
+  struct libyagbe_apu_channel* const c = &apu->channels[ch];
+  unsigned long period;
+  unsigned long offset = 0;
+
+  if (!c->enabled) {
+    return;
+  }
+
+  period = get_period(apu, ch);
+
+  while (c->timer <= (cycles - offset)) {
+    offset += c->timer;
+    c->timer = period;
+
+    step_waveform(apu, ch);
+    update_output(apu, ch, offset);
+  }
+  c->timer -= cycles - offset;
+}
+
+static unsigned int calculate_sweep(struct libyagbe_apu* const apu) {
+  struct libyagbe_apu_channel* const c =
+      &apu->channels[LIBYAGBE_APU_CHANNEL_SQUARE1];
+  const uint8_t nr10 = apu->io[LIBYAGBE_APU_IO_NR10];
+  const unsigned int delta = c->sweep_shadow >> (nr10 & 0x07);
+  const unsigned int frequency =
+      (nr10 & 0x08) ? (c->sweep_shadow - delta) : (c->sweep_shadow + delta);
+
+  if (frequency > 2047) {
+    c->enabled = false;
+    update_output(apu, LIBYAGBE_APU_CHANNEL_SQUARE1, 0);
+  }
+  return frequency;
+}
+
+static void clock_sweep(struct libyagbe_apu* const apu) {
+  struct libyagbe_apu_channel* const c =
+      &apu->channels[LIBYAGBE_APU_CHANNEL_SQUARE1];
+  const uint8_t nr10 = apu->io[LIBYAGBE_APU_IO_NR10];
+  const unsigned int pace = (nr10 >> 4) & 0x07;
+  unsigned int frequency;
+
+  if (--c->sweep_timer != 0) {
+    return;
+  }
+  c->sweep_timer = pace ? pace : 8;
+
+  if (!c->enabled || !c->sweep_enabled || (pace == 0)) {
+    return;
+  }
+
+  frequency = calculate_sweep(apu);
+
+  if ((frequency <= 2047) && (nr10 & 0x07)) {
+    c->sweep_shadow = (uint16_t)frequency;
+
+    apu->io[LIBYAGBE_APU_IO_NR13] = frequency & 0xFF;
+    apu->io[LIBYAGBE_APU_IO_NR14] =
+        (uint8_t)((apu->io[LIBYAGBE_APU_IO_NR14] & ~0x07) | (frequency >> 8));
+
+    /* The new frequency is checked for overflow again straight away. */
+    calculate_sweep(apu);
+  }
+}
+
+static void clock_length(struct libyagbe_apu* const apu,
+                         const unsigned int ch) {
+  struct libyagbe_apu_channel* const c = &apu->channels[ch];
+
+  if ((*get_reg(apu, ch, 4) & NRX4_LENGTH_ENABLE) && (c->length != 0)) {
+    if (--c->length == 0) {
+      c->enabled = false;
+      update_output(apu, ch, 0);
+    }
+  }
+}
+
+static void clock_envelope(struct libyagbe_apu* const apu,
+                           const unsigned int ch) {
+  struct libyagbe_apu_channel* const c = &apu->channels[ch];
+  const uint8_t nrx2 = *get_reg(apu, ch, 2);
+  const unsigned int pace = nrx2 & 0x07;
+
+  if (!c->enabled || (pace == 0) || (--c->envelope_timer != 0)) {
+    return;
+  }
+  c->envelope_timer = (uint8_t)pace;
+
+  if (nrx2 & 0x08) {
+    if (c->volume < 15) {
+      c->volume++;
+    }
+  } else if (c->volume > 0) {
+    c->volume--;
+  }
+  update_output(apu, ch, 0);
+}
+
+static void clock_frame_seq(struct libyagbe_apu* const apu) {
+  const unsigned int step = apu->frame_seq_step;
+  unsigned int ch;
+
+  if ((step & 1) == 0) {
+    for (ch = 0; ch < LIBYAGBE_APU_NUM_CHANNELS; ++ch) {
+      clock_length(apu, ch);
+    }
+  }
+
+  if ((step == 2) || (step == 6)) {
+    clock_sweep(apu);
+  }
+
+  if (step == 7) {
+    clock_envelope(apu, LIBYAGBE_APU_CHANNEL_SQUARE1);
+    clock_envelope(apu, LIBYAGBE_APU_CHANNEL_SQUARE2);
+    clock_envelope(apu, LIBYAGBE_APU_CHANNEL_NOISE);
+  }
+  apu->frame_seq_step = (step + 1) & 7;
+}
+
+static void trigger_channel(struct libyagbe_apu* const apu,
+                            const unsigned int ch) {
+  struct libyagbe_apu_channel* const c = &apu->channels[ch];
+  const uint8_t nrx2 = *get_reg(apu, ch, 2);
+  const uint8_t nr10 = apu->io[LIBYAGBE_APU_IO_NR10];
+
+  c->enabled = dac_enabled(apu, ch);
+
+  if (c->length == 0) {
+    c->length = (ch == LIBYAGBE_APU_CHANNEL_WAVE) ? 256 : 64;
+  }
+
+  c->timer = get_period(apu, ch);
+  c->volume = nrx2 >> 4;
+  c->envelope_timer = (nrx2 & 0x07) ? (nrx2 & 0x07) : 8;
+
+  switch (ch) {
+    case LIBYAGBE_APU_CHANNEL_SQUARE1:
+      c->sweep_shadow = (uint16_t)get_frequency(apu, ch);
+      c->sweep_timer = (nr10 & 0x70) ? ((nr10 >> 4) & 0x07) : 8;
+      c->sweep_enabled = (nr10 & 0x77) != 0;
+
+      if (nr10 & 0x07) {
+        calculate_sweep(apu);
+      }
+      break;
+
+    case LIBYAGBE_APU_CHANNEL_WAVE:
+      c->position = 0;
+      break;
+
+    case LIBYAGBE_APU_CHANNEL_NOISE:
+      c->lfsr = 0x7FFF;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Puts out every sample which can no longer be affected by a step, and makes
+ * room for more. */
+static void push_samples(struct libyagbe_apu* const apu, const size_t count) {
+  struct libyagbe_apu_ring* const ring = apu->ring;
+  const size_t head = ring->head;
+  const size_t space = ring->capacity - (head - LOAD_ACQUIRE(ring->tail));
+  const size_t pushed = (count < space) ? count : space;
+  unsigned int side;
+  size_t i;
+
+  for (side = 0; side < 2; ++side) {
+    long* const deltas = apu->deltas[side];
+    long accumulator = apu->accumulator[side];
+    long highpass = apu->highpass[side];
+
+    for (i = 0; i < count; ++i) {
+      long sample;
+
+      accumulator += deltas[i];
+      sample = accumulator - highpass;
+      highpass += sample >> BLIP_HIGHPASS_SHIFT;
+      sample >>= BLIP_OUTPUT_SHIFT;
+
+      if (sample > 32767) {
+        sample = 32767;
+      } else if (sample < -32768) {
+        sample = -32768;
+      }
+
+      if (i < pushed) {
+        ring->samples[(((head + i) & (ring->capacity - 1)) * 2) + side] =
+            (int16_t)sample;
+      }
+    }
+    apu->accumulator[side] = accumulator;
+    apu->highpass[side] = highpass;
+
+    memmove(deltas, &deltas[count], LIBYAGBE_APU_BLIP_WIDTH * sizeof(long));
+    memset(&deltas[LIBYAGBE_APU_BLIP_WIDTH], 0, count * sizeof(long));
+  }
+
+  apu->dropped += (unsigned long)(count - pushed);
+  STORE_RELEASE(ring->head, head + pushed);
+}
+
+static void end_span(struct libyagbe_apu* const apu,
+                     const unsigned long cycles) {
+  const unsigned long position =
+      apu->sample_fraction + (cycles * apu->sample_rate);
+  const size_t count = position >> CLOCK_RATE_SHIFT;
+
+  apu->sample_fraction = position & ((1UL << CLOCK_RATE_SHIFT) - 1);
+
+  if (count != 0) {
+    push_samples(apu, count);
+  }
+}
+
+/* Sets the filter state to what it would be had the current mix been playing
+ * forever, so that starting output doesn't cause a pop. */
+static void settle_output(struct libyagbe_apu* const apu) {
+  unsigned int side;
+  unsigned int ch;
+
+  memset(apu->deltas, 0, sizeof(apu->deltas));
+  apu->sample_fraction = 0;
+
+  for (side = 0; side < 2; ++side) {
+    long level = 0;
+
+    for (ch = 0; ch < LIBYAGBE_APU_NUM_CHANNELS; ++ch) {
+      level += apu->channels[ch].output * get_gain(apu, ch, side);
+    }
+    apu->accumulator[side] = level << BLIP_KERNEL_SHIFT;
+    apu->highpass[side] = apu->accumulator[side];
+  }
+}
+
+static void write_nr52(struct libyagbe_apu* const apu, const uint8_t data) {
+  unsigned int ch;
+
+  if (!(data & NR52_POWER) && (apu->io[LIBYAGBE_APU_IO_NR52] & NR52_POWER)) {
+    /* Powering off turns off every channel and clears every register up to
+     * NR51. */
+    for (ch = 0; ch < LIBYAGBE_APU_NUM_CHANNELS; ++ch) {
+      apu->channels[ch].enabled = false;
+      update_output(apu, ch, 0);
+    }
+    memset(apu->io, 0, LIBYAGBE_APU_IO_NR52);
+  } else if ((data & NR52_POWER) &&
+             !(apu->io[LIBYAGBE_APU_IO_NR52] & NR52_POWER)) {
+    apu->frame_seq_step = 0;
+  }
+  apu->io[LIBYAGBE_APU_IO_NR52] = data & NR52_POWER;
+}
+
+void libyagbe_apu_ring_init(struct libyagbe_apu_ring* const ring,
+                            int16_t* const samples, const size_t capacity) {
+  assert(ring != NULL);
+  assert(samples != NULL);
+  assert((capacity != 0) && ((capacity & (capacity - 1)) == 0));
+
+  ring->samples = samples;
+  ring->capacity = capacity;
+  ring->head = 0;
+  ring->tail = 0;
+}
+
+size_t libyagbe_apu_ring_pop(struct libyagbe_apu_ring* const ring,
+                             int16_t* const samples, const size_t max_frames) {
+  size_t tail;
+  size_t count;
+  size_t i;
+
+  assert(ring != NULL);
+  assert(samples != NULL);
+
+  tail = ring->tail;
+  count = LOAD_ACQUIRE(ring->head) - tail;
+
+  if (count > max_frames) {
+    count = max_frames;
+  }
+
+  for (i = 0; i < count; ++i) {
+    const size_t index = ((tail + i) & (ring->capacity - 1)) * 2;
+
+    samples[i * 2] = ring->samples[index];
+    samples[(i * 2) + 1] = ring->samples[index + 1];
+  }
+  STORE_RELEASE(ring->tail, tail + count);
+
+  return count;
+}
+
+void libyagbe_apu_init(struct libyagbe_apu* const apu,
+                       struct libyagbe_sched* const sched) {
+  assert(apu != NULL);
+  assert(sched != NULL);
+
+  apu->sched = sched;
+  apu->ring = NULL;
+  apu->sample_rate = 0;
+}
+
+void libyagbe_apu_reset(struct libyagbe_apu* const apu) {
+  struct libyagbe_apu_channel* square1;
+
+  assert(apu != NULL);
+
+  memset(apu->io, 0, sizeof(apu->io));
+  memset(apu->channels, 0, sizeof(apu->channels));
+
+  /* The state left behind by the boot ROM, which has just finished playing
+   * its chime on square channel 1. */
+  apu->io[LIBYAGBE_APU_IO_NR10] = 0x80;
+  apu->io[LIBYAGBE_APU_IO_NR11] = 0x80;
+  apu->io[LIBYAGBE_APU_IO_NR12] = 0xF3;
+  apu->io[LIBYAGBE_APU_IO_NR13] = 0xC1;
+  apu->io[LIBYAGBE_APU_IO_NR14] = 0x87;
+  apu->io[LIBYAGBE_APU_IO_NR50] = 0x77;
+  apu->io[LIBYAGBE_APU_IO_NR51] = 0xF3;
+  apu->io[LIBYAGBE_APU_IO_NR52] = NR52_POWER;
+
+  square1 = &apu->channels[LIBYAGBE_APU_CHANNEL_SQUARE1];
+  square1->enabled = true;
+  square1->sweep_timer = 8;
+  square1->envelope_timer = 3;
+
+  apu->timestamp = apu->sched->current_timestamp;
+  apu->frame_seq_timer = FRAME_SEQ_PERIOD;
+  apu->frame_seq_step = 0;
+  apu->dropped = 0;
+
+  settle_output(apu);
+}
+
+void libyagbe_apu_set_output(struct libyagbe_apu* const apu,
+                             struct libyagbe_apu_ring* const ring,
+                             const unsigned long sample_rate) {
+  assert(apu != NULL);
+  assert((ring == NULL) ||
+         ((sample_rate != 0) && (sample_rate <= LIBYAGBE_APU_MAX_SAMPLE_RATE)));
+
+  /* Whatever happened up to now happened with the old output. */
+  libyagbe_apu_sync(apu);
+
+  apu->ring = ring;
+  apu->sample_rate = (ring != NULL) ? sample_rate : 0;
+
+  settle_output(apu);
+}
+
+void libyagbe_apu_sync(struct libyagbe_apu* const apu) {
+  const uintmax_t now = apu->sched->current_timestamp;
+  unsigned int ch;
+
+  assert(apu != NULL);
+
+  while (apu->timestamp < now) {
+    const uintmax_t elapsed = now - apu->timestamp;
+    const unsigned long cycles = (elapsed < apu->frame_seq_timer)
+                                     ? (unsigned long)elapsed
+                                     : apu->frame_seq_timer;
+
+    if (apu->ring != NULL) {
+      for (ch = 0; ch < LIBYAGBE_APU_NUM_CHANNELS; ++ch) {
+        run_channel(apu, ch, cycles);
+      }
+      end_span(apu, cycles);
+    }
+
+    apu->timestamp += cycles;
+    apu->frame_seq_timer -= cycles;
+
+    if (apu->frame_seq_timer == 0) {
+      apu->frame_seq_timer = FRAME_SEQ_PERIOD;
+
+      if (apu->io[LIBYAGBE_APU_IO_NR52] & NR52_POWER) {
+        clock_frame_seq(apu);
+      }
+    }
+  }
+}
+
+uint8_t libyagbe_apu_read(struct libyagbe_apu* const apu,
+                          const unsigned int offset) {
+  uint8_t data;
+  unsigned int ch;
+
+  assert(apu != NULL);
+  assert(offset < LIBYAGBE_APU_NUM_IO_REGISTERS);
+
+  if (offset >= LIBYAGBE_APU_IO_WAVE_RAM) {
+    return apu->io[offset];
+  }
+
+  if (offset != LIBYAGBE_APU_IO_NR52) {
+    return apu->io[offset] | read_masks[offset];
+  }
+
+  /* Only the channel status bits depend on time, as the length counters run
+   * out. */
+  libyagbe_apu_sync(apu);
+
+  data = apu->io[offset] | read_masks[offset];
+
+  for (ch = 0; ch < LIBYAGBE_APU_NUM_CHANNELS; ++ch) {
+    if (apu->channels[ch].enabled) {
+      data |= 1 << ch;
+    }
+  }
+  return data;
+}
+
+void libyagbe_apu_write(struct libyagbe_apu* const apu,
+                        const unsigned int offset, const uint8_t data) {
+  struct libyagbe_apu_channel* c;
+  unsigned int ch;
+
+  assert(apu != NULL);
+  assert(offset < LIBYAGBE_APU_NUM_IO_REGISTERS);
+
+  /* Everything up to now happened with the old value. */
+  libyagbe_apu_sync(apu);
+
+  if (offset >= LIBYAGBE_APU_IO_WAVE_RAM) {
+    apu->io[offset] = data;
+    update_output(apu, LIBYAGBE_APU_CHANNEL_WAVE, 0);
+
+    return;
+  }
+
+  if (offset == LIBYAGBE_APU_IO_NR52) {
+    write_nr52(apu, data);
+    return;
+  }
+
+  /* Nothing else can be written while the APU is powered off. */
+  if (!(apu->io[LIBYAGBE_APU_IO_NR52] & NR52_POWER)) {
+    return;
+  }
+
+  if ((offset == LIBYAGBE_APU_IO_NR50) || (offset == LIBYAGBE_APU_IO_NR51)) {
+    /* Take every channel out of the mix at the old volume and panning, and
+     * put it back in at the new ones. */
+    for (ch = 0; ch < LIBYAGBE_APU_NUM_CHANNELS; ++ch) {
+      mix_channel(apu, ch, 0, -(long)apu->channels[ch].output);
+    }
+    apu->io[offset] = data;
+
+    for (ch = 0; ch < LIBYAGBE_APU_NUM_CHANNELS; ++ch) {
+      mix_channel(apu, ch, 0, apu->channels[ch].output);
+    }
+    return;
+  }
+
+  if (offset > LIBYAGBE_APU_IO_NR44) {
+    apu->io[offset] = data;
+    return;
+  }
+
+  apu->io[offset] = data;
+
+  ch = offset / 5;
+  c = &apu->channels[ch];
+
+  switch (offset - channel_base[ch]) {
+    case 1:
+      c->length = (ch == LIBYAGBE_APU_CHANNEL_WAVE) ? (256 - data)
+                                                    : (64 - (data & 0x3F));
+      break;
+
+    case 4:
+      if (data & NRX4_TRIGGER) {
+        trigger_channel(apu, ch);
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  if (!dac_enabled(apu, ch)) {
+    c->enabled = false;
+  }
+  update_output(apu, ch, 0);
+}
@@ -20,279 +20,559 @@
 
 #include <assert.h>
 #include <stddef.h>
-#include <stdio.h>
+#include <string.h>
 
 #include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/diag.h"
+#include "libyagbe/irq.h"
 #include "libyagbe/sched.h"
+#include "profile_hooks.h"
+
+/* Base addresses of the IO register groups, relative to $FF00. */
+enum io_group { IO_GROUP_APU = 0x10, IO_GROUP_PPU = 0x40 };
+
+/* Returns the parent's copy of the chunk of memory at `memory`, if it's still
+ * shared. */
+static const uint8_t* get_shared_source(const struct libyagbe_bus* const bus,
+                                        const uint8_t* const memory) {
+  if ((memory >= bus->wram) && (memory < &bus->wram[sizeof(bus->wram)])) {
+    return bus->shared
+        .wram[(size_t)(memory - bus->wram) >> LIBYAGBE_BUS_PAGE_SHIFT];
+  }
+
+  if ((memory >= bus->cart.ram) &&
+      (memory < &bus->cart.ram[sizeof(bus->cart.ram)])) {
+    return bus->shared
+        .cart_ram[(size_t)(memory - bus->cart.ram) >> LIBYAGBE_BUS_PAGE_SHIFT];
+  }
+  return NULL;
+}
+
+/* Points a page which was waiting to copy some memory at it for good, if it
+ * still is. */
+static void remap_unshared(struct libyagbe_bus* const bus,
+                           const unsigned int page, uint8_t* const memory) {
+  if (bus->shared.pending[page] == memory) {
+    bus->read_map[page] = memory;
+    bus->write_map[page] = memory;
+    bus->shared.pending[page] = NULL;
+  }
+}
+
+/* Gives a page mapped to shared memory its own copy of it, on the first write
+ * to it. Returns false if the page isn't mapped to shared memory. */
+static bool unshare_page(struct libyagbe_bus* const bus,
+                         const unsigned int page) {
+  uint8_t* const memory = bus->shared.pending[page];
+  size_t chunk;
+
+  if (memory == NULL) {
+    return false;
+  }
+
+  /* Only the pages which can map the chunk are remapped: WRAM at $C000 and
+   * in echo RAM, and cartridge RAM at $A000 while its bank is selected. */
+  if ((memory >= bus->wram) && (memory < &bus->wram[sizeof(bus->wram)])) {
+    chunk = (size_t)(memory - bus->wram) >> LIBYAGBE_BUS_PAGE_SHIFT;
+
+    memcpy(memory, bus->shared.wram[chunk], LIBYAGBE_BUS_PAGE_SIZE);
+    bus->shared.wram[chunk] = NULL;
+
+    remap_unshared(bus, 0xC0 + (unsigned int)chunk, memory);
+
+    if (chunk < 0x1E) {
+      remap_unshared(bus, 0xE0 + (unsigned int)chunk, memory);
+    }
+  } else {
+    chunk = (size_t)(memory - bus->cart.ram) >> LIBYAGBE_BUS_PAGE_SHIFT;
+
+    memcpy(memory, bus->shared.cart_ram[chunk], LIBYAGBE_BUS_PAGE_SIZE);
+    bus->shared.cart_ram[chunk] = NULL;
+
+    remap_unshared(bus, 0xA0 + (unsigned int)(chunk & 0x1F), memory);
+  }
+  bus->shared.num_shared--;
+
+  return true;
+}
+
+static void map_cart(struct libyagbe_bus* const bus) {
+  uint8_t* const ram = libyagbe_cart_get_ram_bank(&bus->cart);
+
+  /* $0000-$7FFF: ROM, which is never writable; writes go to the MBC. */
+  libyagbe_bus_map(bus, 0x00, 0x40,
+                   libyagbe_cart_get_rom_bank(&bus->cart, 0x0000), NULL);
+  libyagbe_bus_map(bus, 0x40, 0x40,
+                   libyagbe_cart_get_rom_bank(&bus->cart, 0x4000), NULL);
+
+  /* $A000-$BFFF: external RAM, unless it's disabled or the RTC is selected. */
+  libyagbe_bus_map(bus, 0xA0, 0x20, ram, ram);
+}
+
+/* Handles a write to the MBC, remapping only the regions whose bank it
+ * changed. Most writes, such as enabling RAM or selecting the bank already
+ * selected, change nothing. */
+static void write_mbc(struct libyagbe_bus* const bus, const uint16_t address,
+                      const uint8_t data) {
+  const uint8_t* const rom0 = libyagbe_cart_get_rom_bank(&bus->cart, 0x0000);
+  const uint8_t* const rom1 = libyagbe_cart_get_rom_bank(&bus->cart, 0x4000);
+  const uint8_t* const ram = libyagbe_cart_get_ram_bank(&bus->cart);
+  uint8_t* bank;
+
+  libyagbe_cart_write_rom(&bus->cart, address, data);
+
+  if (libyagbe_cart_get_rom_bank(&bus->cart, 0x0000) != rom0) {
+    libyagbe_bus_map(bus, 0x00, 0x40,
+                     libyagbe_cart_get_rom_bank(&bus->cart, 0x0000), NULL);
+  }
+
+  if (libyagbe_cart_get_rom_bank(&bus->cart, 0x4000) != rom1) {
+    libyagbe_bus_map(bus, 0x40, 0x40,
+                     libyagbe_cart_get_rom_bank(&bus->cart, 0x4000), NULL);
+  }
+  bank = libyagbe_cart_get_ram_bank(&bus->cart);
+
+  if (bank != ram) {
+    libyagbe_bus_map(bus, 0xA0, 0x20, bank, bank);
+  }
+}
+
+/* Determines whether OAM DMA keeps the CPU from reaching an address. */
+static bool is_locked(const struct libyagbe_bus* const bus,
+                      const uint16_t address) {
+  return bus->dma.active && (address < 0xFF00);
+}
+
+static bool read_io(struct libyagbe_bus* const bus,
+                    const uint16_t address, uint8_t* const data) {
+  if ((address >= 0xA000) && (address < 0xC000)) {
+    *data = libyagbe_cart_read_ram(&bus->cart, address);
+    return true;
+  }
+
+  if ((address >= 0xFE00) && (address < 0xFF00)) {
+    /* $FEA0-$FEFF is unusable, and reads as 0 on DMG. */
+    *data = (address < (0xFE00 + LIBYAGBE_PPU_MEM_SIZE_OAM))
+                ? bus->ppu.oam[address - 0xFE00]
+                : 0x00;
+    return true;
+  }
+
+  if ((address >= (0xFF00 | IO_GROUP_APU)) &&
+      (address < (0xFF00 | IO_GROUP_PPU))) {
+    *data = libyagbe_apu_read(&bus->apu, address - (0xFF00 | IO_GROUP_APU));
+    return true;
+  }
+
+  if ((address >= 0xFF80) && (address < 0xFFFF)) {
+    *data = bus->hram[address - 0xFF80];
+    return true;
+  }
+
+  switch (address) {
+    case 0xFF00 | LIBYAGBE_JOYPAD_IO_P1:
+      *data = libyagbe_joypad_read(&bus->joypad);
+      return true;
+
+    case 0xFF00 | LIBYAGBE_BUS_IO_DMA:
+      *data = bus->dma.source;
+      return true;
+
+    case 0xFF00 | LIBYAGBE_TIMER_IO_DIV:
+      *data = libyagbe_timer_read_div(&bus->timer);
+      return true;
+
+    case 0xFF00 | LIBYAGBE_TIMER_IO_TIMA:
+      *data = libyagbe_timer_read_tima(&bus->timer);
+      return true;
+
+    case 0xFF00 | LIBYAGBE_TIMER_IO_TMA:
+      *data = bus->timer.tma;
+      return true;
+
+    case 0xFF00 | LIBYAGBE_TIMER_IO_TAC:
+      *data = bus->timer.tac;
+      return true;
+
+    case 0xFF00 | LIBYAGBE_BUS_IO_IF:
+      *data = libyagbe_irq_read_flag(&bus->irq);
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_LCDC:
+      *data = bus->ppu.lcdc;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_STAT:
+      *data = libyagbe_ppu_read_stat(&bus->ppu);
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_SCY:
+      *data = bus->ppu.scy;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_SCX:
+      *data = bus->ppu.scx;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_LY:
+      *data = bus->ppu.ly;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_LYC:
+      *data = bus->ppu.lyc;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_BGP:
+      *data = bus->ppu.bgp;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_OBP0:
+      *data = bus->ppu.obp0;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_OBP1:
+      *data = bus->ppu.obp1;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_WY:
+      *data = bus->ppu.wy;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_WX:
+      *data = bus->ppu.wx;
+      return true;
+
+    case 0xFFFF:
+      *data = bus->irq.enable;
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static bool write_io(struct libyagbe_bus* const bus, const uint16_t address,
+                     const uint8_t data) {
+  if ((bus->shared.num_shared != 0) &&
+      unshare_page(bus, address >> LIBYAGBE_BUS_PAGE_SHIFT)) {
+    bus->write_map[address >> LIBYAGBE_BUS_PAGE_SHIFT]
+                  [address & LIBYAGBE_BUS_PAGE_MASK] = data;
+    return true;
+  }
+
+  if (address < 0x8000) {
+    write_mbc(bus, address, data);
+    return true;
+  }
+
+  if (address < 0x9800) {
+    /* Tile data goes through the PPU so the decoded tile cache can be
+     * invalidated; the tile maps are mapped directly. */
+    libyagbe_ppu_write_tile_data(&bus->ppu, address - 0x8000, data);
+    return true;
+  }
+
+  if ((address >= 0xA000) && (address < 0xC000)) {
+    libyagbe_cart_write_ram(&bus->cart, address, data);
+    return true;
+  }
+
+  if ((address >= (0xFF00 | IO_GROUP_APU)) &&
+      (address < (0xFF00 | IO_GROUP_PPU))) {
+    libyagbe_apu_write(&bus->apu, address - (0xFF00 | IO_GROUP_APU), data);
+    return true;
+  }
+
+  if ((address >= 0xFF80) && (address < 0xFFFF)) {
+    bus->hram[address - 0xFF80] = data;
+    return true;
+  }
+
+  if ((address >= 0xFE00) && (address < 0xFF00)) {
+    if (address < (0xFE00 + LIBYAGBE_PPU_MEM_SIZE_OAM)) {
+      bus->ppu.oam[address - 0xFE00] = data;
+    }
+    return true;
+  }
+
+  switch (address) {
+    case 0xFF00 | LIBYAGBE_JOYPAD_IO_P1:
+      libyagbe_joypad_write(&bus->joypad, data);
+      return true;
+
+    case 0xFF00 | LIBYAGBE_BUS_IO_DMA:
+      /* Starting again while a transfer is running restarts it. */
+      bus->dma.source = data;
+      bus->dma.active = true;
+
+      libyagbe_sched_schedule(bus->sched, LIBYAGBE_SCHED_EVENT_DMA,
+                              LIBYAGBE_BUS_DMA_CYCLES);
+      libyagbe_bus_reset(bus);
+
+      return true;
+
+    case 0xFF00 | LIBYAGBE_BUS_IO_SB:
+      if (bus->serial_cb != NULL) {
+        bus->serial_cb(bus->serial_userdata, data);
+      }
+      return true;
+
+    case 0xFF00 | LIBYAGBE_BUS_IO_SC:
+      return true;
+
+    case 0xFF00 | LIBYAGBE_TIMER_IO_DIV:
+      libyagbe_timer_write_div(&bus->timer);
+      return true;
+
+    case 0xFF00 | LIBYAGBE_TIMER_IO_TIMA:
+      libyagbe_timer_write_tima(&bus->timer, data);
+      return true;
+
+    case 0xFF00 | LIBYAGBE_TIMER_IO_TMA:
+      libyagbe_timer_write_tma(&bus->timer, data);
+      return true;
+
+    case 0xFF00 | LIBYAGBE_TIMER_IO_TAC:
+      libyagbe_timer_handle_tac(&bus->timer, data);
+      return true;
+
+    case 0xFF00 | LIBYAGBE_BUS_IO_IF:
+      libyagbe_irq_write_flag(&bus->irq, data);
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_LCDC:
+      libyagbe_ppu_write_lcdc(&bus->ppu, data);
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_STAT:
+      libyagbe_ppu_write_stat(&bus->ppu, data);
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_SCY:
+      bus->ppu.scy = data;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_SCX:
+      bus->ppu.scx = data;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_LY:
+      /* Read only. */
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_LYC:
+      libyagbe_ppu_write_lyc(&bus->ppu, data);
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_BGP:
+      bus->ppu.bgp = data;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_OBP0:
+      bus->ppu.obp0 = data;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_OBP1:
+      bus->ppu.obp1 = data;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_WY:
+      bus->ppu.wy = data;
+      return true;
+
+    case 0xFF00 | IO_GROUP_PPU | LIBYAGBE_PPU_IO_WX:
+      bus->ppu.wx = data;
+      return true;
+
+    case 0xFFFF:
+      libyagbe_irq_write_enable(&bus->irq, data);
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+/* Finishes OAM DMA by copying the whole transfer at once, and unlocks the
+ * bus. */
+static void handle_dma_complete(void* const userdata) {
+  struct libyagbe_bus* const bus = (struct libyagbe_bus*)userdata;
+  uint16_t source = (uint16_t)(bus->dma.source << 8);
+  const uint8_t* page;
+  unsigned int i;
+
+  bus->dma.active = false;
+  libyagbe_bus_reset(bus);
+
+  /* Everything from $E000 up reads from WRAM, not only echo RAM. */
+  if (source >= 0xE000) {
+    source -= 0x2000;
+  }
+  page = bus->read_map[source >> LIBYAGBE_BUS_PAGE_SHIFT];
+
+  /* The source is always within one page, so one copy does it. */
+  if (page != NULL) {
+    memcpy(bus->ppu.oam, page, LIBYAGBE_PPU_MEM_SIZE_OAM);
+    return;
+  }
+
+  for (i = 0; i < LIBYAGBE_PPU_MEM_SIZE_OAM; ++i) {
+    if (!read_io(bus, (uint16_t)(source + i), &bus->ppu.oam[i])) {
+      bus->ppu.oam[i] = 0xFF;
+    }
+  }
+}
+
+void libyagbe_bus_init(struct libyagbe_bus* const bus,
+                       struct libyagbe_sched* const sched) {
+  assert(bus != NULL);
+  assert(sched != NULL);
+
+  bus->sched = sched;
+  libyagbe_sched_register(sched, LIBYAGBE_SCHED_EVENT_DMA,
+                          &handle_dma_complete, bus);
+}
+
+void libyagbe_bus_map(struct libyagbe_bus* const bus,
+                      const unsigned int first_page,
+                      const unsigned int num_pages, const uint8_t* const read,
+                      uint8_t* const write) {
+  unsigned int i;
+
+  assert(bus != NULL);
+  assert(first_page + num_pages <= LIBYAGBE_BUS_NUM_PAGES);
+
+  for (i = 0; i < num_pages; ++i) {
+    const size_t offset = (size_t)i << LIBYAGBE_BUS_PAGE_SHIFT;
+    const unsigned int page = first_page + i;
+
+    bus->read_map[page] = (read != NULL) ? read + offset : NULL;
+    bus->write_map[page] = (write != NULL) ? write + offset : NULL;
+    bus->shared.pending[page] = NULL;
+
+    if ((bus->shared.num_shared != 0) && (write != NULL)) {
+      const uint8_t* const source = get_shared_source(bus, write + offset);
+
+      /* Read the parent's copy until the first write. */
+      if (source != NULL) {
+        bus->read_map[page] = source;
+        bus->write_map[page] = NULL;
+        bus->shared.pending[page] = write + offset;
+      }
+    }
+  }
+}
+
+void libyagbe_bus_reset(struct libyagbe_bus* const bus) {
+  assert(bus != NULL);
+
+  /* Start with everything going through the IO handlers. */
+  libyagbe_bus_map(bus, 0x00, LIBYAGBE_BUS_NUM_PAGES, NULL, NULL);
+
+  /* $0000-$7FFF and $A000-$BFFF: the cartridge */
+  map_cart(bus);
+
+  /* $8000-$9FFF: VRAM. Writes to the tile data at $8000-$97FF go through the
+   * PPU so it can keep its decoded tiles up to date. */
+  libyagbe_bus_map(bus, 0x80, 0x20, bus->ppu.vram, NULL);
+  libyagbe_bus_map(bus, 0x98, 0x08, &bus->ppu.vram[0x1800],
+                   &bus->ppu.vram[0x1800]);
+
+  /* $C000-$DFFF: WRAM */
+  libyagbe_bus_map(bus, 0xC0, 0x20, bus->wram, bus->wram);
+
+  /* $E000-$FDFF: echo of $C000-$DDFF */
+  libyagbe_bus_map(bus, 0xE0, 0x1E, bus->wram, bus->wram);
+
+  /* With everything below $FF00 unmapped, the IO handlers can lock it. */
+  if (bus->dma.active) {
+    libyagbe_bus_map(bus, 0x00, 0xFE, NULL, NULL);
+  }
+}
+
+const uint8_t* libyagbe_bus_get_memory(const struct libyagbe_bus* const bus,
+                                       const uint8_t* const memory) {
+  const uint8_t* source;
+
+  assert(bus != NULL);
+  assert(memory != NULL);
+
+  if (bus->shared.num_shared == 0) {
+    return memory;
+  }
+
+  source = get_shared_source(bus, memory);
+  return (source != NULL) ? source : memory;
+}
+
+uint8_t libyagbe_bus_inspect_memory(struct libyagbe_bus* const bus,
+                                    const uint16_t address) {
+  const uint8_t* page;
+  uint8_t data;
+
+  assert(bus != NULL);
+
+  page = bus->read_map[address >> LIBYAGBE_BUS_PAGE_SHIFT];
+
+  if (page != NULL) {
+    return page[address & LIBYAGBE_BUS_PAGE_MASK];
+  }
+
+  if (is_locked(bus, address)) {
+    return 0xFF;
+  }
+  return read_io(bus, address, &data) ? data : 0xFF;
+}
 
 uint8_t libyagbe_bus_read_memory(struct libyagbe_bus* const bus,
                                  const uint16_t address) {
+  const uint8_t* page;
+  uint8_t data;
+
   assert(bus != NULL);
 
-  libyagbe_sched_step();
-
-  switch (address >> 12) {
-    case 0x0:
-    case 0x1:
-    case 0x2:
-    case 0x3:
-    case 0x4:
-    case 0x5:
-    case 0x6:
-    case 0x7:
-      return bus->cart.data[address];
-
-    case 0xC:
-    case 0xD:
-      return bus->wram[address - 0xC000];
-
-    case 0xF:
-      switch ((address >> 8) & 0x0F) {
-        case 0xF:
-          switch ((address & 0x00FF) >> 4) {
-            case 0x0:
-              switch (address & 0x000F) {
-                case LIBYAGBE_TIMER_IO_TIMA:
-                  return bus->timer.tima;
-
-                case LIBYAGBE_BUS_IO_IF:
-                  return bus->interrupt_flag;
-
-                default:
-                  break;
-              }
-              break;
-
-            case 0x4:
-              switch (address & 0x000F) {
-                case LIBYAGBE_PPU_IO_LY:
-                  return bus->ppu.ly;
-
-                default:
-                  break;
-              }
-              break;
-
-            case 0x8:
-            case 0x9:
-            case 0xA:
-            case 0xB:
-            case 0xC:
-            case 0xD:
-            case 0xE:
-              return bus->hram[address - 0xFF80];
-
-            case 0xF:
-              switch (address & 0x000F) {
-                case 0x0:
-                case 0x1:
-                case 0x2:
-                case 0x3:
-                case 0x4:
-                case 0x5:
-                case 0x6:
-                case 0x7:
-                case 0x9:
-                case 0xA:
-                case 0xB:
-                case 0xC:
-                case 0xD:
-                case 0xE:
-                  return bus->hram[address - 0xFF80];
-
-                case 0xF:
-                  return bus->interrupt_enable;
-
-                default:
-                  break;
-              }
-              break;
-
-            default:
-              break;
-          }
-          break;
-
-        default:
-          break;
-      }
-      break;
+  libyagbe_sched_step(bus->sched);
 
-    default:
-      break;
+  page = bus->read_map[address >> LIBYAGBE_BUS_PAGE_SHIFT];
+
+  if (page != NULL) {
+    return page[address & LIBYAGBE_BUS_PAGE_MASK];
+  }
+
+  if (is_locked(bus, address)) {
+    return 0xFF;
   }
-  printf("Unhandled read: $%04X\n", address);
+  PROFILE_IO(bus, LIBYAGBE_DIAG_ACCESS_READ, address);
+
+  if (read_io(bus, address, &data)) {
+    return data;
+  }
+  libyagbe_diag_record(&bus->diag, LIBYAGBE_DIAG_ACCESS_READ, address, 0xFF);
   return 0xFF;
 }
 
 void libyagbe_bus_write_memory(struct libyagbe_bus* const bus,
                                const uint16_t address, const uint8_t data) {
+  uint8_t* page;
   bool good;
+
   assert(bus != NULL);
 
-  good = true;
-
-  switch (address >> 12) {
-    case 0x8:
-    case 0x9:
-      bus->ppu.vram[address - 0x8000] = data;
-      break;
-
-    case 0xC:
-    case 0xD:
-      bus->wram[address - 0xC000] = data;
-      break;
-
-    case 0xF:
-      switch ((address >> 8) & 0x0F) {
-        case 0xF:
-          switch ((address & 0x00FF) >> 4) {
-            case 0x0:
-              switch (address & 0x000F) {
-                case 1:
-                  putchar(data);
-                  break;
-
-                case 2:
-                  break;
-
-                case LIBYAGBE_TIMER_IO_TIMA:
-                  bus->timer.tima = data;
-                  break;
-
-                case LIBYAGBE_TIMER_IO_TMA:
-                  bus->timer.tma = data;
-                  break;
-
-                case LIBYAGBE_TIMER_IO_TAC:
-                  libyagbe_timer_handle_tac(&bus->timer, data);
-                  break;
-
-                case LIBYAGBE_BUS_IO_IF:
-                  bus->interrupt_flag = data;
-                  break;
-
-                default:
-                  good = false;
-                  break;
-              }
-              break;
-
-            case 0x1:
-              good = false;
-              break;
-
-            case 0x2:
-              switch (address & 0x000F) {
-                case LIBYAGBE_APU_IO_NR50:
-                  bus->apu.nr50 = data;
-                  break;
-
-                case LIBYAGBE_APU_IO_NR51:
-                  bus->apu.nr51 = data;
-                  break;
-
-                case LIBYAGBE_APU_IO_NR52:
-                  bus->apu.nr52 = data;
-                  break;
-
-                default:
-                  break;
-              }
-              break;
-
-            case 0x3:
-              break;
-
-            case 0x4:
-              switch (address & 0x000F) {
-                case LIBYAGBE_PPU_IO_LCDC:
-                  bus->ppu.lcdc = data;
-                  break;
-
-                case LIBYAGBE_PPU_IO_SCY:
-                  bus->ppu.scy = data;
-                  break;
-
-                case LIBYAGBE_PPU_IO_SCX:
-                  bus->ppu.scx = data;
-                  break;
-
-                case LIBYAGBE_PPU_IO_BGP:
-                  bus->ppu.bgp = data;
-                  break;
-
-                default:
-                  good = false;
-                  break;
-              }
-              break;
-
-            case 0x5:
-            case 0x6:
-            case 0x7:
-              good = false;
-              break;
-
-            case 0x8:
-            case 0x9:
-            case 0xA:
-            case 0xB:
-            case 0xC:
-            case 0xD:
-            case 0xE:
-              bus->hram[address - 0xFF80] = data;
-              break;
-
-            case 0xF:
-              switch (address & 0x000F) {
-                case 0x0:
-                case 0x1:
-                case 0x2:
-                case 0x3:
-                case 0x4:
-                case 0x5:
-                case 0x6:
-                case 0x7:
-                case 0x9:
-                case 0xA:
-                case 0xB:
-                case 0xC:
-                case 0xD:
-                case 0xE:
-                  bus->hram[address - 0xFF80] = data;
-                  break;
-
-                case LIBYAGBE_BUS_IO_IE:
-                  bus->interrupt_enable = data;
-                  break;
-
-                default:
-                  good = false;
-                  break;
-              }
-              break;
-
-            default:
-              good = false;
-              break;
-          }
-          break;
-
-        default:
-          good = false;
-          break;
-      }
-      break;
+  page = bus->write_map[address >> LIBYAGBE_BUS_PAGE_SHIFT];
 
-    default:
-      good = false;
-      break;
+  if (page != NULL) {
+    page[address & LIBYAGBE_BUS_PAGE_MASK] = data;
+    good = true;
+  } else if (is_locked(bus, address)) {
+    good = true;
+  } else {
+    PROFILE_IO(bus, LIBYAGBE_DIAG_ACCESS_WRITE, address);
+    good = write_io(bus, address, data);
   }
 
-  libyagbe_sched_step();
+  libyagbe_sched_step(bus->sched);
 
   if (!good) {
-    printf("Unhandled write: $%04X <- $%02X\n", address, data);
+    libyagbe_diag_record(&bus->diag, LIBYAGBE_DIAG_ACCESS_WRITE, address, data);
   }
 }
@@ -0,0 +1,109 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* The handlers the CPU decodes instructions in the code cache into. The JIT
+ * builds its blocks out of the same handlers, so it can only ever do what the
+ * cached interpreter would. */
+
+#ifndef LIBYAGBE_CACHED_H
+#define LIBYAGBE_CACHED_H
+
+#include <stddef.h>
+
+#include "libyagbe/code_cache.h"
+#include "libyagbe/compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libyagbe_bus;
+struct libyagbe_cpu;
+
+enum cached_handler {
+  CACHED_UNDECODED,
+  CACHED_FALLBACK,
+  CACHED_NOP,
+  CACHED_LD_R_R,
+  CACHED_LD_R_IMM8,
+  CACHED_LD_R_MEM_HL,
+  CACHED_LD_MEM_HL_R,
+  CACHED_LD_MEM_HL_IMM8,
+  CACHED_LD_RR_IMM16,
+  CACHED_LD_A_MEM_RR,
+  CACHED_LD_MEM_RR_A,
+  CACHED_LD_A_MEM_IMM16,
+  CACHED_LD_MEM_IMM16_A,
+  CACHED_INC_R,
+  CACHED_DEC_R,
+  CACHED_INC_RR,
+  CACHED_ADD_HL_RR,
+  CACHED_ROTATE_A,
+  CACHED_ALU_R,
+  CACHED_ALU_MEM_HL,
+  CACHED_ALU_IMM8,
+  CACHED_JR,
+  CACHED_JP,
+  CACHED_CALL,
+  CACHED_RET_IF,
+  CACHED_RET,
+  CACHED_PUSH,
+  CACHED_POP,
+  CACHED_RST,
+  CACHED_CB_SHIFT_R,
+  CACHED_CB_SHIFT_MEM_HL,
+  CACHED_CB_BIT_R,
+  CACHED_CB_BIT_MEM_HL,
+  CACHED_CB_RES_R,
+  CACHED_CB_RES_MEM_HL,
+  CACHED_CB_SET_R,
+  CACHED_CB_SET_MEM_HL,
+  NUM_CACHED_HANDLERS
+};
+
+typedef void (*cached_handler_func)(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const entry);
+/** Decodes the instruction at the start of some code.
+ *
+ * @param e Receives the decoded instruction, which is a fallback if it has to
+ * be executed by the regular interpreter.
+ * @param code The instruction.
+ * @param available How many bytes of code there are, which need to be at
+ * least as many as the instruction is long for it to be anything but a
+ * fallback.
+ */
+void libyagbe_cpu_decode(struct libyagbe_code_cache_entry* const e,
+                         const uint8_t* const code, const size_t available);
+
+/** Returns the function which executes instructions decoded into a handler.
+ *
+ * Before it's called, PC must be moved past the instruction, the current
+ * instruction set to its opcode, and the EI delay cleared.
+ *
+ * @param handler A handler other than \ref CACHED_UNDECODED or
+ * \ref CACHED_FALLBACK.
+ */
+cached_handler_func libyagbe_cpu_get_cached_handler(
+    const unsigned int handler);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_CACHED_H */
@@ -17,3 +17,307 @@
  */
 
 #include "libyagbe/cart.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Offsets of the fields within the cartridge header. */
+enum header_offsets {
+  HEADER_CART_TYPE = 0x147,
+  HEADER_RAM_SIZE = 0x149
+};
+
+/* The MBC register ranges, selected by address bits 13 and 14. */
+enum mbc_registers {
+  MBC_REG_RAM_ENABLE,
+  MBC_REG_ROM_BANK,
+  MBC_REG_RAM_BANK,
+  MBC_REG_MISC
+};
+
+/* The first and last RAM bank register values that select an RTC register. */
+enum rtc_select { RTC_SELECT_FIRST = 0x08, RTC_SELECT_LAST = 0x0C };
+
+/* The number of 8KiB RAM banks for each value of the RAM size field. A 2KiB
+ * RAM is treated as a single bank. */
+static const unsigned int ram_banks[] = {0, 1, 1, 4, 16, 8};
+
+static bool parse_cart_type(struct libyagbe_cart* const cart,
+                            const uint8_t type) {
+  cart->has_rtc = false;
+
+  switch (type) {
+    case 0x00: /* ROM ONLY */
+    case 0x08: /* ROM+RAM */
+    case 0x09: /* ROM+RAM+BATTERY */
+      cart->mbc = LIBYAGBE_CART_MBC_NONE;
+      return true;
+
+    case 0x01: /* MBC1 */
+    case 0x02: /* MBC1+RAM */
+    case 0x03: /* MBC1+RAM+BATTERY */
+      cart->mbc = LIBYAGBE_CART_MBC1;
+      return true;
+
+    case 0x0F: /* MBC3+TIMER+BATTERY */
+    case 0x10: /* MBC3+TIMER+RAM+BATTERY */
+      cart->has_rtc = true;
+      cart->mbc = LIBYAGBE_CART_MBC3;
+      return true;
+
+    case 0x11: /* MBC3 */
+    case 0x12: /* MBC3+RAM */
+    case 0x13: /* MBC3+RAM+BATTERY */
+      cart->mbc = LIBYAGBE_CART_MBC3;
+      return true;
+
+    case 0x19: /* MBC5 */
+    case 0x1A: /* MBC5+RAM */
+    case 0x1B: /* MBC5+RAM+BATTERY */
+    case 0x1C: /* MBC5+RUMBLE */
+    case 0x1D: /* MBC5+RUMBLE+RAM */
+    case 0x1E: /* MBC5+RUMBLE+RAM+BATTERY */
+      cart->mbc = LIBYAGBE_CART_MBC5;
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static bool rtc_selected(const struct libyagbe_cart* const cart) {
+  return (cart->mbc == LIBYAGBE_CART_MBC3) && cart->has_rtc &&
+         (cart->ram_bank >= RTC_SELECT_FIRST) &&
+         (cart->ram_bank <= RTC_SELECT_LAST);
+}
+
+bool libyagbe_cart_init(struct libyagbe_cart* const cart,
+                        const uint8_t* const data, const size_t size) {
+  uint8_t ram_size;
+
+  assert(cart != NULL);
+  assert(data != NULL);
+
+  /* Anything smaller than ROM banks 0 and 1 can't be mapped. */
+  if (size < (2 * LIBYAGBE_CART_MEM_SIZE_ROM_BANK)) {
+    return false;
+  }
+
+  if (!parse_cart_type(cart, data[HEADER_CART_TYPE])) {
+    return false;
+  }
+
+  ram_size = data[HEADER_RAM_SIZE];
+
+  if (ram_size >= (sizeof(ram_banks) / sizeof(ram_banks[0]))) {
+    return false;
+  }
+
+  cart->data = data;
+  cart->size = size;
+
+  /* Trust what was actually provided over what the header claims, so that a
+   * truncated dump can't make bank switching run off the end. */
+  cart->num_rom_banks = (unsigned int)(size / LIBYAGBE_CART_MEM_SIZE_ROM_BANK);
+  cart->num_ram_banks = ram_banks[ram_size];
+
+  memset(cart->rtc, 0, sizeof(cart->rtc));
+  memset(cart->rtc_latched, 0, sizeof(cart->rtc_latched));
+  memset(cart->ram, 0, sizeof(cart->ram));
+
+  libyagbe_cart_reset(cart);
+  return true;
+}
+
+void libyagbe_cart_reset(struct libyagbe_cart* const cart) {
+  assert(cart != NULL);
+
+  /* Without an MBC there's nothing to enable the RAM with, so it always is. */
+  cart->ram_enabled = (cart->mbc == LIBYAGBE_CART_MBC_NONE);
+
+  cart->rom_bank = 1;
+  cart->ram_bank = 0;
+  cart->banking_mode = 0;
+  cart->rtc_latch = 0xFF;
+}
+
+const uint8_t* libyagbe_cart_get_rom_bank(
+    const struct libyagbe_cart* const cart, const uint16_t address) {
+  unsigned int bank;
+
+  assert(cart != NULL);
+
+  switch (cart->mbc) {
+    case LIBYAGBE_CART_MBC1:
+      if (address < 0x4000) {
+        /* Mode 1 lets the upper bits apply to $0000-$3FFF as well. */
+        bank = cart->banking_mode ? ((cart->ram_bank & 0x03) << 5) : 0;
+      } else {
+        /* Only the lower 5 bits are checked for 0, so banks $20, $40 and $60
+         * can't be selected here. */
+        bank = cart->rom_bank & 0x1F;
+        bank = ((cart->ram_bank & 0x03) << 5) | ((bank == 0) ? 1 : bank);
+      }
+      break;
+
+    case LIBYAGBE_CART_MBC3:
+      bank = (address < 0x4000) ? 0 : (cart->rom_bank & 0x7F);
+      bank = ((address >= 0x4000) && (bank == 0)) ? 1 : bank;
+      break;
+
+    case LIBYAGBE_CART_MBC5:
+      /* MBC5 is the only one which can really map bank 0 at $4000. */
+      bank = (address < 0x4000) ? 0 : (cart->rom_bank & 0x1FF);
+      break;
+
+    case LIBYAGBE_CART_MBC_NONE:
+    default:
+      bank = address >> 14;
+      break;
+  }
+
+  bank %= cart->num_rom_banks;
+  return cart->data + ((size_t)bank * LIBYAGBE_CART_MEM_SIZE_ROM_BANK);
+}
+
+uint8_t* libyagbe_cart_get_ram_bank(struct libyagbe_cart* const cart) {
+  unsigned int bank;
+
+  assert(cart != NULL);
+
+  if (!cart->ram_enabled || (cart->num_ram_banks == 0)) {
+    return NULL;
+  }
+
+  switch (cart->mbc) {
+    case LIBYAGBE_CART_MBC1:
+      bank = cart->banking_mode ? (cart->ram_bank & 0x03) : 0;
+      break;
+
+    case LIBYAGBE_CART_MBC3:
+      if (cart->ram_bank >= RTC_SELECT_FIRST) {
+        return NULL;
+      }
+      bank = cart->ram_bank & 0x03;
+      break;
+
+    case LIBYAGBE_CART_MBC5:
+      bank = cart->ram_bank & 0x0F;
+      break;
+
+    case LIBYAGBE_CART_MBC_NONE:
+    default:
+      bank = 0;
+      break;
+  }
+
+  bank %= cart->num_ram_banks;
+  return cart->ram + ((size_t)bank * LIBYAGBE_CART_MEM_SIZE_RAM_BANK);
+}
+
+void libyagbe_cart_write_rom(struct libyagbe_cart* const cart,
+                             const uint16_t address, const uint8_t data) {
+  assert(cart != NULL);
+
+  switch (cart->mbc) {
+    case LIBYAGBE_CART_MBC1:
+      switch (address >> 13) {
+        case MBC_REG_RAM_ENABLE:
+          cart->ram_enabled = (data & 0x0F) == 0x0A;
+          break;
+
+        case MBC_REG_ROM_BANK:
+          cart->rom_bank = data & 0x1F;
+          break;
+
+        case MBC_REG_RAM_BANK:
+          cart->ram_bank = data & 0x03;
+          break;
+
+        case MBC_REG_MISC:
+          cart->banking_mode = data & 0x01;
+          break;
+
+        default:
+          break;
+      }
+      break;
+
+    case LIBYAGBE_CART_MBC3:
+      switch (address >> 13) {
+        case MBC_REG_RAM_ENABLE:
+          cart->ram_enabled = (data & 0x0F) == 0x0A;
+          break;
+
+        case MBC_REG_ROM_BANK:
+          cart->rom_bank = data & 0x7F;
+          break;
+
+        case MBC_REG_RAM_BANK:
+          cart->ram_bank = data;
+          break;
+
+        case MBC_REG_MISC:
+          /* Writing $00 then $01 copies the clock into the latched
+           * registers. */
+          if ((cart->rtc_latch == 0x00) && (data == 0x01)) {
+            memcpy(cart->rtc_latched, cart->rtc, sizeof(cart->rtc));
+          }
+          cart->rtc_latch = data;
+          break;
+
+        default:
+          break;
+      }
+      break;
+
+    case LIBYAGBE_CART_MBC5:
+      switch (address >> 13) {
+        case MBC_REG_RAM_ENABLE:
+          cart->ram_enabled = data == 0x0A;
+          break;
+
+        case MBC_REG_ROM_BANK:
+          if (address < 0x3000) {
+            cart->rom_bank = (cart->rom_bank & 0x100) | data;
+          } else {
+            cart->rom_bank = (cart->rom_bank & 0x0FF) | ((data & 0x01) << 8);
+          }
+          break;
+
+        case MBC_REG_RAM_BANK:
+          cart->ram_bank = data & 0x0F;
+          break;
+
+        default:
+          break;
+      }
+      break;
+
+    case LIBYAGBE_CART_MBC_NONE:
+    default:
+      break;
+  }
+}
+
+uint8_t libyagbe_cart_read_ram(const struct libyagbe_cart* const cart,
+                               const uint16_t address) {
+  assert(cart != NULL);
+  (void)address;
+
+  if (cart->ram_enabled && rtc_selected(cart)) {
+    return cart->rtc_latched[cart->ram_bank - RTC_SELECT_FIRST];
+  }
+  return 0xFF;
+}
+
+void libyagbe_cart_write_ram(struct libyagbe_cart* const cart,
+                             const uint16_t address, const uint8_t data) {
+  assert(cart != NULL);
+  (void)address;
+
+  if (cart->ram_enabled && rtc_selected(cart)) {
+    cart->rtc[cart->ram_bank - RTC_SELECT_FIRST] = data;
+  }
+}
@@ -0,0 +1,89 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/code_cache.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "libyagbe/compat/compat_stdbool.h"
+
+bool libyagbe_code_cache_init(struct libyagbe_code_cache* const cache,
+                              struct libyagbe_code_cache_bank* const banks,
+                              const size_t num_banks) {
+  assert(cache != NULL);
+  assert(banks != NULL);
+
+  if (num_banks < 2) {
+    return false;
+  }
+  cache->banks = banks;
+  cache->num_banks = num_banks;
+
+  libyagbe_code_cache_clear(cache);
+  return true;
+}
+
+void libyagbe_code_cache_clear(struct libyagbe_code_cache* const cache) {
+  size_t i;
+
+  assert(cache != NULL);
+
+  /* The entries are only thrown away once a slot is reused. */
+  for (i = 0; i < cache->num_banks; ++i) {
+    cache->banks[i].rom = NULL;
+  }
+  for (i = 0; i < 2; ++i) {
+    cache->regions[i].rom = NULL;
+    cache->regions[i].bank = NULL;
+  }
+}
+
+struct libyagbe_code_cache_entry* libyagbe_code_cache_map(
+    struct libyagbe_code_cache* const cache,
+    const struct libyagbe_cart* const cart, const uint16_t address) {
+  struct libyagbe_code_cache_region* const region =
+      &cache->regions[address >> 14];
+  struct libyagbe_code_cache_bank* bank;
+  const uint8_t* rom;
+  size_t index;
+
+  assert(cache != NULL);
+  assert(cart != NULL);
+  assert(address < 0x8000);
+
+  rom = libyagbe_cart_get_rom_bank(cart, address & 0x4000);
+
+  /* The first slot is kept for $0000-$3FFF, so that code in both halves of
+   * ROM can never throw the other's away. */
+  if (address < 0x4000) {
+    bank = &cache->banks[0];
+  } else {
+    index = (size_t)(rom - cart->data) / LIBYAGBE_CART_MEM_SIZE_ROM_BANK;
+    bank = &cache->banks[1 + (index % (cache->num_banks - 1))];
+  }
+
+  if (bank->rom != rom) {
+    memset(bank->entries, 0, sizeof(bank->entries));
+    bank->rom = rom;
+  }
+  region->rom = rom;
+  region->bank = bank;
+
+  return &bank->entries[address & (LIBYAGBE_CART_MEM_SIZE_ROM_BANK - 1)];
+}
@@ -31,12 +31,17 @@
 #include "libyagbe/cpu.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "libyagbe/bus.h"
+#include "libyagbe/code_cache.h"
 #include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/irq.h"
 #include "libyagbe/sched.h"
+#include "cached.h"
+#include "profile_hooks.h"
 #include "utility.h"
 
 /** Defines the flag bits for the Flag register. */
@@ -76,6 +81,78 @@ enum alu_flag {
 
 enum ret_flag { RET_NORMAL, RET_TRULY_CONDITIONAL };
 
+/* Works out F after the last ALU operation from what it recorded. */
+static uint8_t compute_flags(const struct libyagbe_cpu* const cpu) {
+  const struct libyagbe_cpu_lazy_flags* const lazy = &cpu->lazy_flags;
+  uint8_t flags;
+  int result;
+
+  switch (lazy->op) {
+    case LIBYAGBE_CPU_LAZY_ADD:
+      result = lazy->lhs + lazy->rhs + lazy->carry;
+      flags = cpu->reg.af.byte.lo & 0x0F;
+      SET_BIT_IF(flags, FLAG_H, ((lazy->lhs ^ lazy->rhs ^ result) & 0x10) != 0);
+      SET_BIT_IF(flags, FLAG_C, result > 0xFF);
+      break;
+
+    case LIBYAGBE_CPU_LAZY_SUB:
+      result = lazy->lhs - lazy->rhs - lazy->carry;
+      flags = (cpu->reg.af.byte.lo & 0x0F) | FLAG_N;
+      SET_BIT_IF(flags, FLAG_H, ((lazy->lhs ^ lazy->rhs ^ result) & 0x10) != 0);
+      SET_BIT_IF(flags, FLAG_C, result < 0);
+      break;
+
+    case LIBYAGBE_CPU_LAZY_INC:
+      result = lazy->lhs + 1;
+      flags = cpu->reg.af.byte.lo & (FLAG_C | 0x0F);
+      SET_BIT_IF(flags, FLAG_H, (lazy->lhs & 0x0F) == 0x0F);
+      break;
+
+    case LIBYAGBE_CPU_LAZY_DEC:
+      result = lazy->lhs - 1;
+      flags = (cpu->reg.af.byte.lo & (FLAG_C | 0x0F)) | FLAG_N;
+      SET_BIT_IF(flags, FLAG_H, (lazy->lhs & 0x0F) == 0);
+      break;
+
+    case LIBYAGBE_CPU_LAZY_SHIFT:
+      result = lazy->lhs;
+      flags = cpu->reg.af.byte.lo & 0x0F;
+      SET_BIT_IF(flags, FLAG_C, lazy->carry != 0);
+      break;
+
+    case LIBYAGBE_CPU_LAZY_ROTATE_A:
+      flags = cpu->reg.af.byte.lo & 0x0F;
+      SET_BIT_IF(flags, FLAG_C, lazy->carry != 0);
+      return flags;
+
+    case LIBYAGBE_CPU_LAZY_NONE:
+    default:
+      return cpu->reg.af.byte.lo;
+  }
+  SET_BIT_IF(flags, FLAG_Z, (uint8_t)result == 0);
+  return flags;
+}
+
+static uint8_t* flush_flags(struct libyagbe_cpu* const cpu) {
+  cpu->reg.af.byte.lo = compute_flags(cpu);
+  cpu->lazy_flags.op = LIBYAGBE_CPU_LAZY_NONE;
+
+  return &cpu->reg.af.byte.lo;
+}
+
+/* Everything in here goes through FLAGS() to get at F, which with lazy flags
+ * works out any that are pending first. */
+#ifdef LIBYAGBE_ENABLE_LAZY_FLAGS
+#define FLAGS(cpu)                                        \
+  (*(((cpu)->lazy_flags.op != LIBYAGBE_CPU_LAZY_NONE)     \
+         ? flush_flags(cpu)                               \
+         : &(cpu)->reg.af.byte.lo))
+#define SYNC_FLAGS(cpu) ((void)FLAGS(cpu))
+#else
+#define FLAGS(cpu) ((cpu)->reg.af.byte.lo)
+#define SYNC_FLAGS(cpu) ((void)0)
+#endif /* LIBYAGBE_ENABLE_LAZY_FLAGS */
+
 enum main_opcodes {
   OP_NOP = 0x00,
   OP_LD_BC_IMM16 = 0x01,
@@ -590,12 +667,49 @@ static void stack_push(struct libyagbe_cpu* const cpu,
   assert(cpu != NULL);
   assert(bus != NULL);
 
-  libyagbe_sched_step();
+  libyagbe_sched_step(bus->sched);
 
   libyagbe_bus_write_memory(bus, --cpu->reg.sp.value, hi);
   libyagbe_bus_write_memory(bus, --cpu->reg.sp.value, lo);
 }
 
+/* @brief Calls the handler of the highest priority pending interrupt.
+ *
+ * This takes 5 m-cycles: 2 idle, 2 to push PC and 1 to jump.
+ */
+static void service_interrupt(struct libyagbe_cpu* const cpu,
+                              struct libyagbe_bus* const bus) {
+  uint8_t request;
+  unsigned int vector;
+
+  assert(cpu != NULL);
+  assert(bus != NULL);
+
+  cpu->ime = false;
+
+  libyagbe_sched_step(bus->sched);
+  libyagbe_sched_step(bus->sched);
+
+  libyagbe_bus_write_memory(bus, --cpu->reg.sp.value, cpu->reg.pc.byte.hi);
+
+  /* The interrupt isn't chosen until the high byte of PC has been pushed, so
+   * if that push overwrote IE and cancelled the request, PC ends up at $0000
+   * instead. */
+  request = bus->irq.pending;
+  libyagbe_bus_write_memory(bus, --cpu->reg.sp.value, cpu->reg.pc.byte.lo);
+
+  if (request == 0) {
+    cpu->reg.pc.value = 0x0000;
+  } else {
+    /* The lowest bit has the highest priority. */
+    for (vector = 0; !(request & (1 << vector)); ++vector) {
+    }
+    libyagbe_irq_acknowledge(&bus->irq, (uint8_t)(1 << vector));
+    cpu->reg.pc.value = (uint16_t)(0x0040 + (vector * 8));
+  }
+  libyagbe_sched_step(bus->sched);
+}
+
 /* @brief Reads the immediate byte referenced by the program counter, then
  *  increments the program counter.
  *
@@ -643,49 +757,259 @@ static uint8_t set_carry_flag(uint8_t flag_reg, const bool condition) {
   return flag_reg;
 }
 
-static uint8_t alu_inc(struct libyagbe_cpu* const cpu, uint8_t value) {
+static void alu_add_hl(struct libyagbe_cpu* const cpu,
+                       struct libyagbe_bus* const bus, const uint16_t pair) {
+  int sum;
+
   assert(cpu != NULL);
+  assert(bus != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
-  cpu->reg.af.byte.lo =
-      set_half_carry_flag(cpu->reg.af.byte.lo, (value & 0x0F) == 0xF);
+  FLAGS(cpu) &= ~FLAG_N;
 
-  value++;
+  sum = cpu->reg.hl.value + pair;
 
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, value);
-  return value;
+  FLAGS(cpu) = set_half_carry_flag(
+      FLAGS(cpu), ((cpu->reg.hl.value ^ pair ^ sum) & 0x1000) != 0);
+
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), sum > 0xFFFF);
+  cpu->reg.hl.value = (uint16_t)sum;
+
+  libyagbe_sched_step(bus->sched);
+}
+
+static void call_if(struct libyagbe_cpu* const cpu,
+                    struct libyagbe_bus* const bus, const bool condition_met) {
+  uint16_t address;
+
+  assert(cpu != NULL);
+  assert(bus != NULL);
+
+  address = read_imm16(cpu, bus);
+
+  if (condition_met) {
+    stack_push(cpu, bus, cpu->reg.pc.byte.hi, cpu->reg.pc.byte.lo);
+    cpu->reg.pc.value = address;
+  }
+}
+
+static void jr_if(struct libyagbe_bus* const bus,
+                  struct libyagbe_cpu* const cpu, const bool condition_met) {
+  int8_t imm;
+
+  assert(bus != NULL);
+  assert(cpu != NULL);
+
+  imm = (int8_t)read_imm8(cpu, bus);
+
+  if (condition_met) {
+    libyagbe_sched_step(bus->sched);
+    cpu->reg.pc.value += imm;
+  }
+}
+
+static void jp_if(struct libyagbe_cpu* const cpu,
+                  struct libyagbe_bus* const bus, const bool condition_met) {
+  uint16_t address;
+
+  assert(bus != NULL);
+  assert(cpu != NULL);
+
+  address = read_imm16(cpu, bus);
+
+  if (condition_met) {
+    libyagbe_sched_step(bus->sched);
+    cpu->reg.pc.value = address;
+  }
+}
+
+static uint16_t stack_pop(struct libyagbe_cpu* const cpu,
+                          struct libyagbe_bus* const bus) {
+  uint8_t lo;
+  uint8_t hi;
+
+  assert(cpu != NULL);
+  assert(bus != NULL);
+
+  lo = libyagbe_bus_read_memory(bus, cpu->reg.sp.value++);
+  hi = libyagbe_bus_read_memory(bus, cpu->reg.sp.value++);
+
+  return (uint16_t)((hi << 8) | lo);
+}
+
+static void ret_if(struct libyagbe_cpu* const cpu,
+                   struct libyagbe_bus* const bus, const bool condition_met,
+                   const enum ret_flag flag) {
+  assert(bus != NULL);
+  assert(cpu != NULL);
+
+  if (flag == RET_TRULY_CONDITIONAL) {
+    libyagbe_sched_step(bus->sched);
+  }
+
+  if (condition_met) {
+    cpu->reg.pc.value = stack_pop(cpu, bus);
+    libyagbe_sched_step(bus->sched);
+
+    return;
+  }
+  libyagbe_sched_step(bus->sched);
+}
+
+static void rst(struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+                const uint16_t address) {
+  assert(bus != NULL);
+  assert(cpu != NULL);
+
+  stack_push(cpu, bus, cpu->reg.pc.byte.hi, cpu->reg.pc.byte.lo);
+  cpu->reg.pc.value = address;
+}
+
+#ifdef LIBYAGBE_ENABLE_LAZY_FLAGS
+/* With lazy flags, the 8-bit arithmetic, shift and rotate helpers only record
+ * what they did, and FLAGS() works the flags out from that when something
+ * reads them. Most get overwritten by the next operation before then. */
+
+static void defer_flags(struct libyagbe_cpu* const cpu,
+                        const enum libyagbe_cpu_lazy_op op, const uint8_t lhs,
+                        const uint8_t rhs, const uint8_t carry) {
+  cpu->lazy_flags.op = op;
+  cpu->lazy_flags.lhs = lhs;
+  cpu->lazy_flags.rhs = rhs;
+  cpu->lazy_flags.carry = carry;
+}
+
+/* Records a shift or rotate which gave `result` and shifted out `carry`. */
+static uint8_t defer_shift(struct libyagbe_cpu* const cpu,
+                           const uint8_t result, const bool carry,
+                           const enum alu_flag flag) {
+  defer_flags(cpu,
+              (flag == ALU_CLEAR_ZERO) ? LIBYAGBE_CPU_LAZY_ROTATE_A
+                                       : LIBYAGBE_CPU_LAZY_SHIFT,
+              result, 0, carry);
+  return result;
+}
+
+static uint8_t alu_inc(struct libyagbe_cpu* const cpu, uint8_t value) {
+  assert(cpu != NULL);
+
+  /* C is left as it was, so it has to be known before this is recorded. */
+  SYNC_FLAGS(cpu);
+  defer_flags(cpu, LIBYAGBE_CPU_LAZY_INC, value, 0, 0);
+
+  return (uint8_t)(value + 1);
 }
 
 static uint8_t alu_dec(struct libyagbe_cpu* const cpu, uint8_t value) {
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo |= FLAG_N;
+  SYNC_FLAGS(cpu);
+  defer_flags(cpu, LIBYAGBE_CPU_LAZY_DEC, value, 0, 0);
 
-  cpu->reg.af.byte.lo =
-      set_half_carry_flag(cpu->reg.af.byte.lo, (value & 0x0F) == 0);
+  return (uint8_t)(value - 1);
+}
 
-  value--;
+static uint8_t alu_rr(struct libyagbe_cpu* const cpu, uint8_t reg,
+                      const enum alu_flag flag) {
+  assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, value);
-  return value;
+  return defer_shift(
+      cpu, (uint8_t)((reg >> 1) | (((FLAGS(cpu) & FLAG_C) != 0) ? 0x80 : 0x00)),
+      (reg & 1) != 0, flag);
 }
 
-static void alu_add_hl(struct libyagbe_cpu* const cpu, const uint16_t pair) {
-  int sum;
+static uint8_t alu_rl(struct libyagbe_cpu* const cpu, uint8_t reg,
+                      const enum alu_flag flag) {
+  assert(cpu != NULL);
+
+  return defer_shift(cpu,
+                     (uint8_t)((reg << 1) | ((FLAGS(cpu) & FLAG_C) != 0)),
+                     (reg & 0x80) != 0, flag);
+}
+
+static void alu_add(struct libyagbe_cpu* const cpu, const uint8_t addend,
+                    const enum alu_flag flag) {
+  uint8_t carry;
 
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
+  carry = (flag == ALU_WITH_CARRY) && (FLAGS(cpu) & FLAG_C);
+  defer_flags(cpu, LIBYAGBE_CPU_LAZY_ADD, cpu->reg.af.byte.hi, addend, carry);
 
-  sum = cpu->reg.hl.value + pair;
+  cpu->reg.af.byte.hi = (uint8_t)(cpu->reg.af.byte.hi + addend + carry);
+}
 
-  cpu->reg.af.byte.lo = set_half_carry_flag(
-      cpu->reg.af.byte.lo, ((cpu->reg.hl.value ^ pair ^ sum) & 0x1000) != 0);
+static void alu_sub(struct libyagbe_cpu* const cpu, uint8_t subtrahend,
+                    const enum alu_flag flag) {
+  uint8_t carry;
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, sum > 0xFFFF);
-  cpu->reg.hl.value = (uint16_t)sum;
+  assert(cpu != NULL);
+
+  carry = (flag == ALU_WITH_CARRY) && (FLAGS(cpu) & FLAG_C);
+  defer_flags(cpu, LIBYAGBE_CPU_LAZY_SUB, cpu->reg.af.byte.hi, subtrahend,
+              carry);
+
+  if (flag != ALU_DISCARD_RESULT) {
+    cpu->reg.af.byte.hi = (uint8_t)(cpu->reg.af.byte.hi - subtrahend - carry);
+  }
+}
+
+static uint8_t alu_srl(struct libyagbe_cpu* const cpu, uint8_t reg) {
+  return defer_shift(cpu, (uint8_t)(reg >> 1), (reg & 1) != 0, ALU_NORMAL);
+}
+
+static uint8_t alu_rlc(struct libyagbe_cpu* const cpu, uint8_t n,
+                       const enum alu_flag flag) {
+  assert(cpu != NULL);
+
+  return defer_shift(cpu, (uint8_t)((n << 1) | (n >> 7)), (n & 0x80) != 0,
+                     flag);
+}
+
+static uint8_t alu_rrc(struct libyagbe_cpu* const cpu, uint8_t n,
+                       const enum alu_flag flag) {
+  assert(cpu != NULL);
+
+  return defer_shift(cpu, (uint8_t)((n >> 1) | (n << 7)), (n & 1) != 0, flag);
+}
+
+static uint8_t alu_sla(struct libyagbe_cpu* const cpu, uint8_t n) {
+  assert(cpu != NULL);
+
+  return defer_shift(cpu, (uint8_t)(n << 1), (n & 0x80) != 0, ALU_NORMAL);
+}
+
+static uint8_t alu_sra(struct libyagbe_cpu* const cpu, uint8_t n) {
+  assert(cpu != NULL);
+
+  return defer_shift(cpu, (uint8_t)((n >> 1) | (n & 0x80)), (n & 1) != 0,
+                     ALU_NORMAL);
+}
+#else
+static uint8_t alu_inc(struct libyagbe_cpu* const cpu, uint8_t value) {
+  assert(cpu != NULL);
+
+  FLAGS(cpu) &= ~FLAG_N;
+  FLAGS(cpu) =
+      set_half_carry_flag(FLAGS(cpu), (value & 0x0F) == 0xF);
+
+  value++;
 
-  libyagbe_sched_step();
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), value);
+  return value;
+}
+
+static uint8_t alu_dec(struct libyagbe_cpu* const cpu, uint8_t value) {
+  assert(cpu != NULL);
+
+  FLAGS(cpu) |= FLAG_N;
+
+  FLAGS(cpu) =
+      set_half_carry_flag(FLAGS(cpu), (value & 0x0F) == 0);
+
+  value--;
+
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), value);
+  return value;
 }
 
 static uint8_t alu_rr(struct libyagbe_cpu* const cpu, uint8_t reg,
@@ -694,22 +1018,22 @@ static uint8_t alu_rr(struct libyagbe_cpu* const cpu, uint8_t reg,
 
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
-  cpu->reg.af.byte.lo &= ~FLAG_H;
+  FLAGS(cpu) &= ~FLAG_N;
+  FLAGS(cpu) &= ~FLAG_H;
 
-  old_carry_flag_value = ((cpu->reg.af.byte.lo & FLAG_C) != 0) ? 0x80 : 0x00;
+  old_carry_flag_value = ((FLAGS(cpu) & FLAG_C) != 0) ? 0x80 : 0x00;
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, (reg & 1) != 0);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), (reg & 1) != 0);
 
   reg >>= 1;
   reg |= old_carry_flag_value;
 
   if (flag == ALU_CLEAR_ZERO) {
-    cpu->reg.af.byte.lo &= ~FLAG_Z;
+    FLAGS(cpu) &= ~FLAG_Z;
     return reg;
   }
 
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, reg);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), reg);
   return reg;
 }
 
@@ -719,20 +1043,20 @@ static uint8_t alu_rl(struct libyagbe_cpu* const cpu, uint8_t reg,
 
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
-  cpu->reg.af.byte.lo &= ~FLAG_H;
+  FLAGS(cpu) &= ~FLAG_N;
+  FLAGS(cpu) &= ~FLAG_H;
 
-  old_carry_flag_value = (cpu->reg.af.byte.lo & FLAG_C) != 0;
+  old_carry_flag_value = (FLAGS(cpu) & FLAG_C) != 0;
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, (reg & 0x80) != 0);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), (reg & 0x80) != 0);
   reg = (uint8_t)((reg << 1) | old_carry_flag_value);
 
   if (flag == ALU_CLEAR_ZERO) {
-    cpu->reg.af.byte.lo &= ~FLAG_Z;
+    FLAGS(cpu) &= ~FLAG_Z;
     return reg;
   }
 
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, reg);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), reg);
   return reg;
 }
 
@@ -743,22 +1067,22 @@ static void alu_add(struct libyagbe_cpu* const cpu, const uint8_t addend,
 
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
+  FLAGS(cpu) &= ~FLAG_N;
 
   sum = cpu->reg.af.byte.hi + addend;
 
   if (flag == ALU_WITH_CARRY) {
-    sum += (cpu->reg.af.byte.lo & FLAG_C) != 0;
+    sum += (FLAGS(cpu) & FLAG_C) != 0;
   }
 
   result = (uint8_t)sum;
 
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, result);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), result);
 
-  cpu->reg.af.byte.lo = set_half_carry_flag(
-      cpu->reg.af.byte.lo, ((cpu->reg.af.byte.hi ^ addend ^ sum) & 0x10) != 0);
+  FLAGS(cpu) = set_half_carry_flag(
+      FLAGS(cpu), ((cpu->reg.af.byte.hi ^ addend ^ sum) & 0x10) != 0);
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, sum > 0xFF);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), sum > 0xFF);
 
   cpu->reg.af.byte.hi = result;
 }
@@ -770,23 +1094,23 @@ static void alu_sub(struct libyagbe_cpu* const cpu, uint8_t subtrahend,
 
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo |= FLAG_N;
+  FLAGS(cpu) |= FLAG_N;
 
   diff = cpu->reg.af.byte.hi - subtrahend;
 
   if (flag == ALU_WITH_CARRY) {
-    diff -= (cpu->reg.af.byte.lo & FLAG_C) != 0;
+    diff -= (FLAGS(cpu) & FLAG_C) != 0;
   }
 
   result = (uint8_t)diff;
 
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, result);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), result);
 
-  cpu->reg.af.byte.lo = set_half_carry_flag(
-      cpu->reg.af.byte.lo,
+  FLAGS(cpu) = set_half_carry_flag(
+      FLAGS(cpu),
       ((cpu->reg.af.byte.hi ^ subtrahend ^ diff) & 0x10) != 0);
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, diff < 0);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), diff < 0);
 
   if (flag != ALU_DISCARD_RESULT) {
     cpu->reg.af.byte.hi = result;
@@ -794,118 +1118,31 @@ static void alu_sub(struct libyagbe_cpu* const cpu, uint8_t subtrahend,
 }
 
 static uint8_t alu_srl(struct libyagbe_cpu* const cpu, uint8_t reg) {
-  cpu->reg.af.byte.lo &= ~FLAG_N;
-  cpu->reg.af.byte.lo &= ~FLAG_H;
+  FLAGS(cpu) &= ~FLAG_N;
+  FLAGS(cpu) &= ~FLAG_H;
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, (reg & 1) != 0);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), (reg & 1) != 0);
   reg >>= 1;
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, reg);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), reg);
 
   return reg;
 }
 
-static void call_if(struct libyagbe_cpu* const cpu,
-                    struct libyagbe_bus* const bus, const bool condition_met) {
-  uint16_t address;
-
-  assert(cpu != NULL);
-  assert(bus != NULL);
-
-  address = read_imm16(cpu, bus);
-
-  if (condition_met) {
-    stack_push(cpu, bus, cpu->reg.pc.byte.hi, cpu->reg.pc.byte.lo);
-    cpu->reg.pc.value = address;
-  }
-}
-
-static void jr_if(struct libyagbe_bus* const bus,
-                  struct libyagbe_cpu* const cpu, const bool condition_met) {
-  int8_t imm;
-
-  assert(bus != NULL);
-  assert(cpu != NULL);
-
-  imm = (int8_t)read_imm8(cpu, bus);
-
-  if (condition_met) {
-    libyagbe_sched_step();
-    cpu->reg.pc.value += imm;
-  }
-}
-
-static void jp_if(struct libyagbe_cpu* const cpu,
-                  struct libyagbe_bus* const bus, const bool condition_met) {
-  uint16_t address;
-
-  assert(bus != NULL);
-  assert(cpu != NULL);
-
-  address = read_imm16(cpu, bus);
-
-  if (condition_met) {
-    libyagbe_sched_step();
-    cpu->reg.pc.value = address;
-  }
-}
-
-static uint16_t stack_pop(struct libyagbe_cpu* const cpu,
-                          struct libyagbe_bus* const bus) {
-  uint8_t lo;
-  uint8_t hi;
-
-  assert(cpu != NULL);
-  assert(bus != NULL);
-
-  lo = libyagbe_bus_read_memory(bus, cpu->reg.sp.value++);
-  hi = libyagbe_bus_read_memory(bus, cpu->reg.sp.value++);
-
-  return (uint16_t)((hi << 8) | lo);
-}
-
-static void ret_if(struct libyagbe_cpu* const cpu,
-                   struct libyagbe_bus* const bus, const bool condition_met,
-                   const enum ret_flag flag) {
-  assert(bus != NULL);
-  assert(cpu != NULL);
-
-  if (flag == RET_TRULY_CONDITIONAL) {
-    libyagbe_sched_step();
-  }
-
-  if (condition_met) {
-    cpu->reg.pc.value = stack_pop(cpu, bus);
-    libyagbe_sched_step();
-
-    return;
-  }
-  libyagbe_sched_step();
-}
-
-static void rst(struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
-                const uint16_t address) {
-  assert(bus != NULL);
-  assert(cpu != NULL);
-
-  stack_push(cpu, bus, cpu->reg.pc.byte.hi, cpu->reg.pc.byte.lo);
-  cpu->reg.pc.value = address;
-}
-
 static uint8_t alu_rlc(struct libyagbe_cpu* const cpu, uint8_t n,
                        const enum alu_flag flag) {
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
-  cpu->reg.af.byte.lo &= ~FLAG_H;
+  FLAGS(cpu) &= ~FLAG_N;
+  FLAGS(cpu) &= ~FLAG_H;
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, (n & 0x80) != 0);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), (n & 0x80) != 0);
   n = (uint8_t)((n << 1) | (n >> 7));
 
   if (flag == ALU_CLEAR_ZERO) {
-    cpu->reg.af.byte.lo &= ~FLAG_Z;
+    FLAGS(cpu) &= ~FLAG_Z;
     return n;
   }
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, n);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), n);
   return n;
 }
 
@@ -913,30 +1150,30 @@ static uint8_t alu_rrc(struct libyagbe_cpu* const cpu, uint8_t n,
                        const enum alu_flag flag) {
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
-  cpu->reg.af.byte.lo &= ~FLAG_H;
+  FLAGS(cpu) &= ~FLAG_N;
+  FLAGS(cpu) &= ~FLAG_H;
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, (n & 1) != 0);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), (n & 1) != 0);
   n = (uint8_t)((n >> 1) | (n << 7));
 
   if (flag == ALU_CLEAR_ZERO) {
-    cpu->reg.af.byte.lo &= ~FLAG_Z;
+    FLAGS(cpu) &= ~FLAG_Z;
     return n;
   }
 
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, n);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), n);
   return n;
 }
 
 static uint8_t alu_sla(struct libyagbe_cpu* const cpu, uint8_t n) {
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
-  cpu->reg.af.byte.lo &= ~FLAG_H;
+  FLAGS(cpu) &= ~FLAG_N;
+  FLAGS(cpu) &= ~FLAG_H;
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, (n & 0x80) != 0);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), (n & 0x80) != 0);
   n <<= 1;
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, n);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), n);
 
   return n;
 }
@@ -944,16 +1181,18 @@ static uint8_t alu_sla(struct libyagbe_cpu* const cpu, uint8_t n) {
 static uint8_t alu_sra(struct libyagbe_cpu* const cpu, uint8_t n) {
   assert(cpu != NULL);
 
-  cpu->reg.af.byte.lo &= ~FLAG_N;
-  cpu->reg.af.byte.lo &= ~FLAG_H;
+  FLAGS(cpu) &= ~FLAG_N;
+  FLAGS(cpu) &= ~FLAG_H;
 
-  cpu->reg.af.byte.lo = set_carry_flag(cpu->reg.af.byte.lo, (n & 1) != 0);
+  FLAGS(cpu) = set_carry_flag(FLAGS(cpu), (n & 1) != 0);
   n = (uint8_t)((n >> 1) | (n & 0x80));
-  cpu->reg.af.byte.lo = set_zero_flag(cpu->reg.af.byte.lo, n);
+  FLAGS(cpu) = set_zero_flag(FLAGS(cpu), n);
 
   return n;
 }
 
+#endif /* LIBYAGBE_ENABLE_LAZY_FLAGS */
+
 static uint8_t alu_bit(uint8_t flag_reg, const int bit_mask, const uint8_t n) {
   SET_BIT_IF(flag_reg, FLAG_Z, (n & bit_mask) == 0);
   flag_reg &= ~FLAG_N;
@@ -972,14 +1211,65 @@ void libyagbe_cpu_reset(struct libyagbe_cpu* const cpu) {
 
   cpu->reg.sp.value = 0xFFFE;
   cpu->reg.pc.value = 0x0100;
+
+  cpu->state = LIBYAGBE_CPU_STATE_RUNNING;
+  cpu->ime = false;
+  cpu->ei_delay = false;
+  cpu->halt_bug = false;
+  cpu->lazy_flags.op = LIBYAGBE_CPU_LAZY_NONE;
 }
 
-void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
-                       struct libyagbe_bus* const bus) {
-  assert(cpu != NULL);
-  assert(bus != NULL);
+uint8_t libyagbe_cpu_get_flags(const struct libyagbe_cpu* const cpu) {
+  assert(cpu != NULL);
+  return compute_flags(cpu);
+}
+
+void libyagbe_cpu_sync_flags(struct libyagbe_cpu* const cpu) {
+  assert(cpu != NULL);
+
+  if (cpu->lazy_flags.op != LIBYAGBE_CPU_LAZY_NONE) {
+    flush_flags(cpu);
+  }
+}
+
+static void step(struct libyagbe_cpu* const cpu,
+                 struct libyagbe_bus* const bus) {
+  switch (cpu->state) {
+    case LIBYAGBE_CPU_STATE_HALTED:
+      if (bus->irq.pending != 0) {
+        cpu->state = LIBYAGBE_CPU_STATE_RUNNING;
+        break;
+      }
+      libyagbe_sched_step(bus->sched);
+      return;
+
+    case LIBYAGBE_CPU_STATE_STOPPED:
+    case LIBYAGBE_CPU_STATE_LOCKED:
+      libyagbe_sched_step(bus->sched);
+      return;
+
+    case LIBYAGBE_CPU_STATE_RUNNING:
+    default:
+      break;
+  }
+
+  /* Nothing is pending most of the time, so check that first. */
+  if ((bus->irq.pending != 0) && cpu->ime && !cpu->ei_delay) {
+    service_interrupt(cpu, bus);
+    return;
+  }
+
+  /* EI takes effect once the instruction after it is done. */
+  cpu->ei_delay = false;
 
-  cpu->instruction = read_imm8(cpu, bus);
+  if (cpu->halt_bug) {
+    /* The byte after HALT gets read twice. */
+    cpu->halt_bug = false;
+    cpu->instruction = libyagbe_bus_read_memory(bus, cpu->reg.pc.value);
+  } else {
+    cpu->instruction = read_imm8(cpu, bus);
+  }
+  PROFILE_OPCODE(bus, 0, cpu->instruction);
 
   switch (cpu->instruction) {
     case OP_NOP:
@@ -991,7 +1281,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_INC_BC:
       cpu->reg.bc.value++;
-      libyagbe_sched_step();
+      libyagbe_sched_step(bus->sched);
 
       return;
 
@@ -1025,7 +1315,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
     }
 
     case OP_ADD_HL_BC:
-      alu_add_hl(cpu, cpu->reg.bc.value);
+      alu_add_hl(cpu, bus, cpu->reg.bc.value);
       return;
 
     case OP_LD_A_MEM_BC:
@@ -1034,7 +1324,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_DEC_BC:
       cpu->reg.bc.value--;
-      libyagbe_sched_step();
+      libyagbe_sched_step(bus->sched);
 
       return;
 
@@ -1054,6 +1344,13 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       cpu->reg.af.byte.hi = alu_rrc(cpu, cpu->reg.af.byte.hi, ALU_CLEAR_ZERO);
       return;
 
+    case OP_STOP:
+      /* STOP is followed by a byte which is skipped over. */
+      cpu->reg.pc.value++;
+      cpu->state = LIBYAGBE_CPU_STATE_STOPPED;
+
+      return;
+
     case OP_LD_DE_IMM16:
       cpu->reg.de.value = read_imm16(cpu, bus);
       return;
@@ -1064,7 +1361,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_INC_DE:
       cpu->reg.de.value++;
-      libyagbe_sched_step();
+      libyagbe_sched_step(bus->sched);
 
       return;
 
@@ -1089,7 +1386,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_ADD_HL_DE:
-      alu_add_hl(cpu, cpu->reg.de.value);
+      alu_add_hl(cpu, bus, cpu->reg.de.value);
       return;
 
     case OP_LD_A_MEM_DE:
@@ -1098,7 +1395,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_DEC_DE:
       cpu->reg.de.value--;
-      libyagbe_sched_step();
+      libyagbe_sched_step(bus->sched);
 
       return;
 
@@ -1119,7 +1416,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_JR_NZ_SIMM8:
-      jr_if(bus, cpu, !(cpu->reg.af.byte.lo & FLAG_Z));
+      jr_if(bus, cpu, !(FLAGS(cpu) & FLAG_Z));
       return;
 
     case OP_LD_HL_IMM16:
@@ -1132,7 +1429,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_INC_HL:
       cpu->reg.hl.value++;
-      libyagbe_sched_step();
+      libyagbe_sched_step(bus->sched);
 
       return;
 
@@ -1153,38 +1450,38 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
        * SM83, this implementation has been taken from
        * https://forums.nesdev.org/viewtopic.php?f=20&t=15944
        */
-      if (!(cpu->reg.af.byte.lo & FLAG_N)) {
-        if ((cpu->reg.af.byte.lo & FLAG_C) || cpu->reg.af.byte.hi > 0x99) {
+      if (!(FLAGS(cpu) & FLAG_N)) {
+        if ((FLAGS(cpu) & FLAG_C) || cpu->reg.af.byte.hi > 0x99) {
           cpu->reg.af.byte.hi += 0x60;
-          cpu->reg.af.byte.lo |= FLAG_C;
+          FLAGS(cpu) |= FLAG_C;
         }
 
-        if ((cpu->reg.af.byte.lo & FLAG_H) ||
+        if ((FLAGS(cpu) & FLAG_H) ||
             (cpu->reg.af.byte.hi & 0x0F) > 0x09) {
           cpu->reg.af.byte.hi += 0x06;
         }
       } else {
-        if (cpu->reg.af.byte.lo & FLAG_C) {
+        if (FLAGS(cpu) & FLAG_C) {
           cpu->reg.af.byte.hi -= 0x60;
         }
 
-        if (cpu->reg.af.byte.lo & FLAG_H) {
+        if (FLAGS(cpu) & FLAG_H) {
           cpu->reg.af.byte.hi -= 0x06;
         }
       }
 
-      cpu->reg.af.byte.lo =
-          set_zero_flag(cpu->reg.af.byte.lo, cpu->reg.af.byte.hi);
-      cpu->reg.af.byte.lo &= ~FLAG_H;
+      FLAGS(cpu) =
+          set_zero_flag(FLAGS(cpu), cpu->reg.af.byte.hi);
+      FLAGS(cpu) &= ~FLAG_H;
 
       return;
 
     case OP_JR_Z_SIMM8:
-      jr_if(bus, cpu, (cpu->reg.af.byte.lo & FLAG_Z) != 0);
+      jr_if(bus, cpu, (FLAGS(cpu) & FLAG_Z) != 0);
       return;
 
     case OP_ADD_HL_HL:
-      alu_add_hl(cpu, cpu->reg.hl.value);
+      alu_add_hl(cpu, bus, cpu->reg.hl.value);
       return;
 
     case OP_LDI_A_MEM_HL:
@@ -1193,7 +1490,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_DEC_HL:
       cpu->reg.hl.value--;
-      libyagbe_sched_step();
+      libyagbe_sched_step(bus->sched);
 
       return;
 
@@ -1211,13 +1508,13 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_CPL:
       cpu->reg.af.byte.hi = ~cpu->reg.af.byte.hi;
-      cpu->reg.af.byte.lo |= FLAG_N;
-      cpu->reg.af.byte.lo |= FLAG_H;
+      FLAGS(cpu) |= FLAG_N;
+      FLAGS(cpu) |= FLAG_H;
 
       return;
 
     case OP_JR_NC_SIMM8:
-      jr_if(bus, cpu, !(cpu->reg.af.byte.lo & FLAG_C));
+      jr_if(bus, cpu, !(FLAGS(cpu) & FLAG_C));
       return;
 
     case OP_LD_SP_IMM16:
@@ -1230,7 +1527,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_INC_SP:
       cpu->reg.sp.value++;
-      libyagbe_sched_step();
+      libyagbe_sched_step(bus->sched);
 
       return;
 
@@ -1258,18 +1555,18 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
     }
 
     case OP_SCF:
-      cpu->reg.af.byte.lo &= ~FLAG_N;
-      cpu->reg.af.byte.lo &= ~FLAG_H;
-      cpu->reg.af.byte.lo |= FLAG_C;
+      FLAGS(cpu) &= ~FLAG_N;
+      FLAGS(cpu) &= ~FLAG_H;
+      FLAGS(cpu) |= FLAG_C;
 
       return;
 
     case OP_JR_C_SIMM8:
-      jr_if(bus, cpu, (cpu->reg.af.byte.lo & FLAG_C) != 0);
+      jr_if(bus, cpu, (FLAGS(cpu) & FLAG_C) != 0);
       return;
 
     case OP_ADD_HL_SP:
-      alu_add_hl(cpu, cpu->reg.sp.value);
+      alu_add_hl(cpu, bus, cpu->reg.sp.value);
       return;
 
     case OP_LDD_A_HL:
@@ -1278,7 +1575,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_DEC_SP:
       cpu->reg.sp.value--;
-      libyagbe_sched_step();
+      libyagbe_sched_step(bus->sched);
 
       return;
 
@@ -1295,10 +1592,10 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_CCF:
-      cpu->reg.af.byte.lo &= ~FLAG_N;
-      cpu->reg.af.byte.lo &= ~FLAG_H;
-      cpu->reg.af.byte.lo =
-          set_carry_flag(cpu->reg.af.byte.lo, !(cpu->reg.af.byte.lo & FLAG_C));
+      FLAGS(cpu) &= ~FLAG_N;
+      FLAGS(cpu) &= ~FLAG_H;
+      FLAGS(cpu) =
+          set_carry_flag(FLAGS(cpu), !(FLAGS(cpu) & FLAG_C));
       return;
 
     case OP_LD_B_B:
@@ -1512,6 +1809,13 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_HALT:
+      /* With IME clear, an interrupt which is already pending keeps the CPU
+       * from halting at all, and PC misses its next increment instead. */
+      if (!cpu->ime && (bus->irq.pending != 0)) {
+        cpu->halt_bug = true;
+      } else {
+        cpu->state = LIBYAGBE_CPU_STATE_HALTED;
+      }
       return;
 
     case OP_LD_MEM_HL_A:
@@ -1691,37 +1995,37 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
     case OP_AND_B:
       cpu->reg.af.byte.hi &= cpu->reg.bc.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
 
       return;
 
     case OP_AND_C:
       cpu->reg.af.byte.hi &= cpu->reg.bc.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
 
       return;
 
     case OP_AND_D:
       cpu->reg.af.byte.hi &= cpu->reg.de.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
 
       return;
 
     case OP_AND_E:
       cpu->reg.af.byte.hi &= cpu->reg.de.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
 
       return;
 
     case OP_AND_H:
       cpu->reg.af.byte.hi &= cpu->reg.hl.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
 
       return;
 
     case OP_AND_L:
       cpu->reg.af.byte.hi &= cpu->reg.hl.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
 
       return;
 
@@ -1729,48 +2033,48 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
 
       cpu->reg.af.byte.hi &= data;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
 
       return;
     }
 
     case OP_AND_A:
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
       return;
 
     case OP_XOR_B:
       cpu->reg.af.byte.hi ^= cpu->reg.bc.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_XOR_C:
       cpu->reg.af.byte.hi ^= cpu->reg.bc.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_XOR_D:
       cpu->reg.af.byte.hi ^= cpu->reg.de.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_XOR_E:
       cpu->reg.af.byte.hi ^= cpu->reg.de.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_XOR_H:
       cpu->reg.af.byte.hi ^= cpu->reg.hl.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_XOR_L:
       cpu->reg.af.byte.hi ^= cpu->reg.hl.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
@@ -1778,50 +2082,50 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
 
       cpu->reg.af.byte.hi ^= data;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
     }
 
     case OP_XOR_A:
       cpu->reg.af.byte.hi ^= cpu->reg.af.byte.hi;
-      cpu->reg.af.byte.lo = 0x80;
+      FLAGS(cpu) = 0x80;
 
       return;
 
     case OP_OR_B:
       cpu->reg.af.byte.hi |= cpu->reg.bc.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_OR_C:
       cpu->reg.af.byte.hi |= cpu->reg.bc.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_OR_D:
       cpu->reg.af.byte.hi |= cpu->reg.de.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_OR_E:
       cpu->reg.af.byte.hi |= cpu->reg.de.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_OR_H:
       cpu->reg.af.byte.hi |= cpu->reg.hl.byte.hi;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
     case OP_OR_L:
       cpu->reg.af.byte.hi |= cpu->reg.hl.byte.lo;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
 
@@ -1829,13 +2133,13 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
 
       cpu->reg.af.byte.hi |= data;
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
       return;
     }
 
     case OP_OR_A:
-      cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
       return;
 
     case OP_CP_B:
@@ -1874,7 +2178,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_RET_NZ:
-      ret_if(cpu, bus, !(cpu->reg.af.byte.lo & FLAG_Z), RET_TRULY_CONDITIONAL);
+      ret_if(cpu, bus, !(FLAGS(cpu) & FLAG_Z), RET_TRULY_CONDITIONAL);
       return;
 
     case OP_POP_BC:
@@ -1882,7 +2186,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_JP_NZ_IMM16:
-      jp_if(cpu, bus, !(cpu->reg.af.byte.lo & FLAG_Z));
+      jp_if(cpu, bus, !(FLAGS(cpu) & FLAG_Z));
       return;
 
     case OP_JP_IMM16:
@@ -1890,7 +2194,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_CALL_NZ_IMM16:
-      call_if(cpu, bus, !(cpu->reg.af.byte.lo & FLAG_Z));
+      call_if(cpu, bus, !(FLAGS(cpu) & FLAG_Z));
       return;
 
     case OP_PUSH_BC:
@@ -1909,7 +2213,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_RET_Z:
-      ret_if(cpu, bus, (cpu->reg.af.byte.lo & FLAG_Z) != 0,
+      ret_if(cpu, bus, (FLAGS(cpu) & FLAG_Z) != 0,
              RET_TRULY_CONDITIONAL);
       return;
 
@@ -1918,12 +2222,14 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       return;
 
     case OP_JP_Z_IMM16:
-      jp_if(cpu, bus, (cpu->reg.af.byte.lo & FLAG_Z) != 0);
+      jp_if(cpu, bus, (FLAGS(cpu) & FLAG_Z) != 0);
       return;
 
     case OP_PREFIX_CB: {
       const uint8_t cb_instruction = read_imm8(cpu, bus);
 
+      PROFILE_OPCODE(bus, 1, cb_instruction);
+
       switch (cb_instruction) {
         case OP_RLC_B:
           cpu->reg.bc.byte.hi = alu_rlc(cpu, cpu->reg.bc.byte.hi, ALU_NORMAL);
@@ -2144,42 +2450,42 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         case OP_SWAP_B:
           cpu->reg.bc.byte.hi = (uint8_t)((cpu->reg.bc.byte.hi & 0x0F) << 4) |
                                 (cpu->reg.bc.byte.hi >> 4);
-          cpu->reg.af.byte.lo = (cpu->reg.bc.byte.hi == 0) ? 0x80 : 0x00;
+          FLAGS(cpu) = (cpu->reg.bc.byte.hi == 0) ? 0x80 : 0x00;
 
           return;
 
         case OP_SWAP_C:
           cpu->reg.bc.byte.lo = (uint8_t)((cpu->reg.bc.byte.lo & 0x0F) << 4) |
                                 (cpu->reg.bc.byte.lo >> 4);
-          cpu->reg.af.byte.lo = (cpu->reg.bc.byte.lo == 0) ? 0x80 : 0x00;
+          FLAGS(cpu) = (cpu->reg.bc.byte.lo == 0) ? 0x80 : 0x00;
 
           return;
 
         case OP_SWAP_D:
           cpu->reg.de.byte.hi = (uint8_t)((cpu->reg.de.byte.hi & 0x0F) << 4) |
                                 (cpu->reg.de.byte.hi >> 4);
-          cpu->reg.af.byte.lo = (cpu->reg.de.byte.hi == 0) ? 0x80 : 0x00;
+          FLAGS(cpu) = (cpu->reg.de.byte.hi == 0) ? 0x80 : 0x00;
 
           return;
 
         case OP_SWAP_E:
           cpu->reg.de.byte.lo = (uint8_t)((cpu->reg.de.byte.lo & 0x0F) << 4) |
                                 (cpu->reg.de.byte.lo >> 4);
-          cpu->reg.af.byte.lo = (cpu->reg.de.byte.lo == 0) ? 0x80 : 0x00;
+          FLAGS(cpu) = (cpu->reg.de.byte.lo == 0) ? 0x80 : 0x00;
 
           return;
 
         case OP_SWAP_H:
           cpu->reg.hl.byte.hi = (uint8_t)((cpu->reg.hl.byte.hi & 0x0F) << 4) |
                                 (cpu->reg.hl.byte.hi >> 4);
-          cpu->reg.af.byte.lo = (cpu->reg.hl.byte.hi == 0) ? 0x80 : 0x00;
+          FLAGS(cpu) = (cpu->reg.hl.byte.hi == 0) ? 0x80 : 0x00;
 
           return;
 
         case OP_SWAP_L:
           cpu->reg.hl.byte.lo = (uint8_t)((cpu->reg.hl.byte.lo & 0x0F) << 4) |
                                 (cpu->reg.hl.byte.lo >> 4);
-          cpu->reg.af.byte.lo = (cpu->reg.hl.byte.lo == 0) ? 0x80 : 0x00;
+          FLAGS(cpu) = (cpu->reg.hl.byte.lo == 0) ? 0x80 : 0x00;
 
           return;
 
@@ -2187,7 +2493,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
           uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
 
           data = (uint8_t)((data & 0x0F) << 4) | (data >> 4);
-          cpu->reg.af.byte.lo = (data == 0) ? 0x80 : 0x00;
+          FLAGS(cpu) = (data == 0) ? 0x80 : 0x00;
 
           libyagbe_bus_write_memory(bus, cpu->reg.hl.value, data);
           return;
@@ -2196,7 +2502,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         case OP_SWAP_A:
           cpu->reg.af.byte.hi = (uint8_t)((cpu->reg.af.byte.hi & 0x0F) << 4) |
                                 (cpu->reg.af.byte.hi >> 4);
-          cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+          FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
           return;
 
@@ -2237,339 +2543,339 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
           return;
 
         case OP_BIT_0_B:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 0), cpu->reg.bc.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 0), cpu->reg.bc.byte.hi);
           return;
 
         case OP_BIT_0_C:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 0), cpu->reg.bc.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 0), cpu->reg.bc.byte.lo);
           return;
 
         case OP_BIT_0_D:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 0), cpu->reg.de.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 0), cpu->reg.de.byte.hi);
           return;
 
         case OP_BIT_0_E:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 0), cpu->reg.de.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 0), cpu->reg.de.byte.lo);
           return;
 
         case OP_BIT_0_H:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 0), cpu->reg.hl.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 0), cpu->reg.hl.byte.hi);
           return;
 
         case OP_BIT_0_L:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 0), cpu->reg.hl.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 0), cpu->reg.hl.byte.lo);
           return;
 
         case OP_BIT_0_HL: {
           const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
-          cpu->reg.af.byte.lo = alu_bit(cpu->reg.af.byte.lo, (1 << 0), data);
+          FLAGS(cpu) = alu_bit(FLAGS(cpu), (1 << 0), data);
 
           return;
         }
 
         case OP_BIT_0_A:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 0), cpu->reg.af.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 0), cpu->reg.af.byte.hi);
           return;
 
         case OP_BIT_1_B:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 1), cpu->reg.bc.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 1), cpu->reg.bc.byte.hi);
           return;
 
         case OP_BIT_1_C:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 1), cpu->reg.bc.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 1), cpu->reg.bc.byte.lo);
           return;
 
         case OP_BIT_1_D:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 1), cpu->reg.de.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 1), cpu->reg.de.byte.hi);
           return;
 
         case OP_BIT_1_E:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 1), cpu->reg.de.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 1), cpu->reg.de.byte.lo);
           return;
 
         case OP_BIT_1_H:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 1), cpu->reg.hl.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 1), cpu->reg.hl.byte.hi);
           return;
 
         case OP_BIT_1_L:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 1), cpu->reg.hl.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 1), cpu->reg.hl.byte.lo);
           return;
 
         case OP_BIT_1_HL: {
           const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
-          cpu->reg.af.byte.lo = alu_bit(cpu->reg.af.byte.lo, (1 << 1), data);
+          FLAGS(cpu) = alu_bit(FLAGS(cpu), (1 << 1), data);
 
           return;
         }
 
         case OP_BIT_1_A:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 1), cpu->reg.af.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 1), cpu->reg.af.byte.hi);
           return;
 
         case OP_BIT_2_B:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 2), cpu->reg.bc.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 2), cpu->reg.bc.byte.hi);
           return;
 
         case OP_BIT_2_C:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 2), cpu->reg.bc.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 2), cpu->reg.bc.byte.lo);
           return;
 
         case OP_BIT_2_D:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 2), cpu->reg.de.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 2), cpu->reg.de.byte.hi);
           return;
 
         case OP_BIT_2_E:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 2), cpu->reg.de.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 2), cpu->reg.de.byte.lo);
           return;
 
         case OP_BIT_2_H:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 2), cpu->reg.hl.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 2), cpu->reg.hl.byte.hi);
           return;
 
         case OP_BIT_2_L:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 2), cpu->reg.hl.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 2), cpu->reg.hl.byte.lo);
           return;
 
         case OP_BIT_2_HL: {
           const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
-          cpu->reg.af.byte.lo = alu_bit(cpu->reg.af.byte.lo, (1 << 2), data);
+          FLAGS(cpu) = alu_bit(FLAGS(cpu), (1 << 2), data);
 
           return;
         }
 
         case OP_BIT_2_A:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 2), cpu->reg.af.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 2), cpu->reg.af.byte.hi);
           return;
 
         case OP_BIT_3_B:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 3), cpu->reg.bc.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 3), cpu->reg.bc.byte.hi);
           return;
 
         case OP_BIT_3_C:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 3), cpu->reg.bc.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 3), cpu->reg.bc.byte.lo);
           return;
 
         case OP_BIT_3_D:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 3), cpu->reg.de.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 3), cpu->reg.de.byte.hi);
           return;
 
         case OP_BIT_3_E:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 3), cpu->reg.de.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 3), cpu->reg.de.byte.lo);
           return;
 
         case OP_BIT_3_H:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 3), cpu->reg.hl.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 3), cpu->reg.hl.byte.hi);
           return;
 
         case OP_BIT_3_L:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 3), cpu->reg.hl.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 3), cpu->reg.hl.byte.lo);
           return;
 
         case OP_BIT_3_HL: {
           const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
-          cpu->reg.af.byte.lo = alu_bit(cpu->reg.af.byte.lo, (1 << 3), data);
+          FLAGS(cpu) = alu_bit(FLAGS(cpu), (1 << 3), data);
 
           return;
         }
 
         case OP_BIT_3_A:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 3), cpu->reg.af.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 3), cpu->reg.af.byte.hi);
           return;
 
         case OP_BIT_4_B:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 4), cpu->reg.bc.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 4), cpu->reg.bc.byte.hi);
           return;
 
         case OP_BIT_4_C:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 4), cpu->reg.bc.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 4), cpu->reg.bc.byte.lo);
           return;
 
         case OP_BIT_4_D:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 4), cpu->reg.de.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 4), cpu->reg.de.byte.hi);
           return;
 
         case OP_BIT_4_E:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 4), cpu->reg.de.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 4), cpu->reg.de.byte.lo);
           return;
 
         case OP_BIT_4_H:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 4), cpu->reg.hl.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 4), cpu->reg.hl.byte.hi);
           return;
 
         case OP_BIT_4_L:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 4), cpu->reg.hl.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 4), cpu->reg.hl.byte.lo);
           return;
 
         case OP_BIT_4_HL: {
           const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
-          cpu->reg.af.byte.lo = alu_bit(cpu->reg.af.byte.lo, (1 << 4), data);
+          FLAGS(cpu) = alu_bit(FLAGS(cpu), (1 << 4), data);
 
           return;
         }
 
         case OP_BIT_4_A:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 4), cpu->reg.af.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 4), cpu->reg.af.byte.hi);
           return;
 
         case OP_BIT_5_B:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 5), cpu->reg.bc.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 5), cpu->reg.bc.byte.hi);
           return;
 
         case OP_BIT_5_C:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 5), cpu->reg.bc.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 5), cpu->reg.bc.byte.lo);
           return;
 
         case OP_BIT_5_D:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 5), cpu->reg.de.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 5), cpu->reg.de.byte.hi);
           return;
 
         case OP_BIT_5_E:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 5), cpu->reg.de.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 5), cpu->reg.de.byte.lo);
           return;
 
         case OP_BIT_5_H:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 5), cpu->reg.hl.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 5), cpu->reg.hl.byte.hi);
           return;
 
         case OP_BIT_5_L:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 5), cpu->reg.hl.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 5), cpu->reg.hl.byte.lo);
           return;
 
         case OP_BIT_5_HL: {
           const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
-          cpu->reg.af.byte.lo = alu_bit(cpu->reg.af.byte.lo, (1 << 5), data);
+          FLAGS(cpu) = alu_bit(FLAGS(cpu), (1 << 5), data);
 
           return;
         }
 
         case OP_BIT_5_A:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 5), cpu->reg.af.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 5), cpu->reg.af.byte.hi);
           return;
 
         case OP_BIT_6_B:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 6), cpu->reg.bc.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 6), cpu->reg.bc.byte.hi);
           return;
 
         case OP_BIT_6_C:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 6), cpu->reg.bc.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 6), cpu->reg.bc.byte.lo);
           return;
 
         case OP_BIT_6_D:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 6), cpu->reg.de.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 6), cpu->reg.de.byte.hi);
           return;
 
         case OP_BIT_6_E:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 6), cpu->reg.de.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 6), cpu->reg.de.byte.lo);
           return;
 
         case OP_BIT_6_H:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 6), cpu->reg.hl.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 6), cpu->reg.hl.byte.hi);
           return;
 
         case OP_BIT_6_L:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 6), cpu->reg.hl.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 6), cpu->reg.hl.byte.lo);
           return;
 
         case OP_BIT_6_HL: {
           const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
-          cpu->reg.af.byte.lo = alu_bit(cpu->reg.af.byte.lo, (1 << 6), data);
+          FLAGS(cpu) = alu_bit(FLAGS(cpu), (1 << 6), data);
 
           return;
         }
 
         case OP_BIT_6_A:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 6), cpu->reg.af.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 6), cpu->reg.af.byte.hi);
           return;
 
         case OP_BIT_7_B:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 7), cpu->reg.bc.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 7), cpu->reg.bc.byte.hi);
           return;
 
         case OP_BIT_7_C:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 7), cpu->reg.bc.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 7), cpu->reg.bc.byte.lo);
           return;
 
         case OP_BIT_7_D:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 7), cpu->reg.de.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 7), cpu->reg.de.byte.hi);
           return;
 
         case OP_BIT_7_E:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 7), cpu->reg.de.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 7), cpu->reg.de.byte.lo);
           return;
 
         case OP_BIT_7_H:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 7), cpu->reg.hl.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 7), cpu->reg.hl.byte.hi);
           return;
 
         case OP_BIT_7_L:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 7), cpu->reg.hl.byte.lo);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 7), cpu->reg.hl.byte.lo);
           return;
 
         case OP_BIT_7_HL: {
           const uint8_t data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
-          cpu->reg.af.byte.lo = alu_bit(cpu->reg.af.byte.lo, (1 << 7), data);
+          FLAGS(cpu) = alu_bit(FLAGS(cpu), (1 << 7), data);
 
           return;
         }
 
         case OP_BIT_7_A:
-          cpu->reg.af.byte.lo =
-              alu_bit(cpu->reg.af.byte.lo, (1 << 7), cpu->reg.af.byte.hi);
+          FLAGS(cpu) =
+              alu_bit(FLAGS(cpu), (1 << 7), cpu->reg.af.byte.hi);
           return;
 
         case OP_RES_0_B:
@@ -3154,7 +3460,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       break;
 
       case OP_CALL_Z_IMM16:
-        call_if(cpu, bus, (cpu->reg.af.byte.lo & FLAG_Z) != 0);
+        call_if(cpu, bus, (FLAGS(cpu) & FLAG_Z) != 0);
         return;
 
       case OP_CALL_IMM16:
@@ -3173,12 +3479,12 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         return;
 
       case OP_RET_NC:
-        ret_if(cpu, bus, !(cpu->reg.af.byte.lo & FLAG_C),
+        ret_if(cpu, bus, !(FLAGS(cpu) & FLAG_C),
                RET_TRULY_CONDITIONAL);
         return;
 
       case OP_CALL_NC_IMM16:
-        call_if(cpu, bus, !(cpu->reg.af.byte.lo & FLAG_C));
+        call_if(cpu, bus, !(FLAGS(cpu) & FLAG_C));
         return;
 
       case OP_PUSH_DE:
@@ -3190,7 +3496,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         return;
 
       case OP_JP_NC_IMM16:
-        jp_if(cpu, bus, !(cpu->reg.af.byte.lo & FLAG_C));
+        jp_if(cpu, bus, !(FLAGS(cpu) & FLAG_C));
         return;
 
       case OP_SUB_IMM8: {
@@ -3205,20 +3511,22 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         return;
 
       case OP_RET_C:
-        ret_if(cpu, bus, (cpu->reg.af.byte.lo & FLAG_C) != 0,
+        ret_if(cpu, bus, (FLAGS(cpu) & FLAG_C) != 0,
                RET_TRULY_CONDITIONAL);
         return;
 
       case OP_RETI:
         ret_if(cpu, bus, true, RET_NORMAL);
+        cpu->ime = true;
+
         return;
 
       case OP_JP_C_IMM16:
-        jp_if(cpu, bus, (cpu->reg.af.byte.lo & FLAG_C) != 0);
+        jp_if(cpu, bus, (FLAGS(cpu) & FLAG_C) != 0);
         return;
 
       case OP_CALL_C_IMM16:
-        call_if(cpu, bus, (cpu->reg.af.byte.lo & FLAG_C) != 0);
+        call_if(cpu, bus, (FLAGS(cpu) & FLAG_C) != 0);
         return;
 
       case OP_SBC_A_IMM8: {
@@ -3256,7 +3564,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         const uint8_t imm8 = read_imm8(cpu, bus);
 
         cpu->reg.af.byte.hi &= imm8;
-        cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+        FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
 
         return;
       }
@@ -3271,16 +3579,16 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
         const int result = cpu->reg.sp.value ^ simm8 ^ sum;
 
-        cpu->reg.af.byte.lo &= ~FLAG_Z;
-        cpu->reg.af.byte.lo &= ~FLAG_N;
+        FLAGS(cpu) &= ~FLAG_Z;
+        FLAGS(cpu) &= ~FLAG_N;
 
-        cpu->reg.af.byte.lo =
-            set_half_carry_flag(cpu->reg.af.byte.lo, (result & 0x10) != 0);
+        FLAGS(cpu) =
+            set_half_carry_flag(FLAGS(cpu), (result & 0x10) != 0);
 
-        cpu->reg.af.byte.lo =
-            set_carry_flag(cpu->reg.af.byte.lo, (result & 0x100) != 0);
+        FLAGS(cpu) =
+            set_carry_flag(FLAGS(cpu), (result & 0x100) != 0);
 
-        libyagbe_sched_step();
+        libyagbe_sched_step(bus->sched);
 
         cpu->reg.sp.value = sum;
         return;
@@ -3301,7 +3609,7 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         const uint8_t imm8 = read_imm8(cpu, bus);
 
         cpu->reg.af.byte.hi ^= imm8;
-        cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+        FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
         return;
       }
@@ -3318,6 +3626,8 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       }
 
       case OP_POP_AF:
+        /* Nothing pending may be worked out over the top of this later. */
+        SYNC_FLAGS(cpu);
         cpu->reg.af.value = stack_pop(cpu, bus) & ~0x000F;
         return;
 
@@ -3327,17 +3637,18 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         return;
 
       case OP_DI:
+        cpu->ime = false;
         return;
 
       case OP_PUSH_AF:
-        stack_push(cpu, bus, cpu->reg.af.byte.hi, cpu->reg.af.byte.lo);
+        stack_push(cpu, bus, cpu->reg.af.byte.hi, FLAGS(cpu));
         return;
 
       case OP_OR_IMM8: {
         const uint8_t imm8 = read_imm8(cpu, bus);
 
         cpu->reg.af.byte.hi |= imm8;
-        cpu->reg.af.byte.lo = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+        FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
 
         return;
       }
@@ -3352,24 +3663,24 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
 
         const int result = cpu->reg.sp.value ^ simm8 ^ sum;
 
-        cpu->reg.af.byte.lo &= ~FLAG_Z;
-        cpu->reg.af.byte.lo &= ~FLAG_N;
+        FLAGS(cpu) &= ~FLAG_Z;
+        FLAGS(cpu) &= ~FLAG_N;
 
-        cpu->reg.af.byte.lo =
-            set_half_carry_flag(cpu->reg.af.byte.lo, (result & 0x10) != 0);
+        FLAGS(cpu) =
+            set_half_carry_flag(FLAGS(cpu), (result & 0x10) != 0);
 
-        cpu->reg.af.byte.lo =
-            set_carry_flag(cpu->reg.af.byte.lo, (result & 0x100) != 0);
+        FLAGS(cpu) =
+            set_carry_flag(FLAGS(cpu), (result & 0x100) != 0);
 
         cpu->reg.hl.value = sum;
-        libyagbe_sched_step();
+        libyagbe_sched_step(bus->sched);
 
         return;
       }
 
       case OP_LD_SP_HL:
         cpu->reg.sp.value = cpu->reg.hl.value;
-        libyagbe_sched_step();
+        libyagbe_sched_step(bus->sched);
 
         return;
 
@@ -3381,6 +3692,9 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
       }
 
       case OP_EI:
+        cpu->ei_delay = !cpu->ime;
+        cpu->ime = true;
+
         return;
 
       case OP_CP_IMM8: {
@@ -3398,5 +3712,864 @@ void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
         break;
     }
   }
-  /*__debugbreak();  */
+
+  /* Only the invalid opcodes make it this far. */
+  cpu->state = LIBYAGBE_CPU_STATE_LOCKED;
+}
+
+/* The predecoded interpreter.
+ *
+ * Instructions in ROM are decoded into a code cache entry the first time
+ * they're executed: the index of a handler in the table below, along with the
+ * registers and immediates it works on. Each handler covers a whole family of
+ * opcodes, and only the common families have one. Everything else, as well as
+ * anything outside of ROM, is marked to go through step() instead, which keeps
+ * step() the reference the handlers can be compared against.
+ *
+ * A handler makes the same memory accesses at the same times as step(). The
+ * fetches are folded into a single advance of the scheduler, which nothing in
+ * the core can tell apart from advancing one m-cycle at a time while only ROM
+ * is being read.
+ */
+
+/* Registers are decoded into their offsets within the CPU structure. */
+#define CACHED_REG(cpu, offset) (((uint8_t*)(cpu))[(offset)])
+#define CACHED_PAIR(cpu, offset) \
+  (*(cpu_register_pair*)((unsigned char*)(cpu) + (offset)))
+
+/* B, C, D, E, H, L, (HL) and A, in the order opcodes encode them. (HL) isn't a
+ * register, so its offset is never used. */
+static const unsigned char reg_offsets[8] = {
+    offsetof(struct libyagbe_cpu, reg.bc.byte.hi),
+    offsetof(struct libyagbe_cpu, reg.bc.byte.lo),
+    offsetof(struct libyagbe_cpu, reg.de.byte.hi),
+    offsetof(struct libyagbe_cpu, reg.de.byte.lo),
+    offsetof(struct libyagbe_cpu, reg.hl.byte.hi),
+    offsetof(struct libyagbe_cpu, reg.hl.byte.lo),
+    0,
+    offsetof(struct libyagbe_cpu, reg.af.byte.hi)};
+
+/* BC, DE, HL and SP, as most 16-bit opcodes encode them. */
+static const unsigned char pair_offsets[4] = {
+    offsetof(struct libyagbe_cpu, reg.bc),
+    offsetof(struct libyagbe_cpu, reg.de),
+    offsetof(struct libyagbe_cpu, reg.hl),
+    offsetof(struct libyagbe_cpu, reg.sp)};
+
+/* BC, DE, HL and AF, as PUSH and POP encode them. */
+static const unsigned char stack_pair_offsets[4] = {
+    offsetof(struct libyagbe_cpu, reg.bc),
+    offsetof(struct libyagbe_cpu, reg.de),
+    offsetof(struct libyagbe_cpu, reg.hl),
+    offsetof(struct libyagbe_cpu, reg.af)};
+
+/* NZ, Z, NC and C, as the flag to test and the value it must have. */
+static const uint8_t condition_masks[4] = {FLAG_Z, FLAG_Z, FLAG_C, FLAG_C};
+static const uint8_t condition_values[4] = {0, FLAG_Z, 0, FLAG_C};
+
+/* Conditions are decoded into a mask of the flag register and what it must
+ * equal, which for unconditional instructions is always true. */
+static bool cached_condition(struct libyagbe_cpu* const cpu,
+                             const struct libyagbe_code_cache_entry* const e) {
+  return (FLAGS(cpu) & e->x) == e->y;
+}
+
+/* Applies one of ADD, ADC, SUB, SBC, AND, XOR, OR and CP to A. */
+static void alu_apply(struct libyagbe_cpu* const cpu, const unsigned int op,
+                      const uint8_t value) {
+  switch (op) {
+    case 0:
+      alu_add(cpu, value, ALU_NORMAL);
+      return;
+
+    case 1:
+      alu_add(cpu, value, ALU_WITH_CARRY);
+      return;
+
+    case 2:
+      alu_sub(cpu, value, ALU_NORMAL);
+      return;
+
+    case 3:
+      alu_sub(cpu, value, ALU_WITH_CARRY);
+      return;
+
+    case 4:
+      cpu->reg.af.byte.hi &= value;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+      return;
+
+    case 5:
+      cpu->reg.af.byte.hi ^= value;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      return;
+
+    case 6:
+      cpu->reg.af.byte.hi |= value;
+      FLAGS(cpu) = (cpu->reg.af.byte.hi == 0) ? 0x80 : 0x00;
+      return;
+
+    default:
+      alu_sub(cpu, value, ALU_DISCARD_RESULT);
+      return;
+  }
+}
+
+/* Applies one of RLC, RRC, RL, RR, SLA, SRA, SWAP and SRL to a value. */
+static uint8_t alu_shift(struct libyagbe_cpu* const cpu, const unsigned int op,
+                         uint8_t value, const enum alu_flag flag) {
+  switch (op) {
+    case 0:
+      return alu_rlc(cpu, value, flag);
+
+    case 1:
+      return alu_rrc(cpu, value, flag);
+
+    case 2:
+      return alu_rl(cpu, value, flag);
+
+    case 3:
+      return alu_rr(cpu, value, flag);
+
+    case 4:
+      return alu_sla(cpu, value);
+
+    case 5:
+      return alu_sra(cpu, value);
+
+    case 6:
+      value = (uint8_t)((value & 0x0F) << 4) | (value >> 4);
+      FLAGS(cpu) = (value == 0) ? 0x80 : 0x00;
+
+      return value;
+
+    default:
+      return alu_srl(cpu, value);
+  }
+}
+
+/* Lets the instruction's fetches, and any idle m-cycles right after them,
+ * pass. */
+static void cached_fetch(struct libyagbe_bus* const bus,
+                         const struct libyagbe_code_cache_entry* const e,
+                         const unsigned int idle_cycles) {
+  libyagbe_sched_advance(bus->sched, (4u * e->length) + (4u * idle_cycles));
+}
+
+/* Does the same for a $CB-prefixed instruction, whose opcode after the prefix
+ * is kept in the upper byte of the immediate. */
+static void cached_fetch_cb(struct libyagbe_bus* const bus,
+                            const struct libyagbe_code_cache_entry* const e) {
+  libyagbe_sched_advance(bus->sched, 4u * e->length);
+  PROFILE_OPCODE(bus, 1, e->imm >> 8);
+}
+
+static void cached_nop(struct libyagbe_cpu* const cpu,
+                       struct libyagbe_bus* const bus,
+                       const struct libyagbe_code_cache_entry* const e) {
+  (void)cpu;
+  cached_fetch(bus, e, 0);
+}
+
+static void cached_ld_r_r(struct libyagbe_cpu* const cpu,
+                          struct libyagbe_bus* const bus,
+                          const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  CACHED_REG(cpu, e->x) = CACHED_REG(cpu, e->y);
+}
+
+static void cached_ld_r_imm8(struct libyagbe_cpu* const cpu,
+                             struct libyagbe_bus* const bus,
+                             const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  CACHED_REG(cpu, e->x) = (uint8_t)e->imm;
+}
+
+static void cached_ld_r_mem_hl(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  CACHED_REG(cpu, e->x) = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
+}
+
+static void cached_ld_mem_hl_r(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  libyagbe_bus_write_memory(bus, cpu->reg.hl.value, CACHED_REG(cpu, e->y));
+}
+
+static void cached_ld_mem_hl_imm8(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  libyagbe_bus_write_memory(bus, cpu->reg.hl.value, (uint8_t)e->imm);
+}
+
+static void cached_ld_rr_imm16(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  CACHED_PAIR(cpu, e->x).value = e->imm;
+}
+
+/* The immediate is added to the pair afterwards, for LDI and LDD. */
+static void cached_ld_a_mem_rr(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  const uint16_t address = CACHED_PAIR(cpu, e->x).value;
+
+  cached_fetch(bus, e, 0);
+
+  CACHED_PAIR(cpu, e->x).value = (uint16_t)(address + e->imm);
+  cpu->reg.af.byte.hi = libyagbe_bus_read_memory(bus, address);
+}
+
+static void cached_ld_mem_rr_a(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  const uint16_t address = CACHED_PAIR(cpu, e->x).value;
+
+  cached_fetch(bus, e, 0);
+
+  CACHED_PAIR(cpu, e->x).value = (uint16_t)(address + e->imm);
+  libyagbe_bus_write_memory(bus, address, cpu->reg.af.byte.hi);
+}
+
+/* LDH is decoded into this as well, with $FF00 already added. */
+static void cached_ld_a_mem_imm16(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  cpu->reg.af.byte.hi = libyagbe_bus_read_memory(bus, e->imm);
+}
+
+static void cached_ld_mem_imm16_a(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  libyagbe_bus_write_memory(bus, e->imm, cpu->reg.af.byte.hi);
+}
+
+static void cached_inc_r(struct libyagbe_cpu* const cpu,
+                         struct libyagbe_bus* const bus,
+                         const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  CACHED_REG(cpu, e->x) = alu_inc(cpu, CACHED_REG(cpu, e->x));
+}
+
+static void cached_dec_r(struct libyagbe_cpu* const cpu,
+                         struct libyagbe_bus* const bus,
+                         const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  CACHED_REG(cpu, e->x) = alu_dec(cpu, CACHED_REG(cpu, e->x));
+}
+
+/* DEC is decoded into this as well, by adding $FFFF. */
+static void cached_inc_rr(struct libyagbe_cpu* const cpu,
+                          struct libyagbe_bus* const bus,
+                          const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 1);
+  CACHED_PAIR(cpu, e->x).value =
+      (uint16_t)(CACHED_PAIR(cpu, e->x).value + e->imm);
+}
+
+static void cached_add_hl_rr(struct libyagbe_cpu* const cpu,
+                             struct libyagbe_bus* const bus,
+                             const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  alu_add_hl(cpu, bus, CACHED_PAIR(cpu, e->x).value);
+}
+
+static void cached_rotate_a(struct libyagbe_cpu* const cpu,
+                            struct libyagbe_bus* const bus,
+                            const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  cpu->reg.af.byte.hi =
+      alu_shift(cpu, e->x, cpu->reg.af.byte.hi, ALU_CLEAR_ZERO);
+}
+
+static void cached_alu_r(struct libyagbe_cpu* const cpu,
+                         struct libyagbe_bus* const bus,
+                         const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  alu_apply(cpu, e->x, CACHED_REG(cpu, e->y));
+}
+
+static void cached_alu_mem_hl(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  alu_apply(cpu, e->x, libyagbe_bus_read_memory(bus, cpu->reg.hl.value));
+}
+
+static void cached_alu_imm8(struct libyagbe_cpu* const cpu,
+                            struct libyagbe_bus* const bus,
+                            const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  alu_apply(cpu, e->x, (uint8_t)e->imm);
+}
+
+/* The displacement is decoded already sign extended. */
+static void cached_jr(struct libyagbe_cpu* const cpu,
+                      struct libyagbe_bus* const bus,
+                      const struct libyagbe_code_cache_entry* const e) {
+  if (cached_condition(cpu, e)) {
+    cached_fetch(bus, e, 1);
+    cpu->reg.pc.value = (uint16_t)(cpu->reg.pc.value + e->imm);
+
+    return;
+  }
+  cached_fetch(bus, e, 0);
+}
+
+static void cached_jp(struct libyagbe_cpu* const cpu,
+                      struct libyagbe_bus* const bus,
+                      const struct libyagbe_code_cache_entry* const e) {
+  if (cached_condition(cpu, e)) {
+    cached_fetch(bus, e, 1);
+    cpu->reg.pc.value = e->imm;
+
+    return;
+  }
+  cached_fetch(bus, e, 0);
+}
+
+static void cached_call(struct libyagbe_cpu* const cpu,
+                        struct libyagbe_bus* const bus,
+                        const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+
+  if (cached_condition(cpu, e)) {
+    stack_push(cpu, bus, cpu->reg.pc.byte.hi, cpu->reg.pc.byte.lo);
+    cpu->reg.pc.value = e->imm;
+  }
+}
+
+static void cached_ret_if(struct libyagbe_cpu* const cpu,
+                          struct libyagbe_bus* const bus,
+                          const struct libyagbe_code_cache_entry* const e) {
+  if (cached_condition(cpu, e)) {
+    cached_fetch(bus, e, 1);
+    cpu->reg.pc.value = stack_pop(cpu, bus);
+    libyagbe_sched_step(bus->sched);
+
+    return;
+  }
+  cached_fetch(bus, e, 2);
+}
+
+static void cached_ret(struct libyagbe_cpu* const cpu,
+                       struct libyagbe_bus* const bus,
+                       const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  cpu->reg.pc.value = stack_pop(cpu, bus);
+  libyagbe_sched_step(bus->sched);
+}
+
+static void cached_push(struct libyagbe_cpu* const cpu,
+                        struct libyagbe_bus* const bus,
+                        const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+
+  /* PUSH AF pushes F straight out of the register. */
+  SYNC_FLAGS(cpu);
+  stack_push(cpu, bus, CACHED_PAIR(cpu, e->x).byte.hi,
+             CACHED_PAIR(cpu, e->x).byte.lo);
+}
+
+/* The immediate masks off the bits of F which always read as 0. */
+static void cached_pop(struct libyagbe_cpu* const cpu,
+                       struct libyagbe_bus* const bus,
+                       const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  SYNC_FLAGS(cpu);
+  CACHED_PAIR(cpu, e->x).value = stack_pop(cpu, bus) & e->imm;
+}
+
+static void cached_rst(struct libyagbe_cpu* const cpu,
+                       struct libyagbe_bus* const bus,
+                       const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch(bus, e, 0);
+  rst(cpu, bus, e->imm);
+}
+
+static void cached_cb_shift_r(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch_cb(bus, e);
+  CACHED_REG(cpu, e->y) =
+      alu_shift(cpu, e->x, CACHED_REG(cpu, e->y), ALU_NORMAL);
+}
+
+static void cached_cb_shift_mem_hl(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  uint8_t data;
+
+  cached_fetch_cb(bus, e);
+
+  data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
+  data = alu_shift(cpu, e->x, data, ALU_NORMAL);
+  libyagbe_bus_write_memory(bus, cpu->reg.hl.value, data);
+}
+
+/* The bit a $CB-prefixed instruction works on is decoded into a mask in the
+ * lower byte of the immediate. */
+static void cached_cb_bit_r(struct libyagbe_cpu* const cpu,
+                            struct libyagbe_bus* const bus,
+                            const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch_cb(bus, e);
+  FLAGS(cpu) =
+      alu_bit(FLAGS(cpu), e->imm & 0xFF, CACHED_REG(cpu, e->y));
+}
+
+static void cached_cb_bit_mem_hl(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  uint8_t data;
+
+  cached_fetch_cb(bus, e);
+
+  data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
+  FLAGS(cpu) = alu_bit(FLAGS(cpu), e->imm & 0xFF, data);
+}
+
+static void cached_cb_res_r(struct libyagbe_cpu* const cpu,
+                            struct libyagbe_bus* const bus,
+                            const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch_cb(bus, e);
+  CACHED_REG(cpu, e->y) &= (uint8_t)~e->imm;
+}
+
+static void cached_cb_res_mem_hl(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  uint8_t data;
+
+  cached_fetch_cb(bus, e);
+
+  data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
+  data &= (uint8_t)~e->imm;
+  libyagbe_bus_write_memory(bus, cpu->reg.hl.value, data);
+}
+
+static void cached_cb_set_r(struct libyagbe_cpu* const cpu,
+                            struct libyagbe_bus* const bus,
+                            const struct libyagbe_code_cache_entry* const e) {
+  cached_fetch_cb(bus, e);
+  CACHED_REG(cpu, e->y) |= (uint8_t)e->imm;
+}
+
+static void cached_cb_set_mem_hl(
+    struct libyagbe_cpu* const cpu, struct libyagbe_bus* const bus,
+    const struct libyagbe_code_cache_entry* const e) {
+  uint8_t data;
+
+  cached_fetch_cb(bus, e);
+
+  data = libyagbe_bus_read_memory(bus, cpu->reg.hl.value);
+  data |= (uint8_t)e->imm;
+  libyagbe_bus_write_memory(bus, cpu->reg.hl.value, data);
+}
+
+/* Indexed by enum cached_handler. The first two are dealt with before
+ * dispatching. */
+static const cached_handler_func cached_handlers[NUM_CACHED_HANDLERS] = {
+    NULL,
+    NULL,
+    &cached_nop,
+    &cached_ld_r_r,
+    &cached_ld_r_imm8,
+    &cached_ld_r_mem_hl,
+    &cached_ld_mem_hl_r,
+    &cached_ld_mem_hl_imm8,
+    &cached_ld_rr_imm16,
+    &cached_ld_a_mem_rr,
+    &cached_ld_mem_rr_a,
+    &cached_ld_a_mem_imm16,
+    &cached_ld_mem_imm16_a,
+    &cached_inc_r,
+    &cached_dec_r,
+    &cached_inc_rr,
+    &cached_add_hl_rr,
+    &cached_rotate_a,
+    &cached_alu_r,
+    &cached_alu_mem_hl,
+    &cached_alu_imm8,
+    &cached_jr,
+    &cached_jp,
+    &cached_call,
+    &cached_ret_if,
+    &cached_ret,
+    &cached_push,
+    &cached_pop,
+    &cached_rst,
+    &cached_cb_shift_r,
+    &cached_cb_shift_mem_hl,
+    &cached_cb_bit_r,
+    &cached_cb_bit_mem_hl,
+    &cached_cb_res_r,
+    &cached_cb_res_mem_hl,
+    &cached_cb_set_r,
+    &cached_cb_set_mem_hl};
+
+static void decode_condition(struct libyagbe_code_cache_entry* const e,
+                             const unsigned int condition) {
+  e->x = condition_masks[condition];
+  e->y = condition_values[condition];
+}
+
+/* Decodes a $CB-prefixed instruction. */
+static void decode_cb(struct libyagbe_code_cache_entry* const e,
+                      const uint8_t opcode) {
+  const unsigned int group = opcode >> 6;
+  const unsigned int bit = (opcode >> 3) & 7;
+  const unsigned int reg = opcode & 7;
+  static const uint8_t r_handlers[4] = {CACHED_CB_SHIFT_R, CACHED_CB_BIT_R,
+                                        CACHED_CB_RES_R, CACHED_CB_SET_R};
+  static const uint8_t mem_hl_handlers[4] = {
+      CACHED_CB_SHIFT_MEM_HL, CACHED_CB_BIT_MEM_HL, CACHED_CB_RES_MEM_HL,
+      CACHED_CB_SET_MEM_HL};
+
+  e->handler = (reg == 6) ? mem_hl_handlers[group] : r_handlers[group];
+  e->x = (uint8_t)bit;
+  e->y = reg_offsets[reg];
+  e->imm = (uint16_t)((opcode << 8) | (1 << bit));
+}
+
+/* Decodes the instruction at the start of some code, which must be at least
+ * as long as the instruction to be decoded as anything but a fallback. */
+static void decode(struct libyagbe_code_cache_entry* const e,
+                   const uint8_t* const code, const size_t available) {
+  const uint8_t opcode = code[0];
+  const unsigned int y = (opcode >> 3) & 7;
+  const unsigned int z = opcode & 7;
+  unsigned int handler = CACHED_FALLBACK;
+  unsigned int length = 1;
+
+  e->opcode = opcode;
+  e->x = 0;
+  e->y = 0;
+  e->imm = 0;
+
+  switch (opcode >> 6) {
+    case 0:
+      switch (z) {
+        case 0:
+          if (y == 0) {
+            handler = CACHED_NOP;
+          } else if (y >= 3) {
+            handler = CACHED_JR;
+            length = 2;
+
+            if (y >= 4) {
+              decode_condition(e, y - 4);
+            }
+          }
+          break;
+
+        case 1:
+          handler = (y & 1) ? CACHED_ADD_HL_RR : CACHED_LD_RR_IMM16;
+          length = (y & 1) ? 1 : 3;
+          e->x = pair_offsets[y >> 1];
+          break;
+
+        case 2:
+          /* (BC), (DE), (HL+) and (HL-). */
+          handler = (y & 1) ? CACHED_LD_A_MEM_RR : CACHED_LD_MEM_RR_A;
+          e->x = pair_offsets[(y >> 1) < 2 ? (y >> 1) : 2];
+          e->imm = ((y >> 1) == 2) ? 0x0001 : ((y >> 1) == 3) ? 0xFFFF : 0;
+          break;
+
+        case 3:
+          handler = CACHED_INC_RR;
+          e->x = pair_offsets[y >> 1];
+          e->imm = (y & 1) ? 0xFFFF : 0x0001;
+          break;
+
+        case 4:
+        case 5:
+          if (y != 6) {
+            handler = (z == 4) ? CACHED_INC_R : CACHED_DEC_R;
+            e->x = reg_offsets[y];
+          }
+          break;
+
+        case 6:
+          handler = (y == 6) ? CACHED_LD_MEM_HL_IMM8 : CACHED_LD_R_IMM8;
+          length = 2;
+          e->x = reg_offsets[y];
+          break;
+
+        default:
+          if (y < 4) {
+            handler = CACHED_ROTATE_A;
+            e->x = (uint8_t)y;
+          }
+          break;
+      }
+      break;
+
+    case 1:
+      if (opcode == OP_HALT) {
+        break;
+      }
+
+      if (y == 6) {
+        handler = CACHED_LD_MEM_HL_R;
+      } else if (z == 6) {
+        handler = CACHED_LD_R_MEM_HL;
+      } else {
+        handler = CACHED_LD_R_R;
+      }
+      e->x = reg_offsets[y];
+      e->y = reg_offsets[z];
+      break;
+
+    case 2:
+      handler = (z == 6) ? CACHED_ALU_MEM_HL : CACHED_ALU_R;
+      e->x = (uint8_t)y;
+      e->y = reg_offsets[z];
+      break;
+
+    default:
+      switch (opcode) {
+        case OP_RET_NZ:
+        case OP_RET_Z:
+        case OP_RET_NC:
+        case OP_RET_C:
+          handler = CACHED_RET_IF;
+          decode_condition(e, y);
+          break;
+
+        case OP_LDH_IMM8_A:
+        case OP_LDH_A_IMM8:
+          handler = (opcode == OP_LDH_IMM8_A) ? CACHED_LD_MEM_IMM16_A
+                                              : CACHED_LD_A_MEM_IMM16;
+          length = 2;
+          break;
+
+        case OP_POP_BC:
+        case OP_POP_DE:
+        case OP_POP_HL:
+        case OP_POP_AF:
+          handler = CACHED_POP;
+          e->x = stack_pair_offsets[y >> 1];
+          e->imm = (opcode == OP_POP_AF) ? 0xFFF0 : 0xFFFF;
+          break;
+
+        case OP_RET:
+          handler = CACHED_RET;
+          break;
+
+        case OP_JP_NZ_IMM16:
+        case OP_JP_Z_IMM16:
+        case OP_JP_NC_IMM16:
+        case OP_JP_C_IMM16:
+          decode_condition(e, y);
+
+          /* Fall through. */
+        case OP_JP_IMM16:
+          handler = CACHED_JP;
+          length = 3;
+          break;
+
+        case OP_LD_MEM_IMM16_A:
+        case OP_LD_A_MEM_IMM16:
+          handler = (opcode == OP_LD_MEM_IMM16_A) ? CACHED_LD_MEM_IMM16_A
+                                                  : CACHED_LD_A_MEM_IMM16;
+          length = 3;
+          break;
+
+        case OP_PREFIX_CB:
+          /* The handler depends on the opcode after the prefix, which is
+           * decoded once it's known to be in the bank. */
+          handler = CACHED_CB_SHIFT_R;
+          length = 2;
+          break;
+
+        case OP_CALL_NZ_IMM16:
+        case OP_CALL_Z_IMM16:
+        case OP_CALL_NC_IMM16:
+        case OP_CALL_C_IMM16:
+          decode_condition(e, y);
+
+          /* Fall through. */
+        case OP_CALL_IMM16:
+          handler = CACHED_CALL;
+          length = 3;
+          break;
+
+        case OP_PUSH_BC:
+        case OP_PUSH_DE:
+        case OP_PUSH_HL:
+        case OP_PUSH_AF:
+          handler = CACHED_PUSH;
+          e->x = stack_pair_offsets[y >> 1];
+          break;
+
+        default:
+          if (z == 6) {
+            handler = CACHED_ALU_IMM8;
+            length = 2;
+            e->x = (uint8_t)y;
+          } else if (z == 7) {
+            handler = CACHED_RST;
+            e->imm = (uint16_t)(y * 8);
+          }
+          break;
+      }
+      break;
+  }
+
+  /* Instructions running off the end of the bank are left to step(), as the
+   * rest of them isn't necessarily in the bank which follows. */
+  if (length > available) {
+    handler = CACHED_FALLBACK;
+    length = 1;
+  }
+  e->handler = (uint8_t)handler;
+  e->length = (uint8_t)length;
+
+  if (handler == CACHED_FALLBACK) {
+    return;
+  }
+
+  if (opcode == OP_PREFIX_CB) {
+    decode_cb(e, code[1]);
+  } else if (handler == CACHED_JR) {
+    e->imm = (uint16_t)(int8_t)code[1];
+  } else if ((opcode == OP_LDH_IMM8_A) || (opcode == OP_LDH_A_IMM8)) {
+    e->imm = (uint16_t)(0xFF00 | code[1]);
+  } else if (length == 2) {
+    e->imm = code[1];
+  } else if (length == 3) {
+    e->imm = (uint16_t)((code[2] << 8) | code[1]);
+  }
+}
+
+void libyagbe_cpu_decode(struct libyagbe_code_cache_entry* const e,
+                         const uint8_t* const code, const size_t available) {
+  assert(e != NULL);
+  assert(code != NULL);
+
+  decode(e, code, available);
+}
+
+cached_handler_func libyagbe_cpu_get_cached_handler(
+    const unsigned int handler) {
+  assert(handler > CACHED_FALLBACK);
+  assert(handler < NUM_CACHED_HANDLERS);
+
+  return cached_handlers[handler];
+}
+
+/* Starts executing a decoded instruction. */
+static void dispatch_cached(struct libyagbe_cpu* const cpu,
+                            struct libyagbe_bus* const bus,
+                            const struct libyagbe_code_cache_entry* const e) {
+  cpu->ei_delay = false;
+  cpu->instruction = e->opcode;
+  PROFILE_OPCODE(bus, 0, e->opcode);
+
+  cpu->reg.pc.value = (uint16_t)(cpu->reg.pc.value + e->length);
+  cached_handlers[e->handler](cpu, bus, e);
+}
+
+/* Executes the instruction at PC once the cache has been brought up to date
+ * with the bank it's in and the instruction has been decoded, or with step()
+ * if it can't be. The bus is checked as well as the cartridge, so nothing is
+ * executed from the cache unless the CPU would really read it from ROM. */
+static void step_cached_slow(struct libyagbe_cpu* const cpu,
+                             struct libyagbe_bus* const bus) {
+  struct libyagbe_code_cache* const cache = cpu->code_cache;
+  const uint16_t pc = cpu->reg.pc.value;
+  const uint8_t* const page = bus->read_map[pc >> LIBYAGBE_BUS_PAGE_SHIFT];
+  struct libyagbe_code_cache_entry* const entry =
+      libyagbe_code_cache_map(cache, &bus->cart, pc);
+  const uint8_t* const rom = cache->regions[pc >> 14].rom;
+
+  if (page != rom + (pc & 0x3F00)) {
+    step(cpu, bus);
+    return;
+  }
+
+  if (entry->handler == CACHED_UNDECODED) {
+    decode(entry, &rom[pc & 0x3FFF],
+           LIBYAGBE_CART_MEM_SIZE_ROM_BANK - (pc & 0x3FFF));
+  }
+
+  if (entry->handler == CACHED_FALLBACK) {
+    step(cpu, bus);
+    return;
+  }
+  dispatch_cached(cpu, bus, entry);
+}
+
+/* Executes an instruction from the code cache, or with step() if it can't
+ * be. */
+static void step_cached(struct libyagbe_cpu* const cpu,
+                        struct libyagbe_bus* const bus) {
+  const uint16_t pc = cpu->reg.pc.value;
+  const struct libyagbe_code_cache_region* region;
+  const struct libyagbe_code_cache_entry* entry;
+
+  /* Anything which isn't simply the next instruction in ROM goes the long
+   * way. */
+  if ((cpu->state != LIBYAGBE_CPU_STATE_RUNNING) || cpu->halt_bug ||
+      (pc >= 0x8000) ||
+      ((bus->irq.pending != 0) && cpu->ime && !cpu->ei_delay)) {
+    step(cpu, bus);
+    return;
+  }
+  region = &cpu->code_cache->regions[pc >> 14];
+
+  /* This is the common case: the bank is still mapped, and the instruction
+   * has been decoded into something other than a fallback. */
+  if ((region->rom == NULL) ||
+      (bus->read_map[pc >> LIBYAGBE_BUS_PAGE_SHIFT] !=
+       region->rom + (pc & 0x3F00))) {
+    step_cached_slow(cpu, bus);
+    return;
+  }
+  entry = &region->bank->entries[pc & 0x3FFF];
+
+  if (entry->handler <= CACHED_FALLBACK) {
+    step_cached_slow(cpu, bus);
+    return;
+  }
+  dispatch_cached(cpu, bus, entry);
+}
+
+/* Executes an instruction with whichever interpreter the CPU is set up for. */
+static void execute(struct libyagbe_cpu* const cpu,
+                    struct libyagbe_bus* const bus) {
+  if (cpu->code_cache != NULL) {
+    step_cached(cpu, bus);
+  } else {
+    step(cpu, bus);
+  }
+}
+
+void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
+                       struct libyagbe_bus* const bus) {
+  assert(cpu != NULL);
+  assert(bus != NULL);
+
+#ifdef LIBYAGBE_ENABLE_PROFILE
+  if (bus->profile != NULL) {
+    const uintmax_t start = bus->sched->current_timestamp;
+    const uint16_t pc = cpu->reg.pc.value;
+
+    libyagbe_profile_begin_step(bus->profile);
+    execute(cpu, bus);
+    libyagbe_profile_end_step(
+        bus->profile, bus, pc,
+        (unsigned int)(bus->sched->current_timestamp - start));
+
+    return;
+  }
+#endif /* LIBYAGBE_ENABLE_PROFILE */
+  execute(cpu, bus);
 }
@@ -0,0 +1,71 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/diag.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+static unsigned long* counter_of(struct libyagbe_diag* const diag,
+                                 const enum libyagbe_diag_access access,
+                                 const uint16_t address) {
+  if (address >= 0xFF00) {
+    return &diag->io_hits[access][address & 0xFF];
+  }
+  return &diag->page_hits[access][address >> 8];
+}
+
+void libyagbe_diag_reset(struct libyagbe_diag* const diag) {
+  assert(diag != NULL);
+
+  memset(diag->io_hits, 0, sizeof(diag->io_hits));
+  memset(diag->page_hits, 0, sizeof(diag->page_hits));
+  memset(diag->total_hits, 0, sizeof(diag->total_hits));
+}
+
+void libyagbe_diag_record(struct libyagbe_diag* const diag,
+                          const enum libyagbe_diag_access access,
+                          const uint16_t address, const uint8_t data) {
+  unsigned long* counter;
+  unsigned long hits;
+
+  assert(diag != NULL);
+  assert(access < LIBYAGBE_DIAG_NUM_ACCESS_TYPES);
+
+  counter = counter_of(diag, access, address);
+  hits = ++*counter;
+  diag->total_hits[access]++;
+
+  /* Only report the 1st, 2nd, 4th, 8th... hit. */
+  if ((diag->cb != NULL) && ((hits & (hits - 1)) == 0)) {
+    diag->cb(diag->userdata, access, address, data, hits);
+  }
+}
+
+unsigned long libyagbe_diag_get_hits(const struct libyagbe_diag* const diag,
+                                     const enum libyagbe_diag_access access,
+                                     const uint16_t address) {
+  assert(diag != NULL);
+  assert(access < LIBYAGBE_DIAG_NUM_ACCESS_TYPES);
+
+  if (address >= 0xFF00) {
+    return diag->io_hits[access][address & 0xFF];
+  }
+  return diag->page_hits[access][address >> 8];
+}
@@ -19,10 +19,10 @@
 #include "libyagbe/disasm.h"
 
 #include <assert.h>
-#include <stdio.h>
-#include <string.h>
+#include <stddef.h>
 
 #include "libyagbe/bus.h"
+#include "libyagbe/compat/compat_stdbool.h"
 #include "libyagbe/cpu.h"
 
 /* Defines the registers that should be shown in the disassembly output *after*
@@ -56,7 +56,6 @@ struct disasm_data {
   int flags;
 };
 
-#if 0
 static const struct disasm_data main_opcodes[256] = {
     {"NOP", OP_NONE, REG_UNUSED},             /* 0x00 */
     {"LD BC, $%04X", OP_IMM16, REG_BC},       /* 0x01 */
@@ -290,7 +289,7 @@ static const struct disasm_data main_opcodes[256] = {
     {"PUSH HL", OP_NONE, REG_HL | REG_SP},              /* 0xE5 */
     {"AND $%02X", OP_IMM8, REG_UNUSED},                 /* 0xE6 */
     {"RST $0020", OP_NONE, REG_UNUSED},                 /* 0xE7 */
-    {"ADD SP, $%02X", OP_SIMM8, REG_SP},                /* 0xE8 */
+    {"ADD SP, $%02X", OP_IMM8, REG_SP},                /* 0xE8 */
     {"JP (HL)", OP_NONE, REG_UNUSED},                   /* 0xE9 */
     {"LD ($%04X), A", OP_IMM16, REG_A | REG_MEM_IMM16}, /* 0xEA */
     {"ILLEGAL $EB", OP_NONE, REG_UNUSED},               /* 0xEB */
@@ -298,7 +297,7 @@ static const struct disasm_data main_opcodes[256] = {
     {"ILLEGAL $ED", OP_NONE, REG_UNUSED},               /* 0xED */
     {"XOR $%02X", OP_IMM8, REG_A},                      /* 0xEE */
     {"RST $0028", OP_NONE, REG_UNUSED},                 /* 0xEF */
-    {"LDH A, ($%02X)", OP_IMM8, REG_A},                 /* 0xF0 */
+    {"LDH A, ($FF%02X)", OP_IMM8, REG_A},                 /* 0xF0 */
     {"POP AF", OP_NONE, REG_AF},                        /* 0xF1 */
     {"LD A, (C)", OP_NONE, REG_UNUSED},                 /* 0xF2 */
     {"DI", OP_NONE, REG_UNUSED},                        /* 0xF3 */
@@ -306,7 +305,7 @@ static const struct disasm_data main_opcodes[256] = {
     {"PUSH AF", OP_NONE, REG_UNUSED},                   /* 0xF5 */
     {"OR $%02X", OP_IMM8, REG_A},                       /* 0xF6 */
     {"RST $0030", OP_NONE, REG_UNUSED},                 /* 0xF7 */
-    {"LD HL, SP+$%02X", OP_SIMM8, REG_UNUSED},          /* 0xF8 */
+    {"LD HL, SP+$%02X", OP_IMM8, REG_UNUSED},          /* 0xF8 */
     {"LD SP, HL", OP_NONE, REG_UNUSED},                 /* 0xF9 */
     {"LD A, ($%04X)", OP_IMM16, REG_A},                 /* 0xFA */
     {"EI", OP_NONE, REG_UNUSED},                        /* 0xFB */
@@ -575,260 +574,255 @@ static const struct disasm_data cb_opcodes[256] = {
     {"SET 7, A", OP_NONE, REG_A | REG_F}          /* 0xFF */
 };
 
-static uint8_t inspect_memory(struct libyagbe_bus* const bus,
-                              const uint16_t address) {
-  assert(bus != NULL);
-
-  switch (address >> 12) {
-    case 0x0:
-    case 0x1:
-    case 0x2:
-    case 0x3:
-    case 0x4:
-    case 0x5:
-    case 0x6:
-    case 0x7:
-      return bus->cart.data[address];
-
-    case 0xC:
-    case 0xD:
-      return bus->wram[address - 0xC000];
-
-    case 0xF:
-      switch ((address >> 8) & 0x0F) {
-        case 0xF:
-          switch ((address & 0x00FF) >> 4) {
-            case 0x0:
-            case 0x1:
-            case 0x2:
-            case 0x3:
-            case 0x4:
-            case 0x5:
-            case 0x6:
-            case 0x7:
-              break;
-
-            case 0x8:
-            case 0x9:
-            case 0xA:
-            case 0xB:
-            case 0xC:
-            case 0xD:
-            case 0xE:
-              return bus->hram[address - 0xFF80];
-
-            case 0xF:
-              switch (address & 0x000F) {
-                case 0x0:
-                case 0x1:
-                case 0x2:
-                case 0x3:
-                case 0x4:
-                case 0x5:
-                case 0x6:
-                case 0x7:
-                case 0x9:
-                case 0xA:
-                case 0xB:
-                case 0xC:
-                case 0xD:
-                case 0xE:
-                  return bus->hram[address - 0xFF80];
-
-                default:
-                  break;
-              }
-              break;
-
-            default:
-              break;
-          }
-          break;
-
-        default:
-          break;
-      }
-      break;
-
-    default:
-      break;
-  }
-  printf("Unhandled read: $%04X\n", address);
-  return 0xFF;
-}
-#endif
+static const char hex_digits[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
+                                    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
 
-static struct current_disasm { char disasm_result[256]; } current_disasm;
+/* Storage for the non-reentrant API. */
+static struct {
+  struct libyagbe_disasm_context ctx;
+  char line[LIBYAGBE_DISASM_LINE_SIZE];
+} legacy;
 
-void libyagbe_disasm_prepare(const uint16_t pc, struct libyagbe_cpu* const cpu,
-                             struct libyagbe_bus* const bus) {
-  assert(bus != NULL);
+static char* put_hex8(char* out, const unsigned int value) {
+  *out++ = hex_digits[(value >> 4) & 0x0F];
+  *out++ = hex_digits[value & 0x0F];
 
-  memset(current_disasm.disasm_result, 0, sizeof(current_disasm.disasm_result));
+  return out;
+}
 
-  sprintf(current_disasm.disasm_result,
-          "BC=%04X DE=%04X HL=%04X AF=%04X SP=%04X PC=%04X", cpu->reg.bc.value,
-          cpu->reg.de.value, cpu->reg.hl.value, cpu->reg.af.value,
-          cpu->reg.sp.value, pc);
+static char* put_hex16(char* out, const unsigned int value) {
+  out = put_hex8(out, value >> 8);
+  return put_hex8(out, value);
 }
 
-char* libyagbe_disasm_execute(struct libyagbe_cpu* const cpu,
-                              struct libyagbe_bus* const bus) {
-  char buf[256];
+static char* put_str(char* out, const char* str) {
+  while (*str != '\0') {
+    *out++ = *str++;
+  }
+  return out;
+}
 
-  assert(cpu != NULL);
-  assert(bus != NULL);
+/* Appends "NAME=$XX" or "NAME=$XXXX" depending on the number of digits. */
+static char* put_reg(char* out, const char* const name,
+                     const unsigned int value, const bool wide) {
+  out = put_str(out, name);
+  *out++ = '=';
+  *out++ = '$';
 
-  sprintf(buf, "   TIMA=%02X TMA=%02X TAC=%02X", bus->timer.tima,
-          bus->timer.tma, bus->timer.tac);
+  return wide ? put_hex16(out, value) : put_hex8(out, value);
+}
 
-  strcat(current_disasm.disasm_result, buf);
-  return current_disasm.disasm_result;
+/* Expands a format string from the opcode tables. The only conversions they
+ * use are %02X and %04X, so there's no need for sprintf(). */
+static char* put_format(char* out, const char* format,
+                        const unsigned int value) {
+  while (*format != '\0') {
+    if (format[0] == '%' && format[1] == '0') {
+      out = (format[2] == '4') ? put_hex16(out, value) : put_hex8(out, value);
+      format += 4;
+    } else {
+      *out++ = *format++;
+    }
+  }
+  return out;
 }
 
-#if 0
-void libyagbe_disasm_prepare(const uint16_t pc,
-                             struct libyagbe_bus* const bus) {
-  uint8_t instruction;
+static const struct disasm_data* lookup(const uint8_t* const bytes) {
+  return (bytes[0] == 0xCB) ? &cb_opcodes[bytes[1]] : &main_opcodes[bytes[0]];
+}
 
-  const struct disasm_data* data;
+static char* put_instruction(char* const out, const uint16_t pc,
+                             const uint8_t* const bytes) {
+  const struct disasm_data* const data = lookup(bytes);
 
-  assert(bus != NULL);
+  switch (data->op) {
+    case OP_IMM8:
+      return put_format(out, data->format_str, bytes[1]);
 
-  memset(&current_disasm, 0, sizeof(current_disasm));
+    case OP_IMM16:
+      return put_format(out, data->format_str,
+                        (unsigned int)((bytes[2] << 8) | bytes[1]));
 
-  instruction = inspect_memory(bus, pc);
+    case OP_SIMM8:
+      return put_format(
+          out, data->format_str,
+          (unsigned int)((pc + 2 + (int8_t)bytes[1]) & 0xFFFF));
 
-  if (instruction == 0xCB) {
-    instruction = inspect_memory(bus, pc + 1);
-    data = &cb_opcodes[instruction];
-  } else {
-    data = &main_opcodes[instruction];
+    case OP_NONE:
+    default:
+      return put_str(out, data->format_str);
   }
+}
 
-  switch (data->op) {
-    case OP_NONE:
-      sprintf(current_disasm.disasm_result, "%s", data->format_str);
-      break;
+size_t libyagbe_disasm_format(char* const buf, const uint16_t pc,
+                              const uint8_t* const bytes) {
+  char* end;
 
-    case OP_IMM8: {
-      const uint8_t imm = inspect_memory(bus, pc + 1);
-      sprintf(current_disasm.disasm_result, data->format_str, imm);
+  assert(buf != NULL);
+  assert(bytes != NULL);
 
-      break;
-    }
+  end = put_instruction(buf, pc, bytes);
+  *end = '\0';
 
-    case OP_IMM16: {
-      const uint8_t lo = inspect_memory(bus, pc + 1);
-      const uint8_t hi = inspect_memory(bus, pc + 2);
+  return (size_t)(end - buf);
+}
 
-      sprintf(current_disasm.disasm_result, data->format_str, (hi << 8) | lo);
-      break;
-    }
+void libyagbe_disasm_prepare_r(struct libyagbe_disasm_context* const ctx,
+                               const uint16_t pc,
+                               const struct libyagbe_cpu* const cpu,
+                               struct libyagbe_bus* const bus) {
+  assert(ctx != NULL);
+  assert(cpu != NULL);
+  assert(bus != NULL);
 
-    case OP_SIMM8: {
-      const int8_t imm = (int8_t)inspect_memory(bus, pc + 1);
+  ctx->pc = pc;
+  ctx->reg = cpu->reg;
+  ctx->reg.af.byte.lo = libyagbe_cpu_get_flags(cpu);
 
-      sprintf(current_disasm.disasm_result, data->format_str, pc + imm + 2);
-      break;
-    }
-  }
-  current_disasm.post_op_flags = data->flags;
+  ctx->bytes[0] = libyagbe_bus_inspect_memory(bus, pc);
+  ctx->bytes[1] = libyagbe_bus_inspect_memory(bus, (uint16_t)(pc + 1));
+  ctx->bytes[2] = libyagbe_bus_inspect_memory(bus, (uint16_t)(pc + 2));
 }
 
-char* libyagbe_disasm_execute(struct libyagbe_cpu* const cpu,
-                              struct libyagbe_bus* const bus) {
-  int bit_counter;
-  char buf[256];
+size_t libyagbe_disasm_execute_r(const struct libyagbe_disasm_context* const ctx,
+                                 const struct libyagbe_cpu* const cpu,
+                                 struct libyagbe_bus* const bus,
+                                 char* const buf) {
+  const struct libyagbe_cpu_registers* const reg = &cpu->reg;
+  const char* separator;
+  int flags;
+  char* out;
 
+  assert(ctx != NULL);
   assert(cpu != NULL);
   assert(bus != NULL);
-
-  sprintf(buf, "         ; TIMA=$%02X, TAC=$%02X, TMA=$%02X, ", bus->timer.tima, bus->timer.tac, bus->timer.tma);
-  strcat(current_disasm.disasm_result, buf);
-
-  if (current_disasm.post_op_flags == REG_UNUSED) {
-    /* No post instruction execution disassembly has to take place. We're
-     * done.
-     */
-    return current_disasm.disasm_result;
+  assert(buf != NULL);
+
+  out = buf;
+
+  /* The registers as they were before the instruction. */
+  out = put_str(out, "BC=");
+  out = put_hex16(out, ctx->reg.bc.value);
+  out = put_str(out, " DE=");
+  out = put_hex16(out, ctx->reg.de.value);
+  out = put_str(out, " HL=");
+  out = put_hex16(out, ctx->reg.hl.value);
+  out = put_str(out, " AF=");
+  out = put_hex16(out, ctx->reg.af.value);
+  out = put_str(out, " SP=");
+  out = put_hex16(out, ctx->reg.sp.value);
+  out = put_str(out, " PC=");
+  out = put_hex16(out, ctx->pc);
+
+  *out++ = ' ';
+  *out++ = ' ';
+  out = put_instruction(out, ctx->pc, ctx->bytes);
+
+  out = put_str(out, "   TIMA=");
+  out = put_hex8(out, libyagbe_timer_peek_tima(&bus->timer));
+  out = put_str(out, " TMA=");
+  out = put_hex8(out, bus->timer.tma);
+  out = put_str(out, " TAC=");
+  out = put_hex8(out, bus->timer.tac);
+
+  /* Then whatever the instruction changed, as it is now. */
+  flags = lookup(ctx->bytes)->flags;
+  separator = " ; ";
+
+  if (flags & REG_B) {
+    out = put_reg(put_str(out, separator), "B", reg->bc.byte.hi, false);
+    separator = ", ";
   }
 
-  for (bit_counter = 0; bit_counter != 15; ++bit_counter) {
-    const int counter = (1 << bit_counter);
-    char buf[256];
+  if (flags & REG_C) {
+    out = put_reg(put_str(out, separator), "C", reg->bc.byte.lo, false);
+    separator = ", ";
+  }
 
-    if (counter & current_disasm.post_op_flags) {
-      switch (counter) {
-        case REG_B:
-          sprintf(buf, "B=$%02X", cpu->reg.bc.byte.hi);
-          break;
+  if (flags & REG_D) {
+    out = put_reg(put_str(out, separator), "D", reg->de.byte.hi, false);
+    separator = ", ";
+  }
 
-        case REG_C:
-          sprintf(buf, "C=$%02X", cpu->reg.bc.byte.lo);
-          break;
+  if (flags & REG_E) {
+    out = put_reg(put_str(out, separator), "E", reg->de.byte.lo, false);
+    separator = ", ";
+  }
 
-        case REG_D:
-          sprintf(buf, "D=$%02X", cpu->reg.de.byte.hi);
-          break;
+  if (flags & REG_F) {
+    out = put_reg(put_str(out, separator), "F", reg->af.byte.lo, false);
+    separator = ", ";
+  }
 
-        case REG_E:
-          sprintf(buf, "E=$%02X", cpu->reg.de.byte.lo);
-          break;
+  if (flags & REG_H) {
+    out = put_reg(put_str(out, separator), "H", reg->hl.byte.hi, false);
+    separator = ", ";
+  }
 
-        case REG_F:
-          sprintf(buf, "F=$%02X", cpu->reg.af.byte.lo);
-          break;
+  if (flags & REG_L) {
+    out = put_reg(put_str(out, separator), "L", reg->hl.byte.lo, false);
+    separator = ", ";
+  }
 
-        case REG_H:
-          sprintf(buf, "H=$%02X", cpu->reg.hl.byte.hi);
-          break;
+  if (flags & REG_A) {
+    out = put_reg(put_str(out, separator), "A", reg->af.byte.hi, false);
+    separator = ", ";
+  }
 
-        case REG_L:
-          sprintf(buf, "L=$%02X", cpu->reg.hl.byte.lo);
-          break;
+  if (flags & REG_BC) {
+    out = put_reg(put_str(out, separator), "BC", reg->bc.value, true);
+    separator = ", ";
+  }
 
-        case REG_A:
-          sprintf(buf, "A=$%02X", cpu->reg.af.byte.hi);
-          break;
+  if (flags & REG_DE) {
+    out = put_reg(put_str(out, separator), "DE", reg->de.value, true);
+    separator = ", ";
+  }
 
-        case REG_BC:
-          sprintf(buf, "BC=$%04X", cpu->reg.bc.value);
-          break;
+  if (flags & REG_HL) {
+    out = put_reg(put_str(out, separator), "HL", reg->hl.value, true);
+    separator = ", ";
+  }
 
-        case REG_DE:
-          sprintf(buf, "DE=$%04X", cpu->reg.de.value);
-          break;
+  if (flags & REG_AF) {
+    out = put_reg(put_str(out, separator), "AF", reg->af.value, true);
+    separator = ", ";
+  }
 
-        case REG_HL:
-          sprintf(buf, "HL=$%04X", cpu->reg.hl.value);
-          break;
+  if (flags & REG_SP) {
+    out = put_reg(put_str(out, separator), "SP", reg->sp.value, true);
+    separator = ", ";
+  }
 
-        case REG_AF:
-          sprintf(buf, "AF=$%04X", cpu->reg.af.value);
-          break;
+  if (flags & REG_HL_MEM) {
+    out = put_reg(put_str(out, separator), "[HL]",
+                  libyagbe_bus_inspect_memory(bus, reg->hl.value), false);
+    separator = ", ";
+  }
 
-        case REG_SP:
-          sprintf(buf, "SP=$%04X", cpu->reg.sp);
-          break;
+  if (flags & REG_MEM_IMM16) {
+    const uint16_t address =
+        (uint16_t)((ctx->bytes[2] << 8) | ctx->bytes[1]);
 
-        case REG_MEM_IMM16: {
-          const uint16_t npc = cpu->reg.pc - 2;
+    out = put_str(out, separator);
+    *out++ = '[';
+    *out++ = '$';
+    out = put_hex16(out, address);
+    *out++ = ']';
+    out = put_reg(out, "", libyagbe_bus_inspect_memory(bus, address), false);
+  }
 
-          const uint8_t lo = inspect_memory(bus, npc);
-          const uint8_t hi = inspect_memory(bus, npc + 1);
+  *out = '\0';
+  return (size_t)(out - buf);
+}
 
-          const uint16_t address = (uint16_t)((hi << 8) | lo);
-          const uint8_t data = inspect_memory(bus, address);
+void libyagbe_disasm_prepare(const uint16_t pc, struct libyagbe_cpu* const cpu,
+                             struct libyagbe_bus* const bus) {
+  libyagbe_disasm_prepare_r(&legacy.ctx, pc, cpu, bus);
+}
 
-          sprintf(buf, "[$%04X]=$%02X", address, data);
-          break;
-        }
-      }
-      strcat(current_disasm.disasm_result, buf);
-      strcat(current_disasm.disasm_result, ", ");
-    }
-  }
-  return current_disasm.disasm_result;
+char* libyagbe_disasm_execute(struct libyagbe_cpu* const cpu,
+                              struct libyagbe_bus* const bus) {
+  libyagbe_disasm_execute_r(&legacy.ctx, cpu, bus, legacy.line);
+  return legacy.line;
 }
-#endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/gb.h"
+
+/* Points every chunk of a memory area of the child at the parent's copy, which
+ * may itself be shared with the parent's parent. */
+static void share_memory(const struct libyagbe_bus* const parent,
+                         const uint8_t* const parent_memory,
+                         const uint8_t** const chunks,
+                         const size_t num_chunks,
+                         struct libyagbe_bus* const child) {
+  size_t i;
+
+  for (i = 0; i < num_chunks; ++i) {
+    chunks[i] = libyagbe_bus_get_memory(
+        parent, &parent_memory[i << LIBYAGBE_BUS_PAGE_SHIFT]);
+  }
+  child->shared.num_shared += num_chunks;
+}
+
+void libyagbe_system_fork(struct libyagbe_system* const child,
+                          const struct libyagbe_system* const parent) {
+  const struct libyagbe_bus* const from = &parent->bus;
+  struct libyagbe_bus* const to = &child->bus;
+  size_t i;
+
+  assert(child != NULL);
+  assert(parent != NULL);
+  assert(child != parent);
+
+  child->cpu = parent->cpu;
+  child->cpu.code_cache = NULL;
+  child->jit = NULL;
+  child->sched = parent->sched;
+  child->loop_cache = parent->loop_cache;
+
+  /* Everything up to the RAM, which is last and is shared instead. */
+  memcpy(&to->cart, &from->cart, offsetof(struct libyagbe_cart, ram));
+
+  /* Everything up to the decoded tiles, which are rebuilt as needed. VRAM is
+   * copied rather than shared, since the PPU reads it directly. */
+  memcpy(&to->ppu, &from->ppu, offsetof(struct libyagbe_ppu, tiles));
+
+  for (i = 0; i < LIBYAGBE_PPU_NUM_TILES; ++i) {
+    to->ppu.tile_dirty[i] = true;
+  }
+
+  /* Everything up to the output buffers, which the child has no use for
+   * unless it's given an output of its own, and that starts them afresh. */
+  memcpy(&to->apu, &from->apu, offsetof(struct libyagbe_apu, deltas));
+  to->apu.dropped = 0;
+
+  to->timer = from->timer;
+  to->joypad = from->joypad;
+  to->dma = from->dma;
+  to->irq = from->irq;
+  memcpy(to->hram, from->hram, sizeof(to->hram));
+
+  to->serial_cb = NULL;
+  to->serial_userdata = NULL;
+  to->diag.cb = NULL;
+  to->diag.userdata = NULL;
+  libyagbe_diag_reset(&to->diag);
+  to->profile = NULL;
+
+  /* Point the handlers and components at the child instead of the parent. */
+  libyagbe_bus_init(to, &child->sched);
+  libyagbe_timer_init(&to->timer, &child->sched, &to->irq);
+  libyagbe_joypad_init(&to->joypad, &to->irq);
+  libyagbe_ppu_init(&to->ppu, &child->sched, &to->irq);
+  libyagbe_apu_init(&to->apu, &child->sched);
+  to->ppu.render = from->ppu.render;
+
+  to->shared.num_shared = 0;
+  share_memory(from, from->wram, to->shared.wram,
+               LIBYAGBE_BUS_MEM_SIZE_WRAM / LIBYAGBE_BUS_PAGE_SIZE, to);
+  share_memory(from, from->cart.ram, to->shared.cart_ram,
+               (from->cart.num_ram_banks * LIBYAGBE_CART_MEM_SIZE_RAM_BANK) /
+                   LIBYAGBE_BUS_PAGE_SIZE,
+               to);
+
+  libyagbe_bus_reset(to);
+}
@@ -21,28 +21,250 @@
 #include <assert.h>
 #include <stddef.h>
 
+#include "libyagbe/compat/compat_stdbool.h"
 #include "libyagbe/sched.h"
+#include "idle.h"
 
-void libyagbe_system_init(struct libyagbe_system* const gb,
-                          const uint8_t* const cart_data) {
+bool libyagbe_system_init(struct libyagbe_system* const gb,
+                          const uint8_t* const cart_data,
+                          const size_t cart_size) {
   assert(gb != NULL);
 
-  gb->bus.cart.data = cart_data;
-  libyagbe_timer_set_interrupt_flag(&gb->bus.interrupt_flag);
+  if (!libyagbe_cart_init(&gb->bus.cart, cart_data, cart_size)) {
+    return false;
+  }
+  libyagbe_bus_init(&gb->bus, &gb->sched);
+  gb->bus.serial_cb = NULL;
+  gb->bus.serial_userdata = NULL;
+  gb->bus.diag.cb = NULL;
+  gb->bus.diag.userdata = NULL;
+  gb->bus.profile = NULL;
+  gb->cpu.code_cache = NULL;
+  gb->jit = NULL;
+  gb->bus.shared.num_shared = 0;
+  gb->loop_cache.page = NULL;
+  libyagbe_timer_init(&gb->bus.timer, &gb->sched, &gb->bus.irq);
+  libyagbe_joypad_init(&gb->bus.joypad, &gb->bus.irq);
+  libyagbe_ppu_init(&gb->bus.ppu, &gb->sched, &gb->bus.irq);
+  libyagbe_apu_init(&gb->bus.apu, &gb->sched);
 
   libyagbe_system_reset(gb);
+  return true;
 }
 
 void libyagbe_system_reset(struct libyagbe_system* const gb) {
   assert(gb != NULL);
-  libyagbe_sched_reset();
+  libyagbe_sched_reset(&gb->sched);
+  libyagbe_ppu_reset(&gb->bus.ppu);
+  libyagbe_apu_reset(&gb->bus.apu);
   libyagbe_timer_reset(&gb->bus.timer);
+  libyagbe_irq_reset(&gb->bus.irq);
+  libyagbe_joypad_reset(&gb->bus.joypad);
+  libyagbe_cart_reset(&gb->bus.cart);
+
+  /* The boot ROM doesn't use OAM DMA. */
+  gb->bus.dma.source = 0xFF;
+  gb->bus.dma.active = false;
+  libyagbe_bus_reset(&gb->bus);
+  libyagbe_diag_reset(&gb->bus.diag);
   libyagbe_cpu_reset(&gb->cpu);
 }
 
+/* Determines whether the CPU is halted with nothing to wake it up before the
+ * scheduler next does something. */
+static bool cpu_is_idle(const struct libyagbe_system* const gb) {
+  return (gb->cpu.state == LIBYAGBE_CPU_STATE_HALTED) &&
+         (gb->bus.irq.pending == 0);
+}
+
+/* Jumps straight to the next event or the limit, whichever comes first, instead
+ * of letting an idle CPU tick one m-cycle at a time. The jump is rounded up to
+ * whole m-cycles so the CPU stays aligned to them. */
+static void skip_idle(struct libyagbe_system* const gb, const uintmax_t limit) {
+  const uintmax_t target =
+      (gb->sched.deadline < limit) ? gb->sched.deadline : limit;
+  uintmax_t cycles;
+
+  cycles = (target > gb->sched.current_timestamp)
+               ? target - gb->sched.current_timestamp
+               : 0;
+  cycles = (cycles + 3) & ~(uintmax_t)3;
+
+  libyagbe_sched_advance(&gb->sched, (cycles != 0) ? cycles : 4);
+}
+
+/* Runs an instruction, or a block of them with the JIT, and then
+ * fast-forwards through the loop the last one jumped back to the start of if
+ * that loop is only polling. */
+static void step_cpu(struct libyagbe_system* const gb, const uintmax_t limit) {
+  uint16_t pc = gb->cpu.reg.pc.value;
+
+  if (gb->jit != NULL) {
+    pc = libyagbe_jit_execute(gb->jit, &gb->cpu, &gb->bus, limit);
+  } else {
+    libyagbe_cpu_step(&gb->cpu, &gb->bus);
+  }
+
+  if ((uint16_t)(pc - gb->cpu.reg.pc.value) <= LIBYAGBE_IDLE_MAX_LOOP_SIZE) {
+    libyagbe_idle_skip_loop(gb, pc, limit);
+  }
+}
+
 unsigned int libyagbe_system_step(struct libyagbe_system* const gb) {
+  uintmax_t start;
+
   assert(gb != NULL);
-  libyagbe_cpu_step(&gb->cpu, &gb->bus);
+  start = gb->sched.current_timestamp;
+
+  if (cpu_is_idle(gb) && (gb->sched.deadline != LIBYAGBE_SCHED_NO_DEADLINE)) {
+    skip_idle(gb, gb->sched.deadline);
+  } else {
+    libyagbe_cpu_step(&gb->cpu, &gb->bus);
+  }
+  libyagbe_cpu_sync_flags(&gb->cpu);
 
-  return 1;
+  if (gb->cpu.state == LIBYAGBE_CPU_STATE_LOCKED) {
+    return 0;
+  }
+  return (unsigned int)(gb->sched.current_timestamp - start);
+}
+
+uintmax_t libyagbe_system_run(struct libyagbe_system* const gb,
+                              const uintmax_t cycles) {
+  uintmax_t start;
+  uintmax_t end;
+
+  assert(gb != NULL);
+
+  start = gb->sched.current_timestamp;
+  end = start + cycles;
+
+  while (gb->sched.current_timestamp < end) {
+    switch (gb->cpu.state) {
+      case LIBYAGBE_CPU_STATE_STOPPED:
+      case LIBYAGBE_CPU_STATE_LOCKED:
+        /* Nothing but the scheduler can make progress now, so there's no
+         * point in going through the CPU one m-cycle at a time. */
+        libyagbe_sched_advance(&gb->sched, end - gb->sched.current_timestamp);
+        libyagbe_cpu_sync_flags(&gb->cpu);
+
+        return gb->sched.current_timestamp - start;
+
+      case LIBYAGBE_CPU_STATE_HALTED:
+        if (cpu_is_idle(gb)) {
+          skip_idle(gb, end);
+          continue;
+        }
+        break;
+
+      case LIBYAGBE_CPU_STATE_RUNNING:
+      default:
+        break;
+    }
+    step_cpu(gb, end);
+  }
+  libyagbe_cpu_sync_flags(&gb->cpu);
+
+  return gb->sched.current_timestamp - start;
+}
+
+uintmax_t libyagbe_system_run_until_event(struct libyagbe_system* const gb) {
+  uintmax_t start;
+  uintmax_t deadline;
+
+  assert(gb != NULL);
+
+  start = gb->sched.current_timestamp;
+  deadline = gb->sched.deadline;
+
+  if (deadline == LIBYAGBE_SCHED_NO_DEADLINE) {
+    libyagbe_cpu_step(&gb->cpu, &gb->bus);
+    libyagbe_cpu_sync_flags(&gb->cpu);
+
+    return gb->sched.current_timestamp - start;
+  }
+
+  while (gb->sched.current_timestamp < deadline) {
+    if (cpu_is_idle(gb)) {
+      skip_idle(gb, deadline);
+    } else {
+      step_cpu(gb, deadline);
+    }
+  }
+  libyagbe_cpu_sync_flags(&gb->cpu);
+
+  return gb->sched.current_timestamp - start;
+}
+
+void libyagbe_system_set_buttons(struct libyagbe_system* const gb,
+                                 const uint8_t buttons) {
+  assert(gb != NULL);
+
+  if (libyagbe_joypad_set_buttons(&gb->bus.joypad, buttons) &&
+      (gb->cpu.state == LIBYAGBE_CPU_STATE_STOPPED)) {
+    gb->cpu.state = LIBYAGBE_CPU_STATE_RUNNING;
+  }
+}
+
+void libyagbe_system_set_serial_cb(struct libyagbe_system* const gb,
+                                   const libyagbe_bus_serial_cb cb,
+                                   void* const userdata) {
+  assert(gb != NULL);
+
+  gb->bus.serial_cb = cb;
+  gb->bus.serial_userdata = userdata;
+}
+
+void libyagbe_system_set_diag_cb(struct libyagbe_system* const gb,
+                                 const libyagbe_diag_cb cb,
+                                 void* const userdata) {
+  assert(gb != NULL);
+
+  gb->bus.diag.cb = cb;
+  gb->bus.diag.userdata = userdata;
+}
+
+void libyagbe_system_set_render(struct libyagbe_system* const gb,
+                                const bool render) {
+  assert(gb != NULL);
+  gb->bus.ppu.render = render;
+}
+
+void libyagbe_system_set_video_output(
+    struct libyagbe_system* const gb,
+    const enum libyagbe_ppu_pixel_format format, void* const buffer0,
+    void* const buffer1, const libyagbe_ppu_frame_cb cb, void* const userdata) {
+  assert(gb != NULL);
+  libyagbe_ppu_set_output(&gb->bus.ppu, format, buffer0, buffer1, cb,
+                          userdata);
+}
+
+void libyagbe_system_set_profile(struct libyagbe_system* const gb,
+                                 struct libyagbe_profile* const profile) {
+  assert(gb != NULL);
+  gb->bus.profile = profile;
+}
+
+void libyagbe_system_set_code_cache(struct libyagbe_system* const gb,
+                                    struct libyagbe_code_cache* const cache) {
+  assert(gb != NULL);
+  gb->cpu.code_cache = cache;
+}
+
+void libyagbe_system_set_jit(struct libyagbe_system* const gb,
+                             struct libyagbe_jit* const jit) {
+  assert(gb != NULL);
+  gb->jit = jit;
+}
+
+void libyagbe_system_set_audio_output(struct libyagbe_system* const gb,
+                                      struct libyagbe_apu_ring* const ring,
+                                      const unsigned long sample_rate) {
+  assert(gb != NULL);
+  libyagbe_apu_set_output(&gb->bus.apu, ring, sample_rate);
+}
+
+void libyagbe_system_flush_audio(struct libyagbe_system* const gb) {
+  assert(gb != NULL);
+  libyagbe_apu_sync(&gb->bus.apu);
 }
@@ -0,0 +1,322 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "idle.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+
+/* The most instructions one turn of a polling loop can take. */
+enum { MAX_LOOP_INSTRUCTIONS = 8 };
+
+enum loop_kind {
+  /* The loop may be a polling loop. */
+  LOOP_POLLING,
+
+  /* The loop can never be a polling loop. */
+  LOOP_NEVER,
+
+  /* The loop reads something which can change between events, but it might
+   * not next time around. */
+  LOOP_NOT_NOW
+};
+
+static const uint8_t* get_page(const struct libyagbe_system* const gb,
+                               const uint16_t address) {
+  return gb->bus.read_map[address >> LIBYAGBE_BUS_PAGE_SHIFT];
+}
+
+static bool fetch(const struct libyagbe_system* const gb,
+                  const uint16_t address, uint8_t* const data) {
+  const uint8_t* const page = get_page(gb, address);
+
+  if (page == NULL) {
+    return false;
+  }
+  *data = page[address & LIBYAGBE_BUS_PAGE_MASK];
+  return true;
+}
+
+/* Determines whether reading an address has no side effects, and gives the
+ * same value until the next scheduled event. */
+static bool is_stable(const uint16_t address) {
+  /* Cartridge RAM might be a real-time clock, which isn't. */
+  if ((address >= 0xA000) && (address < 0xC000)) {
+    return false;
+  }
+
+  /* ROM, VRAM, WRAM, its echo, and OAM. */
+  if (address < 0xFEA0) {
+    return true;
+  }
+
+  /* HRAM and IE. */
+  if (address >= 0xFF80) {
+    return true;
+  }
+
+  /* IF and the PPU registers. */
+  return (address == 0xFF0F) || ((address >= 0xFF40) && (address <= 0xFF4B));
+}
+
+/* Determines the length of an instruction which only changes A and F and
+ * only reads stable memory, or returns 0 if it does anything else. */
+static unsigned int check_instruction(const struct libyagbe_system* const gb,
+                                      const uint16_t address,
+                                      enum loop_kind* const kind) {
+  const struct libyagbe_cpu_registers* const reg = &gb->cpu.reg;
+  uint8_t op;
+  uint8_t imm[2];
+  uint16_t source;
+
+  *kind = LOOP_NEVER;
+
+  if (!fetch(gb, address, &op)) {
+    return 0;
+  }
+
+  switch (op) {
+    case 0x00: /* NOP */
+    case 0x07: /* RLCA */
+    case 0x0F: /* RRCA */
+    case 0x17: /* RLA */
+    case 0x1F: /* RRA */
+    case 0x2F: /* CPL */
+    case 0x37: /* SCF */
+    case 0x3F: /* CCF */
+      *kind = LOOP_POLLING;
+      return 1;
+
+    case 0xC6: /* ADD A, n */
+    case 0xCE: /* ADC A, n */
+    case 0xD6: /* SUB n */
+    case 0xDE: /* SBC A, n */
+    case 0xE6: /* AND n */
+    case 0xEE: /* XOR n */
+    case 0xF6: /* OR n */
+    case 0xFE: /* CP n */
+    case 0x18: /* JR e */
+    case 0x20: /* JR NZ, e */
+    case 0x28: /* JR Z, e */
+    case 0x30: /* JR NC, e */
+    case 0x38: /* JR C, e */
+      *kind = LOOP_POLLING;
+      return 2;
+
+    case 0xC2: /* JP NZ, nn */
+    case 0xC3: /* JP nn */
+    case 0xCA: /* JP Z, nn */
+    case 0xD2: /* JP NC, nn */
+    case 0xDA: /* JP C, nn */
+      *kind = LOOP_POLLING;
+      return 3;
+
+    case 0x0A: /* LD A, (BC) */
+      source = reg->bc.value;
+      break;
+
+    case 0x1A: /* LD A, (DE) */
+      source = reg->de.value;
+      break;
+
+    case 0xF2: /* LD A, (C) */
+      source = (uint16_t)(0xFF00 | reg->bc.byte.lo);
+      break;
+
+    case 0xF0: /* LDH A, (n) */
+      if (!fetch(gb, (uint16_t)(address + 1), &imm[0])) {
+        return 0;
+      }
+      *kind = is_stable((uint16_t)(0xFF00 | imm[0])) ? LOOP_POLLING
+                                                     : LOOP_NEVER;
+      return 2;
+
+    case 0xFA: /* LD A, (nn) */
+      if (!fetch(gb, (uint16_t)(address + 1), &imm[0]) ||
+          !fetch(gb, (uint16_t)(address + 2), &imm[1])) {
+        return 0;
+      }
+      *kind = is_stable((uint16_t)(imm[0] | (imm[1] << 8))) ? LOOP_POLLING
+                                                            : LOOP_NEVER;
+      return 3;
+
+    case 0xCB:
+      if (!fetch(gb, (uint16_t)(address + 1), &imm[0])) {
+        return 0;
+      }
+
+      /* BIT on anything, or anything on A. */
+      if ((imm[0] & 0x07) == 0x06) {
+        if ((imm[0] < 0x40) || (imm[0] >= 0x80)) {
+          return 0;
+        }
+        source = reg->hl.value;
+        *kind = is_stable(source) ? LOOP_POLLING : LOOP_NOT_NOW;
+
+        return 2;
+      }
+
+      if (((imm[0] & 0x07) == 0x07) || ((imm[0] >= 0x40) && (imm[0] < 0x80))) {
+        *kind = LOOP_POLLING;
+        return 2;
+      }
+      return 0;
+
+    default:
+      /* LD A, r and the ALU operations on A and r. */
+      if ((op < 0x78) || (op >= 0xC0)) {
+        return 0;
+      }
+
+      if ((op & 0x07) != 0x06) {
+        *kind = LOOP_POLLING;
+        return 1;
+      }
+      source = reg->hl.value;
+      break;
+  }
+
+  /* Only the loads through a register pair make it this far. */
+  *kind = is_stable(source) ? LOOP_POLLING : LOOP_NOT_NOW;
+  return 1;
+}
+
+/* Determines whether every instruction from the start of a loop up to and
+ * including the jump back could belong to a polling loop, and sets a bit in
+ * starts for the offset from the head of each of them. */
+static enum loop_kind check_loop(const struct libyagbe_system* const gb,
+                                 const uint16_t head, const uint16_t branch,
+                                 unsigned long* const starts) {
+  const unsigned int size = (uint16_t)(branch - head);
+  unsigned int offset = 0;
+  enum loop_kind result = LOOP_POLLING;
+
+  assert(size <= LIBYAGBE_IDLE_MAX_LOOP_SIZE);
+  *starts = 0;
+
+  while (offset <= size) {
+    enum loop_kind kind;
+    const unsigned int length =
+        check_instruction(gb, (uint16_t)(head + offset), &kind);
+
+    if ((length == 0) || (kind == LOOP_NEVER)) {
+      return LOOP_NEVER;
+    }
+
+    if (kind == LOOP_NOT_NOW) {
+      result = LOOP_NOT_NOW;
+    }
+
+    /* The jump back has to be an instruction of its own. */
+    if ((offset < size) && ((offset + length) > size)) {
+      return LOOP_NEVER;
+    }
+    *starts |= 1UL << offset;
+    offset += length;
+  }
+  return result;
+}
+
+void libyagbe_idle_skip_loop(struct libyagbe_system* const gb,
+                             const uint16_t branch, const uintmax_t limit) {
+  struct libyagbe_system_loop_cache* const cache = &gb->loop_cache;
+  const uint16_t head = gb->cpu.reg.pc.value;
+  const uint8_t* const page = get_page(gb, head);
+  struct libyagbe_cpu before;
+  unsigned long starts;
+  uintmax_t start;
+  uintmax_t deadline;
+  uintmax_t end;
+  unsigned int i;
+
+  assert(gb != NULL);
+
+  if ((page == cache->page) && (head == cache->head) &&
+      (branch == cache->branch)) {
+    return;
+  }
+
+  switch (check_loop(gb, head, branch, &starts)) {
+    case LOOP_NEVER:
+      cache->page = page;
+      cache->head = head;
+      cache->branch = branch;
+
+      return;
+
+    case LOOP_NOT_NOW:
+      return;
+
+    case LOOP_POLLING:
+    default:
+      break;
+  }
+
+  /* Run one turn for real, and see whether it changed anything. Nothing may
+   * be pending in F beforehand, or the first turn never looks the same as the
+   * rest. */
+  libyagbe_cpu_sync_flags(&gb->cpu);
+  memcpy(&before, &gb->cpu, sizeof(before));
+  start = gb->sched.current_timestamp;
+  deadline = gb->sched.deadline;
+
+  for (i = 0; i < MAX_LOOP_INSTRUCTIONS; ++i) {
+    unsigned int offset;
+
+    if (gb->sched.current_timestamp >= limit) {
+      return;
+    }
+    libyagbe_cpu_step(&gb->cpu, &gb->bus);
+
+    if (gb->cpu.reg.pc.value == head) {
+      break;
+    }
+
+    /* A branch in the middle may have been taken this time, out of the loop
+     * or into the middle of an instruction. Whatever runs there wasn't
+     * checked, so it can't be skipped. */
+    offset = (uint16_t)(gb->cpu.reg.pc.value - head);
+
+    if ((offset > LIBYAGBE_IDLE_MAX_LOOP_SIZE) ||
+        !(starts & (1UL << offset))) {
+      return;
+    }
+  }
+
+  /* If an event was handled, what the loop reads may have changed. */
+  if ((gb->cpu.reg.pc.value != head) ||
+      (gb->sched.current_timestamp >= deadline) ||
+      (memcmp(&before, &gb->cpu, sizeof(before)) != 0)) {
+    return;
+  }
+
+  /* Skip every whole turn which would end before the next event, and before
+   * the caller stops. */
+  end = (deadline - 1 < limit) ? deadline - 1 : limit;
+
+  if (end > gb->sched.current_timestamp) {
+    const uintmax_t period = gb->sched.current_timestamp - start;
+    const uintmax_t turns = (end - gb->sched.current_timestamp) / period;
+
+    libyagbe_sched_advance(&gb->sched, turns * period);
+  }
+}
@@ -0,0 +1,53 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_IDLE_H
+#define LIBYAGBE_IDLE_H
+
+#include "libyagbe/compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libyagbe_system;
+
+/** The furthest back a jump can go and still close a polling loop. */
+#define LIBYAGBE_IDLE_MAX_LOOP_SIZE 16
+
+/** Fast-forwards through a polling loop the CPU just jumped back to the start
+ * of, if that's what it is.
+ *
+ * A polling loop only reads memory which nothing but scheduled events can
+ * change, and only changes A and F. Once one turn of it leaves the CPU
+ * exactly as it was, every turn until the next event will too, so those
+ * turns can be skipped. Anything else is left to run normally.
+ *
+ * @param gb The YAGBE instance.
+ * @param branch Where the jump which was just taken is.
+ * @param limit The time the caller will stop running at. Nothing runs past
+ * it.
+ */
+void libyagbe_idle_skip_loop(struct libyagbe_system* const gb,
+                             const uint16_t branch, const uintmax_t limit);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_IDLE_H */
@@ -0,0 +1,73 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/irq.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+static void update_pending(struct libyagbe_irq* const irq) {
+  irq->pending = irq->flag & irq->enable & LIBYAGBE_IRQ_ALL;
+}
+
+void libyagbe_irq_reset(struct libyagbe_irq* const irq) {
+  assert(irq != NULL);
+
+  /* The boot ROM leaves a V-Blank request behind. */
+  irq->flag = LIBYAGBE_IRQ_VBLANK;
+  irq->enable = 0x00;
+
+  update_pending(irq);
+}
+
+void libyagbe_irq_request(struct libyagbe_irq* const irq,
+                          const uint8_t sources) {
+  assert(irq != NULL);
+
+  irq->flag |= sources;
+  update_pending(irq);
+}
+
+void libyagbe_irq_acknowledge(struct libyagbe_irq* const irq,
+                              const uint8_t sources) {
+  assert(irq != NULL);
+
+  irq->flag &= ~sources;
+  update_pending(irq);
+}
+
+uint8_t libyagbe_irq_read_flag(const struct libyagbe_irq* const irq) {
+  assert(irq != NULL);
+  return irq->flag | (uint8_t)~LIBYAGBE_IRQ_ALL;
+}
+
+void libyagbe_irq_write_flag(struct libyagbe_irq* const irq,
+                             const uint8_t data) {
+  assert(irq != NULL);
+
+  irq->flag = data & LIBYAGBE_IRQ_ALL;
+  update_pending(irq);
+}
+
+void libyagbe_irq_write_enable(struct libyagbe_irq* const irq,
+                               const uint8_t data) {
+  assert(irq != NULL);
+
+  irq->enable = data;
+  update_pending(irq);
+}
@@ -0,0 +1,661 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Blocks are compiled down to calls to the same handlers the cached
+ * interpreter dispatches to, so they can't do anything it wouldn't. What's
+ * saved is the decoding, the dispatch, and the checks around each
+ * instruction, which are reduced to the few that can actually fail partway
+ * through a block. Instructions which only move data between registers are
+ * compiled to host code themselves. */
+
+#include "libyagbe/jit.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/bus.h"
+#include "libyagbe/cart.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/cpu.h"
+#include "libyagbe/sched.h"
+#include "cached.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X86_64
+#endif /* defined(__x86_64__) && !defined(_WIN32) */
+
+/* The most instructions compiled into one block. */
+enum { MAX_BLOCK_INSTRUCTIONS = 32 };
+
+/* The most host code a single instruction compiles to, checks included, and
+ * the most the entry and exit of a block add. */
+enum { MAX_INSTRUCTION_CODE = 192, MAX_BLOCK_CODE = 128 };
+
+typedef uint16_t (*block_func)(struct libyagbe_cpu* const cpu,
+                               struct libyagbe_bus* const bus,
+                               const uintmax_t limit);
+
+/* Determines whether an instruction can leave PC anywhere but after it. */
+static bool ends_block(const struct libyagbe_code_cache_entry* const e) {
+  switch (e->handler) {
+    case CACHED_JR:
+    case CACHED_JP:
+    case CACHED_CALL:
+    case CACHED_RET_IF:
+    case CACHED_RET:
+    case CACHED_RST:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static bool accesses_io(const struct libyagbe_code_cache_entry* const e) {
+  return ((e->handler == CACHED_LD_A_MEM_IMM16) ||
+          (e->handler == CACHED_LD_MEM_IMM16_A)) &&
+         (e->imm >= 0xFF00);
+}
+
+#ifdef JIT_X86_64
+
+enum host_reg {
+  RAX = 0,
+  RCX = 1,
+  RDX = 2,
+  RBX = 3,
+  RSI = 6,
+  RDI = 7,
+  R12 = 12,
+  R13 = 13,
+  R14 = 14,
+  R15 = 15
+};
+
+/* The registers the generated code keeps its state in, which called
+ * functions preserve. */
+enum {
+  REG_CPU = RBX,
+  REG_BUS = R12,
+  REG_LIMIT = R13,
+  REG_SCHED = R14,
+  REG_LAST_PC = R15
+};
+
+enum condition_code { CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5 };
+
+struct emitter {
+  uint8_t* out;
+};
+
+static void emit8(struct emitter* const em, const unsigned int value) {
+  *em->out++ = (uint8_t)value;
+}
+
+static void emit16(struct emitter* const em, const unsigned int value) {
+  emit8(em, value & 0xFF);
+  emit8(em, (value >> 8) & 0xFF);
+}
+
+static void emit32(struct emitter* const em, const unsigned long value) {
+  emit16(em, (unsigned int)(value & 0xFFFF));
+  emit16(em, (unsigned int)((value >> 16) & 0xFFFF));
+}
+
+/* Host pointers are emitted as they're stored, which is how x86-64 reads
+ * them. */
+static void emit_bytes(struct emitter* const em, const void* const data,
+                       const size_t size) {
+  memcpy(em->out, data, size);
+  em->out += size;
+}
+
+static void emit_rex(struct emitter* const em, const bool wide,
+                     const unsigned int reg, const unsigned int base) {
+  const unsigned int rex =
+      0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2) | (base >> 3);
+
+  if (rex != 0x40) {
+    emit8(em, rex);
+  }
+}
+
+/* Addresses [base + disp32]. */
+static void emit_mem(struct emitter* const em, const unsigned int reg,
+                     const unsigned int base, const size_t disp) {
+  emit8(em, 0x80 | ((reg & 7) << 3) | (base & 7));
+
+  if ((base & 7) == 4) {
+    emit8(em, 0x24);
+  }
+  emit32(em, (unsigned long)disp);
+}
+
+static void emit_modrm_reg(struct emitter* const em, const unsigned int reg,
+                           const unsigned int rm) {
+  emit8(em, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void emit_push(struct emitter* const em, const unsigned int reg) {
+  emit_rex(em, false, 0, reg);
+  emit8(em, 0x50 + (reg & 7));
+}
+
+static void emit_pop(struct emitter* const em, const unsigned int reg) {
+  emit_rex(em, false, 0, reg);
+  emit8(em, 0x58 + (reg & 7));
+}
+
+/* mov dst, src */
+static void emit_mov_reg(struct emitter* const em, const unsigned int dst,
+                         const unsigned int src) {
+  emit_rex(em, true, src, dst);
+  emit8(em, 0x89);
+  emit_modrm_reg(em, src, dst);
+}
+
+/* mov dst, [base + disp] */
+static void emit_load(struct emitter* const em, const unsigned int dst,
+                      const unsigned int base, const size_t disp) {
+  emit_rex(em, true, dst, base);
+  emit8(em, 0x8B);
+  emit_mem(em, dst, base, disp);
+}
+
+/* mov [base + disp], src */
+static void emit_store(struct emitter* const em, const unsigned int base,
+                       const size_t disp, const unsigned int src) {
+  emit_rex(em, true, src, base);
+  emit8(em, 0x89);
+  emit_mem(em, src, base, disp);
+}
+
+/* cmp a, b */
+static void emit_cmp_reg(struct emitter* const em, const unsigned int a,
+                         const unsigned int b) {
+  emit_rex(em, true, b, a);
+  emit8(em, 0x39);
+  emit_modrm_reg(em, b, a);
+}
+
+/* cmp reg, [base + disp] */
+static void emit_cmp_load(struct emitter* const em, const unsigned int reg,
+                          const unsigned int base, const size_t disp) {
+  emit_rex(em, true, reg, base);
+  emit8(em, 0x3B);
+  emit_mem(em, reg, base, disp);
+}
+
+/* add reg, imm32 */
+static void emit_add_imm(struct emitter* const em, const unsigned int reg,
+                         const unsigned long imm) {
+  emit_rex(em, true, 0, reg);
+  emit8(em, 0x81);
+  emit_modrm_reg(em, 0, reg);
+  emit32(em, imm);
+}
+
+/* mov reg32, imm32, which clears the upper half of reg. */
+static void emit_mov_imm32(struct emitter* const em, const unsigned int reg,
+                           const unsigned long imm) {
+  emit_rex(em, false, 0, reg);
+  emit8(em, 0xB8 + (reg & 7));
+  emit32(em, imm);
+}
+
+/* mov reg, imm64, where the immediate is a host pointer of `size` bytes. */
+static void emit_mov_ptr(struct emitter* const em, const unsigned int reg,
+                         const void* const ptr, const size_t size) {
+  emit_rex(em, true, 0, reg);
+  emit8(em, 0xB8 + (reg & 7));
+  emit_bytes(em, ptr, size);
+}
+
+/* call reg */
+static void emit_call(struct emitter* const em, const unsigned int reg) {
+  emit_rex(em, false, 0, reg);
+  emit8(em, 0xFF);
+  emit_modrm_reg(em, 2, reg);
+}
+
+/* Emits a jump whose target is patched in later, and returns where. */
+static uint8_t* emit_jcc(struct emitter* const em,
+                         const enum condition_code cc) {
+  emit8(em, 0x0F);
+  emit8(em, 0x80 | cc);
+  emit32(em, 0);
+
+  return em->out - 4;
+}
+
+static uint8_t* emit_jmp(struct emitter* const em) {
+  emit8(em, 0xE9);
+  emit32(em, 0);
+
+  return em->out - 4;
+}
+
+static void patch_jump(uint8_t* const rel, const uint8_t* const target) {
+  const long offset = (long)(target - (rel + 4));
+  struct emitter em;
+
+  em.out = rel;
+  emit32(&em, (unsigned long)offset & 0xFFFFFFFFUL);
+}
+
+/* mov byte [base + disp], imm8 */
+static void emit_store8_imm(struct emitter* const em, const unsigned int base,
+                            const size_t disp, const unsigned int imm) {
+  emit_rex(em, false, 0, base);
+  emit8(em, 0xC6);
+  emit_mem(em, 0, base, disp);
+  emit8(em, imm);
+}
+
+/* mov word [base + disp], imm16 */
+static void emit_store16_imm(struct emitter* const em,
+                             const unsigned int base, const size_t disp,
+                             const unsigned int imm) {
+  emit8(em, 0x66);
+  emit_rex(em, false, 0, base);
+  emit8(em, 0xC7);
+  emit_mem(em, 0, base, disp);
+  emit16(em, imm);
+}
+
+/* add word [base + disp], imm16 */
+static void emit_add16_imm(struct emitter* const em, const unsigned int base,
+                           const size_t disp, const unsigned int imm) {
+  emit8(em, 0x66);
+  emit_rex(em, false, 0, base);
+  emit8(em, 0x81);
+  emit_mem(em, 0, base, disp);
+  emit16(em, imm);
+}
+
+/* movzx eax, byte [base + disp] and mov byte [base + disp], al */
+static void emit_load8(struct emitter* const em, const unsigned int base,
+                       const size_t disp) {
+  emit_rex(em, false, RAX, base);
+  emit8(em, 0x0F);
+  emit8(em, 0xB6);
+  emit_mem(em, RAX, base, disp);
+}
+
+static void emit_store8(struct emitter* const em, const unsigned int base,
+                        const size_t disp) {
+  emit_rex(em, false, RAX, base);
+  emit8(em, 0x88);
+  emit_mem(em, RAX, base, disp);
+}
+
+/* cmp byte [base + disp], 0 */
+static void emit_test8(struct emitter* const em, const unsigned int base,
+                       const size_t disp) {
+  emit_rex(em, false, 0, base);
+  emit8(em, 0x80);
+  emit_mem(em, 7, base, disp);
+  emit8(em, 0);
+}
+
+/* Booleans are either a byte or an int, depending on the language standard
+ * the core was built with. */
+static void emit_test_bool(struct emitter* const em, const unsigned int base,
+                           const size_t disp) {
+  if (sizeof(bool) == 1) {
+    emit_test8(em, base, disp);
+    return;
+  }
+  emit_rex(em, false, 0, base);
+  emit8(em, 0x83);
+  emit_mem(em, 7, base, disp);
+  emit8(em, 0);
+}
+
+static void emit_clear_bool(struct emitter* const em, const unsigned int base,
+                            const size_t disp) {
+  if (sizeof(bool) == 1) {
+    emit_store8_imm(em, base, disp, 0);
+    return;
+  }
+  emit_rex(em, false, 0, base);
+  emit8(em, 0xC7);
+  emit_mem(em, 0, base, disp);
+  emit32(em, 0);
+}
+
+/* Advances the scheduler, only calling into it if an event is due. */
+static void emit_advance(struct emitter* const em,
+                         const unsigned int cycles) {
+  void (*const advance)(struct libyagbe_sched* const, const uintmax_t) =
+      &libyagbe_sched_advance;
+  uint8_t* slow;
+  uint8_t* done;
+
+  emit_load(em, RAX, REG_SCHED,
+            offsetof(struct libyagbe_sched, current_timestamp));
+  emit_add_imm(em, RAX, cycles);
+  emit_cmp_load(em, RAX, REG_SCHED, offsetof(struct libyagbe_sched, deadline));
+  slow = emit_jcc(em, CC_AE);
+
+  emit_store(em, REG_SCHED,
+             offsetof(struct libyagbe_sched, current_timestamp), RAX);
+  done = emit_jmp(em);
+
+  patch_jump(slow, em->out);
+  emit_mov_reg(em, RDI, REG_SCHED);
+  emit_mov_imm32(em, RSI, cycles);
+  emit_mov_ptr(em, RAX, &advance, sizeof(advance));
+  emit_call(em, RAX);
+
+  patch_jump(done, em->out);
+}
+
+/* Emits what the interpreter checks between instructions which can change
+ * partway through a block, each of which exits the block. */
+static void emit_checks(struct emitter* const em, uint8_t** const exits,
+                        const uint16_t address, const uint8_t* const page) {
+  uint8_t* no_irq;
+
+  /* The caller's time has run out. */
+  emit_load(em, RAX, REG_SCHED,
+            offsetof(struct libyagbe_sched, current_timestamp));
+  emit_cmp_reg(em, RAX, REG_LIMIT);
+  exits[0] = emit_jcc(em, CC_AE);
+
+  /* An interrupt is about to be dispatched. */
+  emit_test8(em, REG_BUS, offsetof(struct libyagbe_bus, irq.pending));
+  no_irq = emit_jcc(em, CC_E);
+  emit_test_bool(em, REG_CPU, offsetof(struct libyagbe_cpu, ime));
+  exits[1] = emit_jcc(em, CC_NE);
+  patch_jump(no_irq, em->out);
+
+  /* A write switched ROM banks. */
+  emit_load(em, RAX, REG_BUS,
+            offsetof(struct libyagbe_bus, read_map) +
+                ((address >> LIBYAGBE_BUS_PAGE_SHIFT) * sizeof(page)));
+  emit_mov_ptr(em, RCX, &page, sizeof(page));
+  emit_cmp_reg(em, RAX, RCX);
+  exits[2] = emit_jcc(em, CC_NE);
+}
+
+/* Emits an instruction, doing what dispatch_cached() does first. */
+static void emit_instruction(struct emitter* const em,
+                             const struct libyagbe_code_cache_entry* const e,
+                             const uint16_t address) {
+  const cached_handler_func handler =
+      libyagbe_cpu_get_cached_handler(e->handler);
+
+  emit_clear_bool(em, REG_CPU, offsetof(struct libyagbe_cpu, ei_delay));
+  emit_store8_imm(em, REG_CPU, offsetof(struct libyagbe_cpu, instruction),
+                  e->opcode);
+  emit_store16_imm(em, REG_CPU, offsetof(struct libyagbe_cpu, reg.pc),
+                   (uint16_t)(address + e->length));
+
+  switch (e->handler) {
+    case CACHED_NOP:
+      emit_advance(em, 4u * e->length);
+      break;
+
+    case CACHED_LD_R_R:
+      emit_advance(em, 4u * e->length);
+      emit_load8(em, REG_CPU, e->y);
+      emit_store8(em, REG_CPU, e->x);
+      break;
+
+    case CACHED_LD_R_IMM8:
+      emit_advance(em, 4u * e->length);
+      emit_store8_imm(em, REG_CPU, e->x, e->imm & 0xFF);
+      break;
+
+    case CACHED_LD_RR_IMM16:
+      emit_advance(em, 4u * e->length);
+      emit_store16_imm(em, REG_CPU, e->x, e->imm);
+      break;
+
+    case CACHED_INC_RR:
+      emit_advance(em, 4u * (e->length + 1));
+      emit_add16_imm(em, REG_CPU, e->x, e->imm);
+      break;
+
+    default:
+      emit_mov_reg(em, RDI, REG_CPU);
+      emit_mov_reg(em, RSI, REG_BUS);
+      emit_mov_ptr(em, RDX, &e, sizeof(e));
+      emit_mov_ptr(em, RAX, &handler, sizeof(handler));
+      emit_call(em, RAX);
+      break;
+  }
+  emit_mov_imm32(em, REG_LAST_PC, address);
+}
+
+/* Compiles a block, with copies of its decoded instructions ahead of the code
+ * for the handlers to be passed. Returns the start of the code. */
+static const uint8_t* emit_block(
+    struct libyagbe_jit* const jit,
+    const struct libyagbe_code_cache_entry* const decoded,
+    const size_t count, const uint8_t* const bank, const uint16_t address) {
+  struct libyagbe_code_cache_entry* const entries =
+      (struct libyagbe_code_cache_entry*)(jit->code +
+                                          ((jit->code_used + 15) & ~15u));
+  uint8_t* exits[MAX_BLOCK_INSTRUCTIONS * 3];
+  size_t num_exits = 0;
+  struct emitter em;
+  const uint8_t* start;
+  uint16_t pc = address;
+  size_t i;
+
+  memcpy(entries, decoded, count * sizeof(*entries));
+
+  em.out = (uint8_t*)&entries[count];
+  em.out += (16 - ((size_t)(em.out - jit->code) & 15)) & 15;
+  start = em.out;
+
+  emit_push(&em, RBX);
+  emit_push(&em, R12);
+  emit_push(&em, R13);
+  emit_push(&em, R14);
+  emit_push(&em, R15);
+  emit_mov_reg(&em, REG_CPU, RDI);
+  emit_mov_reg(&em, REG_BUS, RSI);
+  emit_mov_reg(&em, REG_LIMIT, RDX);
+  emit_load(&em, REG_SCHED, REG_BUS, offsetof(struct libyagbe_bus, sched));
+
+  for (i = 0; i < count; ++i) {
+    /* The caller has already checked everything for the first one. */
+    if (i != 0) {
+      emit_checks(&em, &exits[num_exits], pc,
+                  bank + (pc & (LIBYAGBE_CART_MEM_SIZE_ROM_BANK - 1) &
+                          ~(LIBYAGBE_BUS_PAGE_SIZE - 1)));
+      num_exits += 3;
+    }
+    emit_instruction(&em, &entries[i], pc);
+    pc = (uint16_t)(pc + entries[i].length);
+  }
+
+  for (i = 0; i < num_exits; ++i) {
+    patch_jump(exits[i], em.out);
+  }
+
+  /* mov eax, r15d */
+  emit_rex(&em, false, REG_LAST_PC, RAX);
+  emit8(&em, 0x89);
+  emit_modrm_reg(&em, REG_LAST_PC, RAX);
+
+  emit_pop(&em, R15);
+  emit_pop(&em, R14);
+  emit_pop(&em, R13);
+  emit_pop(&em, R12);
+  emit_pop(&em, RBX);
+  emit8(&em, 0xC3);
+
+  jit->code_used = (size_t)(em.out - jit->code);
+  return start;
+}
+
+#endif /* JIT_X86_64 */
+
+bool libyagbe_jit_is_supported(void) {
+#ifdef JIT_X86_64
+  return (sizeof(void*) == 8) && (sizeof(cached_handler_func) == 8) &&
+         (sizeof(uintmax_t) == 8);
+#else
+  return false;
+#endif /* JIT_X86_64 */
+}
+
+bool libyagbe_jit_init(struct libyagbe_jit* const jit, void* const code,
+                       const size_t code_size,
+                       struct libyagbe_jit_block* const blocks,
+                       const size_t num_blocks) {
+  assert(jit != NULL);
+  assert(code != NULL);
+  assert(blocks != NULL);
+
+  if (!libyagbe_jit_is_supported() ||
+      (code_size < LIBYAGBE_JIT_MIN_CODE_SIZE) || (num_blocks == 0)) {
+    return false;
+  }
+  jit->code = (uint8_t*)code;
+  jit->code_size = code_size;
+  jit->blocks = blocks;
+  jit->num_blocks = num_blocks;
+  jit->num_compiled = 0;
+  jit->num_flushes = 0;
+
+  libyagbe_jit_clear(jit);
+  return true;
+}
+
+void libyagbe_jit_clear(struct libyagbe_jit* const jit) {
+  size_t i;
+
+  assert(jit != NULL);
+
+  for (i = 0; i < jit->num_blocks; ++i) {
+    jit->blocks[i].source = NULL;
+    jit->blocks[i].code = NULL;
+  }
+  jit->code_used = 0;
+}
+
+/* Decodes and compiles the block which starts at an address, leaving it to
+ * the interpreter if that's where it'd spend most of its time anyway. */
+static void compile(struct libyagbe_jit* const jit,
+                    struct libyagbe_jit_block* const block,
+                    const uint8_t* const bank, const uint16_t address) {
+  struct libyagbe_code_cache_entry decoded[MAX_BLOCK_INSTRUCTIONS];
+  size_t offset = address & (LIBYAGBE_CART_MEM_SIZE_ROM_BANK - 1);
+  size_t count = 0;
+  size_t io = 0;
+  size_t size;
+
+  block->source = bank + offset;
+  block->address = address;
+  block->code = NULL;
+
+  while (count < MAX_BLOCK_INSTRUCTIONS) {
+    struct libyagbe_code_cache_entry* const e = &decoded[count];
+
+    libyagbe_cpu_decode(e, bank + offset,
+                        LIBYAGBE_CART_MEM_SIZE_ROM_BANK - offset);
+
+    if (e->handler == CACHED_FALLBACK) {
+      break;
+    }
+    count++;
+    io += accesses_io(e);
+    offset += e->length;
+
+    if (ends_block(e) || (offset == LIBYAGBE_CART_MEM_SIZE_ROM_BANK)) {
+      break;
+    }
+  }
+
+  if ((count == 0) || (io * 2 > count)) {
+    return;
+  }
+  size = (count * (sizeof(*decoded) + MAX_INSTRUCTION_CODE)) + MAX_BLOCK_CODE;
+
+  if (size > jit->code_size - jit->code_used) {
+    const struct libyagbe_jit_block kept = *block;
+
+    libyagbe_jit_clear(jit);
+    jit->num_flushes++;
+    *block = kept;
+  }
+#ifdef JIT_X86_64
+  block->code = emit_block(jit, decoded, count, bank, address);
+  jit->num_compiled++;
+#else
+  (void)bank;
+#endif /* JIT_X86_64 */
+}
+
+uint16_t libyagbe_jit_execute(struct libyagbe_jit* const jit,
+                              struct libyagbe_cpu* const cpu,
+                              struct libyagbe_bus* const bus,
+                              const uintmax_t limit) {
+  const uint16_t pc = cpu->reg.pc.value;
+  const uint8_t* bank;
+  struct libyagbe_jit_block* block;
+  block_func func;
+
+  assert(jit != NULL);
+  assert(cpu != NULL);
+  assert(bus != NULL);
+
+  /* These are the same conditions the cached interpreter runs the next
+   * instruction under. */
+  if ((cpu->state != LIBYAGBE_CPU_STATE_RUNNING) || cpu->halt_bug ||
+      (pc >= 0x8000) ||
+      ((bus->irq.pending != 0) && cpu->ime && !cpu->ei_delay)) {
+    libyagbe_cpu_step(cpu, bus);
+    return pc;
+  }
+
+#ifdef LIBYAGBE_ENABLE_PROFILE
+  /* The profiler counts every instruction as it's executed. */
+  if (bus->profile != NULL) {
+    libyagbe_cpu_step(cpu, bus);
+    return pc;
+  }
+#endif /* LIBYAGBE_ENABLE_PROFILE */
+
+  bank = libyagbe_cart_get_rom_bank(&bus->cart, pc & 0x4000);
+
+  if (bus->read_map[pc >> LIBYAGBE_BUS_PAGE_SHIFT] != bank + (pc & 0x3F00)) {
+    libyagbe_cpu_step(cpu, bus);
+    return pc;
+  }
+  block = &jit->blocks[((size_t)(bank - bus->cart.data) + (pc & 0x3FFF) +
+                        (pc >> 14)) %
+                       jit->num_blocks];
+
+  if ((block->source != bank + (pc & 0x3FFF)) || (block->address != pc)) {
+    compile(jit, block, bank, pc);
+  }
+
+  if (block->code == NULL) {
+    libyagbe_cpu_step(cpu, bus);
+    return pc;
+  }
+  memcpy(&func, &block->code, sizeof(func));
+  return func(cpu, bus, limit);
+}
@@ -0,0 +1,96 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/joypad.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "libyagbe/irq.h"
+
+enum p1_bits {
+  P1_SELECT_DIRECTIONS = 1 << 4,
+  P1_SELECT_ACTIONS = 1 << 5,
+  P1_SELECT_MASK = P1_SELECT_DIRECTIONS | P1_SELECT_ACTIONS
+};
+
+/* Returns the input lines which are pulled low, as bits 0-3. */
+static uint8_t get_low_lines(const uint8_t select, const uint8_t buttons) {
+  uint8_t lines = 0;
+
+  if (!(select & P1_SELECT_DIRECTIONS)) {
+    lines |= buttons & 0x0F;
+  }
+
+  if (!(select & P1_SELECT_ACTIONS)) {
+    lines |= buttons >> 4;
+  }
+  return lines;
+}
+
+/* Raises the interrupt if any line was high before and is low now. */
+static bool update(struct libyagbe_joypad* const joypad, const uint8_t select,
+                   const uint8_t buttons) {
+  const uint8_t before = get_low_lines(joypad->select, joypad->buttons);
+  const uint8_t after = get_low_lines(select, buttons);
+
+  joypad->select = select;
+  joypad->buttons = buttons;
+
+  if ((after & ~before) != 0) {
+    libyagbe_irq_request(joypad->irq, LIBYAGBE_IRQ_JOYPAD);
+    return true;
+  }
+  return false;
+}
+
+void libyagbe_joypad_init(struct libyagbe_joypad* const joypad,
+                          struct libyagbe_irq* const irq) {
+  assert(joypad != NULL);
+  assert(irq != NULL);
+
+  joypad->irq = irq;
+}
+
+void libyagbe_joypad_reset(struct libyagbe_joypad* const joypad) {
+  assert(joypad != NULL);
+
+  /* The boot ROM leaves both groups selected. */
+  joypad->select = 0;
+  joypad->buttons = 0;
+}
+
+uint8_t libyagbe_joypad_read(const struct libyagbe_joypad* const joypad) {
+  assert(joypad != NULL);
+
+  /* The unused bits read as 1. */
+  return (uint8_t)(0xC0 | joypad->select |
+                   (~get_low_lines(joypad->select, joypad->buttons) & 0x0F));
+}
+
+void libyagbe_joypad_write(struct libyagbe_joypad* const joypad,
+                           const uint8_t data) {
+  assert(joypad != NULL);
+  update(joypad, data & P1_SELECT_MASK, joypad->buttons);
+}
+
+bool libyagbe_joypad_set_buttons(struct libyagbe_joypad* const joypad,
+                                 const uint8_t buttons) {
+  assert(joypad != NULL);
+  return update(joypad, joypad->select, buttons);
+}
@@ -0,0 +1,436 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/movie.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/gb.h"
+
+/* A movie is a header followed by every input and then every checkpoint.
+ * Every value is stored little endian at a fixed width, and timestamps are
+ * relative to the start of the movie. */
+enum movie_header {
+  HEADER_VERSION = 4,
+  HEADER_CART_ID = 8,
+  HEADER_INTERVAL = 12,
+  HEADER_NUM_INPUTS = 16,
+  HEADER_NUM_CHECKPOINTS = 20,
+
+  /* The offsets of the cartridge header bytes which identify the game. */
+  CART_ID_TYPE = 0x0147,
+  CART_ID_RAM_SIZE = 0x0149,
+  CART_ID_CHECKSUM = 0x014E
+};
+
+static const uint8_t movie_magic[4] = {'Y', 'G', 'B', 'M'};
+
+static void put_value(uint8_t* const out, const uintmax_t value,
+                      const size_t width) {
+  size_t i;
+
+  for (i = 0; i < width; ++i) {
+    out[i] = (uint8_t)(value >> (i * 8));
+  }
+}
+
+static uintmax_t get_value(const uint8_t* const in, const size_t width) {
+  uintmax_t value = 0;
+  size_t i;
+
+  for (i = 0; i < width; ++i) {
+    value |= (uintmax_t)in[i] << (i * 8);
+  }
+  return value;
+}
+
+static void get_cart_id(const struct libyagbe_system* const gb,
+                        uint8_t* const id) {
+  id[0] = gb->bus.cart.data[CART_ID_TYPE];
+  id[1] = gb->bus.cart.data[CART_ID_RAM_SIZE];
+  id[2] = gb->bus.cart.data[CART_ID_CHECKSUM];
+  id[3] = gb->bus.cart.data[CART_ID_CHECKSUM + 1];
+}
+
+/* 64-bit FNV-1a, which is simple and quick enough for a few pages of memory
+ * per frame. The constants are built up since C90 has no 64-bit literals. */
+#define FNV_OFFSET_BASIS \
+  ((((uintmax_t)0xCBF29CE4UL) << 32) | (uintmax_t)0x84222325UL)
+#define FNV_PRIME ((((uintmax_t)1) << 40) | (uintmax_t)0x1B3)
+
+static uintmax_t hash_bytes(uintmax_t hash, const uint8_t* const data,
+                            const size_t size) {
+  size_t i;
+
+  for (i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static uintmax_t hash_value(const uintmax_t hash, const uintmax_t value,
+                            const size_t width) {
+  uint8_t bytes[8];
+
+  put_value(bytes, value, width);
+  return hash_bytes(hash, bytes, width);
+}
+
+uintmax_t libyagbe_movie_hash(const struct libyagbe_system* const gb) {
+  const struct libyagbe_cpu_registers* reg;
+  uintmax_t hash = FNV_OFFSET_BASIS;
+  size_t i;
+
+  assert(gb != NULL);
+  reg = &gb->cpu.reg;
+
+  /* Values are hashed one by one rather than as structures, so that padding
+   * and the layout of the host don't matter. */
+  hash = hash_value(hash, gb->sched.current_timestamp, 8);
+  hash = hash_value(hash, reg->af.byte.hi, 1);
+  hash = hash_value(hash, libyagbe_cpu_get_flags(&gb->cpu), 1);
+  hash = hash_value(hash, reg->bc.value, 2);
+  hash = hash_value(hash, reg->de.value, 2);
+  hash = hash_value(hash, reg->hl.value, 2);
+  hash = hash_value(hash, reg->sp.value, 2);
+  hash = hash_value(hash, reg->pc.value, 2);
+  hash = hash_value(hash, gb->cpu.ime ? 1 : 0, 1);
+  hash = hash_value(hash, (uintmax_t)gb->cpu.state, 1);
+
+  /* A forked instance may still be reading some of WRAM from its parent. */
+  for (i = 0; i < sizeof(gb->bus.wram); i += LIBYAGBE_BUS_PAGE_SIZE) {
+    hash = hash_bytes(hash, libyagbe_bus_get_memory(&gb->bus, &gb->bus.wram[i]),
+                      LIBYAGBE_BUS_PAGE_SIZE);
+  }
+  hash = hash_bytes(hash, gb->bus.ppu.vram, sizeof(gb->bus.ppu.vram));
+  return hash_bytes(hash, gb->bus.hram, sizeof(gb->bus.hram));
+}
+
+static uintmax_t get_elapsed(const struct libyagbe_movie* const movie,
+                             const struct libyagbe_system* const gb) {
+  return gb->sched.current_timestamp - movie->start;
+}
+
+/* Returns when the next checkpoint is due, relative to the start. */
+static uintmax_t get_next_checkpoint(const struct libyagbe_movie* const movie) {
+  if (movie->interval == 0) {
+    return LIBYAGBE_SCHED_NO_DEADLINE;
+  }
+  return (uintmax_t)(movie->checkpoints_reached + 1) * movie->interval *
+         LIBYAGBE_MOVIE_CYCLES_PER_FRAME;
+}
+
+static void start(struct libyagbe_movie* const movie,
+                  const struct libyagbe_system* const gb,
+                  const enum libyagbe_movie_mode mode) {
+  movie->mode = mode;
+  movie->start = gb->sched.current_timestamp;
+  movie->next_input = 0;
+  movie->checkpoints_reached = 0;
+  movie->last_hash = 0;
+  movie->mismatch = LIBYAGBE_MOVIE_NO_MISMATCH;
+}
+
+void libyagbe_movie_init(struct libyagbe_movie* const movie,
+                         struct libyagbe_movie_input* const inputs,
+                         const size_t max_inputs,
+                         struct libyagbe_movie_checkpoint* const checkpoints,
+                         const size_t max_checkpoints) {
+  assert(movie != NULL);
+  assert((inputs != NULL) || (max_inputs == 0));
+  assert((checkpoints != NULL) || (max_checkpoints == 0));
+
+  movie->inputs = inputs;
+  movie->num_inputs = 0;
+  movie->max_inputs = max_inputs;
+  movie->checkpoints = checkpoints;
+  movie->num_checkpoints = 0;
+  movie->max_checkpoints = max_checkpoints;
+  movie->interval = 0;
+  movie->mode = LIBYAGBE_MOVIE_PLAYING;
+  movie->start = 0;
+  movie->next_input = 0;
+  movie->checkpoints_reached = 0;
+  movie->last_hash = 0;
+  movie->mismatch = LIBYAGBE_MOVIE_NO_MISMATCH;
+}
+
+void libyagbe_movie_record(struct libyagbe_movie* const movie,
+                           const struct libyagbe_system* const gb,
+                           const unsigned long interval) {
+  assert(movie != NULL);
+  assert(gb != NULL);
+
+  movie->num_inputs = 0;
+  movie->num_checkpoints = 0;
+  movie->interval = interval;
+  start(movie, gb, LIBYAGBE_MOVIE_RECORDING);
+}
+
+void libyagbe_movie_play(struct libyagbe_movie* const movie,
+                         const struct libyagbe_system* const gb) {
+  assert(movie != NULL);
+  assert(gb != NULL);
+
+  start(movie, gb, LIBYAGBE_MOVIE_PLAYING);
+}
+
+bool libyagbe_movie_set_buttons(struct libyagbe_movie* const movie,
+                                struct libyagbe_system* const gb,
+                                const uint8_t buttons) {
+  uintmax_t now;
+
+  assert(movie != NULL);
+  assert(gb != NULL);
+  assert(movie->mode == LIBYAGBE_MOVIE_RECORDING);
+
+  /* Anything due now has to come first, just as it will when playing. */
+  libyagbe_movie_sync(movie, gb);
+  now = get_elapsed(movie, gb);
+
+  /* Changes at the same time only leave the last one to record. */
+  if ((movie->num_inputs != 0) &&
+      (movie->inputs[movie->num_inputs - 1].timestamp == now)) {
+    movie->inputs[movie->num_inputs - 1].buttons = buttons;
+  } else if (movie->num_inputs < movie->max_inputs) {
+    movie->inputs[movie->num_inputs].timestamp = now;
+    movie->inputs[movie->num_inputs].buttons = buttons;
+    movie->num_inputs++;
+  } else {
+    return false;
+  }
+  libyagbe_system_set_buttons(gb, buttons);
+  return true;
+}
+
+uintmax_t libyagbe_movie_get_next_stop(
+    const struct libyagbe_movie* const movie) {
+  uintmax_t next;
+
+  assert(movie != NULL);
+  next = get_next_checkpoint(movie);
+
+  if ((movie->mode == LIBYAGBE_MOVIE_PLAYING) &&
+      (movie->next_input < movie->num_inputs) &&
+      (movie->inputs[movie->next_input].timestamp < next)) {
+    next = movie->inputs[movie->next_input].timestamp;
+  }
+  return (next == LIBYAGBE_SCHED_NO_DEADLINE) ? next : movie->start + next;
+}
+
+/* Takes the hash for the checkpoint just reached, and records it or checks
+ * it against the recorded one. */
+static void reach_checkpoint(struct libyagbe_movie* const movie,
+                             const struct libyagbe_system* const gb) {
+  const size_t index = movie->checkpoints_reached++;
+  struct libyagbe_movie_checkpoint checkpoint;
+
+  checkpoint.timestamp = get_elapsed(movie, gb);
+  checkpoint.hash = libyagbe_movie_hash(gb);
+  movie->last_hash = checkpoint.hash;
+
+  if (movie->mode == LIBYAGBE_MOVIE_RECORDING) {
+    if (index < movie->max_checkpoints) {
+      movie->checkpoints[index] = checkpoint;
+      movie->num_checkpoints = index + 1;
+    }
+    return;
+  }
+
+  if ((index < movie->num_checkpoints) &&
+      (movie->mismatch == LIBYAGBE_MOVIE_NO_MISMATCH) &&
+      ((movie->checkpoints[index].timestamp != checkpoint.timestamp) ||
+       (movie->checkpoints[index].hash != checkpoint.hash))) {
+    movie->mismatch = index;
+  }
+}
+
+void libyagbe_movie_sync(struct libyagbe_movie* const movie,
+                         struct libyagbe_system* const gb) {
+  uintmax_t now;
+
+  assert(movie != NULL);
+  assert(gb != NULL);
+
+  now = get_elapsed(movie, gb);
+
+  while (get_next_checkpoint(movie) <= now) {
+    reach_checkpoint(movie, gb);
+  }
+
+  if (movie->mode != LIBYAGBE_MOVIE_PLAYING) {
+    return;
+  }
+
+  while ((movie->next_input < movie->num_inputs) &&
+         (movie->inputs[movie->next_input].timestamp <= now)) {
+    libyagbe_system_set_buttons(gb, movie->inputs[movie->next_input].buttons);
+    movie->next_input++;
+  }
+}
+
+uintmax_t libyagbe_movie_run(struct libyagbe_movie* const movie,
+                             struct libyagbe_system* const gb,
+                             const uintmax_t cycles) {
+  uintmax_t begin;
+  uintmax_t end;
+
+  assert(movie != NULL);
+  assert(gb != NULL);
+
+  begin = gb->sched.current_timestamp;
+  end = begin + cycles;
+
+  libyagbe_movie_sync(movie, gb);
+
+  while (gb->sched.current_timestamp < end) {
+    uintmax_t stop = libyagbe_movie_get_next_stop(movie);
+
+    if (stop > end) {
+      stop = end;
+    }
+
+    /* Runs never split instructions, so the system stops at the same place
+     * however the time is divided up, and the movie acts between the same
+     * two instructions every time. */
+    libyagbe_system_run(gb, stop - gb->sched.current_timestamp);
+    libyagbe_movie_sync(movie, gb);
+  }
+  return gb->sched.current_timestamp - begin;
+}
+
+uintmax_t libyagbe_movie_get_length(const struct libyagbe_movie* const movie) {
+  uintmax_t length = 0;
+
+  assert(movie != NULL);
+
+  if (movie->num_inputs != 0) {
+    length = movie->inputs[movie->num_inputs - 1].timestamp;
+  }
+
+  if ((movie->num_checkpoints != 0) &&
+      (movie->checkpoints[movie->num_checkpoints - 1].timestamp > length)) {
+    length = movie->checkpoints[movie->num_checkpoints - 1].timestamp;
+  }
+  return length;
+}
+
+size_t libyagbe_movie_get_size(const struct libyagbe_movie* const movie) {
+  assert(movie != NULL);
+
+  return LIBYAGBE_MOVIE_HEADER_SIZE +
+         (movie->num_inputs * LIBYAGBE_MOVIE_INPUT_SIZE) +
+         (movie->num_checkpoints * LIBYAGBE_MOVIE_CHECKPOINT_SIZE);
+}
+
+size_t libyagbe_movie_save(const struct libyagbe_movie* const movie,
+                           const struct libyagbe_system* const gb,
+                           void* const buffer, const size_t size) {
+  const size_t movie_size = libyagbe_movie_get_size(movie);
+  uint8_t* out = (uint8_t*)buffer;
+  size_t i;
+
+  assert(gb != NULL);
+  assert(buffer != NULL);
+
+  if (size < movie_size) {
+    return 0;
+  }
+
+  memcpy(out, movie_magic, sizeof(movie_magic));
+  put_value(&out[HEADER_VERSION], LIBYAGBE_MOVIE_VERSION, 2);
+  put_value(&out[HEADER_VERSION + 2], 0, 2);
+  get_cart_id(gb, &out[HEADER_CART_ID]);
+  put_value(&out[HEADER_INTERVAL], movie->interval, 4);
+  put_value(&out[HEADER_NUM_INPUTS], movie->num_inputs, 4);
+  put_value(&out[HEADER_NUM_CHECKPOINTS], movie->num_checkpoints, 4);
+  out += LIBYAGBE_MOVIE_HEADER_SIZE;
+
+  for (i = 0; i < movie->num_inputs; ++i) {
+    put_value(out, movie->inputs[i].timestamp, 8);
+    out[8] = movie->inputs[i].buttons;
+    out += LIBYAGBE_MOVIE_INPUT_SIZE;
+  }
+
+  for (i = 0; i < movie->num_checkpoints; ++i) {
+    put_value(out, movie->checkpoints[i].timestamp, 8);
+    put_value(&out[8], movie->checkpoints[i].hash, 8);
+    out += LIBYAGBE_MOVIE_CHECKPOINT_SIZE;
+  }
+  return movie_size;
+}
+
+bool libyagbe_movie_load(struct libyagbe_movie* const movie,
+                         const struct libyagbe_system* const gb,
+                         const void* const buffer, const size_t size) {
+  const uint8_t* in = (const uint8_t*)buffer;
+  uint8_t id[4];
+  size_t num_inputs;
+  size_t num_checkpoints;
+  size_t i;
+
+  assert(movie != NULL);
+  assert(gb != NULL);
+  assert(buffer != NULL);
+
+  if (size < LIBYAGBE_MOVIE_HEADER_SIZE) {
+    return false;
+  }
+  get_cart_id(gb, id);
+
+  if ((memcmp(in, movie_magic, sizeof(movie_magic)) != 0) ||
+      (get_value(&in[HEADER_VERSION], 2) != LIBYAGBE_MOVIE_VERSION) ||
+      (memcmp(&in[HEADER_CART_ID], id, sizeof(id)) != 0)) {
+    return false;
+  }
+  num_inputs = (size_t)get_value(&in[HEADER_NUM_INPUTS], 4);
+  num_checkpoints = (size_t)get_value(&in[HEADER_NUM_CHECKPOINTS], 4);
+
+  /* Check each count on its own first, so that working out the size can't
+   * overflow. */
+  if ((num_inputs > movie->max_inputs) ||
+      (num_checkpoints > movie->max_checkpoints) ||
+      (num_inputs > size / LIBYAGBE_MOVIE_INPUT_SIZE) ||
+      (num_checkpoints > size / LIBYAGBE_MOVIE_CHECKPOINT_SIZE) ||
+      (size < LIBYAGBE_MOVIE_HEADER_SIZE +
+                  (num_inputs * LIBYAGBE_MOVIE_INPUT_SIZE) +
+                  (num_checkpoints * LIBYAGBE_MOVIE_CHECKPOINT_SIZE))) {
+    return false;
+  }
+
+  movie->interval = (unsigned long)get_value(&in[HEADER_INTERVAL], 4);
+  movie->num_inputs = num_inputs;
+  movie->num_checkpoints = num_checkpoints;
+  in += LIBYAGBE_MOVIE_HEADER_SIZE;
+
+  for (i = 0; i < num_inputs; ++i) {
+    movie->inputs[i].timestamp = get_value(in, 8);
+    movie->inputs[i].buttons = in[8];
+    in += LIBYAGBE_MOVIE_INPUT_SIZE;
+  }
+
+  for (i = 0; i < num_checkpoints; ++i) {
+    movie->checkpoints[i].timestamp = get_value(in, 8);
+    movie->checkpoints[i].hash = get_value(&in[8], 8);
+    in += LIBYAGBE_MOVIE_CHECKPOINT_SIZE;
+  }
+  start(movie, gb, LIBYAGBE_MOVIE_PLAYING);
+  return true;
+}
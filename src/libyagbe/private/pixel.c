@@ -0,0 +1,284 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pixel.h"
+
+#include <assert.h>
+
+#if !defined(LIBYAGBE_NO_SIMD) &&                             \
+    (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+     (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define PIXEL_USE_SSE2
+#include <emmintrin.h>
+#elif !defined(LIBYAGBE_NO_SIMD) && \
+    (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define PIXEL_USE_NEON
+#include <arm_neon.h>
+#endif
+
+/* The number of pixels handled by one iteration of a vector loop. */
+enum { VECTOR_WIDTH = 16 };
+
+static void map_palette_scalar(const uint8_t* const colors,
+                               const uint8_t palette, uint8_t* const dst,
+                               const size_t first, const size_t count) {
+  size_t i;
+
+  for (i = first; i < count; ++i) {
+    dst[i] = (palette >> (colors[i] * 2)) & 0x03;
+  }
+}
+
+static void compose_objs_scalar(const uint8_t* const obj_shades,
+                                const uint8_t* const behind,
+                                const uint8_t* const bg_colors,
+                                uint8_t* const dst, const size_t first,
+                                const size_t count) {
+  size_t i;
+
+  for (i = first; i < count; ++i) {
+    if ((obj_shades[i] != LIBYAGBE_PIXEL_NO_OBJ) &&
+        ((behind[i] == 0) || (bg_colors[i] == 0))) {
+      dst[i] = obj_shades[i];
+    }
+  }
+}
+
+#ifdef PIXEL_USE_SSE2
+/* Expands two rows of one bit plane, with each row's byte repeated 8 times, to
+ * `value` where a bit is set and 0 where it isn't. */
+static __m128i expand_plane(const __m128i rows, const __m128i bits,
+                            const __m128i value) {
+  return _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(rows, bits), bits), value);
+}
+
+void libyagbe_pixel_decode_tile(const uint8_t* const src, uint8_t* const dst) {
+  /* The leftmost pixel is bit 7, so byte 0 of each row tests 0x80. */
+  const __m128i bits =
+      _mm_set_epi32(0x01020408, 0x10204080, 0x01020408, 0x10204080);
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i two = _mm_set1_epi8(2);
+  __m128i planes;
+  __m128i lo;
+  __m128i hi;
+  __m128i lo_rows[2];
+  __m128i hi_rows[2];
+  unsigned int i;
+
+  assert(src != NULL);
+  assert(dst != NULL);
+
+  /* Deinterleave the planes: each half of lo and hi holds all 8 rows. */
+  planes = _mm_loadu_si128((const __m128i*)src);
+  lo = _mm_and_si128(planes, _mm_set1_epi16(0x00FF));
+  lo = _mm_packus_epi16(lo, lo);
+  hi = _mm_srli_epi16(planes, 8);
+  hi = _mm_packus_epi16(hi, hi);
+
+  /* Repeat each row's byte 4 times; rows 0-3 and 4-7. */
+  lo = _mm_unpacklo_epi8(lo, lo);
+  hi = _mm_unpacklo_epi8(hi, hi);
+  lo_rows[0] = _mm_unpacklo_epi16(lo, lo);
+  lo_rows[1] = _mm_unpackhi_epi16(lo, lo);
+  hi_rows[0] = _mm_unpacklo_epi16(hi, hi);
+  hi_rows[1] = _mm_unpackhi_epi16(hi, hi);
+
+  for (i = 0; i < 2; ++i) {
+    const __m128i lo_01 = _mm_unpacklo_epi32(lo_rows[i], lo_rows[i]);
+    const __m128i lo_23 = _mm_unpackhi_epi32(lo_rows[i], lo_rows[i]);
+    const __m128i hi_01 = _mm_unpacklo_epi32(hi_rows[i], hi_rows[i]);
+    const __m128i hi_23 = _mm_unpackhi_epi32(hi_rows[i], hi_rows[i]);
+
+    _mm_storeu_si128((__m128i*)&dst[i * 32],
+                     _mm_or_si128(expand_plane(lo_01, bits, one),
+                                  expand_plane(hi_01, bits, two)));
+    _mm_storeu_si128((__m128i*)&dst[(i * 32) + 16],
+                     _mm_or_si128(expand_plane(lo_23, bits, one),
+                                  expand_plane(hi_23, bits, two)));
+  }
+}
+
+void libyagbe_pixel_map_palette(const uint8_t* const colors,
+                                const uint8_t palette, uint8_t* const dst,
+                                const size_t count) {
+  const __m128i shade_0 = _mm_set1_epi8((char)(palette & 0x03));
+  const __m128i shade_1 = _mm_set1_epi8((char)((palette >> 2) & 0x03));
+  const __m128i shade_2 = _mm_set1_epi8((char)((palette >> 4) & 0x03));
+  const __m128i shade_3 = _mm_set1_epi8((char)((palette >> 6) & 0x03));
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i two = _mm_set1_epi8(2);
+  const __m128i three = _mm_set1_epi8(3);
+  size_t i;
+
+  assert(colors != NULL);
+  assert(dst != NULL);
+
+  for (i = 0; (i + VECTOR_WIDTH) <= count; i += VECTOR_WIDTH) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)&colors[i]);
+    __m128i shades;
+
+    shades = _mm_and_si128(_mm_cmpeq_epi8(c, _mm_setzero_si128()), shade_0);
+    shades = _mm_or_si128(shades, _mm_and_si128(_mm_cmpeq_epi8(c, one),
+                                                 shade_1));
+    shades = _mm_or_si128(shades, _mm_and_si128(_mm_cmpeq_epi8(c, two),
+                                                 shade_2));
+    shades = _mm_or_si128(shades, _mm_and_si128(_mm_cmpeq_epi8(c, three),
+                                                 shade_3));
+    _mm_storeu_si128((__m128i*)&dst[i], shades);
+  }
+  map_palette_scalar(colors, palette, dst, i, count);
+}
+
+void libyagbe_pixel_compose_objs(const uint8_t* const obj_shades,
+                                 const uint8_t* const behind,
+                                 const uint8_t* const bg_colors,
+                                 uint8_t* const dst, const size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i no_obj = _mm_set1_epi8((char)LIBYAGBE_PIXEL_NO_OBJ);
+  size_t i;
+
+  assert(obj_shades != NULL);
+  assert(behind != NULL);
+  assert(bg_colors != NULL);
+  assert(dst != NULL);
+
+  for (i = 0; (i + VECTOR_WIDTH) <= count; i += VECTOR_WIDTH) {
+    const __m128i obj = _mm_loadu_si128((const __m128i*)&obj_shades[i]);
+    const __m128i b = _mm_loadu_si128((const __m128i*)&behind[i]);
+    const __m128i bg = _mm_loadu_si128((const __m128i*)&bg_colors[i]);
+    const __m128i d = _mm_loadu_si128((const __m128i*)&dst[i]);
+    const __m128i visible =
+        _mm_or_si128(_mm_cmpeq_epi8(b, zero), _mm_cmpeq_epi8(bg, zero));
+    const __m128i mask =
+        _mm_andnot_si128(_mm_cmpeq_epi8(obj, no_obj), visible);
+
+    _mm_storeu_si128((__m128i*)&dst[i],
+                     _mm_or_si128(_mm_and_si128(mask, obj),
+                                  _mm_andnot_si128(mask, d)));
+  }
+  compose_objs_scalar(obj_shades, behind, bg_colors, dst, i, count);
+}
+#elif defined(PIXEL_USE_NEON)
+static const uint8_t row_bits[8] = {0x80, 0x40, 0x20, 0x10,
+                                    0x08, 0x04, 0x02, 0x01};
+
+void libyagbe_pixel_decode_tile(const uint8_t* const src, uint8_t* const dst) {
+  const uint8x8_t bits = vld1_u8(row_bits);
+  const uint8x8_t one = vdup_n_u8(1);
+  const uint8x8_t two = vdup_n_u8(2);
+  unsigned int row;
+
+  assert(src != NULL);
+  assert(dst != NULL);
+
+  for (row = 0; row < 8; ++row) {
+    const uint8x8_t lo = vand_u8(vtst_u8(vdup_n_u8(src[row * 2]), bits), one);
+    const uint8x8_t hi =
+        vand_u8(vtst_u8(vdup_n_u8(src[(row * 2) + 1]), bits), two);
+
+    vst1_u8(&dst[row * 8], vorr_u8(lo, hi));
+  }
+}
+
+void libyagbe_pixel_map_palette(const uint8_t* const colors,
+                                const uint8_t palette, uint8_t* const dst,
+                                const size_t count) {
+  uint8_t shades[8] = {0};
+  uint8x8_t table;
+  size_t i;
+
+  assert(colors != NULL);
+  assert(dst != NULL);
+
+  for (i = 0; i < 4; ++i) {
+    shades[i] = (palette >> (i * 2)) & 0x03;
+  }
+  table = vld1_u8(shades);
+
+  for (i = 0; (i + 8) <= count; i += 8) {
+    vst1_u8(&dst[i], vtbl1_u8(table, vld1_u8(&colors[i])));
+  }
+  map_palette_scalar(colors, palette, dst, i, count);
+}
+
+void libyagbe_pixel_compose_objs(const uint8_t* const obj_shades,
+                                 const uint8_t* const behind,
+                                 const uint8_t* const bg_colors,
+                                 uint8_t* const dst, const size_t count) {
+  const uint8x16_t zero = vdupq_n_u8(0);
+  const uint8x16_t no_obj = vdupq_n_u8(LIBYAGBE_PIXEL_NO_OBJ);
+  size_t i;
+
+  assert(obj_shades != NULL);
+  assert(behind != NULL);
+  assert(bg_colors != NULL);
+  assert(dst != NULL);
+
+  for (i = 0; (i + VECTOR_WIDTH) <= count; i += VECTOR_WIDTH) {
+    const uint8x16_t obj = vld1q_u8(&obj_shades[i]);
+    const uint8x16_t visible =
+        vorrq_u8(vceqq_u8(vld1q_u8(&behind[i]), zero),
+                 vceqq_u8(vld1q_u8(&bg_colors[i]), zero));
+    const uint8x16_t mask = vbicq_u8(visible, vceqq_u8(obj, no_obj));
+
+    vst1q_u8(&dst[i], vbslq_u8(mask, obj, vld1q_u8(&dst[i])));
+  }
+  compose_objs_scalar(obj_shades, behind, bg_colors, dst, i, count);
+}
+#else
+void libyagbe_pixel_decode_tile(const uint8_t* const src, uint8_t* const dst) {
+  unsigned int row;
+  unsigned int x;
+
+  assert(src != NULL);
+  assert(dst != NULL);
+
+  for (row = 0; row < 8; ++row) {
+    const unsigned int lo = src[row * 2];
+    const unsigned int hi = src[(row * 2) + 1];
+
+    for (x = 0; x < 8; ++x) {
+      const unsigned int shift = 7 - x;
+
+      dst[(row * 8) + x] =
+          (uint8_t)((((hi >> shift) & 1) << 1) | ((lo >> shift) & 1));
+    }
+  }
+}
+
+void libyagbe_pixel_map_palette(const uint8_t* const colors,
+                                const uint8_t palette, uint8_t* const dst,
+                                const size_t count) {
+  assert(colors != NULL);
+  assert(dst != NULL);
+
+  map_palette_scalar(colors, palette, dst, 0, count);
+}
+
+void libyagbe_pixel_compose_objs(const uint8_t* const obj_shades,
+                                 const uint8_t* const behind,
+                                 const uint8_t* const bg_colors,
+                                 uint8_t* const dst, const size_t count) {
+  assert(obj_shades != NULL);
+  assert(behind != NULL);
+  assert(bg_colors != NULL);
+  assert(dst != NULL);
+
+  compose_objs_scalar(obj_shades, behind, bg_colors, dst, 0, count);
+}
+#endif
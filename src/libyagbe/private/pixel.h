@@ -0,0 +1,59 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_PIXEL_H
+#define LIBYAGBE_PIXEL_H
+
+#include <stddef.h>
+
+#include "libyagbe/compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* The pixel kernels used by the PPU. The scalar versions are the reference;
+ * SSE2 or NEON versions are used instead when the compiler targets them,
+ * unless LIBYAGBE_NO_SIMD is defined. Every kernel must produce exactly the
+ * same output as its scalar version. */
+
+/* Marks a pixel of an object line buffer as having no object on it. */
+#define LIBYAGBE_PIXEL_NO_OBJ 0xFF
+
+/* Decodes the 16 bytes of bit planes of a tile at `src` into 64 color indices
+ * at `dst`, one byte per pixel, row by row. */
+void libyagbe_pixel_decode_tile(const uint8_t* src, uint8_t* dst);
+
+/* Maps `count` color indices at `colors` to shades through `palette`, in the
+ * format of BGP, OBP0 and OBP1. */
+void libyagbe_pixel_map_palette(const uint8_t* colors, uint8_t palette,
+                                uint8_t* dst, size_t count);
+
+/* Draws a line of object shades over `dst`. Pixels where `obj_shades` is
+ * LIBYAGBE_PIXEL_NO_OBJ are left alone; pixels where `behind` is nonzero are
+ * only drawn where `bg_colors` is 0. */
+void libyagbe_pixel_compose_objs(const uint8_t* obj_shades,
+                                 const uint8_t* behind,
+                                 const uint8_t* bg_colors, uint8_t* dst,
+                                 size_t count);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_PIXEL_H */
@@ -16,4 +16,536 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include "libyagbe/ppu.h"
\ No newline at end of file
+#include "libyagbe/ppu.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/irq.h"
+#include "libyagbe/sched.h"
+#include "pixel.h"
+
+/* The length of each mode in T-cycles. Mode 3 really takes anywhere from 172
+ * to 289 cycles depending on what's being drawn, but since whole lines are
+ * rendered at once, the shortest length is used and HBLANK makes up the rest
+ * of the line. */
+enum mode_length {
+  OAM_SCAN_CYCLES = 80,
+  DRAWING_CYCLES = 172,
+  HBLANK_CYCLES = 204,
+  LINE_CYCLES = OAM_SCAN_CYCLES + DRAWING_CYCLES + HBLANK_CYCLES
+};
+
+enum lines {
+  NUM_VISIBLE_LINES = LIBYAGBE_PPU_SCREEN_HEIGHT,
+  NUM_LINES = LIBYAGBE_PPU_NUM_LINES
+};
+
+enum lcdc_bits {
+  LCDC_BG_ENABLE = 1 << 0,
+  LCDC_OBJ_ENABLE = 1 << 1,
+  LCDC_OBJ_SIZE = 1 << 2,
+  LCDC_BG_MAP = 1 << 3,
+  LCDC_TILE_DATA = 1 << 4,
+  LCDC_WINDOW_ENABLE = 1 << 5,
+  LCDC_WINDOW_MAP = 1 << 6,
+  LCDC_LCD_ENABLE = 1 << 7
+};
+
+enum stat_bits {
+  STAT_LYC_EQUAL = 1 << 2,
+  STAT_HBLANK_SELECT = 1 << 3,
+  STAT_VBLANK_SELECT = 1 << 4,
+  STAT_OAM_SCAN_SELECT = 1 << 5,
+  STAT_LYC_SELECT = 1 << 6,
+  STAT_SELECT_MASK = 0x78
+};
+
+enum obj_attributes {
+  OBJ_PALETTE = 1 << 4,
+  OBJ_X_FLIP = 1 << 5,
+  OBJ_Y_FLIP = 1 << 6,
+  OBJ_BEHIND_BG = 1 << 7
+};
+
+enum obj_limits { NUM_OBJS = 40, MAX_OBJS_PER_LINE = 10 };
+
+/* Offsets of the tile maps within VRAM. */
+enum tile_maps { TILE_MAP_0 = 0x1800, TILE_MAP_1 = 0x1C00 };
+
+enum { NUM_PIXELS = LIBYAGBE_PPU_SCREEN_WIDTH * LIBYAGBE_PPU_SCREEN_HEIGHT };
+
+/* The gray of each shade in the RGB formats. */
+static const uint16_t rgb565_shades[4] = {0xFFFF, 0xAD55, 0x52AA, 0x0000};
+static const uint8_t rgba8888_shades[4][4] = {{0xFF, 0xFF, 0xFF, 0xFF},
+                                              {0xAA, 0xAA, 0xAA, 0xFF},
+                                              {0x55, 0x55, 0x55, 0xFF},
+                                              {0x00, 0x00, 0x00, 0xFF}};
+
+static void update_stat_line(struct libyagbe_ppu* const ppu) {
+  bool line;
+
+  line = (ppu->stat & STAT_LYC_SELECT) && (ppu->ly == ppu->lyc);
+
+  switch (ppu->mode) {
+    case LIBYAGBE_PPU_MODE_HBLANK:
+      line = line || (ppu->stat & STAT_HBLANK_SELECT);
+      break;
+
+    case LIBYAGBE_PPU_MODE_VBLANK:
+      line = line || (ppu->stat & STAT_VBLANK_SELECT);
+      break;
+
+    case LIBYAGBE_PPU_MODE_OAM_SCAN:
+      line = line || (ppu->stat & STAT_OAM_SCAN_SELECT);
+      break;
+
+    case LIBYAGBE_PPU_MODE_DRAWING:
+    default:
+      break;
+  }
+
+  line = line && (ppu->lcdc & LCDC_LCD_ENABLE);
+
+  if (line && !ppu->stat_line) {
+    libyagbe_irq_request(ppu->irq, LIBYAGBE_IRQ_STAT);
+  }
+  ppu->stat_line = line;
+}
+
+static const uint8_t* get_tile_row(struct libyagbe_ppu* const ppu,
+                                   const unsigned int tile,
+                                   const unsigned int row) {
+  if (ppu->tile_dirty[tile]) {
+    libyagbe_pixel_decode_tile(&ppu->vram[tile * 16], ppu->tiles[tile][0]);
+    ppu->tile_dirty[tile] = false;
+  }
+  return ppu->tiles[tile][row];
+}
+
+/* Converts an index from a tile map into a tile number, according to the
+ * addressing mode selected in LCDC. */
+static unsigned int get_bg_tile(const struct libyagbe_ppu* const ppu,
+                                const uint8_t index) {
+  if (ppu->lcdc & LCDC_TILE_DATA) {
+    return index;
+  }
+  return (unsigned int)(256 + (int8_t)index);
+}
+
+static void render_bg(struct libyagbe_ppu* const ppu, uint8_t* const colors) {
+  const uint8_t* const map =
+      &ppu->vram[(ppu->lcdc & LCDC_BG_MAP) ? TILE_MAP_1 : TILE_MAP_0];
+  const unsigned int y = (ppu->scy + ppu->ly) & 0xFF;
+  const uint8_t* const map_row = &map[(y / 8) * 32];
+  unsigned int px = ppu->scx;
+  unsigned int x = 0;
+
+  /* Go a tile at a time, since every pixel of a tile row shares the same map
+   * entry. */
+  while (x < LIBYAGBE_PPU_SCREEN_WIDTH) {
+    const uint8_t* const src =
+        get_tile_row(ppu, get_bg_tile(ppu, map_row[px / 8]), y & 7);
+    unsigned int i;
+
+    for (i = px & 7; (i < 8) && (x < LIBYAGBE_PPU_SCREEN_WIDTH); ++i) {
+      colors[x++] = src[i];
+    }
+    px = ((px | 7) + 1) & 0xFF;
+  }
+}
+
+static bool window_is_visible(const struct libyagbe_ppu* const ppu) {
+  return (ppu->lcdc & LCDC_BG_ENABLE) && (ppu->lcdc & LCDC_WINDOW_ENABLE) &&
+         (ppu->ly >= ppu->wy) && (ppu->wx <= 166);
+}
+
+static void render_window(struct libyagbe_ppu* const ppu,
+                          uint8_t* const colors) {
+  const uint8_t* const map =
+      &ppu->vram[(ppu->lcdc & LCDC_WINDOW_MAP) ? TILE_MAP_1 : TILE_MAP_0];
+  const uint8_t* const map_row = &map[(ppu->window_line / 8) * 32];
+  const int start = ppu->wx - 7;
+  unsigned int x;
+
+  for (x = (start > 0) ? (unsigned int)start : 0;
+       x < LIBYAGBE_PPU_SCREEN_WIDTH; ++x) {
+    const unsigned int wx = x - start;
+    const uint8_t* const src = get_tile_row(
+        ppu, get_bg_tile(ppu, map_row[wx / 8]), ppu->window_line & 7);
+
+    colors[x] = src[wx & 7];
+  }
+  ppu->window_line++;
+}
+
+/* Finds the objects on the current line, in the order the hardware gives them
+ * priority: lowest X first, then lowest OAM index. */
+static unsigned int select_objs(const struct libyagbe_ppu* const ppu,
+                                const int height, uint8_t* const objs) {
+  unsigned int count = 0;
+  unsigned int i;
+
+  for (i = 0; (i < NUM_OBJS) && (count < MAX_OBJS_PER_LINE); ++i) {
+    const int y = ppu->oam[i * 4] - 16;
+
+    if ((ppu->ly >= y) && (ppu->ly < (y + height))) {
+      unsigned int j = count++;
+
+      /* Insertion sort keeps objects with equal X in OAM order. */
+      while ((j > 0) && (ppu->oam[(objs[j - 1] * 4) + 1] >
+                         ppu->oam[(i * 4) + 1])) {
+        objs[j] = objs[j - 1];
+        --j;
+      }
+      objs[j] = (uint8_t)i;
+    }
+  }
+  return count;
+}
+
+static void render_objs(struct libyagbe_ppu* const ppu,
+                        const uint8_t* const bg_colors, uint8_t* const out) {
+  const int height = (ppu->lcdc & LCDC_OBJ_SIZE) ? 16 : 8;
+  uint8_t objs[MAX_OBJS_PER_LINE];
+  uint8_t shades[LIBYAGBE_PPU_SCREEN_WIDTH];
+  uint8_t behind[LIBYAGBE_PPU_SCREEN_WIDTH];
+  unsigned int count;
+
+  count = select_objs(ppu, height, objs);
+
+  if (count == 0) {
+    return;
+  }
+
+  memset(shades, LIBYAGBE_PIXEL_NO_OBJ, sizeof(shades));
+  memset(behind, 0, sizeof(behind));
+
+  /* Draw the lowest priority object first, so the highest priority one ends
+   * up on top. */
+  while (count-- != 0) {
+    const uint8_t* const obj = &ppu->oam[objs[count] * 4];
+    const int obj_x = obj[1] - 8;
+    const uint8_t attributes = obj[3];
+    const uint8_t palette = (attributes & OBJ_PALETTE) ? ppu->obp1 : ppu->obp0;
+    unsigned int row = (unsigned int)(ppu->ly - (obj[0] - 16));
+    unsigned int tile = obj[2];
+    const uint8_t* src;
+    unsigned int i;
+
+    if (attributes & OBJ_Y_FLIP) {
+      row = (unsigned int)height - 1 - row;
+    }
+
+    if (height == 16) {
+      tile = (tile & 0xFE) + (row / 8);
+      row &= 7;
+    }
+
+    src = get_tile_row(ppu, tile, row);
+
+    for (i = 0; i < 8; ++i) {
+      const int px = obj_x + (int)i;
+      const uint8_t color = src[(attributes & OBJ_X_FLIP) ? (7 - i) : i];
+
+      if ((px < 0) || (px >= LIBYAGBE_PPU_SCREEN_WIDTH) || (color == 0)) {
+        continue;
+      }
+      shades[px] = (palette >> (color * 2)) & 0x03;
+      behind[px] = attributes & OBJ_BEHIND_BG;
+    }
+  }
+
+  libyagbe_pixel_compose_objs(shades, behind, bg_colors, out,
+                              LIBYAGBE_PPU_SCREEN_WIDTH);
+}
+
+/* Converts a line of shades into the current line of the caller's buffer. */
+static void convert_scanline(const struct libyagbe_ppu* const ppu,
+                             const uint8_t* const shades) {
+  const size_t offset = (size_t)ppu->ly * LIBYAGBE_PPU_SCREEN_WIDTH;
+  unsigned int x;
+
+  if (ppu->output.format == LIBYAGBE_PPU_PIXEL_FORMAT_RGB565) {
+    uint16_t* const dst = (uint16_t*)ppu->output.buffers[ppu->output.back];
+
+    for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; ++x) {
+      dst[offset + x] = rgb565_shades[shades[x]];
+    }
+  } else {
+    uint8_t* const dst = (uint8_t*)ppu->output.buffers[ppu->output.back];
+
+    for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; ++x) {
+      memcpy(&dst[(offset + x) * 4], rgba8888_shades[shades[x]], 4);
+    }
+  }
+}
+
+/* Returns where the shades of the current line go: straight into the
+ * caller's buffer if it holds shades, or else somewhere to convert them
+ * from. */
+static uint8_t* get_scanline(struct libyagbe_ppu* const ppu,
+                             uint8_t* const line) {
+  if (ppu->output.buffers[0] == NULL) {
+    return ppu->framebuffer[ppu->ly];
+  }
+
+  if (ppu->output.format == LIBYAGBE_PPU_PIXEL_FORMAT_INDEX) {
+    return (uint8_t*)ppu->output.buffers[ppu->output.back] +
+           ((size_t)ppu->ly * LIBYAGBE_PPU_SCREEN_WIDTH);
+  }
+  return line;
+}
+
+static void render_scanline(struct libyagbe_ppu* const ppu) {
+  uint8_t colors[LIBYAGBE_PPU_SCREEN_WIDTH];
+  uint8_t line[LIBYAGBE_PPU_SCREEN_WIDTH];
+  uint8_t* const out = get_scanline(ppu, line);
+
+  if (ppu->lcdc & LCDC_BG_ENABLE) {
+    render_bg(ppu, colors);
+
+    if (window_is_visible(ppu)) {
+      render_window(ppu, colors);
+    }
+
+    libyagbe_pixel_map_palette(colors, ppu->bgp, out,
+                               LIBYAGBE_PPU_SCREEN_WIDTH);
+  } else {
+    /* With the background off, the screen behind the objects is white. */
+    memset(colors, 0, sizeof(colors));
+    memset(out, 0, LIBYAGBE_PPU_SCREEN_WIDTH);
+  }
+
+  if (ppu->lcdc & LCDC_OBJ_ENABLE) {
+    render_objs(ppu, colors, out);
+  }
+
+  if (out == line) {
+    convert_scanline(ppu, line);
+  }
+}
+
+/* Hands the frame just drawn to the caller, and starts drawing the next one
+ * into the other buffer. */
+static void present_frame(struct libyagbe_ppu* const ppu) {
+  const void* const frame = ppu->output.buffers[ppu->output.back];
+
+  ppu->output.back ^= 1;
+  ppu->output.cb(ppu->output.userdata, frame);
+}
+
+static void handle_ppu_event(void* const userdata) {
+  struct libyagbe_ppu* const ppu = (struct libyagbe_ppu*)userdata;
+
+  switch (ppu->mode) {
+    case LIBYAGBE_PPU_MODE_OAM_SCAN:
+      ppu->mode = LIBYAGBE_PPU_MODE_DRAWING;
+      libyagbe_sched_schedule(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU,
+                              DRAWING_CYCLES);
+      return;
+
+    case LIBYAGBE_PPU_MODE_DRAWING:
+      if (ppu->render) {
+        render_scanline(ppu);
+      } else if (window_is_visible(ppu)) {
+        /* Keep counting window lines, so drawing can be turned back on in
+         * the middle of a frame. */
+        ppu->window_line++;
+      }
+
+      ppu->mode = LIBYAGBE_PPU_MODE_HBLANK;
+      libyagbe_sched_schedule(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU,
+                              HBLANK_CYCLES);
+      break;
+
+    case LIBYAGBE_PPU_MODE_HBLANK:
+      ppu->ly++;
+
+      if (ppu->ly == NUM_VISIBLE_LINES) {
+        ppu->mode = LIBYAGBE_PPU_MODE_VBLANK;
+        ppu->frame_count++;
+
+        libyagbe_irq_request(ppu->irq, LIBYAGBE_IRQ_VBLANK);
+        libyagbe_sched_schedule(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU,
+                                LINE_CYCLES);
+
+        if (ppu->render && (ppu->output.buffers[0] != NULL)) {
+          present_frame(ppu);
+        }
+      } else {
+        ppu->mode = LIBYAGBE_PPU_MODE_OAM_SCAN;
+        libyagbe_sched_schedule(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU,
+                                OAM_SCAN_CYCLES);
+      }
+      break;
+
+    case LIBYAGBE_PPU_MODE_VBLANK:
+    default:
+      ppu->ly++;
+
+      if (ppu->ly == NUM_LINES) {
+        ppu->ly = 0;
+        ppu->window_line = 0;
+        ppu->mode = LIBYAGBE_PPU_MODE_OAM_SCAN;
+
+        libyagbe_sched_schedule(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU,
+                                OAM_SCAN_CYCLES);
+      } else {
+        libyagbe_sched_schedule(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU,
+                                LINE_CYCLES);
+      }
+      break;
+  }
+  update_stat_line(ppu);
+}
+
+void libyagbe_ppu_init(struct libyagbe_ppu* const ppu,
+                       struct libyagbe_sched* const sched,
+                       struct libyagbe_irq* const irq) {
+  assert(ppu != NULL);
+  assert(sched != NULL);
+  assert(irq != NULL);
+
+  ppu->sched = sched;
+  ppu->irq = irq;
+  ppu->render = true;
+  libyagbe_ppu_set_output(ppu, LIBYAGBE_PPU_PIXEL_FORMAT_INDEX, NULL, NULL,
+                          NULL, NULL);
+
+  libyagbe_sched_register(sched, LIBYAGBE_SCHED_EVENT_PPU, &handle_ppu_event,
+                          ppu);
+}
+
+void libyagbe_ppu_reset(struct libyagbe_ppu* const ppu) {
+  assert(ppu != NULL);
+
+  ppu->lcdc = 0x91;
+  ppu->stat = 0x00;
+  ppu->scy = 0x00;
+  ppu->scx = 0x00;
+  ppu->ly = 0x00;
+  ppu->lyc = 0x00;
+  ppu->bgp = 0xFC;
+  ppu->obp0 = 0xFF;
+  ppu->obp1 = 0xFF;
+  ppu->wy = 0x00;
+  ppu->wx = 0x00;
+
+  ppu->mode = LIBYAGBE_PPU_MODE_OAM_SCAN;
+  ppu->window_line = 0;
+  ppu->stat_line = false;
+  ppu->frame_count = 0;
+
+  /* Cleared VRAM decodes to cleared tiles, so nothing is dirty. */
+  memset(ppu->vram, 0, sizeof(ppu->vram));
+  memset(ppu->oam, 0, sizeof(ppu->oam));
+  memset(ppu->tiles, 0, sizeof(ppu->tiles));
+  memset(ppu->tile_dirty, false, sizeof(ppu->tile_dirty));
+  memset(ppu->framebuffer, 0, sizeof(ppu->framebuffer));
+
+  libyagbe_sched_schedule(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU,
+                          OAM_SCAN_CYCLES);
+  update_stat_line(ppu);
+}
+
+size_t libyagbe_ppu_get_frame_size(
+    const enum libyagbe_ppu_pixel_format format) {
+  switch (format) {
+    case LIBYAGBE_PPU_PIXEL_FORMAT_RGB565:
+      return NUM_PIXELS * sizeof(uint16_t);
+
+    case LIBYAGBE_PPU_PIXEL_FORMAT_RGBA8888:
+      return (size_t)NUM_PIXELS * 4;
+
+    case LIBYAGBE_PPU_PIXEL_FORMAT_INDEX:
+    default:
+      return NUM_PIXELS;
+  }
+}
+
+void libyagbe_ppu_set_output(struct libyagbe_ppu* const ppu,
+                             const enum libyagbe_ppu_pixel_format format,
+                             void* const buffer0, void* const buffer1,
+                             const libyagbe_ppu_frame_cb cb,
+                             void* const userdata) {
+  assert(ppu != NULL);
+  assert((buffer0 == NULL) || ((buffer1 != NULL) && (cb != NULL)));
+
+  ppu->output.buffers[0] = buffer0;
+  ppu->output.buffers[1] = (buffer0 != NULL) ? buffer1 : NULL;
+  ppu->output.format = format;
+  ppu->output.back = 0;
+  ppu->output.cb = cb;
+  ppu->output.userdata = userdata;
+}
+
+void libyagbe_ppu_write_tile_data(struct libyagbe_ppu* const ppu,
+                                  const uint16_t address, const uint8_t data) {
+  assert(ppu != NULL);
+  assert(address < (LIBYAGBE_PPU_NUM_TILES * 16));
+
+  if (ppu->vram[address] != data) {
+    ppu->vram[address] = data;
+    ppu->tile_dirty[address / 16] = true;
+  }
+}
+
+void libyagbe_ppu_write_lcdc(struct libyagbe_ppu* const ppu,
+                             const uint8_t data) {
+  const bool was_on = (ppu->lcdc & LCDC_LCD_ENABLE) != 0;
+  const bool is_on = (data & LCDC_LCD_ENABLE) != 0;
+
+  assert(ppu != NULL);
+
+  ppu->lcdc = data;
+
+  if (was_on && !is_on) {
+    /* The PPU stops dead, and starts again from the top of the frame. */
+    libyagbe_sched_cancel(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU);
+
+    ppu->ly = 0;
+    ppu->window_line = 0;
+    ppu->mode = LIBYAGBE_PPU_MODE_HBLANK;
+  } else if (!was_on && is_on) {
+    ppu->mode = LIBYAGBE_PPU_MODE_OAM_SCAN;
+    libyagbe_sched_schedule(ppu->sched, LIBYAGBE_SCHED_EVENT_PPU,
+                            OAM_SCAN_CYCLES);
+  }
+  update_stat_line(ppu);
+}
+
+uint8_t libyagbe_ppu_read_stat(const struct libyagbe_ppu* const ppu) {
+  uint8_t stat;
+
+  assert(ppu != NULL);
+
+  stat = 0x80 | ppu->stat;
+
+  if (ppu->ly == ppu->lyc) {
+    stat |= STAT_LYC_EQUAL;
+  }
+
+  /* The mode reads as 0 while the LCD is off. */
+  if (ppu->lcdc & LCDC_LCD_ENABLE) {
+    stat |= (uint8_t)ppu->mode;
+  }
+  return stat;
+}
+
+void libyagbe_ppu_write_stat(struct libyagbe_ppu* const ppu,
+                             const uint8_t data) {
+  assert(ppu != NULL);
+
+  ppu->stat = data & STAT_SELECT_MASK;
+  update_stat_line(ppu);
+}
+
+void libyagbe_ppu_write_lyc(struct libyagbe_ppu* const ppu,
+                            const uint8_t data) {
+  assert(ppu != NULL);
+
+  ppu->lyc = data;
+  update_stat_line(ppu);
+}
@@ -0,0 +1,98 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/profile.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/bus.h"
+#include "profile_hooks.h"
+
+/* Marks that nothing has been fetched yet. */
+enum { NO_OPCODE = 0x200 };
+
+bool libyagbe_profile_is_supported(void) {
+#ifdef LIBYAGBE_ENABLE_PROFILE
+  return true;
+#else
+  return false;
+#endif /* LIBYAGBE_ENABLE_PROFILE */
+}
+
+void libyagbe_profile_reset(struct libyagbe_profile* const profile) {
+  assert(profile != NULL);
+
+  memset(profile, 0, sizeof(*profile));
+  profile->sample_countdown = LIBYAGBE_PROFILE_SAMPLE_PERIOD;
+  profile->current = NO_OPCODE;
+}
+
+void libyagbe_profile_begin_step(struct libyagbe_profile* const profile) {
+  profile->current = NO_OPCODE;
+}
+
+static void sample_pc(struct libyagbe_profile* const profile,
+                      const struct libyagbe_bus* const bus,
+                      const uint16_t pc) {
+  const uint8_t* const page = bus->read_map[pc >> LIBYAGBE_BUS_PAGE_SHIFT];
+  const uint8_t* const rom = bus->cart.data;
+
+  /* The bank comes from wherever the page is mapped to, which accounts for
+   * every quirk of the cartridge's banking. */
+  if ((page != NULL) && (page >= rom) && (page < (rom + bus->cart.size))) {
+    const size_t offset = (size_t)(page - rom) + (pc & LIBYAGBE_BUS_PAGE_MASK);
+    const size_t bank = offset >> 14;
+
+    if (bank < LIBYAGBE_PROFILE_NUM_ROM_BANKS) {
+      profile->rom_samples[bank][(offset & 0x3FFF) >>
+                                 LIBYAGBE_PROFILE_BUCKET_SHIFT]++;
+    }
+  } else if (pc >= 0x8000) {
+    profile->ram_samples[(pc - 0x8000) >> LIBYAGBE_PROFILE_BUCKET_SHIFT]++;
+  }
+}
+
+void libyagbe_profile_end_step(struct libyagbe_profile* const profile,
+                               const struct libyagbe_bus* const bus,
+                               const uint16_t pc, const unsigned int cycles) {
+  struct libyagbe_profile_opcode* opcode;
+
+  /* Interrupts being serviced and halted steps aren't instructions. */
+  if (profile->current == NO_OPCODE) {
+    return;
+  }
+
+  /* $CB opcodes count towards $CB itself too. */
+  if (profile->current & 0x100) {
+    opcode = &profile->cb_opcodes[profile->current & 0xFF];
+    opcode->count++;
+    opcode->cycles += cycles;
+
+    profile->current = 0xCB;
+  }
+  opcode = &profile->opcodes[profile->current];
+  opcode->count++;
+  opcode->cycles += cycles;
+
+  if (--profile->sample_countdown == 0) {
+    profile->sample_countdown = LIBYAGBE_PROFILE_SAMPLE_PERIOD;
+    sample_pc(profile, bus, pc);
+  }
+}
@@ -0,0 +1,74 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* The hooks the CPU and bus call into the profiler through. Without
+ * LIBYAGBE_ENABLE_PROFILE defined they expand to nothing, so the hot paths are
+ * exactly what they would be without a profiler. */
+
+#ifndef LIBYAGBE_PROFILE_HOOKS_H
+#define LIBYAGBE_PROFILE_HOOKS_H
+
+#include "libyagbe/compat/compat_stdint.h"
+#include "libyagbe/diag.h"
+#include "libyagbe/profile.h"
+
+struct libyagbe_bus;
+
+#ifdef LIBYAGBE_ENABLE_PROFILE
+
+/* Marks an opcode, or a $CB opcode if `table` is 1, as the one executing. */
+#define PROFILE_OPCODE(bus, table, opcode)                                    \
+  do {                                                                        \
+    if ((bus)->profile != NULL) {                                             \
+      (bus)->profile->current = ((unsigned int)(table) << 8) | (opcode);      \
+    }                                                                         \
+  } while (0)
+
+/* Counts an access to $FF00-$FFFF. */
+#define PROFILE_IO(bus, access, address)                                      \
+  do {                                                                        \
+    if (((bus)->profile != NULL) && ((address) >= 0xFF00)) {                  \
+      (bus)->profile->io_accesses[(access)][(address) & 0xFF]++;              \
+    }                                                                         \
+  } while (0)
+
+#else
+
+#define PROFILE_OPCODE(bus, table, opcode) ((void)0)
+#define PROFILE_IO(bus, access, address) ((void)0)
+
+#endif /* LIBYAGBE_ENABLE_PROFILE */
+
+/** Prepares to profile a CPU step.
+ *
+ * @param profile The profile.
+ */
+void libyagbe_profile_begin_step(struct libyagbe_profile* const profile);
+
+/** Records a CPU step, if it executed an instruction.
+ *
+ * @param profile The profile.
+ * @param bus The bus the step was run on.
+ * @param pc Where the instruction was fetched from.
+ * @param cycles The T-cycles the step took.
+ */
+void libyagbe_profile_end_step(struct libyagbe_profile* const profile,
+                               const struct libyagbe_bus* const bus,
+                               const uint16_t pc, const unsigned int cycles);
+
+#endif /* LIBYAGBE_PROFILE_HOOKS_H */
@@ -0,0 +1,347 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/rewind.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/gb.h"
+
+/* States are encoded as a series of runs, each starting with a byte giving
+ * its length less one in the low 7 bits. If the top bit is set, that many
+ * bytes to XOR in follow; otherwise that many bytes are left alone. */
+enum run_encoding { RUN_LITERAL = 0x80, MAX_RUN_LENGTH = 128 };
+
+enum entry_kind { ENTRY_KEYFRAME, ENTRY_DELTA };
+
+/* Marks the lack of a previous entry. */
+#define NO_ENTRY ((size_t)-1)
+
+/* Precedes every state in the data area. */
+struct entry_header {
+  /* The size of the encoded state following the header. */
+  size_t size;
+
+  /* The offset of the entry pushed before this one, or NO_ENTRY. */
+  size_t prev;
+
+  /* The offset of the keyframe this entry is stored against. */
+  size_t keyframe;
+
+  enum entry_kind kind;
+};
+
+/* Returns the most an encoded state can take up. The worst case is long runs
+ * of literals, which cost one byte in 128. */
+static size_t get_max_encoded_size(const size_t state_size) {
+  return state_size + (state_size / 64) + 16;
+}
+
+static size_t get_max_entry_size(const size_t state_size) {
+  return sizeof(struct entry_header) + get_max_encoded_size(state_size);
+}
+
+static struct entry_header read_header(const struct libyagbe_rewind* const rw,
+                                       const size_t offset) {
+  struct entry_header header;
+
+  memcpy(&header, &rw->data[offset], sizeof(header));
+  return header;
+}
+
+/* Encodes the XOR of a state and a base, or the state itself if the base is
+ * NULL. Returns the size of the encoded state. */
+static size_t encode_state(uint8_t* const dst, const uint8_t* const state,
+                           const uint8_t* const base, const size_t size) {
+#define GET_BYTE(i) ((base != NULL) ? (state[i] ^ base[i]) : state[i])
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < size) {
+    size_t start;
+    size_t length = 0;
+
+    while (((in + length) < size) && (length < MAX_RUN_LENGTH) &&
+           (GET_BYTE(in + length) == 0)) {
+      length++;
+    }
+
+    if (length != 0) {
+      dst[out++] = (uint8_t)(length - 1);
+      in += length;
+
+      continue;
+    }
+
+    /* Single zeros are cheaper to keep inside a literal run than to end it
+     * for. */
+    start = out++;
+
+    while ((in < size) && (length < MAX_RUN_LENGTH)) {
+      const uint8_t data = GET_BYTE(in);
+
+      if ((data == 0) && (((in + 1) >= size) || (GET_BYTE(in + 1) == 0))) {
+        break;
+      }
+      dst[out++] = data;
+      in++;
+      length++;
+    }
+    dst[start] = (uint8_t)(RUN_LITERAL | (length - 1));
+  }
+  return out;
+#undef GET_BYTE
+}
+
+/* XORs an encoded state into `dst`. */
+static void apply_state(uint8_t* const dst, const uint8_t* const src,
+                        const size_t size) {
+  size_t in = 0;
+  size_t pos = 0;
+
+  while (in < size) {
+    const uint8_t run = src[in++];
+    const size_t length = (size_t)(run & ~RUN_LITERAL) + 1;
+
+    if (run & RUN_LITERAL) {
+      size_t i;
+
+      for (i = 0; i < length; ++i) {
+        dst[pos + i] ^= src[in + i];
+      }
+      in += length;
+    }
+    pos += length;
+  }
+}
+
+static void apply_entry(const struct libyagbe_rewind* const rw,
+                        uint8_t* const dst, const size_t offset) {
+  const struct entry_header header = read_header(rw, offset);
+
+  apply_state(dst, &rw->data[offset + sizeof(header)], header.size);
+}
+
+/* Throws away the oldest state. */
+static void evict_oldest(struct libyagbe_rewind* const rw) {
+  const struct entry_header header = read_header(rw, rw->oldest);
+
+  if (rw->oldest == rw->keyframe_offset) {
+    rw->keyframe_valid = false;
+  }
+
+  if (--rw->count == 0) {
+    libyagbe_rewind_clear(rw);
+    return;
+  }
+
+  rw->oldest += sizeof(header) + header.size;
+
+  if (rw->wrapped && (rw->oldest == rw->end)) {
+    rw->oldest = 0;
+    rw->wrapped = false;
+    rw->end = rw->data_size;
+  }
+}
+
+/* Throws away the oldest keyframe, and every state stored against it. */
+static void evict_oldest_keyframe(struct libyagbe_rewind* const rw) {
+  evict_oldest(rw);
+
+  while ((rw->count != 0) &&
+         (read_header(rw, rw->oldest).kind != ENTRY_KEYFRAME)) {
+    evict_oldest(rw);
+  }
+}
+
+/* Makes room for a state at the write position, throwing away old states as
+ * needed. */
+static void reserve(struct libyagbe_rewind* const rw, const size_t size) {
+  for (;;) {
+    if (rw->count == 0) {
+      return;
+    }
+
+    if (!rw->wrapped) {
+      if ((rw->data_size - rw->write_pos) >= size) {
+        return;
+      }
+
+      if (rw->oldest >= size) {
+        rw->wrapped = true;
+        rw->end = rw->write_pos;
+        rw->write_pos = 0;
+
+        return;
+      }
+    } else if ((rw->oldest - rw->write_pos) >= size) {
+      return;
+    }
+    evict_oldest_keyframe(rw);
+  }
+}
+
+size_t libyagbe_rewind_get_min_storage(const size_t state_size) {
+  return (state_size * 2) + get_max_entry_size(state_size);
+}
+
+bool libyagbe_rewind_init(struct libyagbe_rewind* const rw,
+                          const size_t state_size, void* const storage,
+                          const size_t size,
+                          const unsigned int keyframe_interval) {
+  assert(rw != NULL);
+  assert(storage != NULL);
+  assert(keyframe_interval != 0);
+
+  if (size < libyagbe_rewind_get_min_storage(state_size)) {
+    return false;
+  }
+
+  rw->state_size = state_size;
+  rw->keyframe = (uint8_t*)storage;
+  rw->scratch = &rw->keyframe[state_size];
+  rw->data = &rw->scratch[state_size];
+  rw->data_size = size - (state_size * 2);
+  rw->keyframe_interval = keyframe_interval;
+
+  libyagbe_rewind_clear(rw);
+  return true;
+}
+
+void libyagbe_rewind_clear(struct libyagbe_rewind* const rw) {
+  assert(rw != NULL);
+
+  rw->since_keyframe = 0;
+  rw->keyframe_valid = false;
+  rw->keyframe_offset = NO_ENTRY;
+  rw->oldest = 0;
+  rw->newest = NO_ENTRY;
+  rw->write_pos = 0;
+  rw->wrapped = false;
+  rw->end = rw->data_size;
+  rw->count = 0;
+}
+
+void libyagbe_rewind_push(struct libyagbe_rewind* const rw,
+                          const struct libyagbe_system* const gb) {
+  struct entry_header header;
+  size_t offset;
+  size_t saved;
+
+  assert(rw != NULL);
+  assert(gb != NULL);
+
+  saved = libyagbe_system_save_state(gb, rw->scratch, rw->state_size);
+
+  assert(saved == rw->state_size);
+  (void)saved;
+
+  reserve(rw, get_max_entry_size(rw->state_size));
+
+  /* Making room may have thrown away the keyframe. */
+  header.kind = (rw->keyframe_valid &&
+                 (rw->since_keyframe < rw->keyframe_interval))
+                    ? ENTRY_DELTA
+                    : ENTRY_KEYFRAME;
+
+  offset = rw->write_pos;
+
+  header.size = encode_state(
+      &rw->data[offset + sizeof(header)], rw->scratch,
+      (header.kind == ENTRY_DELTA) ? rw->keyframe : NULL, rw->state_size);
+  header.prev = (rw->count != 0) ? rw->newest : NO_ENTRY;
+
+  if (header.kind == ENTRY_KEYFRAME) {
+    memcpy(rw->keyframe, rw->scratch, rw->state_size);
+
+    rw->keyframe_valid = true;
+    rw->keyframe_offset = offset;
+    rw->since_keyframe = 0;
+  } else {
+    rw->since_keyframe++;
+  }
+  header.keyframe = rw->keyframe_offset;
+
+  memcpy(&rw->data[offset], &header, sizeof(header));
+
+  if (rw->count == 0) {
+    rw->oldest = offset;
+  }
+  rw->newest = offset;
+  rw->write_pos = offset + sizeof(header) + header.size;
+  rw->count++;
+}
+
+bool libyagbe_rewind_pop(struct libyagbe_rewind* const rw,
+                         struct libyagbe_system* const gb) {
+  struct entry_header header;
+  size_t offset;
+  bool loaded;
+
+  assert(rw != NULL);
+  assert(gb != NULL);
+
+  if (rw->count == 0) {
+    return false;
+  }
+
+  offset = rw->newest;
+  header = read_header(rw, offset);
+
+  /* Start from the keyframe, which is usually the latest one and so already
+   * decoded. */
+  if (rw->keyframe_valid && (header.keyframe == rw->keyframe_offset)) {
+    memcpy(rw->scratch, rw->keyframe, rw->state_size);
+  } else {
+    memset(rw->scratch, 0, rw->state_size);
+    apply_entry(rw, rw->scratch, header.keyframe);
+  }
+
+  if (header.kind == ENTRY_DELTA) {
+    apply_entry(rw, rw->scratch, offset);
+  }
+
+  loaded = libyagbe_system_load_state(gb, rw->scratch, rw->state_size);
+
+  assert(loaded);
+  (void)loaded;
+
+  if (offset == rw->keyframe_offset) {
+    rw->keyframe_valid = false;
+  } else if (rw->since_keyframe != 0) {
+    rw->since_keyframe--;
+  }
+
+  if (--rw->count == 0) {
+    libyagbe_rewind_clear(rw);
+    return true;
+  }
+
+  rw->newest = header.prev;
+  rw->write_pos = offset;
+
+  /* Popping the first state after the wrap undoes it. */
+  if (rw->wrapped && (offset == 0)) {
+    rw->wrapped = false;
+    rw->write_pos = rw->end;
+    rw->end = rw->data_size;
+  }
+  return true;
+}
@@ -0,0 +1,231 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if !defined(_WIN32) && (defined(__unix__) || defined(__APPLE__))
+#define _POSIX_C_SOURCE 200112L
+#define ROM_USE_MMAP
+#endif
+
+#include "libyagbe/rom.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(ROM_USE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "libyagbe/cart.h"
+
+/* Anything smaller than this can't be mapped as it is, since the bus would
+ * read past the end of the file. */
+enum { MIN_ROM_SIZE = 2 * LIBYAGBE_CART_MEM_SIZE_ROM_BANK };
+
+/* Reads a whole file into memory, padding it to at least MIN_ROM_SIZE. */
+static bool read_rom(struct libyagbe_rom* const rom, const char* const path) {
+  FILE* const rom_file = fopen(path, "rb");
+  long rom_file_size;
+  size_t alloc_size;
+  uint8_t* data;
+
+  if (rom_file == NULL) {
+    return false;
+  }
+
+  if ((fseek(rom_file, 0, SEEK_END) != 0) ||
+      ((rom_file_size = ftell(rom_file)) < 0) ||
+      (fseek(rom_file, 0, SEEK_SET) != 0)) {
+    fclose(rom_file);
+    return false;
+  }
+
+  alloc_size = (size_t)rom_file_size;
+
+  if (alloc_size < MIN_ROM_SIZE) {
+    alloc_size = MIN_ROM_SIZE;
+  }
+
+  data = calloc(alloc_size, sizeof(uint8_t));
+
+  if ((data == NULL) || (fread(data, sizeof(uint8_t), (size_t)rom_file_size,
+                               rom_file) != (size_t)rom_file_size)) {
+    free(data);
+    fclose(rom_file);
+
+    return false;
+  }
+
+  fclose(rom_file);
+
+  rom->data = data;
+  rom->size = alloc_size;
+  rom->storage = LIBYAGBE_ROM_STORAGE_ALLOCATED;
+  rom->mapping = NULL;
+
+  return true;
+}
+
+#ifdef _WIN32
+/* Maps a file into memory.
+ *
+ * @returns true if the file was mapped, or false if it should be read instead.
+ */
+static bool map_rom(struct libyagbe_rom* const rom, const char* const path) {
+  HANDLE file;
+  HANDLE mapping;
+  DWORD size_high;
+  DWORD size_low;
+  void* view;
+
+  file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                     FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  size_low = GetFileSize(file, &size_high);
+
+  if (((size_low == INVALID_FILE_SIZE) && (GetLastError() != NO_ERROR)) ||
+      (size_high != 0) || (size_low < MIN_ROM_SIZE)) {
+    CloseHandle(file);
+    return false;
+  }
+
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+  /* The mapping keeps the file alive on its own. */
+  CloseHandle(file);
+
+  if (mapping == NULL) {
+    return false;
+  }
+
+  view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+  if (view == NULL) {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  rom->data = (const uint8_t*)view;
+  rom->size = (size_t)size_low;
+  rom->storage = LIBYAGBE_ROM_STORAGE_MAPPED;
+  rom->mapping = mapping;
+
+  return true;
+}
+#elif defined(ROM_USE_MMAP)
+/* Maps a file into memory.
+ *
+ * @returns true if the file was mapped, or false if it should be read instead.
+ */
+static bool map_rom(struct libyagbe_rom* const rom, const char* const path) {
+  struct stat st;
+  void* view;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+      (st.st_size < MIN_ROM_SIZE)) {
+    close(fd);
+    return false;
+  }
+
+  view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  /* The mapping keeps the file alive on its own. */
+  close(fd);
+
+  if (view == MAP_FAILED) {
+    return false;
+  }
+
+  rom->data = (const uint8_t*)view;
+  rom->size = (size_t)st.st_size;
+  rom->storage = LIBYAGBE_ROM_STORAGE_MAPPED;
+  rom->mapping = NULL;
+
+  return true;
+}
+#else
+static bool map_rom(struct libyagbe_rom* const rom, const char* const path) {
+  (void)rom;
+  (void)path;
+
+  return false;
+}
+#endif /* _WIN32 */
+
+bool libyagbe_rom_open(struct libyagbe_rom* const rom, const char* const path) {
+  assert(rom != NULL);
+  assert(path != NULL);
+
+  return map_rom(rom, path) || read_rom(rom, path);
+}
+
+void libyagbe_rom_from_buffer(struct libyagbe_rom* const rom,
+                              const uint8_t* const data, const size_t size) {
+  assert(rom != NULL);
+  assert(data != NULL);
+
+  rom->data = data;
+  rom->size = size;
+  rom->storage = LIBYAGBE_ROM_STORAGE_BUFFER;
+  rom->mapping = NULL;
+}
+
+void libyagbe_rom_close(struct libyagbe_rom* const rom) {
+  assert(rom != NULL);
+
+  switch (rom->storage) {
+    case LIBYAGBE_ROM_STORAGE_MAPPED:
+#ifdef _WIN32
+      UnmapViewOfFile(rom->data);
+      CloseHandle((HANDLE)rom->mapping);
+#elif defined(ROM_USE_MMAP)
+      munmap((void*)rom->data, rom->size);
+#endif /* _WIN32 */
+      break;
+
+    case LIBYAGBE_ROM_STORAGE_ALLOCATED:
+      free((void*)rom->data);
+      break;
+
+    case LIBYAGBE_ROM_STORAGE_BUFFER:
+    default:
+      break;
+  }
+
+  rom->data = NULL;
+  rom->size = 0;
+  rom->storage = LIBYAGBE_ROM_STORAGE_BUFFER;
+  rom->mapping = NULL;
+}
@@ -24,19 +24,8 @@
 #include "libyagbe/compat/compat_stdint.h"
 #include "utility.h"
 
-/** @brief The maximum number of events possible. */
-#define MAX_EVENTS 10
-
-/** @brief The total number of T-cycles which have passed since the start of
- * the emulation.
- */
-static uintmax_t current_timestamp = 0;
-
-/** @brief The current number of events queued. */
-static size_t heap_size = 0;
-
-/** @brief An array containing \ref libyagbe_sched_event structures. */
-static struct libyagbe_sched_event events[MAX_EVENTS];
+/** @brief The heap index of an event type which isn't queued. */
+#define NOT_QUEUED ((size_t)LIBYAGBE_SCHED_NUM_EVENT_TYPES)
 
 static size_t get_parent_node(const size_t index) { return (index - 1) / 2; }
 
@@ -48,10 +37,29 @@ static size_t get_right_child_of_node(const size_t index) {
   return (index * 2) + 2;
 }
 
-/** @brief Returns the expiry time of the root event. */
-static unsigned int find_min(void) { return events[0].expiry_time; }
+/** @brief Returns the expiry time of the event at a given heap node. */
+static uintmax_t expiry_of_node(const struct libyagbe_sched* const sched,
+                                   const size_t node) {
+  return sched->events[sched->heap[node]].expiry_time;
+}
+
+/** @brief Swaps two heap nodes, keeping the index of each type up to date. */
+static void swap_nodes(struct libyagbe_sched* const sched, const size_t a,
+                       const size_t b) {
+  SWAP(sched->heap[a], sched->heap[b], uint8_t);
+
+  sched->heap_index[sched->heap[a]] = a;
+  sched->heap_index[sched->heap[b]] = b;
+}
+
+/** @brief Refreshes the cached deadline after the heap has changed. */
+static void update_deadline(struct libyagbe_sched* const sched) {
+  sched->deadline = (sched->heap_size != 0) ? expiry_of_node(sched, 0)
+                                            : LIBYAGBE_SCHED_NO_DEADLINE;
+}
 
-static void heapify_top_bottom(const size_t parent_node) {
+static void heapify_top_bottom(struct libyagbe_sched* const sched,
+                               const size_t parent_node) {
   size_t left_node;
   size_t right_node;
   size_t smallest_node;
@@ -60,79 +68,193 @@ static void heapify_top_bottom(const size_t parent_node) {
   right_node = get_right_child_of_node(parent_node);
   smallest_node = parent_node;
 
-  if ((smallest_node < heap_size) &&
-      (events[left_node].expiry_time < events[smallest_node].expiry_time)) {
+  if ((left_node < sched->heap_size) &&
+      (expiry_of_node(sched, left_node) <
+       expiry_of_node(sched, smallest_node))) {
     smallest_node = left_node;
   }
 
-  if ((right_node < heap_size) &&
-      events[right_node].expiry_time < events[smallest_node].expiry_time) {
+  if ((right_node < sched->heap_size) &&
+      (expiry_of_node(sched, right_node) <
+       expiry_of_node(sched, smallest_node))) {
     smallest_node = right_node;
   }
 
   if (smallest_node != parent_node) {
-    SWAP(events[smallest_node], events[parent_node],
-         struct libyagbe_sched_event);
+    swap_nodes(sched, smallest_node, parent_node);
+    heapify_top_bottom(sched, smallest_node);
+  }
+}
+
+static void heapify_bottom_top(struct libyagbe_sched* const sched,
+                               const size_t index) {
+  size_t parent_node;
 
-    heapify_top_bottom(smallest_node);
+  /* The root node has no parent. */
+  if (index == 0) {
+    return;
+  }
+
+  parent_node = get_parent_node(index);
+
+  if (expiry_of_node(sched, parent_node) > expiry_of_node(sched, index)) {
+    swap_nodes(sched, parent_node, index);
+    heapify_bottom_top(sched, parent_node);
   }
 }
 
-/** @brief Returns the node of minimum value after removing it from the heap. */
-static struct libyagbe_sched_event extract_min(void) {
-  struct libyagbe_sched_event event;
-  assert(heap_size != 0);
+/** @brief Removes the node at a given index from the heap. */
+static void remove_node(struct libyagbe_sched* const sched, const size_t node) {
+  const size_t last_node = --sched->heap_size;
 
-  event = events[0];
-  heap_size--;
+  sched->heap_index[sched->heap[node]] = NOT_QUEUED;
 
-  if (heap_size == 0) {
-    memset(&events[0], 0, sizeof(struct libyagbe_sched_event));
-  } else {
-    events[0] = events[heap_size];
+  if (node != last_node) {
+    sched->heap[node] = sched->heap[last_node];
+    sched->heap_index[sched->heap[node]] = node;
+
+    /* The event moved into the hole may belong either above or below it. */
+    heapify_bottom_top(sched, node);
+    heapify_top_bottom(sched, sched->heap_index[sched->heap[node]]);
   }
-  heapify_top_bottom(0);
-  return event;
+  update_deadline(sched);
 }
 
-static void heapify_bottom_top(const size_t index) {
-  size_t parent_node;
+void libyagbe_sched_register(struct libyagbe_sched* const sched,
+                             const enum libyagbe_sched_event_type type,
+                             const libyagbe_sched_event_cb cb_func,
+                             void* const userdata) {
+  assert(sched != NULL);
+  assert(type < LIBYAGBE_SCHED_NUM_EVENT_TYPES);
+  assert(cb_func != NULL);
 
-  parent_node = get_parent_node(index);
+  sched->events[type].cb_func = cb_func;
+  sched->events[type].userdata = userdata;
+}
+
+void libyagbe_sched_schedule(struct libyagbe_sched* const sched,
+                             const enum libyagbe_sched_event_type type,
+                             const unsigned int cycles) {
+  size_t node;
+
+  assert(sched != NULL);
+  assert(type < LIBYAGBE_SCHED_NUM_EVENT_TYPES);
+  assert(sched->events[type].cb_func != NULL);
+
+  sched->events[type].expiry_time = sched->current_timestamp + cycles;
 
-  if (events[parent_node].expiry_time > events[index].expiry_time) {
-    SWAP(events[parent_node], events[index], struct libyagbe_sched_event);
-    heapify_bottom_top(parent_node);
+  node = sched->heap_index[type];
+
+  if (node == NOT_QUEUED) {
+    node = sched->heap_size++;
+
+    sched->heap[node] = (uint8_t)type;
+    sched->heap_index[type] = node;
+
+    heapify_bottom_top(sched, node);
+  } else {
+    /* The event may have moved in either direction. */
+    heapify_bottom_top(sched, node);
+    heapify_top_bottom(sched, sched->heap_index[type]);
   }
+  update_deadline(sched);
 }
 
-void libyagbe_sched_insert(struct libyagbe_sched_event* const event) {
-  assert(heap_size != (MAX_EVENTS - 1));
+void libyagbe_sched_cancel(struct libyagbe_sched* const sched,
+                           const enum libyagbe_sched_event_type type) {
+  assert(sched != NULL);
+  assert(type < LIBYAGBE_SCHED_NUM_EVENT_TYPES);
+
+  if (sched->heap_index[type] != NOT_QUEUED) {
+    remove_node(sched, sched->heap_index[type]);
+  }
+}
 
-  events[heap_size] = *event;
-  events[heap_size].expiry_time += current_timestamp;
+bool libyagbe_sched_is_scheduled(const struct libyagbe_sched* const sched,
+                                 const enum libyagbe_sched_event_type type) {
+  assert(sched != NULL);
+  assert(type < LIBYAGBE_SCHED_NUM_EVENT_TYPES);
 
-  heapify_bottom_top(heap_size++);
+  return sched->heap_index[type] != NOT_QUEUED;
 }
 
-void libyagbe_sched_reset(void) {
-  current_timestamp = 0;
-  memset(&events, 0, sizeof(events));
-  heap_size = 0;
+bool libyagbe_sched_restore_heap(struct libyagbe_sched* const sched) {
+  size_t node;
+  size_t type;
+
+  assert(sched != NULL);
+
+  if (sched->heap_size > LIBYAGBE_SCHED_NUM_EVENT_TYPES) {
+    return false;
+  }
+
+  for (type = 0; type < LIBYAGBE_SCHED_NUM_EVENT_TYPES; ++type) {
+    sched->heap_index[type] = NOT_QUEUED;
+  }
+
+  for (node = 0; node < sched->heap_size; ++node) {
+    type = sched->heap[node];
+
+    if ((type >= LIBYAGBE_SCHED_NUM_EVENT_TYPES) ||
+        (sched->heap_index[type] != NOT_QUEUED)) {
+      return false;
+    }
+
+    /* Handling an event sets the time to when it was due, which mustn't take
+     * the clock backwards. */
+    if (sched->events[type].expiry_time < sched->current_timestamp) {
+      return false;
+    }
+
+    if ((node != 0) && (expiry_of_node(sched, node) <
+                        expiry_of_node(sched, get_parent_node(node)))) {
+      return false;
+    }
+    sched->heap_index[type] = node;
+  }
+
+  update_deadline(sched);
+  return true;
 }
 
-void libyagbe_sched_step(void) {
-  unsigned int expiry_time;
-  current_timestamp += 4;
+void libyagbe_sched_reset(struct libyagbe_sched* const sched) {
+  size_t type;
 
-  if (heap_size == 0) {
-    return;
+  assert(sched != NULL);
+
+  sched->current_timestamp = 0;
+  sched->heap_size = 0;
+  sched->deadline = LIBYAGBE_SCHED_NO_DEADLINE;
+
+  for (type = 0; type < LIBYAGBE_SCHED_NUM_EVENT_TYPES; ++type) {
+    sched->heap_index[type] = NOT_QUEUED;
+    sched->events[type].expiry_time = 0;
   }
+}
+
+void libyagbe_sched_advance(struct libyagbe_sched* const sched,
+                            const uintmax_t cycles) {
+  uintmax_t end;
+
+  assert(sched != NULL);
+  end = sched->current_timestamp + cycles;
 
-  expiry_time = find_min();
+  while (sched->deadline <= end) {
+    const struct libyagbe_sched_event event = sched->events[sched->heap[0]];
 
-  if (current_timestamp == expiry_time) {
-    struct libyagbe_sched_event event = extract_min();
+    /* Handlers see the time at which their event was due, so anything they
+     * queue relative to "now" lands exactly where it would have if the clock
+     * had been advanced one cycle at a time. */
+    sched->current_timestamp = event.expiry_time;
+
+    /* The event is removed before its handler runs so that the handler is
+     * free to queue it again. */
+    remove_node(sched, 0);
     event.cb_func(event.userdata);
   }
+  sched->current_timestamp = end;
+}
+
+void libyagbe_sched_step(struct libyagbe_sched* const sched) {
+  libyagbe_sched_advance(sched, 4);
 }
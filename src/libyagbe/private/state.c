@@ -0,0 +1,494 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libyagbe/gb.h"
+
+/* A save state is a header followed by the state of every component, in a
+ * fixed order. Every value is stored little endian at a fixed width, so that a
+ * state can be loaded on any host. Nothing derived from other state (such as
+ * the memory map, the decoded tiles or the pending interrupts) is stored. */
+enum state_header {
+  STATE_HEADER_SIZE = 16,
+
+  /* The offsets of the cartridge header bytes which identify the game. */
+  CART_ID_TYPE = 0x0147,
+  CART_ID_RAM_SIZE = 0x0149,
+  CART_ID_CHECKSUM = 0x014E
+};
+
+static const uint8_t state_magic[4] = {'Y', 'G', 'B', 'S'};
+
+/* Moves values into or out of a save state, so the same code describes the
+ * layout for measuring, saving and loading. It also describes what a state
+ * must hold to be loaded: a state is loaded in two passes, the first of which
+ * only checks that every value is in range, so that nothing is stored from a
+ * damaged state. */
+struct state_stream {
+  /* Where values are read from while loading, or NULL otherwise. */
+  const uint8_t* in;
+
+  /* Where values are written to while saving, or NULL otherwise. */
+  uint8_t* out;
+
+  size_t pos;
+
+  /* Whether values loaded are stored, rather than only checked. */
+  bool store;
+
+  /* Cleared by the first value loaded which is out of range. */
+  bool valid;
+
+  /* The scheduler the state is checked against, which while loading is the
+   * one loaded from the state. */
+  const struct libyagbe_sched* sched;
+};
+
+/* Marks the state as damaged if a value loaded from it is out of range.
+ * Values being saved are always in range. */
+static void check(struct state_stream* const s, const bool in_range) {
+  if (!in_range) {
+    s->valid = false;
+  }
+}
+
+static void transfer_bytes(struct state_stream* const s, void* const data,
+                           const size_t size) {
+  if (s->in != NULL) {
+    if (s->store) {
+      memcpy(data, &s->in[s->pos], size);
+    }
+  } else if (s->out != NULL) {
+    memcpy(&s->out[s->pos], data, size);
+  }
+  s->pos += size;
+}
+
+static uintmax_t transfer_value(struct state_stream* const s,
+                                const uintmax_t value, const size_t width) {
+  uintmax_t result = value;
+  size_t i;
+
+  if (s->in != NULL) {
+    result = 0;
+
+    for (i = 0; i < width; ++i) {
+      result |= (uintmax_t)s->in[s->pos + i] << (i * 8);
+    }
+  } else if (s->out != NULL) {
+    for (i = 0; i < width; ++i) {
+      s->out[s->pos + i] = (uint8_t)(value >> (i * 8));
+    }
+  }
+  s->pos += width;
+
+  return result;
+}
+
+/* Each of these returns the value transferred, which is the one in the state
+ * even when loading only checks it. */
+static uint8_t transfer_u8(struct state_stream* const s, uint8_t* const value) {
+  const uint8_t result = (uint8_t)transfer_value(s, *value, 1);
+
+  if (s->store) {
+    *value = result;
+  }
+  return result;
+}
+
+static uint16_t transfer_u16(struct state_stream* const s,
+                             uint16_t* const value) {
+  const uint16_t result = (uint16_t)transfer_value(s, *value, 2);
+
+  if (s->store) {
+    *value = result;
+  }
+  return result;
+}
+
+static bool transfer_bool(struct state_stream* const s, bool* const value) {
+  const uintmax_t result = transfer_value(s, *value ? 1 : 0, 1);
+
+  /* Anything else can't have been saved. */
+  check(s, result <= 1);
+
+  if (s->store) {
+    *value = result != 0;
+  }
+  return result != 0;
+}
+
+static unsigned int transfer_uint(struct state_stream* const s,
+                                  unsigned int* const value,
+                                  const size_t width) {
+  const unsigned int result = (unsigned int)transfer_value(s, *value, width);
+
+  if (s->store) {
+    *value = result;
+  }
+  return result;
+}
+
+static unsigned long transfer_ulong(struct state_stream* const s,
+                                    unsigned long* const value) {
+  const unsigned long result = (unsigned long)transfer_value(s, *value, 4);
+
+  if (s->store) {
+    *value = result;
+  }
+  return result;
+}
+
+static uintmax_t transfer_timestamp(struct state_stream* const s,
+                                    uintmax_t* const value) {
+  const uintmax_t result = transfer_value(s, *value, 8);
+
+  if (s->store) {
+    *value = result;
+  }
+  return result;
+}
+
+/* Transfers a timestamp which can't be later than the current time. */
+static void transfer_past_timestamp(struct state_stream* const s,
+                                    uintmax_t* const value) {
+  check(s, transfer_timestamp(s, value) <= s->sched->current_timestamp);
+}
+
+static void transfer_sched(struct state_stream* const s,
+                           struct libyagbe_sched* const sched) {
+  unsigned int heap_size = (unsigned int)sched->heap_size;
+  size_t i;
+
+  transfer_timestamp(s, &sched->current_timestamp);
+  transfer_uint(s, &heap_size, 1);
+  sched->heap_size = heap_size;
+
+  /* The heap is stored as is, rather than rebuilt, so that events expiring
+   * at the same time are still handled in the same order. */
+  transfer_bytes(s, sched->heap, sizeof(sched->heap));
+
+  for (i = 0; i < LIBYAGBE_SCHED_NUM_EVENT_TYPES; ++i) {
+    transfer_timestamp(s, &sched->events[i].expiry_time);
+  }
+}
+
+static void transfer_cpu(struct state_stream* const s,
+                         struct libyagbe_cpu* const cpu) {
+  unsigned int state = cpu->state;
+
+  /* F is saved with any pending flags worked out, so the format doesn't
+   * depend on how the core was built. */
+  uint16_t af = (uint16_t)((cpu->reg.af.byte.hi << 8) |
+                           libyagbe_cpu_get_flags(cpu));
+
+  transfer_u16(s, &af);
+  transfer_u16(s, &cpu->reg.bc.value);
+  transfer_u16(s, &cpu->reg.de.value);
+  transfer_u16(s, &cpu->reg.hl.value);
+  transfer_u16(s, &cpu->reg.pc.value);
+  transfer_u16(s, &cpu->reg.sp.value);
+  transfer_u8(s, &cpu->instruction);
+  check(s, transfer_uint(s, &state, 1) <= LIBYAGBE_CPU_STATE_LOCKED);
+  transfer_bool(s, &cpu->ime);
+  transfer_bool(s, &cpu->ei_delay);
+  transfer_bool(s, &cpu->halt_bug);
+
+  cpu->state = (enum libyagbe_cpu_state)state;
+
+  if ((s->in != NULL) && s->store) {
+    cpu->reg.af.value = af;
+    cpu->lazy_flags.op = LIBYAGBE_CPU_LAZY_NONE;
+  }
+}
+
+static void transfer_ppu(struct state_stream* const s,
+                         struct libyagbe_ppu* const ppu) {
+  unsigned int mode = ppu->mode;
+  unsigned int loaded_mode;
+  uint8_t ly;
+
+  transfer_u8(s, &ppu->lcdc);
+  transfer_u8(s, &ppu->stat);
+  transfer_u8(s, &ppu->scy);
+  transfer_u8(s, &ppu->scx);
+  ly = transfer_u8(s, &ppu->ly);
+  transfer_u8(s, &ppu->lyc);
+  transfer_u8(s, &ppu->bgp);
+  transfer_u8(s, &ppu->obp0);
+  transfer_u8(s, &ppu->obp1);
+  transfer_u8(s, &ppu->wy);
+  transfer_u8(s, &ppu->wx);
+  loaded_mode = transfer_uint(s, &mode, 1);
+
+  /* Lines are drawn at LY, so it must be on screen in every mode but VBLANK,
+   * and VBLANK must be where the frame really is. */
+  check(s, loaded_mode <= LIBYAGBE_PPU_MODE_DRAWING);
+  check(s, (loaded_mode == LIBYAGBE_PPU_MODE_VBLANK)
+               ? ((ly >= LIBYAGBE_PPU_SCREEN_HEIGHT) &&
+                  (ly < LIBYAGBE_PPU_NUM_LINES))
+               : (ly < LIBYAGBE_PPU_SCREEN_HEIGHT));
+
+  check(s, transfer_u8(s, &ppu->window_line) <= LIBYAGBE_PPU_SCREEN_HEIGHT);
+  transfer_bool(s, &ppu->stat_line);
+  transfer_ulong(s, &ppu->frame_count);
+  transfer_bytes(s, ppu->vram, sizeof(ppu->vram));
+  transfer_bytes(s, ppu->oam, sizeof(ppu->oam));
+
+  ppu->mode = (enum libyagbe_ppu_mode)mode;
+}
+
+static void transfer_apu(struct state_stream* const s,
+                         struct libyagbe_apu* const apu) {
+  unsigned int frame_seq_timer;
+  size_t i;
+
+  transfer_bytes(s, apu->io, sizeof(apu->io));
+
+  for (i = 0; i < LIBYAGBE_APU_NUM_CHANNELS; ++i) {
+    struct libyagbe_apu_channel* const c = &apu->channels[i];
+
+    /* The wave channel steps through 32 samples of wave RAM, and the others
+     * through 8 steps of a duty pattern. */
+    const unsigned int num_positions =
+        (i == LIBYAGBE_APU_CHANNEL_WAVE) ? 32 : 8;
+
+    transfer_bool(s, &c->enabled);
+    check(s, transfer_u8(s, &c->output) <= 15);
+    check(s, transfer_u8(s, &c->volume) <= 15);
+    check(s, transfer_u8(s, &c->envelope_timer) <= 8);
+    check(s, transfer_u16(s, &c->length) <= 256);
+    transfer_ulong(s, &c->timer);
+    check(s, transfer_u8(s, &c->position) < num_positions);
+    transfer_u16(s, &c->lfsr);
+    transfer_u16(s, &c->sweep_shadow);
+    check(s, transfer_u8(s, &c->sweep_timer) <= 8);
+    transfer_bool(s, &c->sweep_enabled);
+  }
+
+  /* A span between frame sequencer steps is the most the APU catches up on
+   * at once, and its buffers are sized for no more. */
+  transfer_past_timestamp(s, &apu->timestamp);
+  frame_seq_timer = transfer_uint(s, &apu->frame_seq_timer, 2);
+  check(s, (frame_seq_timer != 0) &&
+               (frame_seq_timer <= LIBYAGBE_APU_FRAME_SEQ_PERIOD));
+  check(s, transfer_u8(s, &apu->frame_seq_step) < 8);
+}
+
+/* Transfers WRAM or cartridge RAM, which may partly be the parent's copy if
+ * the instance was forked. */
+static void transfer_memory(struct state_stream* const s,
+                            const struct libyagbe_bus* const bus,
+                            uint8_t* const memory, const size_t size) {
+  size_t i;
+
+  if (s->out == NULL) {
+    transfer_bytes(s, memory, size);
+    return;
+  }
+
+  for (i = 0; i < size; i += LIBYAGBE_BUS_PAGE_SIZE) {
+    /* Saving only reads from the source. */
+    transfer_bytes(s, (void*)libyagbe_bus_get_memory(bus, &memory[i]),
+                   LIBYAGBE_BUS_PAGE_SIZE);
+  }
+}
+
+static void transfer_cart(struct state_stream* const s,
+                          const struct libyagbe_bus* const bus,
+                          struct libyagbe_cart* const cart) {
+  transfer_bool(s, &cart->ram_enabled);
+  check(s, transfer_uint(s, &cart->rom_bank, 2) <= 0x1FF);
+  transfer_uint(s, &cart->ram_bank, 1);
+  check(s, transfer_u8(s, &cart->banking_mode) <= 1);
+  transfer_u8(s, &cart->rtc_latch);
+  transfer_bytes(s, cart->rtc, sizeof(cart->rtc));
+  transfer_bytes(s, cart->rtc_latched, sizeof(cart->rtc_latched));
+
+  /* Only the RAM the cartridge actually has. */
+  transfer_memory(s, bus, cart->ram,
+                  cart->num_ram_banks * LIBYAGBE_CART_MEM_SIZE_RAM_BANK);
+}
+
+/* Everything after the scheduler, which is handled separately so it can be
+ * checked before anything is overwritten. */
+static void transfer_system(struct state_stream* const s,
+                            struct libyagbe_system* const gb) {
+  transfer_cpu(s, &gb->cpu);
+  transfer_u8(s, &gb->bus.irq.flag);
+  transfer_u8(s, &gb->bus.irq.enable);
+  transfer_u8(s, &gb->bus.timer.tima);
+  transfer_u8(s, &gb->bus.timer.tac);
+  transfer_u8(s, &gb->bus.timer.tma);
+  transfer_timestamp(s, &gb->bus.timer.counter_offset);
+  transfer_past_timestamp(s, &gb->bus.timer.last_update);
+  transfer_u8(s, &gb->bus.joypad.select);
+  transfer_u8(s, &gb->bus.joypad.buttons);
+  transfer_u8(s, &gb->bus.dma.source);
+
+  /* Only the end of the transfer unlocks the bus. */
+  if (transfer_bool(s, &gb->bus.dma.active)) {
+    check(s, libyagbe_sched_is_scheduled(s->sched, LIBYAGBE_SCHED_EVENT_DMA));
+  }
+  transfer_ppu(s, &gb->bus.ppu);
+  transfer_apu(s, &gb->bus.apu);
+  transfer_memory(s, &gb->bus, gb->bus.wram, sizeof(gb->bus.wram));
+  transfer_bytes(s, gb->bus.hram, sizeof(gb->bus.hram));
+  transfer_cart(s, &gb->bus, &gb->bus.cart);
+}
+
+static void transfer_header(struct state_stream* const s,
+                            const struct libyagbe_system* const gb,
+                            const size_t size) {
+  uint8_t id[4];
+
+  id[0] = gb->bus.cart.data[CART_ID_TYPE];
+  id[1] = gb->bus.cart.data[CART_ID_RAM_SIZE];
+  id[2] = gb->bus.cart.data[CART_ID_CHECKSUM];
+  id[3] = gb->bus.cart.data[CART_ID_CHECKSUM + 1];
+
+  transfer_bytes(s, (void*)state_magic, sizeof(state_magic));
+  transfer_value(s, LIBYAGBE_SYSTEM_STATE_VERSION, 2);
+  transfer_value(s, 0, 2);
+  transfer_value(s, size, 4);
+  transfer_bytes(s, id, sizeof(id));
+}
+
+size_t libyagbe_system_get_state_size(const struct libyagbe_system* const gb) {
+  struct state_stream s;
+
+  assert(gb != NULL);
+
+  s.in = NULL;
+  s.out = NULL;
+  s.pos = STATE_HEADER_SIZE;
+  s.store = true;
+  s.valid = true;
+  s.sched = &gb->sched;
+
+  /* Nothing is written, so casting away const is harmless. */
+  transfer_sched(&s, (struct libyagbe_sched*)&gb->sched);
+  transfer_system(&s, (struct libyagbe_system*)gb);
+
+  return s.pos;
+}
+
+size_t libyagbe_system_save_state(const struct libyagbe_system* const gb,
+                                  void* const buffer, const size_t size) {
+  const size_t state_size = libyagbe_system_get_state_size(gb);
+  struct state_stream s;
+
+  assert(buffer != NULL);
+
+  if (size < state_size) {
+    return 0;
+  }
+
+  s.in = NULL;
+  s.out = (uint8_t*)buffer;
+  s.pos = 0;
+  s.store = true;
+  s.valid = true;
+  s.sched = &gb->sched;
+
+  /* Values are only read from the instance while saving. */
+  transfer_header(&s, gb, state_size);
+  transfer_sched(&s, (struct libyagbe_sched*)&gb->sched);
+  transfer_system(&s, (struct libyagbe_system*)gb);
+
+  assert(s.pos == state_size);
+  return state_size;
+}
+
+bool libyagbe_system_load_state(struct libyagbe_system* const gb,
+                                const void* const buffer, const size_t size) {
+  const size_t state_size = libyagbe_system_get_state_size(gb);
+  uint8_t header[STATE_HEADER_SIZE];
+  struct libyagbe_sched sched;
+  struct state_stream s;
+  size_t system_pos;
+  size_t i;
+
+  assert(buffer != NULL);
+
+  if (size < state_size) {
+    return false;
+  }
+
+  /* The header must match exactly what saving this instance would write. */
+  s.in = NULL;
+  s.out = header;
+  s.pos = 0;
+  s.store = true;
+  s.valid = true;
+  s.sched = &gb->sched;
+  transfer_header(&s, gb, state_size);
+
+  if (memcmp(header, buffer, sizeof(header)) != 0) {
+    return false;
+  }
+
+  s.in = (const uint8_t*)buffer;
+  s.out = NULL;
+
+  /* The handlers are part of the instance, not the state. */
+  sched = gb->sched;
+  transfer_sched(&s, &sched);
+
+  if (!libyagbe_sched_restore_heap(&sched)) {
+    return false;
+  }
+  system_pos = s.pos;
+
+  /* Check everything else against the scheduler it'll run with, before
+   * storing any of it. */
+  s.store = false;
+  s.sched = &sched;
+  transfer_system(&s, gb);
+
+  if (!s.valid) {
+    return false;
+  }
+  gb->sched = sched;
+
+  /* All of memory is about to be overwritten, so nothing needs to be shared
+   * any more. */
+  gb->bus.shared.num_shared = 0;
+
+  s.pos = system_pos;
+  s.store = true;
+  s.sched = &gb->sched;
+  transfer_system(&s, gb);
+
+  /* Rebuild everything which isn't stored. */
+  gb->bus.irq.pending =
+      gb->bus.irq.flag & gb->bus.irq.enable & LIBYAGBE_IRQ_ALL;
+
+  for (i = 0; i < LIBYAGBE_PPU_NUM_TILES; ++i) {
+    gb->bus.ppu.tile_dirty[i] = true;
+  }
+
+  libyagbe_apu_set_output(&gb->bus.apu, gb->bus.apu.ring,
+                          gb->bus.apu.sample_rate);
+  libyagbe_bus_reset(&gb->bus);
+
+  return true;
+}
@@ -21,38 +21,71 @@
 #include <assert.h>
 #include <stddef.h>
 
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/irq.h"
 #include "libyagbe/sched.h"
 
+/* How often TIMA is clocked at each rate in TAC, which is also the period of
+ * the system counter bit whose falling edges clock it. */
 static const unsigned int timing[4] = {1024, 16, 64, 256};
 enum tac_bits { TAC_ENABLED = 1 << 2 };
 
-static uint8_t* interrupt_flag = NULL;
+/* The system counter after the boot ROM has run. */
+enum { COUNTER_AFTER_BOOT = 0xABCC };
 
-enum interrupt_flags { FLAG_TIMER = 1 << 2 };
+static uintmax_t get_counter(const struct libyagbe_timer* const timer) {
+  return timer->sched->current_timestamp + timer->counter_offset;
+}
 
-static void handle_timer_update(void* const userdata) {
-  struct libyagbe_timer* timer = (struct libyagbe_timer*)userdata;
+/* Returns the signal TIMA counts falling edges of, which is the enable bit
+ * ANDed with the selected bit of the system counter. Anything which drops it
+ * clocks TIMA, even without the counter moving. */
+static bool get_signal(const struct libyagbe_timer* const timer,
+                       const uint8_t tac) {
+  return (tac & TAC_ENABLED) &&
+         (get_counter(timer) & (timing[tac & 0x03] >> 1));
+}
 
-  struct libyagbe_sched_event event;
-  event.expiry_time = timing[timer->tac & 0x03];
-  event.cb_func = &handle_timer_update;
-  event.userdata = timer;
+/* Counts the falling edges TIMA has missed since it was last updated. */
+static uintmax_t get_pending_ticks(const struct libyagbe_timer* const timer) {
+  const unsigned int period = timing[timer->tac & 0x03];
 
-  if (timer->tima == 0xFF) {
-    timer->tima = timer->tma;
-    *interrupt_flag |= FLAG_TIMER;
-  } else {
-    timer->tima++;
+  if (!(timer->tac & TAC_ENABLED)) {
+    return 0;
   }
+  return ((timer->sched->current_timestamp + timer->counter_offset) /
+          period) -
+         ((timer->last_update + timer->counter_offset) / period);
+}
 
-  /* Don't schedule an event again if the timer is not enabled. */
-  if (timer->tac & TAC_ENABLED) {
-    libyagbe_sched_insert(&event);
+static void increment(struct libyagbe_timer* const timer, uintmax_t ticks) {
+  while (ticks >= (0x100u - timer->tima)) {
+    ticks -= 0x100u - timer->tima;
+    timer->tima = timer->tma;
+    libyagbe_irq_request(timer->irq, LIBYAGBE_IRQ_TIMER);
   }
+  timer->tima = (uint8_t)(timer->tima + ticks);
 }
 
-void libyagbe_timer_set_interrupt_flag(uint8_t* const iflag) {
-  interrupt_flag = iflag;
+static void handle_timer_overflow(void* const userdata) {
+  struct libyagbe_timer* timer = (struct libyagbe_timer*)userdata;
+
+  libyagbe_timer_sync(timer);
+  libyagbe_timer_reschedule(timer);
+}
+
+void libyagbe_timer_init(struct libyagbe_timer* const timer,
+                         struct libyagbe_sched* const sched,
+                         struct libyagbe_irq* const irq) {
+  assert(timer != NULL);
+  assert(sched != NULL);
+  assert(irq != NULL);
+
+  timer->sched = sched;
+  timer->irq = irq;
+
+  libyagbe_sched_register(sched, LIBYAGBE_SCHED_EVENT_TIMER,
+                          &handle_timer_overflow, timer);
 }
 
 void libyagbe_timer_reset(struct libyagbe_timer* const timer) {
@@ -61,34 +94,116 @@ void libyagbe_timer_reset(struct libyagbe_timer* const timer) {
   timer->tac = 0xF8;
   timer->tima = 0x00;
   timer->tma = 0x00;
+  timer->counter_offset = COUNTER_AFTER_BOOT - timer->sched->current_timestamp;
+  timer->last_update = timer->sched->current_timestamp;
+
+  libyagbe_timer_reschedule(timer);
 }
 
-void libyagbe_timer_handle_tac(struct libyagbe_timer* const timer,
-                               const uint8_t tac) {
+void libyagbe_timer_sync(struct libyagbe_timer* const timer) {
+  uintmax_t now;
+
   assert(timer != NULL);
+  now = timer->sched->current_timestamp;
 
-  /* Is the timer being enabled from a disabled state? */
-  if (!(timer->tac & TAC_ENABLED) && (tac & TAC_ENABLED)) {
-    /* The timer has now been enabled from a previously disabled state, schedule
-     * an event. */
-    struct libyagbe_sched_event event;
+  increment(timer, get_pending_ticks(timer));
+  timer->last_update = now;
+}
 
-    event.expiry_time = timing[tac & 0x03];
-    event.cb_func = &handle_timer_update;
-    event.userdata = timer;
+void libyagbe_timer_reschedule(struct libyagbe_timer* const timer) {
+  uintmax_t counter;
+  unsigned int period;
 
-    libyagbe_sched_insert(&event);
-    timer->tac = (timer->tac & ~0x07) | (tac & 0x07);
+  assert(timer != NULL);
 
+  if (!(timer->tac & TAC_ENABLED)) {
+    libyagbe_sched_cancel(timer->sched, LIBYAGBE_SCHED_EVENT_TIMER);
     return;
   }
 
-  /* Is the timer being disabled from an enabled state? */
-  if ((timer->tac & TAC_ENABLED) && !(tac & TAC_ENABLED)) {
-    /* Delete all events related to the timer. */
-    /*libyagbe_sched_delete_events(timer);*/
-    timer->tac = (timer->tac & ~0x07) | (tac & 0x07);
-    return;
+  counter = get_counter(timer);
+  period = timing[timer->tac & 0x03];
+
+  /* TIMA overflows on the falling edge which takes it past $FF. */
+  libyagbe_sched_schedule(
+      timer->sched, LIBYAGBE_SCHED_EVENT_TIMER,
+      (unsigned int)((((counter / period) + (0x100u - timer->tima)) * period) -
+                     counter));
+}
+
+uint8_t libyagbe_timer_read_div(const struct libyagbe_timer* const timer) {
+  assert(timer != NULL);
+  return (uint8_t)(get_counter(timer) >> 8);
+}
+
+uint8_t libyagbe_timer_read_tima(struct libyagbe_timer* const timer) {
+  assert(timer != NULL);
+
+  libyagbe_timer_sync(timer);
+  return timer->tima;
+}
+
+uint8_t libyagbe_timer_peek_tima(const struct libyagbe_timer* const timer) {
+  uintmax_t ticks;
+
+  assert(timer != NULL);
+  ticks = get_pending_ticks(timer);
+
+  if (ticks < (0x100u - timer->tima)) {
+    return (uint8_t)(timer->tima + ticks);
   }
+
+  /* After the first overflow, TIMA counts up from TMA every time. */
+  ticks -= 0x100u - timer->tima;
+  return (uint8_t)(timer->tma + (ticks % (0x100u - timer->tma)));
+}
+
+void libyagbe_timer_write_div(struct libyagbe_timer* const timer) {
+  assert(timer != NULL);
+
+  libyagbe_timer_sync(timer);
+
+  /* Resetting the counter drops the selected bit if it was set. */
+  if (get_signal(timer, timer->tac)) {
+    increment(timer, 1);
+  }
+  timer->counter_offset = 0 - timer->sched->current_timestamp;
+
+  libyagbe_timer_reschedule(timer);
+}
+
+void libyagbe_timer_write_tima(struct libyagbe_timer* const timer,
+                               const uint8_t data) {
+  assert(timer != NULL);
+
+  libyagbe_timer_sync(timer);
+  timer->tima = data;
+  libyagbe_timer_reschedule(timer);
+}
+
+void libyagbe_timer_write_tma(struct libyagbe_timer* const timer,
+                              const uint8_t data) {
+  assert(timer != NULL);
+
+  /* Overflows up to now reload the old value. */
+  libyagbe_timer_sync(timer);
+  timer->tma = data;
+}
+
+void libyagbe_timer_handle_tac(struct libyagbe_timer* const timer,
+                               const uint8_t tac) {
+  bool clocked;
+
+  assert(timer != NULL);
+
+  libyagbe_timer_sync(timer);
+
+  /* Switching rates or disabling the timer can drop the signal too. */
+  clocked = get_signal(timer, timer->tac) && !get_signal(timer, tac);
   timer->tac = (timer->tac & ~0x07) | (tac & 0x07);
-}
\ No newline at end of file
+
+  if (clocked) {
+    increment(timer, 1);
+  }
+  libyagbe_timer_reschedule(timer);
+}
@@ -0,0 +1,301 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/trace.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "libyagbe/bus.h"
+#include "libyagbe/cpu.h"
+#include "utility.h"
+
+enum { TRACE_VERSION = 1 };
+
+static const uint8_t trace_magic[4] = {'Y', 'G', 'B', 'T'};
+
+/* Determines the address of the memory operand of an instruction, if it has
+ * one. Stack accesses aren't counted. */
+static bool find_mem_operand(const struct libyagbe_trace_record* const record,
+                             uint16_t* const address) {
+  const uint8_t op = record->bytes[0];
+
+  switch (op) {
+    case 0x02: /* LD (BC), A */
+    case 0x0A: /* LD A, (BC) */
+      *address = record->bc;
+      return true;
+
+    case 0x12: /* LD (DE), A */
+    case 0x1A: /* LD A, (DE) */
+      *address = record->de;
+      return true;
+
+    case 0x22: /* LD (HL+), A */
+    case 0x2A: /* LD A, (HL+) */
+    case 0x32: /* LD (HL-), A */
+    case 0x3A: /* LD A, (HL-) */
+    case 0x34: /* INC (HL) */
+    case 0x35: /* DEC (HL) */
+    case 0x36: /* LD (HL), u8 */
+      *address = record->hl;
+      return true;
+
+    case 0x08: /* LD (u16), SP */
+    case 0xEA: /* LD (u16), A */
+    case 0xFA: /* LD A, (u16) */
+      *address = (uint16_t)((record->bytes[2] << 8) | record->bytes[1]);
+      return true;
+
+    case 0xE0: /* LDH (u8), A */
+    case 0xF0: /* LDH A, (u8) */
+      *address = (uint16_t)(0xFF00 | record->bytes[1]);
+      return true;
+
+    case 0xE2: /* LD ($FF00+C), A */
+    case 0xF2: /* LD A, ($FF00+C) */
+      *address = (uint16_t)(0xFF00 | (record->bc & 0xFF));
+      return true;
+
+    case 0xCB:
+      if ((record->bytes[1] & 0x07) == 0x06) {
+        *address = record->hl;
+        return true;
+      }
+      return false;
+
+    default:
+      /* LD r, (HL), LD (HL), r and the ALU operations on (HL), but not HALT
+       * which sits where LD (HL), (HL) would be. */
+      if ((op >= 0x40) && (op < 0xC0) && (op != 0x76) &&
+          (((op & 0x07) == 0x06) || ((op & 0xF8) == 0x70))) {
+        *address = record->hl;
+        return true;
+      }
+      return false;
+  }
+}
+
+static void put_u16(uint8_t* const out, const uint16_t value) {
+  out[0] = (uint8_t)(value & 0xFF);
+  out[1] = (uint8_t)(value >> 8);
+}
+
+static uint16_t get_u16(const uint8_t* const in) {
+  return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+void libyagbe_trace_begin(struct libyagbe_trace_record* const record,
+                          const struct libyagbe_cpu* const cpu,
+                          struct libyagbe_bus* const bus,
+                          const uintmax_t timestamp) {
+  uint16_t address;
+
+  assert(record != NULL);
+  assert(cpu != NULL);
+  assert(bus != NULL);
+
+  record->timestamp = timestamp;
+
+  record->pc = cpu->reg.pc.value;
+  record->sp = cpu->reg.sp.value;
+  record->af = (uint16_t)((cpu->reg.af.byte.hi << 8) |
+                          libyagbe_cpu_get_flags(cpu));
+  record->bc = cpu->reg.bc.value;
+  record->de = cpu->reg.de.value;
+  record->hl = cpu->reg.hl.value;
+
+  record->bytes[0] = libyagbe_bus_inspect_memory(bus, record->pc);
+  record->bytes[1] =
+      libyagbe_bus_inspect_memory(bus, (uint16_t)(record->pc + 1));
+  record->bytes[2] =
+      libyagbe_bus_inspect_memory(bus, (uint16_t)(record->pc + 2));
+
+  /* The address has to be worked out before the instruction runs, since it
+   * may change the registers it came from. */
+  if (find_mem_operand(record, &address)) {
+    record->flags = LIBYAGBE_TRACE_FLAG_MEM;
+    record->mem_address = address;
+  } else {
+    record->flags = 0;
+    record->mem_address = 0;
+  }
+  record->mem_data = 0;
+}
+
+void libyagbe_trace_end(struct libyagbe_trace_record* const record,
+                        struct libyagbe_bus* const bus) {
+  assert(record != NULL);
+  assert(bus != NULL);
+
+  if (record->flags & LIBYAGBE_TRACE_FLAG_MEM) {
+    record->mem_data = libyagbe_bus_inspect_memory(bus, record->mem_address);
+  }
+}
+
+void libyagbe_trace_encode(const struct libyagbe_trace_record* const record,
+                           uint8_t* const out) {
+  uintmax_t timestamp;
+  size_t i;
+
+  assert(record != NULL);
+  assert(out != NULL);
+
+  /* Shift a byte at a time, so this works whatever the width of uintmax_t. */
+  timestamp = record->timestamp;
+
+  for (i = 0; i < 8; ++i) {
+    out[i] = (uint8_t)(timestamp & 0xFF);
+    timestamp >>= 8;
+  }
+
+  put_u16(&out[8], record->pc);
+  put_u16(&out[10], record->sp);
+  put_u16(&out[12], record->af);
+  put_u16(&out[14], record->bc);
+  put_u16(&out[16], record->de);
+  put_u16(&out[18], record->hl);
+
+  out[20] = record->bytes[0];
+  out[21] = record->bytes[1];
+  out[22] = record->bytes[2];
+  out[23] = record->flags;
+
+  put_u16(&out[24], record->mem_address);
+  out[26] = record->mem_data;
+  out[27] = 0;
+}
+
+void libyagbe_trace_decode(struct libyagbe_trace_record* const record,
+                           const uint8_t* const in) {
+  size_t i;
+
+  assert(record != NULL);
+  assert(in != NULL);
+
+  record->timestamp = 0;
+
+  for (i = 8; i != 0; --i) {
+    record->timestamp = (record->timestamp << 8) | in[i - 1];
+  }
+
+  record->pc = get_u16(&in[8]);
+  record->sp = get_u16(&in[10]);
+  record->af = get_u16(&in[12]);
+  record->bc = get_u16(&in[14]);
+  record->de = get_u16(&in[16]);
+  record->hl = get_u16(&in[18]);
+
+  record->bytes[0] = in[20];
+  record->bytes[1] = in[21];
+  record->bytes[2] = in[22];
+  record->flags = in[23];
+
+  record->mem_address = get_u16(&in[24]);
+  record->mem_data = in[26];
+}
+
+void libyagbe_trace_encode_header(uint8_t* const out) {
+  assert(out != NULL);
+
+  out[0] = trace_magic[0];
+  out[1] = trace_magic[1];
+  out[2] = trace_magic[2];
+  out[3] = trace_magic[3];
+  out[4] = TRACE_VERSION;
+  out[5] = LIBYAGBE_TRACE_RECORD_SIZE;
+  out[6] = 0;
+  out[7] = 0;
+}
+
+bool libyagbe_trace_check_header(const uint8_t* const in) {
+  assert(in != NULL);
+
+  return (in[0] == trace_magic[0]) && (in[1] == trace_magic[1]) &&
+         (in[2] == trace_magic[2]) && (in[3] == trace_magic[3]) &&
+         (in[4] == TRACE_VERSION) && (in[5] == LIBYAGBE_TRACE_RECORD_SIZE);
+}
+
+void libyagbe_trace_ring_init(struct libyagbe_trace_ring* const ring,
+                              struct libyagbe_trace_record* const records,
+                              const size_t capacity) {
+  assert(ring != NULL);
+  assert(records != NULL);
+  assert((capacity != 0) && ((capacity & (capacity - 1)) == 0));
+
+  ring->records = records;
+  ring->capacity = capacity;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->closed = 0;
+}
+
+bool libyagbe_trace_ring_push(
+    struct libyagbe_trace_ring* const ring,
+    const struct libyagbe_trace_record* const record) {
+  size_t head;
+
+  assert(ring != NULL);
+  assert(record != NULL);
+
+  head = ring->head;
+
+  if ((head - LOAD_ACQUIRE(ring->tail)) == ring->capacity) {
+    return false;
+  }
+
+  ring->records[head & (ring->capacity - 1)] = *record;
+  STORE_RELEASE(ring->head, head + 1);
+
+  return true;
+}
+
+size_t libyagbe_trace_ring_pop(struct libyagbe_trace_ring* const ring,
+                               struct libyagbe_trace_record* const out,
+                               const size_t max) {
+  size_t tail;
+  size_t count;
+  size_t i;
+
+  assert(ring != NULL);
+  assert(out != NULL);
+
+  tail = ring->tail;
+  count = LOAD_ACQUIRE(ring->head) - tail;
+
+  if (count > max) {
+    count = max;
+  }
+
+  for (i = 0; i < count; ++i) {
+    out[i] = ring->records[(tail + i) & (ring->capacity - 1)];
+  }
+
+  STORE_RELEASE(ring->tail, tail + count);
+  return count;
+}
+
+void libyagbe_trace_ring_close(struct libyagbe_trace_ring* const ring) {
+  assert(ring != NULL);
+  STORE_RELEASE(ring->closed, 1);
+}
+
+bool libyagbe_trace_ring_is_closed(struct libyagbe_trace_ring* const ring) {
+  assert(ring != NULL);
+  return LOAD_ACQUIRE(ring->closed) != 0;
+}
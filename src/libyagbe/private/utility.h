@@ -30,6 +30,60 @@ extern "C" {
 
 #define SWAP(x, y, T) do { T TEMP = x; x = y; y = TEMP; } while (0)
 
+/* Accesses an index shared between exactly one producer and one consumer
+ * thread, so that everything written before the index is stored is visible to
+ * whoever loads it. */
+#if defined(__GNUC__)
+#define LOAD_ACQUIRE(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+
+/* Whether volatile accesses are ordered for other threads depends on
+ * /volatile, which defaults to ms on x86 and x64 but to iso on ARM, so
+ * neither is relied on. x86 and x64 only need the compiler kept from
+ * reordering, since the hardware already orders plain loads and stores
+ * strongly enough. ARM needs a barrier. */
+#if defined(_M_ARM64)
+#define LIBYAGBE_ISO_LOAD(p) \
+  ((size_t)__iso_volatile_load64((const volatile __int64*)(p)))
+#define LIBYAGBE_ISO_STORE(p, v) \
+  __iso_volatile_store64((volatile __int64*)(p), (__int64)(v))
+#define LIBYAGBE_BARRIER() __dmb(_ARM64_BARRIER_ISH)
+#elif defined(_M_ARM)
+#define LIBYAGBE_ISO_LOAD(p) \
+  ((size_t)__iso_volatile_load32((const volatile __int32*)(p)))
+#define LIBYAGBE_ISO_STORE(p, v) \
+  __iso_volatile_store32((volatile __int32*)(p), (__int32)(v))
+#define LIBYAGBE_BARRIER() __dmb(_ARM_BARRIER_ISH)
+#else
+#define LIBYAGBE_ISO_LOAD(p) (*(p))
+#define LIBYAGBE_ISO_STORE(p, v) (*(p) = (v))
+#define LIBYAGBE_BARRIER() _ReadWriteBarrier()
+#endif /* defined(_M_ARM64) */
+
+static __inline size_t libyagbe_load_acquire(const volatile size_t* const p) {
+  const size_t value = LIBYAGBE_ISO_LOAD(p);
+
+  LIBYAGBE_BARRIER();
+  return value;
+}
+
+static __inline void libyagbe_store_release(volatile size_t* const p,
+                                            const size_t value) {
+  LIBYAGBE_BARRIER();
+  LIBYAGBE_ISO_STORE(p, value);
+}
+
+#define LOAD_ACQUIRE(x) libyagbe_load_acquire(&(x))
+#define STORE_RELEASE(x, v) libyagbe_store_release(&(x), (v))
+#else
+/* Without C11 or a known compiler, volatile is the best that can be done,
+ * and only keeps the accesses themselves from being optimized away. */
+#define LOAD_ACQUIRE(x) (*(volatile size_t*)&(x))
+#define STORE_RELEASE(x, v) (*(volatile size_t*)&(x) = (v))
+#endif /* defined(__GNUC__) */
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,18 +19,250 @@
 #ifndef LIBYAGBE_APU_H
 #define LIBYAGBE_APU_H
 
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
 #include "compat/compat_stdint.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libyagbe_sched;
+
+/** The offsets of the sound registers from $FF10. */
 enum libyagbe_io_registers_apu {
-  LIBYAGBE_APU_IO_NR50 = 0x4,
-  LIBYAGBE_APU_IO_NR51 = 0x5,
-  LIBYAGBE_APU_IO_NR52 = 0x6
+  LIBYAGBE_APU_IO_NR10 = 0x00,
+  LIBYAGBE_APU_IO_NR11 = 0x01,
+  LIBYAGBE_APU_IO_NR12 = 0x02,
+  LIBYAGBE_APU_IO_NR13 = 0x03,
+  LIBYAGBE_APU_IO_NR14 = 0x04,
+  LIBYAGBE_APU_IO_NR21 = 0x06,
+  LIBYAGBE_APU_IO_NR22 = 0x07,
+  LIBYAGBE_APU_IO_NR23 = 0x08,
+  LIBYAGBE_APU_IO_NR24 = 0x09,
+  LIBYAGBE_APU_IO_NR30 = 0x0A,
+  LIBYAGBE_APU_IO_NR31 = 0x0B,
+  LIBYAGBE_APU_IO_NR32 = 0x0C,
+  LIBYAGBE_APU_IO_NR33 = 0x0D,
+  LIBYAGBE_APU_IO_NR34 = 0x0E,
+  LIBYAGBE_APU_IO_NR41 = 0x10,
+  LIBYAGBE_APU_IO_NR42 = 0x11,
+  LIBYAGBE_APU_IO_NR43 = 0x12,
+  LIBYAGBE_APU_IO_NR44 = 0x13,
+  LIBYAGBE_APU_IO_NR50 = 0x14,
+  LIBYAGBE_APU_IO_NR51 = 0x15,
+  LIBYAGBE_APU_IO_NR52 = 0x16,
+  LIBYAGBE_APU_IO_WAVE_RAM = 0x20,
+
+  /** The number of bytes from $FF10 to the end of wave RAM at $FF3F. */
+  LIBYAGBE_APU_NUM_IO_REGISTERS = 0x30
+};
+
+enum libyagbe_apu_channel_index {
+  LIBYAGBE_APU_CHANNEL_SQUARE1,
+  LIBYAGBE_APU_CHANNEL_SQUARE2,
+  LIBYAGBE_APU_CHANNEL_WAVE,
+  LIBYAGBE_APU_CHANNEL_NOISE,
+  LIBYAGBE_APU_NUM_CHANNELS
+};
+
+/** @brief The number of T-cycles between steps of the frame sequencer, which
+ * runs at 512 Hz. */
+enum { LIBYAGBE_APU_FRAME_SEQ_PERIOD = 8192 };
+
+enum libyagbe_apu_output_limits {
+  /** The highest sample rate which can be requested. */
+  LIBYAGBE_APU_MAX_SAMPLE_RATE = 96000,
+
+  /** The number of samples which can be waiting to be output at once. This
+   * covers one frame sequencer step at the highest sample rate. */
+  LIBYAGBE_APU_BLIP_SIZE = 256,
+
+  /** The number of samples each band-limited step is spread across. */
+  LIBYAGBE_APU_BLIP_WIDTH = 16
+};
+
+/** Defines a single producer, single consumer queue of stereo samples.
+ *
+ * The emulation thread pushes samples a block at a time, and the host's audio
+ * thread pops them, without either ever taking a lock.
+ */
+struct libyagbe_apu_ring {
+  /** The storage of the queue, provided by the caller. Samples are signed
+   * 16-bit, with the left channel first. */
+  int16_t* samples;
+
+  /** The number of stereo frames \ref samples holds. Always a power of two. */
+  size_t capacity;
+
+  /** Only written by the producer. */
+  size_t head;
+
+  /** Keeps \ref head and \ref tail on separate cache lines. */
+  char padding[64];
+
+  /** Only written by the consumer. */
+  size_t tail;
 };
 
+/** Defines the state of one sound channel. Not every field is used by every
+ * channel. */
+struct libyagbe_apu_channel {
+  bool enabled;
+
+  /** The value the channel is currently putting out, from 0 to 15. This is 0
+   * while the channel or its DAC is off. */
+  uint8_t output;
+
+  /** The current volume of the envelope. */
+  uint8_t volume;
+
+  /** The number of envelope clocks until the volume next changes. */
+  uint8_t envelope_timer;
+
+  /** The number of length clocks until the channel turns itself off. */
+  uint16_t length;
+
+  /** The number of T-cycles until the waveform next steps. */
+  unsigned long timer;
+
+  /** The step of the duty cycle, or the sample of wave RAM. */
+  uint8_t position;
+
+  /** The noise channel's linear feedback shift register. */
+  uint16_t lfsr;
+
+  /** Square channel 1's frequency sweep. */
+  uint16_t sweep_shadow;
+  uint8_t sweep_timer;
+  bool sweep_enabled;
+};
+
+/** Defines the audio processing unit.
+ *
+ * Nothing in here runs on the scheduler. Instead, the channels are caught up
+ * to the current time whenever a sound register is accessed or the host asks
+ * for samples, and every change to a channel's output is turned into a
+ * band-limited step rather than generating one sample at a time.
+ */
 struct libyagbe_apu {
-  uint8_t nr50;
-  uint8_t nr51;
-  uint8_t nr52;
+  /** The raw contents of $FF10-$FF3F, including wave RAM. */
+  uint8_t io[LIBYAGBE_APU_NUM_IO_REGISTERS];
+
+  struct libyagbe_apu_channel channels[LIBYAGBE_APU_NUM_CHANNELS];
+
+  /** The scheduler of the system this APU belongs to. */
+  struct libyagbe_sched* sched;
+
+  /** The timestamp the channels have been caught up to. */
+  uintmax_t timestamp;
+
+  /** The number of T-cycles until the frame sequencer next steps, and the
+   * step it will take. */
+  unsigned int frame_seq_timer;
+  uint8_t frame_seq_step;
+
+  /** Where samples go, or NULL if audio is muted. While muted, only the
+   * state visible to the program (such as the length counters) is kept up,
+   * which makes the APU almost free. */
+  struct libyagbe_apu_ring* ring;
+
+  /** The number of samples put out per second. */
+  unsigned long sample_rate;
+
+  /** The position of \ref timestamp within the first sample of
+   * \ref deltas, in units of 1/4194304 of a sample. */
+  unsigned long sample_fraction;
+
+  /** Band-limited steps which haven't been put out yet, for the left and
+   * right channels. */
+  long deltas[2][LIBYAGBE_APU_BLIP_SIZE + LIBYAGBE_APU_BLIP_WIDTH];
+
+  /** The running sum of \ref deltas, and the DC level being removed from it,
+   * for the left and right channels. */
+  long accumulator[2];
+  long highpass[2];
+
+  /** The number of stereo frames thrown away because \ref ring was full. */
+  unsigned long dropped;
 };
 
+/** Initializes a sample queue.
+ *
+ * @param ring The queue instance.
+ * @param samples Storage for 2 * capacity samples.
+ * @param capacity The number of stereo frames the queue can hold, which must
+ * be a power of two.
+ */
+void libyagbe_apu_ring_init(struct libyagbe_apu_ring* const ring,
+                            int16_t* const samples, const size_t capacity);
+
+/** Removes samples from a queue. Only the consumer may call this.
+ *
+ * @param ring The queue instance.
+ * @param samples Where to copy the samples to.
+ * @param max_frames The maximum number of stereo frames to copy.
+ *
+ * @returns The number of stereo frames copied.
+ */
+size_t libyagbe_apu_ring_pop(struct libyagbe_apu_ring* const ring,
+                             int16_t* const samples, const size_t max_frames);
+
+/** Connects an APU to the system it belongs to.
+ *
+ * @param apu The APU instance.
+ * @param sched The scheduler whose time the APU follows.
+ */
+void libyagbe_apu_init(struct libyagbe_apu* const apu,
+                       struct libyagbe_sched* const sched);
+
+/** Resets an APU to the startup state. The output set with
+ * \ref libyagbe_apu_set_output is kept.
+ *
+ * @param apu The APU instance.
+ */
+void libyagbe_apu_reset(struct libyagbe_apu* const apu);
+
+/** Sets where an APU puts its samples.
+ *
+ * @param apu The APU instance.
+ * @param ring The queue to push samples to, or NULL to mute audio.
+ * @param sample_rate The number of samples to put out per second, up to
+ * \ref LIBYAGBE_APU_MAX_SAMPLE_RATE. Ignored if ring is NULL.
+ */
+void libyagbe_apu_set_output(struct libyagbe_apu* const apu,
+                             struct libyagbe_apu_ring* const ring,
+                             const unsigned long sample_rate);
+
+/** Catches an APU up to the current time of its scheduler, pushing every
+ * sample up to that point.
+ *
+ * @param apu The APU instance.
+ */
+void libyagbe_apu_sync(struct libyagbe_apu* const apu);
+
+/** Reads a sound register.
+ *
+ * @param apu The APU instance.
+ * @param offset The offset of the register from $FF10.
+ *
+ * @returns The value of the register.
+ */
+uint8_t libyagbe_apu_read(struct libyagbe_apu* const apu,
+                          const unsigned int offset);
+
+/** Writes a sound register.
+ *
+ * @param apu The APU instance.
+ * @param offset The offset of the register from $FF10.
+ * @param data The value to write.
+ */
+void libyagbe_apu_write(struct libyagbe_apu* const apu,
+                        const unsigned int offset, const uint8_t data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
 #endif /* LIBYAGBE_APU_H */
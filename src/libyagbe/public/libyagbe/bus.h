@@ -21,7 +21,12 @@
 
 #include "apu.h"
 #include "cart.h"
+#include "diag.h"
+#include "irq.h"
+#include "joypad.h"
 #include "ppu.h"
+#include "profile.h"
+#include "sched.h"
 #include "timer.h"
 
 /** @brief Defines the maximum number of elements of various RAM areas. */
@@ -31,32 +36,185 @@ enum libyagbe_bus_memory_size {
   LIBYAGBE_BUS_MEM_SIZE_HRAM = 128
 };
 
+/** @brief Defines the geometry of the memory map.
+ *
+ * The 64KiB address space is split into pages of 256 bytes. Each page either
+ * points directly at host memory, or is NULL and goes through the IO handlers.
+ */
+enum libyagbe_bus_page_geometry {
+  LIBYAGBE_BUS_PAGE_SHIFT = 8,
+  LIBYAGBE_BUS_PAGE_SIZE = 1 << LIBYAGBE_BUS_PAGE_SHIFT,
+  LIBYAGBE_BUS_PAGE_MASK = LIBYAGBE_BUS_PAGE_SIZE - 1,
+  LIBYAGBE_BUS_NUM_PAGES = 0x10000 >> LIBYAGBE_BUS_PAGE_SHIFT
+};
+
 enum libyagbe_bus_registers {
+  /** $FF01 */
+  LIBYAGBE_BUS_IO_SB = 0x1,
+
+  /** $FF02 */
+  LIBYAGBE_BUS_IO_SC = 0x2,
+
   /** $FF0F */
   LIBYAGBE_BUS_IO_IF = 0xF,
 
+  /** $FF46 */
+  LIBYAGBE_BUS_IO_DMA = 0x46,
+
   /** $FFFF */
   LIBYAGBE_BUS_IO_IE = 0xF
 };
 
+/** @brief Defines how long OAM DMA takes: the rest of the m-cycle of the
+ * write to $FF46, an m-cycle to start, and an m-cycle per byte. */
+enum { LIBYAGBE_BUS_DMA_CYCLES = 4 + 4 + (4 * LIBYAGBE_PPU_MEM_SIZE_OAM) };
+
+/** Defines the state of OAM DMA.
+ *
+ * Nothing is done per byte. The whole transfer is one copy, made when the
+ * event for its completion is handled. Until then the bus is locked:
+ * everything below $FF00, OAM included, is unmapped and reads as $FF, so the
+ * CPU can only reach the IO registers and HRAM. That also means nothing the
+ * CPU does can change the source in the meantime, so one copy at the end
+ * leaves OAM just as copying a byte at a time would.
+ */
+struct libyagbe_bus_dma {
+  /** The last value written to $FF46: the upper byte of the source. */
+  uint8_t source;
+
+  /** Whether a transfer is in progress, keeping the bus locked. */
+  bool active;
+};
+
+/** @brief Defines the function prototype used to receive serial output. */
+typedef void (*libyagbe_bus_serial_cb)(void* const userdata,
+                                       const uint8_t data);
+
+/** Defines the memory a forked bus still shares with the instance it was
+ * forked from.
+ *
+ * Shared memory is tracked in 256-byte chunks, the size of a page. Until a
+ * chunk is first written to, pages covering it read straight from the
+ * parent's copy and have no write mapping, so the write reaches the IO
+ * handlers, which copy the chunk and remap it.
+ */
+struct libyagbe_bus_shared {
+  /** The parent's copy of each chunk of WRAM, or NULL once this bus has its
+   * own. */
+  const uint8_t* wram[LIBYAGBE_BUS_MEM_SIZE_WRAM / LIBYAGBE_BUS_PAGE_SIZE];
+
+  /** The parent's copy of each chunk of cartridge RAM, or NULL once this bus
+   * has its own. */
+  const uint8_t*
+      cart_ram[LIBYAGBE_CART_MEM_SIZE_RAM / LIBYAGBE_BUS_PAGE_SIZE];
+
+  /** The memory of this bus that each page would be mapped to for writing,
+   * for pages which are mapped to shared memory instead. */
+  uint8_t* pending[LIBYAGBE_BUS_NUM_PAGES];
+
+  /** The number of chunks which are still shared. */
+  size_t num_shared;
+};
+
 /** Defines the system bus.
  *
  * The system bus is really just the interconnect between the CPU, memory, and
  * peripherals.
  */
 struct libyagbe_bus {
+  /** The host memory backing each page for reads, or NULL if the page must go
+   * through the IO handlers. */
+  const uint8_t* read_map[LIBYAGBE_BUS_NUM_PAGES];
+
+  /** The host memory backing each page for writes, or NULL if the page must go
+   * through the IO handlers. */
+  uint8_t* write_map[LIBYAGBE_BUS_NUM_PAGES];
+
   struct libyagbe_apu apu;
   struct libyagbe_cart cart;
   struct libyagbe_timer timer;
   struct libyagbe_ppu ppu;
+  struct libyagbe_joypad joypad;
+
+  /** The scheduler of the system this bus belongs to. */
+  struct libyagbe_sched* sched;
+
+  /** The function, if any, which receives every byte written to SB. */
+  libyagbe_bus_serial_cb serial_cb;
+
+  /** Context specific data passed to \ref serial_cb. */
+  void* serial_userdata;
+
+  struct libyagbe_bus_dma dma;
+
+  /** Counters of accesses nothing on the bus responded to. */
+  struct libyagbe_diag diag;
+
+  /** The profile being recorded into, if any. */
+  struct libyagbe_profile* profile;
 
   uint8_t wram[LIBYAGBE_BUS_MEM_SIZE_WRAM];
   uint8_t hram[LIBYAGBE_BUS_MEM_SIZE_HRAM];
 
-  uint8_t interrupt_flag;
-  uint8_t interrupt_enable;
+  struct libyagbe_irq irq;
+
+  /** The memory shared with the instance this bus was forked from, if any. */
+  struct libyagbe_bus_shared shared;
 };
 
+/** Connects a bus to the system it belongs to.
+ *
+ * @param bus The current system bus.
+ * @param sched The scheduler the bus should queue its events on.
+ */
+void libyagbe_bus_init(struct libyagbe_bus* const bus,
+                       struct libyagbe_sched* const sched);
+
+/** Maps a run of pages directly to host memory.
+ *
+ * @param bus The current system bus.
+ * @param first_page The first page to map, i.e. the address shifted right by
+ * \ref LIBYAGBE_BUS_PAGE_SHIFT.
+ * @param num_pages The number of consecutive pages to map.
+ * @param read The host memory to read from, or NULL to read through the IO
+ * handlers.
+ * @param write The host memory to write to, or NULL to write through the IO
+ * handlers.
+ */
+void libyagbe_bus_map(struct libyagbe_bus* const bus,
+                      const unsigned int first_page,
+                      const unsigned int num_pages, const uint8_t* const read,
+                      uint8_t* const write);
+
+/** Returns what a chunk of WRAM or cartridge RAM currently holds.
+ *
+ * For a forked bus this may be the parent's copy of the chunk.
+ *
+ * @param bus The current system bus.
+ * @param memory The start of a 256-byte chunk of \ref libyagbe_bus::wram or
+ * \ref libyagbe_cart::ram.
+ *
+ * @returns Where the contents of the chunk can be read from.
+ */
+const uint8_t* libyagbe_bus_get_memory(const struct libyagbe_bus* const bus,
+                                       const uint8_t* const memory);
+
+/** Rebuilds the entire memory map from the current state of the system,
+ * including whether OAM DMA has the bus locked.
+ *
+ * @param bus The current system bus.
+ */
+void libyagbe_bus_reset(struct libyagbe_bus* const bus);
+
+/** Reads a byte from the system bus without advancing the system or causing
+ * any side effects. While OAM DMA has the bus locked, this reads what the CPU
+ * would.
+ *
+ * @param bus The current system bus.
+ * @param address The address to read from the system bus.
+ *
+ * @returns The byte from system bus, or $FF if nothing responds there.
+ */
 uint8_t libyagbe_bus_inspect_memory(struct libyagbe_bus* const bus,
                                     const uint16_t address);
 
@@ -19,19 +19,158 @@
 #ifndef LIBYAGBE_CART_H
 #define LIBYAGBE_CART_H
 
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
 #include "compat/compat_stdint.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/** @brief Defines the memory bank controllers which are supported. */
+enum libyagbe_cart_mbc {
+  LIBYAGBE_CART_MBC_NONE,
+  LIBYAGBE_CART_MBC1,
+  LIBYAGBE_CART_MBC3,
+  LIBYAGBE_CART_MBC5
+};
+
+/** @brief Defines the sizes of the memory areas of a cartridge. */
+enum libyagbe_cart_mem_size {
+  LIBYAGBE_CART_MEM_SIZE_ROM_BANK = 16384,
+  LIBYAGBE_CART_MEM_SIZE_RAM_BANK = 8192,
+
+  /** @brief The largest amount of external RAM any cartridge has. */
+  LIBYAGBE_CART_MEM_SIZE_RAM = 131072
+};
+
+/** @brief Defines the registers of the MBC3 real time clock. */
+enum libyagbe_cart_rtc_registers {
+  LIBYAGBE_CART_RTC_S,
+  LIBYAGBE_CART_RTC_M,
+  LIBYAGBE_CART_RTC_H,
+  LIBYAGBE_CART_RTC_DL,
+  LIBYAGBE_CART_RTC_DH,
+  LIBYAGBE_CART_NUM_RTC_REGISTERS
+};
+
 struct libyagbe_cart {
-  /* Array containing the raw cartridge data. */
+  /** The raw cartridge data. This is owned by the caller and never copied, so
+   * it may point into a memory mapped file. */
   const uint8_t* data;
+
+  /** The size of \ref data in bytes. */
+  size_t size;
+
+  enum libyagbe_cart_mbc mbc;
+
+  /** The number of 16KiB ROM banks actually present. */
+  unsigned int num_rom_banks;
+
+  /** The number of 8KiB RAM banks, according to the header. */
+  unsigned int num_ram_banks;
+
+  /** Whether or not the cartridge has an MBC3 real time clock. */
+  bool has_rtc;
+
+  /** Whether or not external RAM (and the RTC) is accessible. */
+  bool ram_enabled;
+
+  /** The ROM bank register, as written. */
+  unsigned int rom_bank;
+
+  /** The RAM bank register, as written. On MBC1 this is also the upper ROM
+   * bank bits, and on MBC3 it may select an RTC register instead. */
+  unsigned int ram_bank;
+
+  /** The MBC1 banking mode. */
+  uint8_t banking_mode;
+
+  /** The last value written to the MBC3 latch register. */
+  uint8_t rtc_latch;
+
+  /** The RTC registers.
+   *
+   * These can be read, written and latched, but the clock doesn't tick.
+   */
+  uint8_t rtc[LIBYAGBE_CART_NUM_RTC_REGISTERS];
+
+  /** The RTC registers as of the last latch, which is what reads return. */
+  uint8_t rtc_latched[LIBYAGBE_CART_NUM_RTC_REGISTERS];
+
+  uint8_t ram[LIBYAGBE_CART_MEM_SIZE_RAM];
 };
 
+/** Inserts a cartridge, determining its hardware from the header.
+ *
+ * @param cart The cartridge instance.
+ * @param data The raw cartridge data, which must outlive the instance.
+ * @param size The size of the cartridge data in bytes.
+ *
+ * @returns true if the cartridge is supported, false if it is too small or
+ * uses hardware which isn't emulated.
+ */
+bool libyagbe_cart_init(struct libyagbe_cart* const cart,
+                        const uint8_t* const data, const size_t size);
+
+/** Resets the bank registers of a cartridge. External RAM is left alone.
+ *
+ * @param cart The cartridge instance.
+ */
 void libyagbe_cart_reset(struct libyagbe_cart* const cart);
 
+/** Retrieves the ROM bank currently visible in one half of $0000-$7FFF.
+ *
+ * @param cart The cartridge instance.
+ * @param address An address within the half to look up.
+ *
+ * @returns The start of the 16KiB bank.
+ */
+const uint8_t* libyagbe_cart_get_rom_bank(
+    const struct libyagbe_cart* const cart, const uint16_t address);
+
+/** Retrieves the RAM bank currently visible at $A000-$BFFF.
+ *
+ * @param cart The cartridge instance.
+ *
+ * @returns The start of the 8KiB bank, or NULL if the area is disabled or
+ * doesn't contain plain RAM and so must go through \ref
+ * libyagbe_cart_read_ram and \ref libyagbe_cart_write_ram.
+ */
+uint8_t* libyagbe_cart_get_ram_bank(struct libyagbe_cart* const cart);
+
+/** Handles a write to the MBC registers at $0000-$7FFF.
+ *
+ * The banks returned by \ref libyagbe_cart_get_rom_bank and \ref
+ * libyagbe_cart_get_ram_bank may have changed afterwards.
+ *
+ * @param cart The cartridge instance.
+ * @param address The address written to.
+ * @param data The data written.
+ */
+void libyagbe_cart_write_rom(struct libyagbe_cart* const cart,
+                             const uint16_t address, const uint8_t data);
+
+/** Reads from $A000-$BFFF when it isn't mapped to plain RAM.
+ *
+ * @param cart The cartridge instance.
+ * @param address The address to read from.
+ *
+ * @returns The selected RTC register, or $FF if the area is disabled.
+ */
+uint8_t libyagbe_cart_read_ram(const struct libyagbe_cart* const cart,
+                               const uint16_t address);
+
+/** Writes to $A000-$BFFF when it isn't mapped to plain RAM.
+ *
+ * @param cart The cartridge instance.
+ * @param address The address to write to.
+ * @param data The data to write.
+ */
+void libyagbe_cart_write_ram(struct libyagbe_cart* const cart,
+                             const uint16_t address, const uint8_t data);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
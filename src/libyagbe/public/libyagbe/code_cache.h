@@ -0,0 +1,138 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_CODE_CACHE_H
+#define LIBYAGBE_CODE_CACHE_H
+
+#include <stddef.h>
+
+#include "cart.h"
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Defines an instruction which has been decoded ahead of time.
+ *
+ * Only the CPU knows what the handler and operands mean.
+ */
+struct libyagbe_code_cache_entry {
+  /** What executes the instruction, or 0 if it hasn't been decoded yet. */
+  uint8_t handler;
+
+  /** The opcode, which is $CB for every $CB-prefixed instruction. */
+  uint8_t opcode;
+
+  /** The length of the instruction in bytes. */
+  uint8_t length;
+
+  /** Operands already picked out of the instruction, such as registers. */
+  uint8_t x;
+  uint8_t y;
+  uint16_t imm;
+};
+
+/** Defines the decoded instructions of a single ROM bank.
+ *
+ * Instructions are decoded the first time they're executed, so most entries
+ * are never filled in; there's one for every address an instruction could
+ * start at.
+ */
+struct libyagbe_code_cache_bank {
+  /** The ROM bank which was decoded into this slot, or NULL if none was. */
+  const uint8_t* rom;
+
+  struct libyagbe_code_cache_entry entries[LIBYAGBE_CART_MEM_SIZE_ROM_BANK];
+};
+
+/** Defines a cache of decoded instructions, which the CPU executes in place
+ * of fetching and decoding them from the bus.
+ *
+ * Only instructions in ROM are cached, so nothing ever has to be invalidated
+ * by a write; anything running from RAM goes through the regular interpreter.
+ * $0000-$3FFF always decodes into the first slot, and each bank mapped at
+ * $4000-$7FFF into one of the rest, the bank number modulo their count. Code
+ * in one half of ROM therefore never throws away the other's, and switching
+ * banks only throws a bank away when it shares a slot with the one being
+ * switched to.
+ */
+struct libyagbe_code_cache {
+  struct libyagbe_code_cache_bank* banks;
+  size_t num_banks;
+
+  /** The ROM banks the two halves of $0000-$7FFF were last seen mapping. */
+  struct libyagbe_code_cache_region {
+    /** The start of the ROM bank, or NULL if the region must be looked up
+     * again. */
+    const uint8_t* rom;
+
+    /** The slot the bank decodes into. */
+    struct libyagbe_code_cache_bank* bank;
+  } regions[2];
+};
+
+/** Initializes a code cache. Nothing is ever allocated.
+ *
+ * One slot more than the cartridge has ROM banks means nothing is ever
+ * decoded twice, but a handful is usually enough as most games spend their
+ * time in only a few banks.
+ *
+ * @param cache The code cache.
+ * @param banks The slots to decode banks into, which must stay valid for as
+ * long as the code cache is used.
+ * @param num_banks The number of slots, which must be at least 2: one for
+ * $0000-$3FFF and at least one for the banks switched into $4000-$7FFF.
+ *
+ * @returns true if the code cache was initialized, or false if there are too
+ * few slots.
+ */
+bool libyagbe_code_cache_init(struct libyagbe_code_cache* const cache,
+                              struct libyagbe_code_cache_bank* const banks,
+                              const size_t num_banks);
+
+/** Throws away every decoded instruction.
+ *
+ * This must be done before the cache is used with a different cartridge, or
+ * if the cartridge data is changed.
+ *
+ * @param cache The code cache.
+ */
+void libyagbe_code_cache_clear(struct libyagbe_code_cache* const cache);
+
+/** Looks up where the instruction at an address in ROM decodes into, changing
+ * which banks are cached if necessary.
+ *
+ * @param cache The code cache.
+ * @param cart The cartridge.
+ * @param address An address in $0000-$7FFF.
+ *
+ * @returns The entry, or NULL if the address isn't mapped to the ROM bank the
+ * cartridge selected, in which case the instruction must be fetched from the
+ * bus as usual.
+ */
+struct libyagbe_code_cache_entry* libyagbe_code_cache_map(
+    struct libyagbe_code_cache* const cache,
+    const struct libyagbe_cart* const cart, const uint16_t address);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_CODE_CACHE_H */
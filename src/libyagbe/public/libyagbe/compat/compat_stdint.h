@@ -30,9 +30,24 @@
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef signed char int8_t;
+typedef signed short int16_t;
+
+/* The scheduler counts T-cycles in this, so it must be 64 bits wide: at 32
+ * bits the clock would wrap after about 17 minutes. C90 has no 64-bit type,
+ * so an extension is needed wherever long is 32 bits. */
+#ifdef _MSC_VER
+typedef unsigned __int64 uintmax_t;
+#elif defined(__GNUC__)
+__extension__ typedef unsigned long long uintmax_t;
+#else
 typedef unsigned long uintmax_t;
+#endif /* _MSC_VER */
 
 #endif /* (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L) || \
            defined(__cplusplus) */
 
+/* Fails to compile if uintmax_t is too narrow for the clock. */
+typedef char libyagbe_compat_uintmax_is_64_bits[(sizeof(uintmax_t) >= 8) ? 1
+                                                                          : -1];
+
 #endif /* LIBYAGBE_COMPAT_STDINT_H */
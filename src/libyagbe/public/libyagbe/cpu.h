@@ -19,6 +19,7 @@
 #ifndef LIBYAGBE_CPU_H
 #define LIBYAGBE_CPU_H
 
+#include "compat/compat_stdbool.h"
 #include "compat/compat_stdint.h"
 
 #ifdef __cplusplus
@@ -26,6 +27,7 @@ extern "C" {
 #endif /* __cplusplus */
 
 struct libyagbe_bus;
+struct libyagbe_code_cache;
 
 /* XXX: On older compilers, though I seriously doubt it, this may be dangerous.
 *  Need to investigate.
@@ -48,6 +50,50 @@ typedef union _cpu_register_pair {
   } byte;
 } cpu_register_pair;
 
+/** Defines the execution states of an SM83 CPU. */
+enum libyagbe_cpu_state {
+  /** The CPU is fetching and executing instructions normally. */
+  LIBYAGBE_CPU_STATE_RUNNING,
+
+  /** The CPU has executed HALT, and is waiting for an enabled interrupt to be
+   * requested. */
+  LIBYAGBE_CPU_STATE_HALTED,
+
+  /** The CPU has executed STOP, and is waiting for a button to be pressed. */
+  LIBYAGBE_CPU_STATE_STOPPED,
+
+  /** The CPU has executed an invalid opcode and locked up, as the hardware
+   * does. Only a reset will bring it back.
+   */
+  LIBYAGBE_CPU_STATE_LOCKED
+};
+
+/** Defines the ALU operations whose flags can be left to be worked out later.
+ */
+enum libyagbe_cpu_lazy_op {
+  /** F is up to date. */
+  LIBYAGBE_CPU_LAZY_NONE,
+
+  /** ADD or ADC of `rhs` and `carry` to `lhs`. */
+  LIBYAGBE_CPU_LAZY_ADD,
+
+  /** SUB, SBC or CP of `rhs` and `carry` from `lhs`. */
+  LIBYAGBE_CPU_LAZY_SUB,
+
+  /** INC of `lhs`. */
+  LIBYAGBE_CPU_LAZY_INC,
+
+  /** DEC of `lhs`. */
+  LIBYAGBE_CPU_LAZY_DEC,
+
+  /** A shift or rotate which gave `lhs` and shifted out `carry`. */
+  LIBYAGBE_CPU_LAZY_SHIFT,
+
+  /** RLCA, RRCA, RLA or RRA, which are the same as a shift or rotate except
+   * that Z is always cleared. */
+  LIBYAGBE_CPU_LAZY_ROTATE_A
+};
+
 /* Defines the structure of an SM83 CPU. */
 struct libyagbe_cpu {
   struct libyagbe_cpu_registers {
@@ -61,6 +107,35 @@ struct libyagbe_cpu {
 
   /** The current instruction being processed. */
   uint8_t instruction;
+
+  /** The current execution state. */
+  enum libyagbe_cpu_state state;
+
+  /** The interrupt master enable flag. */
+  bool ime;
+
+  /** Whether EI was the last instruction executed, in which case IME has been
+   * set but doesn't take effect until after the next instruction. */
+  bool ei_delay;
+
+  /** Whether the next opcode fetch fails to increment PC, which happens when
+   * HALT is executed with an interrupt pending but IME clear. */
+  bool halt_bug;
+
+  /** The decoded instructions to execute from instead of the bus where
+   * possible, or NULL to always fetch and decode from the bus. */
+  struct libyagbe_code_cache* code_cache;
+
+  /** The last ALU operation, if its flags haven't been worked out yet. F
+   * holds the flags from before it until then. This is only ever set when the
+   * core is built with lazy flags.
+   */
+  struct libyagbe_cpu_lazy_flags {
+    enum libyagbe_cpu_lazy_op op;
+    uint8_t lhs;
+    uint8_t rhs;
+    uint8_t carry;
+  } lazy_flags;
 };
 
 /** Resets an SM83 CPU to the startup state.
@@ -69,13 +144,39 @@ struct libyagbe_cpu {
  */
 void libyagbe_cpu_reset(struct libyagbe_cpu* const cpu);
 
-/** Advances the CPU by one cycle.
+/** Advances the CPU by one instruction.
+ *
+ * With a code cache, instructions in ROM are decoded once and then executed
+ * from the cache. The result is exactly the same as decoding them every time,
+ * down to when each memory access happens.
+ *
+ * A halted, stopped or locked up CPU still lets 1 m-cycle pass, so the rest of
+ * the system keeps running.
  *
  * @param cpu The SM83 CPU instance.
  */
 void libyagbe_cpu_step(struct libyagbe_cpu* const cpu,
                        struct libyagbe_bus* const bus);
 
+/** Returns the flag register as the program would see it.
+ *
+ * @param cpu The SM83 CPU instance.
+ *
+ * @returns F, including any flags the last ALU operation has left pending.
+ */
+uint8_t libyagbe_cpu_get_flags(const struct libyagbe_cpu* const cpu);
+
+/** Works out any flags the last ALU operation has left pending and stores
+ * them in F, so `reg.af` can be read directly.
+ *
+ * The system does this before returning from stepping or running, so this is
+ * only needed after calling libyagbe_cpu_step() directly. Without lazy flags
+ * it does nothing.
+ *
+ * @param cpu The SM83 CPU instance.
+ */
+void libyagbe_cpu_sync_flags(struct libyagbe_cpu* const cpu);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,108 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_DIAG_H
+#define LIBYAGBE_DIAG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "compat/compat_stdint.h"
+
+/** @brief Defines the kinds of bus accesses diagnostics are kept for. */
+enum libyagbe_diag_access {
+  LIBYAGBE_DIAG_ACCESS_READ,
+  LIBYAGBE_DIAG_ACCESS_WRITE,
+  LIBYAGBE_DIAG_NUM_ACCESS_TYPES
+};
+
+/** @brief Defines the function prototype used to report unhandled accesses.
+ *
+ * The function is only called when the hit count of an address reaches a
+ * power of two, so a game polling an unimplemented register costs a handful of
+ * calls rather than one per access.
+ *
+ * @param userdata Context specific data.
+ * @param access The kind of access.
+ * @param address The address which was accessed.
+ * @param data The data written, or $FF for reads.
+ * @param hits The number of times this has been seen so far.
+ */
+typedef void (*libyagbe_diag_cb)(void* const userdata,
+                                 const enum libyagbe_diag_access access,
+                                 const uint16_t address, const uint8_t data,
+                                 const unsigned long hits);
+
+/** Defines the diagnostics of a system instance.
+ *
+ * Accesses to $FF00-$FFFF are counted per address, since that's where the
+ * registers live; anything else is counted per 256 byte page.
+ */
+struct libyagbe_diag {
+  /** Unhandled accesses to each address in $FF00-$FFFF. */
+  unsigned long io_hits[LIBYAGBE_DIAG_NUM_ACCESS_TYPES][256];
+
+  /** Unhandled accesses to each page in $0000-$FEFF. */
+  unsigned long page_hits[LIBYAGBE_DIAG_NUM_ACCESS_TYPES][255];
+
+  /** The total number of unhandled accesses of each kind. */
+  unsigned long total_hits[LIBYAGBE_DIAG_NUM_ACCESS_TYPES];
+
+  /** The function, if any, which is told about unhandled accesses. */
+  libyagbe_diag_cb cb;
+
+  /** Context specific data passed to \ref cb. */
+  void* userdata;
+};
+
+/** Clears every counter, leaving the callback in place.
+ *
+ * @param diag The diagnostics instance.
+ */
+void libyagbe_diag_reset(struct libyagbe_diag* const diag);
+
+/** Records an access nothing on the bus responded to.
+ *
+ * @param diag The diagnostics instance.
+ * @param access The kind of access.
+ * @param address The address which was accessed.
+ * @param data The data written, or $FF for reads.
+ */
+void libyagbe_diag_record(struct libyagbe_diag* const diag,
+                          const enum libyagbe_diag_access access,
+                          const uint16_t address, const uint8_t data);
+
+/** Retrieves the number of unhandled accesses to an address.
+ *
+ * @param diag The diagnostics instance.
+ * @param access The kind of access.
+ * @param address The address to look up. Outside of $FF00-$FFFF, this returns
+ * the count of the whole page the address is in.
+ *
+ * @returns The number of unhandled accesses.
+ */
+unsigned long libyagbe_diag_get_hits(const struct libyagbe_diag* const diag,
+                                     const enum libyagbe_diag_access access,
+                                     const uint16_t address);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_DIAG_H */
@@ -19,26 +19,101 @@
 #ifndef LIBYAGBE_DISASM_H
 #define LIBYAGBE_DISASM_H
 
+#include <stddef.h>
+
 #include "compat/compat_stdint.h"
+#include "cpu.h"
 
 /* Forward declaration of the system bus. */
-struct libyagbe_cpu;
 struct libyagbe_bus;
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/** @brief Defines the sizes of the buffers the disassembler writes to,
+ * including the terminating NUL. */
+enum libyagbe_disasm_sizes {
+  /** Enough for any instruction on its own. */
+  LIBYAGBE_DISASM_INSTRUCTION_SIZE = 32,
+
+  /** Enough for any line written by \ref libyagbe_disasm_execute_r. */
+  LIBYAGBE_DISASM_LINE_SIZE = 384
+};
+
+/** Defines the state of one in-progress disassembly.
+ *
+ * Each thread disassembling should have its own context.
+ */
+struct libyagbe_disasm_context {
+  /** The address of the instruction. */
+  uint16_t pc;
+
+  /** The opcode and the two bytes after it. */
+  uint8_t bytes[3];
+
+  /** The registers before the instruction was executed. */
+  struct libyagbe_cpu_registers reg;
+};
+
+/**
+ * Formats a single instruction from its raw bytes.
+ *
+ * @param buf Receives the NUL terminated text, and must be at least \ref
+ * LIBYAGBE_DISASM_INSTRUCTION_SIZE bytes long.
+ * @param pc The address of the instruction, used to resolve relative jumps.
+ * @param bytes The opcode followed by its operands. Three bytes are always
+ * enough, and bytes past the end of the instruction are ignored.
+ *
+ * @returns The length of the text, not counting the terminating NUL.
+ */
+size_t libyagbe_disasm_format(char* const buf, const uint16_t pc,
+                              const uint8_t* const bytes);
+
+/**
+ * Captures the state needed to disassemble the instruction about to execute.
+ *
+ * @param ctx The context to fill in.
+ * @param pc The address of the instruction.
+ * @param cpu The CPU about to execute the instruction.
+ * @param bus The system bus of the CPU.
+ */
+void libyagbe_disasm_prepare_r(struct libyagbe_disasm_context* const ctx,
+                               const uint16_t pc,
+                               const struct libyagbe_cpu* const cpu,
+                               struct libyagbe_bus* const bus);
+
+/**
+ * Disassembles an instruction once it has executed.
+ *
+ * The line holds the registers from before the instruction, the instruction
+ * itself, the timer registers, and whatever the instruction changed.
+ *
+ * @param ctx The context filled in by \ref libyagbe_disasm_prepare_r.
+ * @param cpu The CPU which executed the instruction.
+ * @param bus The system bus of the CPU.
+ * @param buf Receives the NUL terminated line, and must be at least \ref
+ * LIBYAGBE_DISASM_LINE_SIZE bytes long.
+ *
+ * @returns The length of the line, not counting the terminating NUL.
+ */
+size_t libyagbe_disasm_execute_r(const struct libyagbe_disasm_context* const ctx,
+                                 const struct libyagbe_cpu* const cpu,
+                                 struct libyagbe_bus* const bus,
+                                 char* const buf);
+
 /** Prepares to disassemble the current instruction.
+ *
+ * This shares one context between all callers, so it isn't thread-safe; use
+ * \ref libyagbe_disasm_prepare_r instead where that matters.
  */
 void libyagbe_disasm_prepare(const uint16_t pc, struct libyagbe_cpu* const cpu,
                              struct libyagbe_bus* const bus);
 
 /**
- * Disassembles a given instruction.
+ * Disassembles the instruction given to \ref libyagbe_disasm_prepare.
  *
- * @returns The disassembled string. It is your responsibility to free the
- * memory held by the string.
+ * @returns The disassembled line, which is overwritten by the next call.
  */
 char* libyagbe_disasm_execute(struct libyagbe_cpu* const cpu,
                               struct libyagbe_bus* const bus);
@@ -20,26 +20,62 @@
 #define LIBYAGBE_GB_H
 
 #include "bus.h"
+#include "code_cache.h"
 #include "cpu.h"
+#include "jit.h"
+#include "sched.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
-/** Defines a YAGBE system instance. */
+/** The version of the save state format written by this library. States of
+ * any other version are refused. */
+enum { LIBYAGBE_SYSTEM_STATE_VERSION = 4 };
+
+/** Defines the last loop found not to be a polling loop, so that ordinary
+ * loops only cost a comparison each time around. */
+struct libyagbe_system_loop_cache {
+  /** The host memory the start of the loop was mapped to. */
+  const uint8_t* page;
+
+  /** Where the loop starts. */
+  uint16_t head;
+
+  /** Where the jump back to the start of the loop is. */
+  uint16_t branch;
+};
+
+/** Defines a YAGBE system instance.
+ *
+ * All emulation state is owned by the instance, so separate instances may be
+ * run on separate threads without any locking.
+ */
 struct libyagbe_system {
   struct libyagbe_bus bus;
   struct libyagbe_cpu cpu;
+  struct libyagbe_sched sched;
+  struct libyagbe_system_loop_cache loop_cache;
+
+  /** The JIT to run blocks of instructions with, or NULL to interpret every
+   * instruction. */
+  struct libyagbe_jit* jit;
 };
 
 /**
  * @brief Initializes a YAGBE instance.
  *
  * @param gb The YAGBE instance to initialize.
- * @param cart_data The cart data.
+ * @param cart_data The cart data. This is not copied, and must remain valid
+ * for as long as the instance is used.
+ * @param cart_size The size of the cart data in bytes.
+ *
+ * @returns true if the instance was initialized, or false if the cartridge is
+ * not supported.
  */
-void libyagbe_system_init(struct libyagbe_system* const gb,
-                          const uint8_t* const cart_data);
+bool libyagbe_system_init(struct libyagbe_system* const gb,
+                          const uint8_t* const cart_data,
+                          const size_t cart_size);
 
 /**
  * @brief Resets a YAGBE instance to the startup state.
@@ -52,12 +88,276 @@ void libyagbe_system_init(struct libyagbe_system* const gb,
 void libyagbe_system_reset(struct libyagbe_system* const gb);
 
 /**
- * @brief Advances a YAGBE instance by one step.
+ * @brief Advances a YAGBE instance by one instruction.
  *
  * @param gb The YAGBE instance.
+ *
+ * @returns The number of T-cycles the instruction took, or 0 if the CPU has
+ * locked up.
  */
 unsigned int libyagbe_system_step(struct libyagbe_system* const gb);
 
+/**
+ * @brief Runs a YAGBE instance for at least the given number of T-cycles.
+ *
+ * Instructions are never split, so the instance may run for slightly longer
+ * than requested. While the CPU is halted, time jumps straight from one
+ * scheduled event to the next. The same goes for short loops which do nothing
+ * but poll registers such as LY, STAT or IF, or RAM, waiting on something
+ * only an event can change: the iterations that would have run before the
+ * event are skipped, leaving exactly the state running them would have.
+ *
+ * @param gb The YAGBE instance.
+ * @param cycles The number of T-cycles to run for.
+ *
+ * @returns The number of T-cycles which actually elapsed.
+ */
+uintmax_t libyagbe_system_run(struct libyagbe_system* const gb,
+                              const uintmax_t cycles);
+
+/**
+ * @brief Runs a YAGBE instance until the next scheduled event has been
+ * handled.
+ *
+ * If no event is queued, a single instruction is executed.
+ *
+ * @param gb The YAGBE instance.
+ *
+ * @returns The number of T-cycles which elapsed.
+ */
+uintmax_t libyagbe_system_run_until_event(struct libyagbe_system* const gb);
+
+/**
+ * @brief Sets which buttons are held.
+ *
+ * The change takes effect at the current time of the instance, between
+ * instructions. Pressing a button in a group the program has selected raises
+ * the joypad interrupt, and ends STOP.
+ *
+ * @param gb The YAGBE instance.
+ * @param buttons The \ref libyagbe_joypad_button bits of the buttons held.
+ */
+void libyagbe_system_set_buttons(struct libyagbe_system* const gb,
+                                 const uint8_t buttons);
+
+/**
+ * @brief Sets the function which receives bytes written to the serial port.
+ *
+ * @param gb The YAGBE instance.
+ * @param cb The function to call, or NULL to discard serial output.
+ * @param userdata Context specific data passed to the function.
+ */
+void libyagbe_system_set_serial_cb(struct libyagbe_system* const gb,
+                                   const libyagbe_bus_serial_cb cb,
+                                   void* const userdata);
+
+/**
+ * @brief Sets the function which is told about unhandled bus accesses.
+ *
+ * The counters themselves are always kept in \ref libyagbe_bus::diag, and are
+ * cleared when the instance is reset.
+ *
+ * @param gb The YAGBE instance.
+ * @param cb The function to call, or NULL to only keep counters.
+ * @param userdata Context specific data passed to the function.
+ */
+void libyagbe_system_set_diag_cb(struct libyagbe_system* const gb,
+                                 const libyagbe_diag_cb cb,
+                                 void* const userdata);
+
+/**
+ * @brief Sets whether the PPU draws pixels.
+ *
+ * Turning drawing off only skips pixel output: LY, STAT and the PPU's
+ * interrupts keep exactly the same timing. To capture a single frame, turn
+ * drawing on as soon as the previous frame has completed (when
+ * \ref libyagbe_ppu::frame_count changes), and off again after the next one.
+ *
+ * Drawing is on by default.
+ *
+ * @param gb The YAGBE instance.
+ * @param render true to draw, or false to leave every framebuffer untouched.
+ */
+void libyagbe_system_set_render(struct libyagbe_system* const gb,
+                                const bool render);
+
+/**
+ * @brief Sets the pair of buffers the PPU draws frames into.
+ *
+ * Frames are drawn into the two buffers alternately, with nothing copied. As
+ * each frame completes, at the start of VBlank, it's handed to the callback
+ * and the PPU moves on to the other buffer. The frame handed over isn't
+ * touched again until the callback for the next frame has returned, so it
+ * can be read by another thread while the next frame is emulated, without
+ * any locking. While the LCD is off or drawing is off, no frames are handed
+ * over.
+ *
+ * Each buffer must hold \ref libyagbe_ppu_get_frame_size bytes, and be
+ * aligned for the pixel format. Until buffers are set, frames are drawn in
+ * shades into \ref libyagbe_ppu::framebuffer.
+ *
+ * @param gb The YAGBE instance.
+ * @param format The pixel format to draw in.
+ * @param buffer0 The buffer to draw the next frame into, or NULL to stop
+ * drawing into caller buffers.
+ * @param buffer1 The buffer to draw the frame after that into.
+ * @param cb The function to hand each completed frame to. It's called from
+ * within the instance, so it must not use the instance itself.
+ * @param userdata Context specific data passed to the function.
+ */
+void libyagbe_system_set_video_output(
+    struct libyagbe_system* const gb,
+    const enum libyagbe_ppu_pixel_format format, void* const buffer0,
+    void* const buffer1, const libyagbe_ppu_frame_cb cb, void* const userdata);
+
+/**
+ * @brief Sets the profile to record into.
+ *
+ * Nothing is recorded unless the core was built with the profiler hooks; see
+ * \ref libyagbe_profile_is_supported. The profile must have been reset with
+ * \ref libyagbe_profile_reset before it's first used.
+ *
+ * @param gb The YAGBE instance.
+ * @param profile The profile, or NULL to stop profiling.
+ */
+void libyagbe_system_set_profile(struct libyagbe_system* const gb,
+                                 struct libyagbe_profile* const profile);
+
+/**
+ * @brief Sets the code cache to execute instructions from.
+ *
+ * A cache can only be used by one instance at a time, and must have been
+ * cleared with \ref libyagbe_code_cache_clear since it was last used with a
+ * different cartridge.
+ *
+ * @param gb The YAGBE instance.
+ * @param cache The code cache, or NULL to fetch and decode every instruction
+ * from the bus.
+ */
+void libyagbe_system_set_code_cache(struct libyagbe_system* const gb,
+                                    struct libyagbe_code_cache* const cache);
+
+/**
+ * @brief Sets the JIT to run blocks of instructions with.
+ *
+ * Blocks are only run by \ref libyagbe_system_run and
+ * \ref libyagbe_system_run_until_event, which give exactly the same results
+ * either way, so an instance with a JIT can be checked against one without.
+ * The same rules apply as for a code cache: a JIT can only be used by one
+ * instance at a time, and must have been cleared with
+ * \ref libyagbe_jit_clear since it was last used with a different cartridge.
+ *
+ * @param gb The YAGBE instance.
+ * @param jit The JIT, or NULL to interpret every instruction.
+ */
+void libyagbe_system_set_jit(struct libyagbe_system* const gb,
+                             struct libyagbe_jit* const jit);
+
+/**
+ * @brief Sets where the audio of a YAGBE instance goes.
+ *
+ * Samples are only generated up to the last time a sound register was
+ * accessed, so call \ref libyagbe_system_flush_audio before taking samples out
+ * of the queue. Audio is muted by default, which costs next to nothing.
+ *
+ * @param gb The YAGBE instance.
+ * @param ring The queue to push samples to, or NULL to mute audio.
+ * @param sample_rate The number of samples to put out per second, up to
+ * \ref LIBYAGBE_APU_MAX_SAMPLE_RATE.
+ */
+void libyagbe_system_set_audio_output(struct libyagbe_system* const gb,
+                                      struct libyagbe_apu_ring* const ring,
+                                      const unsigned long sample_rate);
+
+/**
+ * @brief Pushes every sample up to the current time of a YAGBE instance.
+ *
+ * @param gb The YAGBE instance.
+ */
+void libyagbe_system_flush_audio(struct libyagbe_system* const gb);
+
+/**
+ * @brief Returns the size of the save state of a YAGBE instance.
+ *
+ * This only depends on the cartridge, so it never changes once the instance
+ * is initialized.
+ *
+ * @param gb The YAGBE instance.
+ *
+ * @returns The size of the save state in bytes.
+ */
+size_t libyagbe_system_get_state_size(const struct libyagbe_system* const gb);
+
+/**
+ * @brief Saves the state of a YAGBE instance into a caller provided buffer.
+ *
+ * Nothing is allocated. Callbacks, the audio and video outputs and the render
+ * mode are settings of the instance rather than part of its state, so they
+ * aren't saved.
+ *
+ * @param gb The YAGBE instance.
+ * @param buffer Where to write the save state.
+ * @param size The size of the buffer in bytes.
+ *
+ * @returns The number of bytes written, or 0 if the buffer is smaller than
+ * \ref libyagbe_system_get_state_size.
+ */
+size_t libyagbe_system_save_state(const struct libyagbe_system* const gb,
+                                  void* const buffer, const size_t size);
+
+/**
+ * @brief Restores a YAGBE instance from a save state.
+ *
+ * The state must have been saved by an instance with the same cartridge, by
+ * a library writing the same \ref LIBYAGBE_SYSTEM_STATE_VERSION.
+ *
+ * Every value the core indexes memory with or loops on is checked to be in
+ * range before anything is changed, such as LY, the PPU and CPU modes and
+ * the positions of the audio channels. The rest, such as the contents of
+ * memory and registers or when events are due, isn't checked: a state
+ * damaged there still loads, and then runs differently from the one saved.
+ * States must come from a trusted source.
+ *
+ * @param gb The YAGBE instance.
+ * @param buffer The save state.
+ * @param size The size of the save state in bytes.
+ *
+ * @returns true if the state was loaded, or false if it is for another
+ * cartridge, another version or is damaged, in which case the instance is
+ * unchanged.
+ */
+bool libyagbe_system_load_state(struct libyagbe_system* const gb,
+                                const void* const buffer, const size_t size);
+
+/**
+ * @brief Starts a YAGBE instance from the current state of another.
+ *
+ * WRAM and cartridge RAM aren't copied. The child reads the parent's memory
+ * until it first writes to each 256-byte page, and only then copies that
+ * page. The rest of the state, including VRAM, is copied. Any number of
+ * children can be forked from one parent, and children can themselves be
+ * forked.
+ *
+ * The child is still a whole \ref libyagbe_system, about 216 KiB on a 64-bit
+ * host, most of it cartridge RAM. Forking only writes to part of it, though,
+ * leaving alone WRAM, cartridge RAM, the audio output buffers, and the
+ * decoded tiles and framebuffer the PPU draws with. In memory which is only
+ * committed when it's first written, as large allocations and mmap() usually
+ * are, a child therefore takes up about 48 KiB once forked, plus the pages of
+ * WRAM and cartridge RAM it writes to, plus up to about 48 KiB more once it
+ * draws with rendering on. Memory committed up front costs the whole size of
+ * the struct per child.
+ *
+ * The parent must not be run, reset, loaded or destroyed while anything
+ * forked from it still exists. Callbacks, the audio and video outputs, the
+ * code cache and the JIT aren't inherited; the render mode is.
+ *
+ * @param child The instance to start. It doesn't need to be initialized.
+ * @param parent The instance to start from.
+ */
+void libyagbe_system_fork(struct libyagbe_system* const child,
+                          const struct libyagbe_system* const parent);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,105 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_IRQ_H
+#define LIBYAGBE_IRQ_H
+
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** @brief Defines the interrupt sources, as they appear in IF and IE. */
+enum libyagbe_irq_source {
+  LIBYAGBE_IRQ_VBLANK = 1 << 0,
+  LIBYAGBE_IRQ_STAT = 1 << 1,
+  LIBYAGBE_IRQ_TIMER = 1 << 2,
+  LIBYAGBE_IRQ_SERIAL = 1 << 3,
+  LIBYAGBE_IRQ_JOYPAD = 1 << 4,
+
+  LIBYAGBE_IRQ_ALL = 0x1F
+};
+
+/** Defines the interrupt controller.
+ *
+ * \ref pending is kept up to date whenever either register changes, so
+ * checking for an interrupt between instructions is a single test.
+ */
+struct libyagbe_irq {
+  /** IF: the requested interrupts. */
+  uint8_t flag;
+
+  /** IE: the enabled interrupts. */
+  uint8_t enable;
+
+  /** The interrupts which are both requested and enabled. */
+  uint8_t pending;
+};
+
+/** Resets the interrupt controller to the startup state.
+ *
+ * @param irq The interrupt controller instance.
+ */
+void libyagbe_irq_reset(struct libyagbe_irq* const irq);
+
+/** Requests interrupts on behalf of a device.
+ *
+ * @param irq The interrupt controller instance.
+ * @param sources The \ref libyagbe_irq_source bits to set in IF.
+ */
+void libyagbe_irq_request(struct libyagbe_irq* const irq,
+                          const uint8_t sources);
+
+/** Clears requests once the CPU has started servicing them.
+ *
+ * @param irq The interrupt controller instance.
+ * @param sources The \ref libyagbe_irq_source bits to clear in IF.
+ */
+void libyagbe_irq_acknowledge(struct libyagbe_irq* const irq,
+                              const uint8_t sources);
+
+/** Handles a read of IF.
+ *
+ * @param irq The interrupt controller instance.
+ *
+ * @returns IF, with the unused bits reading as 1.
+ */
+uint8_t libyagbe_irq_read_flag(const struct libyagbe_irq* const irq);
+
+/** Handles a write to IF.
+ *
+ * @param irq The interrupt controller instance.
+ * @param data The data written.
+ */
+void libyagbe_irq_write_flag(struct libyagbe_irq* const irq,
+                             const uint8_t data);
+
+/** Handles a write to IE.
+ *
+ * @param irq The interrupt controller instance.
+ * @param data The data written.
+ */
+void libyagbe_irq_write_enable(struct libyagbe_irq* const irq,
+                               const uint8_t data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_IRQ_H */
@@ -0,0 +1,140 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_JIT_H
+#define LIBYAGBE_JIT_H
+
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libyagbe_bus;
+struct libyagbe_cpu;
+
+/** The smallest code buffer worth handing to \ref libyagbe_jit_init. */
+enum { LIBYAGBE_JIT_MIN_CODE_SIZE = 64 * 1024 };
+
+/** Defines a block of SM83 code which has been compiled to host code. */
+struct libyagbe_jit_block {
+  /** Where the block starts within the cartridge data, or NULL if the slot
+   * is empty. */
+  const uint8_t* source;
+
+  /** The address the block runs at. */
+  uint16_t address;
+
+  /** The host code, or NULL if the block is left to the interpreter. */
+  const uint8_t* code;
+};
+
+/** Defines an experimental JIT, which compiles straight runs of SM83 code in
+ * ROM into host code.
+ *
+ * A block ends at the first jump, call, return or instruction the cached
+ * interpreter can't execute, and execution leaves it early whenever the
+ * interpreter would do something other than run the next instruction: an
+ * interrupt being dispatched, the ROM bank being switched, or the caller's
+ * time running out. Code in RAM may be modified at any time, so it's always
+ * interpreted, as are blocks which mostly access IO registers.
+ *
+ * Only x86-64 hosts using the System V calling convention are supported; see
+ * \ref libyagbe_jit_is_supported.
+ */
+struct libyagbe_jit {
+  /** The host code buffer, which must be readable, writable and executable.
+   */
+  uint8_t* code;
+  size_t code_size;
+
+  /** How much of the code buffer is in use. */
+  size_t code_used;
+
+  /** The compiled blocks, found by hashing where they start. */
+  struct libyagbe_jit_block* blocks;
+  size_t num_blocks;
+
+  /** The number of blocks compiled, and the number of times every block was
+   * thrown away because the code buffer was full. */
+  unsigned long num_compiled;
+  unsigned long num_flushes;
+};
+
+/** Determines whether the JIT supports the host it was built for.
+ *
+ * @returns true if it does, or false if \ref libyagbe_jit_init always fails.
+ */
+bool libyagbe_jit_is_supported(void);
+
+/** Initializes a JIT. Nothing is ever allocated.
+ *
+ * @param jit The JIT.
+ * @param code The buffer to write host code into, which must be mapped
+ * readable, writable and executable, and stay valid for as long as the JIT is
+ * used.
+ * @param code_size The size of the buffer in bytes, at least
+ * \ref LIBYAGBE_JIT_MIN_CODE_SIZE.
+ * @param blocks The slots to keep track of blocks in.
+ * @param num_blocks The number of slots, at least 1.
+ *
+ * @returns true if the JIT was initialized, or false if the host isn't
+ * supported or the buffers are too small.
+ */
+bool libyagbe_jit_init(struct libyagbe_jit* const jit, void* const code,
+                       const size_t code_size,
+                       struct libyagbe_jit_block* const blocks,
+                       const size_t num_blocks);
+
+/** Throws away every compiled block.
+ *
+ * This must be done before the JIT is used with a different cartridge, or if
+ * the cartridge data is changed.
+ *
+ * @param jit The JIT.
+ */
+void libyagbe_jit_clear(struct libyagbe_jit* const jit);
+
+/** Executes the block at PC, compiling it first if necessary. Anything which
+ * can't be executed as a block is executed with \ref libyagbe_cpu_step
+ * instead, one instruction at a time.
+ *
+ * The result is exactly the same as executing each instruction with
+ * \ref libyagbe_cpu_step until the block ends.
+ *
+ * @param jit The JIT.
+ * @param cpu The SM83 CPU instance.
+ * @param bus The system bus instance.
+ * @param limit No instruction after the first is started at or after this
+ * time.
+ *
+ * @returns Where the last instruction executed starts.
+ */
+uint16_t libyagbe_jit_execute(struct libyagbe_jit* const jit,
+                              struct libyagbe_cpu* const cpu,
+                              struct libyagbe_bus* const bus,
+                              const uintmax_t limit);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_JIT_H */
@@ -0,0 +1,116 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef LIBYAGBE_JOYPAD_H
+#define LIBYAGBE_JOYPAD_H
+
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libyagbe_irq;
+
+enum libyagbe_joypad_io_registers {
+  /** $FF00 */
+  LIBYAGBE_JOYPAD_IO_P1 = 0x0
+};
+
+/** @brief Defines the buttons, as passed to \ref libyagbe_joypad_set_buttons.
+ *
+ * The direction keys and the action buttons each share the 4 input lines of
+ * P1, in this order.
+ */
+enum libyagbe_joypad_button {
+  LIBYAGBE_JOYPAD_RIGHT = 1 << 0,
+  LIBYAGBE_JOYPAD_LEFT = 1 << 1,
+  LIBYAGBE_JOYPAD_UP = 1 << 2,
+  LIBYAGBE_JOYPAD_DOWN = 1 << 3,
+  LIBYAGBE_JOYPAD_A = 1 << 4,
+  LIBYAGBE_JOYPAD_B = 1 << 5,
+  LIBYAGBE_JOYPAD_SELECT = 1 << 6,
+  LIBYAGBE_JOYPAD_START = 1 << 7
+};
+
+/** Defines the joypad.
+ *
+ * P1 is worked out from the selected groups and the held buttons whenever
+ * it's read, so the only state is what the program last wrote and what the
+ * frontend last set.
+ */
+struct libyagbe_joypad {
+  /** Bits 4 and 5 of P1, which are cleared to select the direction keys and
+   * the action buttons respectively. */
+  uint8_t select;
+
+  /** The \ref libyagbe_joypad_button bits of the buttons being held. */
+  uint8_t buttons;
+
+  /** The interrupt controller of the system this joypad belongs to. */
+  struct libyagbe_irq* irq;
+};
+
+/** Connects a joypad to the system it belongs to.
+ *
+ * @param joypad The joypad instance.
+ * @param irq The interrupt controller the joypad should raise interrupts on.
+ */
+void libyagbe_joypad_init(struct libyagbe_joypad* const joypad,
+                          struct libyagbe_irq* const irq);
+
+/** Resets the joypad to the startup state, with no buttons held.
+ *
+ * @param joypad The joypad instance.
+ */
+void libyagbe_joypad_reset(struct libyagbe_joypad* const joypad);
+
+/** Handles a read of P1.
+ *
+ * @param joypad The joypad instance.
+ *
+ * @returns P1, with the input lines of held buttons in the selected groups
+ * pulled low.
+ */
+uint8_t libyagbe_joypad_read(const struct libyagbe_joypad* const joypad);
+
+/** Handles a write to P1. Selecting a group with a button held raises the
+ * joypad interrupt, since the input line falls.
+ *
+ * @param joypad The joypad instance.
+ * @param data The data written.
+ */
+void libyagbe_joypad_write(struct libyagbe_joypad* const joypad,
+                           const uint8_t data);
+
+/** Sets which buttons are held, raising the joypad interrupt if any input
+ * line falls.
+ *
+ * @param joypad The joypad instance.
+ * @param buttons The \ref libyagbe_joypad_button bits of the buttons held.
+ *
+ * @returns true if an input line fell, which also ends STOP.
+ */
+bool libyagbe_joypad_set_buttons(struct libyagbe_joypad* const joypad,
+                                 const uint8_t buttons);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_JOYPAD_H */
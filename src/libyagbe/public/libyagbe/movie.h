@@ -0,0 +1,286 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef LIBYAGBE_MOVIE_H
+#define LIBYAGBE_MOVIE_H
+
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libyagbe_system;
+
+/** The version of the movie format written by this library. Movies of any
+ * other version are refused. */
+enum { LIBYAGBE_MOVIE_VERSION = 1 };
+
+/** @brief Defines the sizes of the parts of an encoded movie. */
+enum libyagbe_movie_sizes {
+  LIBYAGBE_MOVIE_HEADER_SIZE = 24,
+  LIBYAGBE_MOVIE_INPUT_SIZE = 9,
+  LIBYAGBE_MOVIE_CHECKPOINT_SIZE = 16
+};
+
+/** The number of T-cycles in a frame, which is what the interval between
+ * checkpoints is counted in. A frame is always this long, whether the LCD is
+ * on or not. */
+enum { LIBYAGBE_MOVIE_CYCLES_PER_FRAME = 70224 };
+
+/** Marks the lack of a checkpoint which didn't match. */
+#define LIBYAGBE_MOVIE_NO_MISMATCH ((size_t)-1)
+
+enum libyagbe_movie_mode {
+  /** Inputs given to \ref libyagbe_movie_set_buttons are recorded, and so
+   * are the hashes taken at each checkpoint. */
+  LIBYAGBE_MOVIE_RECORDING,
+
+  /** The recorded inputs are replayed, and the hash taken at each checkpoint
+   * is checked against the recorded one. */
+  LIBYAGBE_MOVIE_PLAYING
+};
+
+/** Defines a change to the buttons held. */
+struct libyagbe_movie_input {
+  /** When the change happened, in T-cycles since the movie started. This is
+   * always between instructions. */
+  uintmax_t timestamp;
+
+  /** The \ref libyagbe_joypad_button bits of the buttons held from then on.
+   */
+  uint8_t buttons;
+};
+
+/** Defines the hash of the state of the system at a checkpoint. */
+struct libyagbe_movie_checkpoint {
+  /** When the hash was taken, in T-cycles since the movie started. This is
+   * the first time between instructions at or after the checkpoint was due.
+   */
+  uintmax_t timestamp;
+
+  /** The hash, from \ref libyagbe_movie_hash. */
+  uintmax_t hash;
+};
+
+/** Defines a movie: the inputs given to a system from some starting state,
+ * and hashes of its state every so often to check a replay against.
+ *
+ * A system run from the same starting state with the same inputs always ends
+ * up in the same state, so two replays of a movie, by two builds of the
+ * library or by the interpreter and the JIT, can be compared checkpoint by
+ * checkpoint. The first checkpoint that differs narrows a desync down to the
+ * frames since the one before it.
+ *
+ * All storage is provided by the caller. The fields can be read at any time,
+ * but must only be changed through the functions below.
+ */
+struct libyagbe_movie {
+  struct libyagbe_movie_input* inputs;
+  size_t num_inputs;
+  size_t max_inputs;
+
+  struct libyagbe_movie_checkpoint* checkpoints;
+  size_t num_checkpoints;
+  size_t max_checkpoints;
+
+  /** How many frames apart checkpoints are, or 0 to not take any. */
+  unsigned long interval;
+
+  enum libyagbe_movie_mode mode;
+
+  /** The timestamp of the system when the movie started. */
+  uintmax_t start;
+
+  /** The next input to apply while playing. */
+  size_t next_input;
+
+  /** How many checkpoints have been reached since the movie started. */
+  size_t checkpoints_reached;
+
+  /** The hash taken at the last checkpoint reached. */
+  uintmax_t last_hash;
+
+  /** The first checkpoint whose hash didn't match the recorded one while
+   * playing, or \ref LIBYAGBE_MOVIE_NO_MISMATCH. */
+  size_t mismatch;
+};
+
+/** Initializes a movie with no inputs or checkpoints. Nothing is ever
+ * allocated.
+ *
+ * @param movie The movie.
+ * @param inputs Where to keep inputs.
+ * @param max_inputs The number of inputs \p inputs holds.
+ * @param checkpoints Where to keep checkpoints.
+ * @param max_checkpoints The number of checkpoints \p checkpoints holds.
+ */
+void libyagbe_movie_init(struct libyagbe_movie* const movie,
+                         struct libyagbe_movie_input* const inputs,
+                         const size_t max_inputs,
+                         struct libyagbe_movie_checkpoint* const checkpoints,
+                         const size_t max_checkpoints);
+
+/** Hashes the CPU registers, WRAM, VRAM, HRAM and the timestamp of a system.
+ *
+ * This is cheap enough to do every frame. Nothing about how the library was
+ * built or how the system is being run, such as the code cache, the JIT or
+ * lazy flags, makes any difference to it.
+ *
+ * @param gb The YAGBE instance, which must be between instructions.
+ *
+ * @returns The hash.
+ */
+uintmax_t libyagbe_movie_hash(const struct libyagbe_system* const gb);
+
+/** Starts recording a new movie from the current state of a system, throwing
+ * away anything recorded before.
+ *
+ * Only inputs given by \ref libyagbe_movie_set_buttons are recorded, and the
+ * system must only be run by \ref libyagbe_movie_run while recording, so
+ * that checkpoints are taken exactly when they're due.
+ *
+ * @param movie The movie.
+ * @param gb The YAGBE instance.
+ * @param interval How many frames apart checkpoints should be, or 0 to not
+ * take any.
+ */
+void libyagbe_movie_record(struct libyagbe_movie* const movie,
+                           const struct libyagbe_system* const gb,
+                           const unsigned long interval);
+
+/** Starts playing a movie from the current state of a system, which must be
+ * the state the movie was recorded from.
+ *
+ * @param movie The movie.
+ * @param gb The YAGBE instance.
+ */
+void libyagbe_movie_play(struct libyagbe_movie* const movie,
+                         const struct libyagbe_system* const gb);
+
+/** Changes the buttons held, recording the change.
+ *
+ * @param movie The movie, which must be recording.
+ * @param gb The YAGBE instance.
+ * @param buttons The \ref libyagbe_joypad_button bits of the buttons held.
+ *
+ * @returns true if the change was recorded and made, or false if there's no
+ * room left for it, in which case nothing changes.
+ */
+bool libyagbe_movie_set_buttons(struct libyagbe_movie* const movie,
+                                struct libyagbe_system* const gb,
+                                const uint8_t buttons);
+
+/** Returns when the movie next needs \ref libyagbe_movie_sync to be called:
+ * the next input, if playing, or the next checkpoint.
+ *
+ * This is for frontends which have to run the system themselves, for instance
+ * to trace it. Running it to this time with \ref libyagbe_system_run, or an
+ * instruction at a time, and then calling \ref libyagbe_movie_sync has the
+ * same effect as \ref libyagbe_movie_run.
+ *
+ * @param movie The movie.
+ *
+ * @returns The timestamp of the system at which the movie next needs to
+ * act, or \ref LIBYAGBE_SCHED_NO_DEADLINE if it never will.
+ */
+uintmax_t libyagbe_movie_get_next_stop(const struct libyagbe_movie* const movie);
+
+/** Does everything the movie has due at the current time of a system. Any
+ * checkpoint is taken before any input is applied.
+ *
+ * @param movie The movie.
+ * @param gb The YAGBE instance, which must be between instructions.
+ */
+void libyagbe_movie_sync(struct libyagbe_movie* const movie,
+                         struct libyagbe_system* const gb);
+
+/** Runs a system for at least the given number of T-cycles, like
+ * \ref libyagbe_system_run, while recording or playing a movie.
+ *
+ * @param movie The movie.
+ * @param gb The YAGBE instance.
+ * @param cycles The number of T-cycles to run for.
+ *
+ * @returns The number of T-cycles which actually elapsed.
+ */
+uintmax_t libyagbe_movie_run(struct libyagbe_movie* const movie,
+                             struct libyagbe_system* const gb,
+                             const uintmax_t cycles);
+
+/** Returns how long a movie lasts: until its last input or its last
+ * checkpoint, whichever is later.
+ *
+ * @param movie The movie.
+ *
+ * @returns The length of the movie in T-cycles.
+ */
+uintmax_t libyagbe_movie_get_length(const struct libyagbe_movie* const movie);
+
+/** Returns the size of a movie once it's encoded.
+ *
+ * @param movie The movie.
+ *
+ * @returns The size in bytes.
+ */
+size_t libyagbe_movie_get_size(const struct libyagbe_movie* const movie);
+
+/** Encodes a movie into a caller provided buffer, in a form any host can
+ * load.
+ *
+ * @param movie The movie.
+ * @param gb The YAGBE instance the movie was recorded on, which identifies
+ * the cartridge.
+ * @param buffer Where to write the movie.
+ * @param size The size of the buffer in bytes.
+ *
+ * @returns The number of bytes written, or 0 if the buffer is smaller than
+ * \ref libyagbe_movie_get_size.
+ */
+size_t libyagbe_movie_save(const struct libyagbe_movie* const movie,
+                           const struct libyagbe_system* const gb,
+                           void* const buffer, const size_t size);
+
+/** Decodes a movie, replacing whatever the movie held before. The movie is
+ * left ready to be played with \ref libyagbe_movie_play.
+ *
+ * A buffer of N bytes never holds more than
+ * N / \ref LIBYAGBE_MOVIE_INPUT_SIZE inputs or
+ * N / \ref LIBYAGBE_MOVIE_CHECKPOINT_SIZE checkpoints, which is enough
+ * storage to load it.
+ *
+ * @param movie The movie, initialized with enough storage.
+ * @param gb The YAGBE instance the movie will be played on.
+ * @param buffer The encoded movie.
+ * @param size The size of the encoded movie in bytes.
+ *
+ * @returns true if the movie was loaded, or false if it is for another
+ * cartridge, another version, is damaged or doesn't fit, in which case the
+ * movie is unchanged.
+ */
+bool libyagbe_movie_load(struct libyagbe_movie* const movie,
+                         const struct libyagbe_system* const gb,
+                         const void* const buffer, const size_t size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_MOVIE_H */
@@ -19,26 +19,248 @@
 #ifndef LIBYAGBE_PPU_H
 #define LIBYAGBE_PPU_H
 
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
 #include "compat/compat_stdint.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libyagbe_irq;
+struct libyagbe_sched;
+
 enum libyagbe_ppu_io_registers {
   LIBYAGBE_PPU_IO_LCDC = 0x0,
+  LIBYAGBE_PPU_IO_STAT = 0x1,
   LIBYAGBE_PPU_IO_SCY = 0x2,
   LIBYAGBE_PPU_IO_SCX = 0x3,
   LIBYAGBE_PPU_IO_LY = 0x4,
-  LIBYAGBE_PPU_IO_BGP = 0x7
+  LIBYAGBE_PPU_IO_LYC = 0x5,
+  LIBYAGBE_PPU_IO_BGP = 0x7,
+  LIBYAGBE_PPU_IO_OBP0 = 0x8,
+  LIBYAGBE_PPU_IO_OBP1 = 0x9,
+  LIBYAGBE_PPU_IO_WY = 0xA,
+  LIBYAGBE_PPU_IO_WX = 0xB
+};
+
+enum libyagbe_ppu_mem_size {
+  LIBYAGBE_PPU_MEM_SIZE_VRAM = 8192,
+  LIBYAGBE_PPU_MEM_SIZE_OAM = 160
+};
+
+/** @brief Defines the dimensions of the screen and of the tile data. */
+enum libyagbe_ppu_geometry {
+  LIBYAGBE_PPU_SCREEN_WIDTH = 160,
+  LIBYAGBE_PPU_SCREEN_HEIGHT = 144,
+
+  /** The number of lines in a frame, counting the ones in VBlank. */
+  LIBYAGBE_PPU_NUM_LINES = 154,
+
+  /** The number of tiles in $8000-$97FF. */
+  LIBYAGBE_PPU_NUM_TILES = 384
 };
 
-enum libyagbe_ppu_mem_size { LIBYAGBE_PPU_MEM_SIZE_VRAM = 8192 };
+/** @brief Defines the modes reported in the lower bits of STAT. */
+enum libyagbe_ppu_mode {
+  LIBYAGBE_PPU_MODE_HBLANK,
+  LIBYAGBE_PPU_MODE_VBLANK,
+  LIBYAGBE_PPU_MODE_OAM_SCAN,
+  LIBYAGBE_PPU_MODE_DRAWING
+};
+
+/** @brief Defines the formats frames can be drawn into caller buffers in.
+ *
+ * Pixels are stored row by row with no padding, and the RGB formats draw the
+ * shades in gray, from white to black.
+ */
+enum libyagbe_ppu_pixel_format {
+  /** One byte per pixel: the shade, from 0 (lightest) to 3 (darkest). */
+  LIBYAGBE_PPU_PIXEL_FORMAT_INDEX,
+
+  /** A native endian uint16_t per pixel, with red in the top 5 bits and blue
+   * in the bottom 5. */
+  LIBYAGBE_PPU_PIXEL_FORMAT_RGB565,
+
+  /** Four bytes per pixel: red, green, blue and alpha, in that order. */
+  LIBYAGBE_PPU_PIXEL_FORMAT_RGBA8888
+};
+
+/** @brief Defines the function prototype used to receive completed frames.
+ *
+ * This is called from within the instance as it enters VBlank, so it must not
+ * use the instance itself.
+ */
+typedef void (*libyagbe_ppu_frame_cb)(void* const userdata,
+                                      const void* const frame);
+
+/** Defines where a PPU draws its frames, when the caller provides buffers.
+ *
+ * Frames are drawn into \ref buffers alternately. At the start of VBlank the
+ * buffer just completed is handed to \ref cb, and drawing moves to the other
+ * one, so the completed frame isn't touched again until the callback for the
+ * next frame has returned.
+ */
+struct libyagbe_ppu_output {
+  /** The buffers to draw into, or NULL to draw into
+   * \ref libyagbe_ppu::framebuffer instead. */
+  void* buffers[2];
+
+  enum libyagbe_ppu_pixel_format format;
+
+  /** The index of the buffer being drawn into. */
+  unsigned int back;
+
+  /** The function told about each completed frame. */
+  libyagbe_ppu_frame_cb cb;
+
+  /** Context specific data passed to \ref cb. */
+  void* userdata;
+};
 
 struct libyagbe_ppu {
   uint8_t lcdc;
+
+  /** Only the interrupt select bits of STAT are stored here; the rest are
+   * worked out when it's read. */
+  uint8_t stat;
+
   uint8_t scy;
   uint8_t scx;
   uint8_t ly;
+  uint8_t lyc;
   uint8_t bgp;
+  uint8_t obp0;
+  uint8_t obp1;
+  uint8_t wy;
+  uint8_t wx;
+
+  enum libyagbe_ppu_mode mode;
+
+  /** The line of the window to draw next, which only advances on lines where
+   * the window was actually drawn. */
+  uint8_t window_line;
+
+  /** The state of the STAT interrupt line, which only requests an interrupt
+   * when it goes from low to high. */
+  bool stat_line;
+
+  /** The number of frames completed since reset. */
+  unsigned long frame_count;
+
+  /** Whether lines are drawn. When this is false, the PPU's timing and
+   * interrupts are unaffected, but nothing is drawn and no frames are handed
+   * to \ref libyagbe_ppu_output::cb. This is kept across resets. */
+  bool render;
+
+  /** Where frames are drawn. This is kept across resets. */
+  struct libyagbe_ppu_output output;
+
+  /** The scheduler of the system this PPU belongs to. */
+  struct libyagbe_sched* sched;
+
+  /** The interrupt controller of the system this PPU belongs to. */
+  struct libyagbe_irq* irq;
 
   uint8_t vram[LIBYAGBE_PPU_MEM_SIZE_VRAM];
+  uint8_t oam[LIBYAGBE_PPU_MEM_SIZE_OAM];
+
+  /** Every tile in VRAM, decoded to one 2-bit color index per byte. */
+  uint8_t tiles[LIBYAGBE_PPU_NUM_TILES][8][8];
+
+  /** Whether each entry of \ref tiles is out of date with \ref vram. */
+  bool tile_dirty[LIBYAGBE_PPU_NUM_TILES];
+
+  /** The shade, from 0 (lightest) to 3 (darkest), of every pixel drawn while
+   * no caller buffers are set. */
+  uint8_t framebuffer[LIBYAGBE_PPU_SCREEN_HEIGHT][LIBYAGBE_PPU_SCREEN_WIDTH];
 };
 
+/** Connects a PPU to the system it belongs to.
+ *
+ * @param ppu The PPU instance.
+ * @param sched The scheduler the PPU should queue its events on.
+ * @param irq The interrupt controller the PPU should raise interrupts on.
+ */
+void libyagbe_ppu_init(struct libyagbe_ppu* const ppu,
+                       struct libyagbe_sched* const sched,
+                       struct libyagbe_irq* const irq);
+
+/** Resets a PPU to the startup state, with the LCD on at the start of a frame.
+ * The output set with \ref libyagbe_ppu_set_output is kept.
+ *
+ * @param ppu The PPU instance.
+ */
+void libyagbe_ppu_reset(struct libyagbe_ppu* const ppu);
+
+/** Returns the size of a frame in a pixel format.
+ *
+ * @param format The pixel format.
+ *
+ * @returns The size of a frame in bytes.
+ */
+size_t libyagbe_ppu_get_frame_size(const enum libyagbe_ppu_pixel_format format);
+
+/** Sets where a PPU draws its frames. Drawing starts with the first buffer.
+ *
+ * @param ppu The PPU instance.
+ * @param format The pixel format to draw in.
+ * @param buffer0 The first buffer, or NULL to go back to drawing into
+ * \ref libyagbe_ppu::framebuffer.
+ * @param buffer1 The second buffer. This may be the same as the first, if the
+ * callback copies each frame out.
+ * @param cb The function to hand each completed frame to.
+ * @param userdata Context specific data passed to the function.
+ */
+void libyagbe_ppu_set_output(struct libyagbe_ppu* const ppu,
+                             const enum libyagbe_ppu_pixel_format format,
+                             void* const buffer0, void* const buffer1,
+                             const libyagbe_ppu_frame_cb cb,
+                             void* const userdata);
+
+/** Handles a write to $8000-$97FF, where the tile data lives.
+ *
+ * @param ppu The PPU instance.
+ * @param address The offset into VRAM.
+ * @param data The data to write.
+ */
+void libyagbe_ppu_write_tile_data(struct libyagbe_ppu* const ppu,
+                                  const uint16_t address, const uint8_t data);
+
+/** Handles a write to LCDC, turning the LCD on or off as needed.
+ *
+ * @param ppu The PPU instance.
+ * @param data The data written.
+ */
+void libyagbe_ppu_write_lcdc(struct libyagbe_ppu* const ppu,
+                             const uint8_t data);
+
+/** Handles a read of STAT.
+ *
+ * @param ppu The PPU instance.
+ *
+ * @returns STAT, including the current mode and the LY=LYC flag.
+ */
+uint8_t libyagbe_ppu_read_stat(const struct libyagbe_ppu* const ppu);
+
+/** Handles a write to STAT.
+ *
+ * @param ppu The PPU instance.
+ * @param data The data written.
+ */
+void libyagbe_ppu_write_stat(struct libyagbe_ppu* const ppu,
+                             const uint8_t data);
+
+/** Handles a write to LYC.
+ *
+ * @param ppu The PPU instance.
+ * @param data The data written.
+ */
+void libyagbe_ppu_write_lyc(struct libyagbe_ppu* const ppu, const uint8_t data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
 #endif /* LIBYAGBE_PPU_H */
@@ -0,0 +1,107 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_PROFILE_H
+#define LIBYAGBE_PROFILE_H
+
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+#include "diag.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+enum {
+  /** The number of ROM banks PC samples are kept for, which is the most any
+   * supported cartridge has. */
+  LIBYAGBE_PROFILE_NUM_ROM_BANKS = 512,
+
+  /** The log2 of the number of bytes each PC sample bucket covers. */
+  LIBYAGBE_PROFILE_BUCKET_SHIFT = 6,
+
+  /** The number of PC sample buckets in each 16 KiB ROM bank. */
+  LIBYAGBE_PROFILE_NUM_ROM_BUCKETS = 0x4000 >> LIBYAGBE_PROFILE_BUCKET_SHIFT,
+
+  /** The number of PC sample buckets covering $8000-$FFFF. */
+  LIBYAGBE_PROFILE_NUM_RAM_BUCKETS = 0x8000 >> LIBYAGBE_PROFILE_BUCKET_SHIFT,
+
+  /** The number of instructions between PC samples. This is prime so that it
+   * doesn't keep landing on the same instruction of a loop. */
+  LIBYAGBE_PROFILE_SAMPLE_PERIOD = 61
+};
+
+/** Defines what was spent on a single opcode. */
+struct libyagbe_profile_opcode {
+  /** How many times the opcode was executed. */
+  uintmax_t count;
+
+  /** The T-cycles spent executing it, including any memory accesses. */
+  uintmax_t cycles;
+};
+
+/** Defines a profile of where the emulated program spends its time.
+ *
+ * The counters are only updated if the core was built with
+ * LIBYAGBE_ENABLE_PROFILE defined (the YAGBE_ENABLE_PROFILE CMake option).
+ * Otherwise the hooks compile to nothing and a profile attached to an
+ * instance stays as it was. The structure is around 1 MiB in size, so it's
+ * best allocated on the heap.
+ */
+struct libyagbe_profile {
+  /** The base opcodes, including $CB itself. */
+  struct libyagbe_profile_opcode opcodes[256];
+
+  /** The opcodes following $CB. Their cycles include fetching the $CB. */
+  struct libyagbe_profile_opcode cb_opcodes[256];
+
+  /** PC samples taken while running from ROM, by the bank actually mapped in
+   * and then by bucket within the bank. */
+  unsigned long rom_samples[LIBYAGBE_PROFILE_NUM_ROM_BANKS]
+                           [LIBYAGBE_PROFILE_NUM_ROM_BUCKETS];
+
+  /** PC samples taken while running from $8000-$FFFF, by bucket. */
+  unsigned long ram_samples[LIBYAGBE_PROFILE_NUM_RAM_BUCKETS];
+
+  /** Reads and writes of each address in $FF00-$FFFF, whether or not anything
+   * responded to them. */
+  unsigned long io_accesses[LIBYAGBE_DIAG_NUM_ACCESS_TYPES][256];
+
+  /** The number of instructions left before the next PC sample. */
+  unsigned int sample_countdown;
+
+  /** The opcode currently executing, as an index into \ref opcodes or, past
+   * 256, \ref cb_opcodes. */
+  unsigned int current;
+};
+
+/** @returns true if the core was built with the profiler hooks, false if
+ * profiles are never updated. */
+bool libyagbe_profile_is_supported(void);
+
+/** Clears every counter.
+ *
+ * @param profile The profile.
+ */
+void libyagbe_profile_reset(struct libyagbe_profile* const profile);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_PROFILE_H */
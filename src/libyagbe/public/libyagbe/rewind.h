@@ -0,0 +1,141 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_REWIND_H
+#define LIBYAGBE_REWIND_H
+
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libyagbe_system;
+
+/** Defines a rewind buffer: a history of save states in a fixed amount of
+ * memory.
+ *
+ * Most states are stored as the XOR of the state against the latest
+ * keyframe, which is mostly zeros since most of memory doesn't change from
+ * one frame to the next, and then run-length encoded. Keyframes are stored
+ * the same way against zeros. When memory runs out, the oldest keyframe and
+ * every state stored against it are thrown away.
+ */
+struct libyagbe_rewind {
+  /** The size of every save state, which is fixed by the cartridge. */
+  size_t state_size;
+
+  /** The uncompressed contents of the latest keyframe. */
+  uint8_t* keyframe;
+
+  /** Where states are uncompressed to and saved into. */
+  uint8_t* scratch;
+
+  /** Where the compressed states are kept. */
+  uint8_t* data;
+  size_t data_size;
+
+  /** The number of states pushed between keyframes. */
+  unsigned int keyframe_interval;
+
+  /** The number of states pushed since the latest keyframe. */
+  unsigned int since_keyframe;
+
+  /** Whether \ref keyframe holds the keyframe at \ref keyframe_offset; this
+   * stops being true once that keyframe has been popped or thrown away. */
+  bool keyframe_valid;
+  size_t keyframe_offset;
+
+  /** The offsets within \ref data of the oldest and newest states. */
+  size_t oldest;
+  size_t newest;
+
+  /** Where the next state will be written. */
+  size_t write_pos;
+
+  /** Whether the states wrap around from the end of \ref data to the start,
+   * and if so, where the states at the end stop. */
+  bool wrapped;
+  size_t end;
+
+  /** The number of states held. */
+  size_t count;
+};
+
+/** Returns the least amount of memory a rewind buffer can be given to hold
+ * states of a given size, which is enough for a single state.
+ *
+ * @param state_size The size of a save state, from
+ * \ref libyagbe_system_get_state_size.
+ *
+ * @returns The amount of memory in bytes.
+ */
+size_t libyagbe_rewind_get_min_storage(const size_t state_size);
+
+/** Initializes a rewind buffer. Nothing is ever allocated.
+ *
+ * @param rewind The rewind buffer.
+ * @param state_size The size of a save state, from
+ * \ref libyagbe_system_get_state_size.
+ * @param storage The memory to keep states in, which must stay valid for as
+ * long as the rewind buffer is used.
+ * @param size The size of the memory in bytes.
+ * @param keyframe_interval How many states to store between keyframes. Larger
+ * intervals take less memory as long as the states drift slowly.
+ *
+ * @returns true if the rewind buffer was initialized, or false if the memory
+ * is smaller than \ref libyagbe_rewind_get_min_storage.
+ */
+bool libyagbe_rewind_init(struct libyagbe_rewind* const rewind,
+                          const size_t state_size, void* const storage,
+                          const size_t size,
+                          const unsigned int keyframe_interval);
+
+/** Throws away every state held.
+ *
+ * @param rewind The rewind buffer.
+ */
+void libyagbe_rewind_clear(struct libyagbe_rewind* const rewind);
+
+/** Adds the current state of a YAGBE instance, typically once per frame.
+ *
+ * @param rewind The rewind buffer.
+ * @param gb The YAGBE instance, which must be running the same cartridge for
+ * every call.
+ */
+void libyagbe_rewind_push(struct libyagbe_rewind* const rewind,
+                          const struct libyagbe_system* const gb);
+
+/** Restores a YAGBE instance to the newest state held, and removes it.
+ *
+ * @param rewind The rewind buffer.
+ * @param gb The YAGBE instance.
+ *
+ * @returns true if a state was restored, or false if there are none left.
+ */
+bool libyagbe_rewind_pop(struct libyagbe_rewind* const rewind,
+                         struct libyagbe_system* const gb);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_REWIND_H */
@@ -0,0 +1,92 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_ROM_H
+#define LIBYAGBE_ROM_H
+
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** @brief Defines where the data of a ROM image lives. */
+enum libyagbe_rom_storage {
+  /** The data belongs to the caller. */
+  LIBYAGBE_ROM_STORAGE_BUFFER,
+
+  /** The data is a read-only mapping of the file. */
+  LIBYAGBE_ROM_STORAGE_MAPPED,
+
+  /** The data was read into memory allocated for it. */
+  LIBYAGBE_ROM_STORAGE_ALLOCATED
+};
+
+/** Defines a ROM image which can be passed to \ref libyagbe_system_init.
+ *
+ * Files are memory mapped where the platform allows, so the same ROM opened
+ * by many instances or processes shares the page cache and is only read from
+ * disk as it's actually touched.
+ */
+struct libyagbe_rom {
+  const uint8_t* data;
+  size_t size;
+
+  enum libyagbe_rom_storage storage;
+
+  /** The platform file mapping object, if any. */
+  void* mapping;
+};
+
+/** Opens a ROM file.
+ *
+ * Files smaller than the smallest cartridge are read into memory and padded
+ * with zeroes instead of being mapped.
+ *
+ * @param rom The ROM instance.
+ * @param path The path of the ROM file.
+ *
+ * @returns true if the file was opened, false otherwise.
+ */
+bool libyagbe_rom_open(struct libyagbe_rom* const rom, const char* const path);
+
+/** Wraps a ROM image the caller already has in memory.
+ *
+ * The data is not copied, and must remain valid until the ROM is closed.
+ *
+ * @param rom The ROM instance.
+ * @param data The ROM image.
+ * @param size The size of the ROM image in bytes.
+ */
+void libyagbe_rom_from_buffer(struct libyagbe_rom* const rom,
+                              const uint8_t* const data, const size_t size);
+
+/** Releases a ROM image. Any instance using it must no longer be run.
+ *
+ * @param rom The ROM instance.
+ */
+void libyagbe_rom_close(struct libyagbe_rom* const rom);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_ROM_H */
@@ -19,12 +19,45 @@
 #ifndef LIBYAGBE_SCHED_H
 #define LIBYAGBE_SCHED_H
 
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** @brief Defines the kinds of events which can be scheduled.
+ *
+ * Each type can have at most one pending event, so the type also serves as the
+ * handle used to reschedule or cancel it.
+ */
+enum libyagbe_sched_event_type {
+  LIBYAGBE_SCHED_EVENT_TIMER,
+  LIBYAGBE_SCHED_EVENT_PPU,
+  LIBYAGBE_SCHED_EVENT_APU,
+  LIBYAGBE_SCHED_EVENT_DMA,
+  LIBYAGBE_SCHED_EVENT_SERIAL,
+
+  /** @brief The number of event types; not an event type itself. */
+  LIBYAGBE_SCHED_NUM_EVENT_TYPES
+};
+
+/** @brief The deadline reported when no events are queued. */
+#define LIBYAGBE_SCHED_NO_DEADLINE ((uintmax_t)-1)
+
 /** @brief Defines the function prototype used to handle events. */
 typedef void (*libyagbe_sched_event_cb)(void* const userdata);
 
 struct libyagbe_sched_event {
-  /** @brief When should this event be triggered? */
-  unsigned int expiry_time;
+  /** @brief When should this event be triggered?
+   *
+   * This is an absolute timestamp of the same width as the scheduler's clock,
+   * which at 64 bits won't wrap for well over a hundred thousand years of
+   * emulated time.
+   */
+  uintmax_t expiry_time;
 
   /** @brief What function should be called when the event has expired? */
   libyagbe_sched_event_cb cb_func;
@@ -35,14 +68,102 @@ struct libyagbe_sched_event {
   void* userdata;
 };
 
-void libyagbe_sched_insert(struct libyagbe_sched_event* const event);
+/** @brief Defines the scheduler state of a single system instance.
+ *
+ * Nothing in here is shared between instances, so any number of systems may
+ * be driven concurrently as long as each one is only touched by one thread at
+ * a time.
+ */
+struct libyagbe_sched {
+  /** @brief The total number of T-cycles which have passed since the start of
+   * the emulation.
+   */
+  uintmax_t current_timestamp;
+
+  /** @brief The expiry time of the earliest queued event, or
+   * \ref LIBYAGBE_SCHED_NO_DEADLINE if nothing is queued.
+   *
+   * This is kept up to date whenever the heap changes so that stepping the
+   * scheduler only costs a comparison until the deadline is reached.
+   */
+  uintmax_t deadline;
+
+  /** @brief The current number of events queued. */
+  size_t heap_size;
+
+  /** @brief A binary min-heap of queued event types, ordered by expiry time.
+   */
+  uint8_t heap[LIBYAGBE_SCHED_NUM_EVENT_TYPES];
+
+  /** @brief The position of each event type within \ref heap, or
+   * \ref LIBYAGBE_SCHED_NUM_EVENT_TYPES if it isn't queued.
+   */
+  size_t heap_index[LIBYAGBE_SCHED_NUM_EVENT_TYPES];
+
+  /** @brief The event of each type, whether queued or not. */
+  struct libyagbe_sched_event events[LIBYAGBE_SCHED_NUM_EVENT_TYPES];
+};
+
+/** @brief Sets the function which handles events of a given type.
+ *
+ * Handlers survive \ref libyagbe_sched_reset, so this only needs to be done
+ * once when a system is initialized.
+ */
+void libyagbe_sched_register(struct libyagbe_sched* const sched,
+                             const enum libyagbe_sched_event_type type,
+                             const libyagbe_sched_event_cb cb_func,
+                             void* const userdata);
+
+/** @brief Queues an event to expire some number of T-cycles from now.
+ *
+ * If an event of this type is already queued it is moved to the new expiry
+ * time.
+ */
+void libyagbe_sched_schedule(struct libyagbe_sched* const sched,
+                             const enum libyagbe_sched_event_type type,
+                             const unsigned int cycles);
+
+/** @brief Removes the pending event of a given type, if there is one. */
+void libyagbe_sched_cancel(struct libyagbe_sched* const sched,
+                           const enum libyagbe_sched_event_type type);
 
-void libyagbe_sched_reset(void);
+/** @brief Returns whether or not an event of a given type is queued. */
+bool libyagbe_sched_is_scheduled(const struct libyagbe_sched* const sched,
+                                 const enum libyagbe_sched_event_type type);
+
+/** @brief Checks and indexes a heap which was written directly.
+ *
+ * This is for restoring a saved scheduler: after \ref heap_size, \ref heap
+ * and the expiry time of each event are filled in, this rebuilds everything
+ * derived from them.
+ *
+ * @returns true if the heap is valid, or false if it names an unknown event
+ * type, names a type twice, is out of order or holds an event which was due
+ * before \ref current_timestamp.
+ */
+bool libyagbe_sched_restore_heap(struct libyagbe_sched* const sched);
+
+/** @brief Cancels every pending event and resets the timestamp to zero. */
+void libyagbe_sched_reset(struct libyagbe_sched* const sched);
+
+/** @brief Advances the scheduler by any number of T-cycles.
+ *
+ * Every event which expires on or before the new timestamp is handled, in
+ * order of expiry, and the timestamp seen by each handler is that event's own
+ * expiry time. Handlers may queue further events; those are handled too if
+ * they also fall within the advanced period.
+ */
+void libyagbe_sched_advance(struct libyagbe_sched* const sched,
+                            const uintmax_t cycles);
 
 /** @brief Advances the scheduler by 1 m-cycle.
 *
 * This function *must* be called once every m-cycle.
 */
-void libyagbe_sched_step(void);
+void libyagbe_sched_step(struct libyagbe_sched* const sched);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
 
 #endif /* LIBYAGBE_SCHED_H */
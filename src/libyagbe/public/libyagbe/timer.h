@@ -25,22 +25,96 @@ extern "C" {
 
 #include "compat/compat_stdint.h"
 
+struct libyagbe_irq;
+struct libyagbe_sched;
+
 enum libyagbe_timer_io_registers {
+  LIBYAGBE_TIMER_IO_DIV = 0x4,
   LIBYAGBE_TIMER_IO_TIMA = 0x5,
   LIBYAGBE_TIMER_IO_TMA = 0x6,
   LIBYAGBE_TIMER_IO_TAC = 0x7
 };
 
+/** Defines the timer.
+ *
+ * Nothing is done per tick. DIV and TIMA both count falling edges of a 16-bit
+ * system counter which is derived from the scheduler's timestamp, so they're
+ * only brought up to date when they're accessed, and the only event queued is
+ * the one for the next time TIMA overflows.
+ */
 struct libyagbe_timer {
+  /** The value of TIMA as of \ref last_update. */
   uint8_t tima;
   uint8_t tac;
   uint8_t tma;
+
+  /** What to add to the scheduler's timestamp to get the system counter, of
+   * which DIV is the upper 8 bits. Writing to DIV resets the counter. */
+  uintmax_t counter_offset;
+
+  /** The timestamp \ref tima was last brought up to date at. */
+  uintmax_t last_update;
+
+  /** The scheduler of the system this timer belongs to. */
+  struct libyagbe_sched* sched;
+
+  /** The interrupt controller of the system this timer belongs to. */
+  struct libyagbe_irq* irq;
 };
 
-void libyagbe_timer_set_interrupt_flag(uint8_t* const interrupt_flag);
+/** Connects a timer to the system it belongs to.
+ *
+ * @param timer The timer instance.
+ * @param sched The scheduler the timer should queue its events on.
+ * @param irq The interrupt controller the timer should raise interrupts on.
+ */
+void libyagbe_timer_init(struct libyagbe_timer* const timer,
+                         struct libyagbe_sched* const sched,
+                         struct libyagbe_irq* const irq);
 
 void libyagbe_timer_reset(struct libyagbe_timer* const timer);
 
+/** Brings TIMA up to the current time, raising any overflows since it was
+ * last brought up to date.
+ *
+ * @param timer The timer instance.
+ */
+void libyagbe_timer_sync(struct libyagbe_timer* const timer);
+
+/** Queues the event for the next time TIMA overflows, replacing any queued
+ * before. This must be called after changing any timer state directly.
+ *
+ * @param timer The timer instance.
+ */
+void libyagbe_timer_reschedule(struct libyagbe_timer* const timer);
+
+/** Returns the current value of DIV.
+ *
+ * @param timer The timer instance.
+ */
+uint8_t libyagbe_timer_read_div(const struct libyagbe_timer* const timer);
+
+/** Returns the current value of TIMA.
+ *
+ * @param timer The timer instance.
+ */
+uint8_t libyagbe_timer_read_tima(struct libyagbe_timer* const timer);
+
+/** Returns the value TIMA would read as now, without bringing the timer up to
+ * date or raising any interrupts.
+ *
+ * @param timer The timer instance.
+ */
+uint8_t libyagbe_timer_peek_tima(const struct libyagbe_timer* const timer);
+
+void libyagbe_timer_write_div(struct libyagbe_timer* const timer);
+
+void libyagbe_timer_write_tima(struct libyagbe_timer* const timer,
+                               const uint8_t data);
+
+void libyagbe_timer_write_tma(struct libyagbe_timer* const timer,
+                              const uint8_t data);
+
 void libyagbe_timer_handle_tac(struct libyagbe_timer* const timer,
                                const uint8_t tac);
 
@@ -0,0 +1,200 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_TRACE_H
+#define LIBYAGBE_TRACE_H
+
+#include <stddef.h>
+
+#include "compat/compat_stdbool.h"
+#include "compat/compat_stdint.h"
+
+struct libyagbe_bus;
+struct libyagbe_cpu;
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** @brief Defines the size of an encoded trace record, and of the header which
+ * starts a trace file. */
+enum libyagbe_trace_sizes {
+  LIBYAGBE_TRACE_RECORD_SIZE = 28,
+  LIBYAGBE_TRACE_HEADER_SIZE = 8
+};
+
+/** @brief Defines the bits of \ref libyagbe_trace_record::flags. */
+enum libyagbe_trace_flags {
+  /** \ref libyagbe_trace_record::mem_address and \ref
+   * libyagbe_trace_record::mem_data are valid. */
+  LIBYAGBE_TRACE_FLAG_MEM = 1 << 0
+};
+
+/** Defines the state of the system as one instruction is executed. */
+struct libyagbe_trace_record {
+  /** The number of T-cycles elapsed before the instruction. */
+  uintmax_t timestamp;
+
+  /** The registers before the instruction. */
+  uint16_t pc;
+  uint16_t sp;
+  uint16_t af;
+  uint16_t bc;
+  uint16_t de;
+  uint16_t hl;
+
+  /** The opcode and the two bytes after it. */
+  uint8_t bytes[3];
+
+  uint8_t flags;
+
+  /** The memory operand of the instruction, if any, and its value after the
+   * instruction. */
+  uint16_t mem_address;
+  uint8_t mem_data;
+};
+
+/** Defines a single producer, single consumer queue of trace records.
+ *
+ * The emulation thread pushes and a writer thread pops, without either ever
+ * taking a lock.
+ */
+struct libyagbe_trace_ring {
+  /** The storage of the queue, provided by the caller. */
+  struct libyagbe_trace_record* records;
+
+  /** The number of records \ref records holds. Always a power of two. */
+  size_t capacity;
+
+  /** Only written by the producer. */
+  size_t head;
+
+  /** Keeps \ref head and \ref tail on separate cache lines. */
+  char padding[64];
+
+  /** Only written by the consumer. */
+  size_t tail;
+
+  /** Set by the producer once it will no longer push anything. */
+  size_t closed;
+};
+
+/** Captures the state of the system before an instruction executes.
+ *
+ * @param record The record to fill in.
+ * @param cpu The CPU about to execute the instruction.
+ * @param bus The system bus of the CPU.
+ * @param timestamp The current timestamp of the system.
+ */
+void libyagbe_trace_begin(struct libyagbe_trace_record* const record,
+                          const struct libyagbe_cpu* const cpu,
+                          struct libyagbe_bus* const bus,
+                          const uintmax_t timestamp);
+
+/** Captures the memory operand of an instruction once it has executed.
+ *
+ * @param record The record filled in by \ref libyagbe_trace_begin.
+ * @param bus The system bus of the CPU.
+ */
+void libyagbe_trace_end(struct libyagbe_trace_record* const record,
+                        struct libyagbe_bus* const bus);
+
+/** Writes a record in its portable on-disk form.
+ *
+ * @param record The record to encode.
+ * @param out Receives \ref LIBYAGBE_TRACE_RECORD_SIZE bytes.
+ */
+void libyagbe_trace_encode(const struct libyagbe_trace_record* const record,
+                           uint8_t* const out);
+
+/** Reads a record from its portable on-disk form.
+ *
+ * @param record Receives the record.
+ * @param in \ref LIBYAGBE_TRACE_RECORD_SIZE bytes from a trace file.
+ */
+void libyagbe_trace_decode(struct libyagbe_trace_record* const record,
+                           const uint8_t* const in);
+
+/** Writes the header which starts a trace file.
+ *
+ * @param out Receives \ref LIBYAGBE_TRACE_HEADER_SIZE bytes.
+ */
+void libyagbe_trace_encode_header(uint8_t* const out);
+
+/** Checks the header which starts a trace file.
+ *
+ * @param in \ref LIBYAGBE_TRACE_HEADER_SIZE bytes from a trace file.
+ *
+ * @returns true if this is a trace file this version can read.
+ */
+bool libyagbe_trace_check_header(const uint8_t* const in);
+
+/** Initializes a trace queue.
+ *
+ * @param ring The queue instance.
+ * @param records The storage of the queue.
+ * @param capacity The number of records \p records holds, which must be a
+ * power of two.
+ */
+void libyagbe_trace_ring_init(struct libyagbe_trace_ring* const ring,
+                              struct libyagbe_trace_record* const records,
+                              const size_t capacity);
+
+/** Adds a record to the queue. Only the producer may call this.
+ *
+ * @param ring The queue instance.
+ * @param record The record to add.
+ *
+ * @returns true if the record was added, or false if the queue is full.
+ */
+bool libyagbe_trace_ring_push(struct libyagbe_trace_ring* const ring,
+                              const struct libyagbe_trace_record* const record);
+
+/** Removes records from the queue. Only the consumer may call this.
+ *
+ * @param ring The queue instance.
+ * @param out Receives the records, oldest first.
+ * @param max The most records to remove.
+ *
+ * @returns The number of records removed.
+ */
+size_t libyagbe_trace_ring_pop(struct libyagbe_trace_ring* const ring,
+                               struct libyagbe_trace_record* const out,
+                               const size_t max);
+
+/** Tells the consumer that nothing more will be pushed. Only the producer may
+ * call this.
+ *
+ * @param ring The queue instance.
+ */
+void libyagbe_trace_ring_close(struct libyagbe_trace_ring* const ring);
+
+/** Determines whether the producer has closed the queue. Records pushed
+ * before closing may still be waiting to be popped.
+ *
+ * @param ring The queue instance.
+ *
+ * @returns true if the queue has been closed.
+ */
+bool libyagbe_trace_ring_is_closed(struct libyagbe_trace_ring* const ring);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_TRACE_H */
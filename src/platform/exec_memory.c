@@ -0,0 +1,58 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#endif /* _WIN32 */
+
+#include "exec_memory.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif /* !defined(MAP_ANONYMOUS) && defined(MAP_ANON) */
+#endif /* _WIN32 */
+
+void* yagbe_exec_memory_alloc(const size_t size) {
+#ifdef _WIN32
+  return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+                      PAGE_EXECUTE_READWRITE);
+#else
+  void* const memory = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return (memory == MAP_FAILED) ? NULL : memory;
+#endif /* _WIN32 */
+}
+
+void yagbe_exec_memory_free(void* const memory, const size_t size) {
+  if (memory == NULL) {
+    return;
+  }
+
+#ifdef _WIN32
+  (void)size;
+  VirtualFree(memory, 0, MEM_RELEASE);
+#else
+  munmap(memory, size);
+#endif /* _WIN32 */
+}
@@ -0,0 +1,45 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Provides memory the JIT can write code into and then run. The core library
+ * never allocates, so the frontends which enable the JIT get it from here. */
+
+#ifndef YAGBE_PLATFORM_EXEC_MEMORY_H
+#define YAGBE_PLATFORM_EXEC_MEMORY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** @brief Allocates memory which is readable, writable and executable.
+ * @param size The number of bytes to allocate.
+ * @returns The memory, or NULL if the host refused to allocate it. */
+void* yagbe_exec_memory_alloc(size_t size);
+
+/** @brief Releases memory from @ref yagbe_exec_memory_alloc.
+ * @param memory The memory to release, which may be NULL.
+ * @param size The size it was allocated with. */
+void yagbe_exec_memory_free(void* memory, size_t size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* YAGBE_PLATFORM_EXEC_MEMORY_H */
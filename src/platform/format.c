@@ -0,0 +1,43 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "format.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+const char* yagbe_format_uintmax(char* const buffer, uintmax_t value) {
+  char digits[YAGBE_FORMAT_UINTMAX_SIZE];
+  size_t count = 0;
+  size_t i;
+
+  assert(buffer != NULL);
+
+  /* The digits come out last first. */
+  do {
+    digits[count++] = (char)('0' + (int)(value % 10));
+    value /= 10;
+  } while (value != 0);
+
+  for (i = 0; i < count; ++i) {
+    buffer[i] = digits[count - 1 - i];
+  }
+  buffer[count] = '\0';
+
+  return buffer;
+}
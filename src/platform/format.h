@@ -0,0 +1,51 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Prints 64-bit counts for the frontends. C90 has no conversion for anything
+ * wider than a long, which is only 32 bits on Windows and 32-bit hosts. The
+ * core library never uses any of this. */
+
+#ifndef YAGBE_PLATFORM_FORMAT_H
+#define YAGBE_PLATFORM_FORMAT_H
+
+#include "libyagbe/compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** The most characters \ref yagbe_format_uintmax writes, including the
+ * terminating null character: enough for the 20 digits of 2^64 - 1. */
+enum { YAGBE_FORMAT_UINTMAX_SIZE = 21 };
+
+/** Writes a value in decimal.
+ *
+ * @param buffer Where to write the value, which must have room for
+ * \ref YAGBE_FORMAT_UINTMAX_SIZE characters.
+ * @param value The value.
+ *
+ * @returns The buffer, so the value can be passed straight to printf() with
+ * "%s".
+ */
+const char* yagbe_format_uintmax(char* const buffer, uintmax_t value);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* YAGBE_PLATFORM_FORMAT_H */
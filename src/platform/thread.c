@@ -0,0 +1,171 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif /* _WIN32 */
+
+#include "thread.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+/* The native entry point signatures differ from ours, so the function and its
+ * argument are handed to the new thread through one of these. */
+struct thread_start {
+  yagbe_thread_func func;
+  void* userdata;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID param) {
+#else
+static void* thread_entry(void* param) {
+#endif /* _WIN32 */
+  struct thread_start start = *(struct thread_start*)param;
+
+  free(param);
+  start.func(start.userdata);
+
+  return 0;
+}
+
+bool yagbe_thread_create(yagbe_thread* const thread,
+                         const yagbe_thread_func func, void* const userdata) {
+  struct thread_start* start;
+
+  assert(thread != NULL);
+  assert(func != NULL);
+
+  start = malloc(sizeof(struct thread_start));
+
+  if (start == NULL) {
+    return false;
+  }
+
+  start->func = func;
+  start->userdata = userdata;
+
+#ifdef _WIN32
+  *thread = CreateThread(NULL, 0, &thread_entry, start, 0, NULL);
+
+  if (*thread == NULL) {
+    free(start);
+    return false;
+  }
+#else
+  if (pthread_create(thread, NULL, &thread_entry, start) != 0) {
+    free(start);
+    return false;
+  }
+#endif /* _WIN32 */
+  return true;
+}
+
+void yagbe_thread_join(yagbe_thread* const thread) {
+  assert(thread != NULL);
+
+#ifdef _WIN32
+  WaitForSingleObject(*thread, INFINITE);
+  CloseHandle(*thread);
+#else
+  pthread_join(*thread, NULL);
+#endif /* _WIN32 */
+}
+
+void yagbe_mutex_init(yagbe_mutex* const mutex) {
+  assert(mutex != NULL);
+
+#ifdef _WIN32
+  InitializeCriticalSection(mutex);
+#else
+  pthread_mutex_init(mutex, NULL);
+#endif /* _WIN32 */
+}
+
+void yagbe_mutex_destroy(yagbe_mutex* const mutex) {
+  assert(mutex != NULL);
+
+#ifdef _WIN32
+  DeleteCriticalSection(mutex);
+#else
+  pthread_mutex_destroy(mutex);
+#endif /* _WIN32 */
+}
+
+void yagbe_mutex_lock(yagbe_mutex* const mutex) {
+  assert(mutex != NULL);
+
+#ifdef _WIN32
+  EnterCriticalSection(mutex);
+#else
+  pthread_mutex_lock(mutex);
+#endif /* _WIN32 */
+}
+
+void yagbe_mutex_unlock(yagbe_mutex* const mutex) {
+  assert(mutex != NULL);
+
+#ifdef _WIN32
+  LeaveCriticalSection(mutex);
+#else
+  pthread_mutex_unlock(mutex);
+#endif /* _WIN32 */
+}
+
+void yagbe_thread_yield(void) {
+#ifdef _WIN32
+  SwitchToThread();
+#else
+  sched_yield();
+#endif /* _WIN32 */
+}
+
+void yagbe_thread_sleep(const unsigned int milliseconds) {
+#ifdef _WIN32
+  Sleep(milliseconds);
+#else
+  struct timespec duration;
+
+  duration.tv_sec = (time_t)(milliseconds / 1000);
+  duration.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+
+  /* Carry on sleeping if a signal cuts it short. */
+  while (nanosleep(&duration, &duration) != 0) {
+  }
+#endif /* _WIN32 */
+}
+
+unsigned int yagbe_cpu_count(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+
+  GetSystemInfo(&info);
+  return (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+#else
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? (unsigned int)count : 1;
+#endif /* _WIN32 */
+}
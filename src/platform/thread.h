@@ -0,0 +1,83 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Provides the small amount of threading the frontends need on top of either
+ * POSIX threads or the Win32 API. The core library never uses any of this. */
+
+#ifndef YAGBE_PLATFORM_THREAD_H
+#define YAGBE_PLATFORM_THREAD_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif /* _WIN32 */
+
+#include "libyagbe/compat/compat_stdbool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** @brief Defines the function prototype of a thread entry point. */
+typedef void (*yagbe_thread_func)(void* const userdata);
+
+#ifdef _WIN32
+typedef HANDLE yagbe_thread;
+typedef CRITICAL_SECTION yagbe_mutex;
+#else
+typedef pthread_t yagbe_thread;
+typedef pthread_mutex_t yagbe_mutex;
+#endif /* _WIN32 */
+
+/** Starts a new thread.
+ *
+ * @param thread Receives the handle of the new thread.
+ * @param func The function the new thread should run.
+ * @param userdata Context specific data passed to the function.
+ *
+ * @returns true if the thread was started, false otherwise.
+ */
+bool yagbe_thread_create(yagbe_thread* const thread,
+                         const yagbe_thread_func func, void* const userdata);
+
+/** Waits for a thread to finish and releases its handle. */
+void yagbe_thread_join(yagbe_thread* const thread);
+
+void yagbe_mutex_init(yagbe_mutex* const mutex);
+void yagbe_mutex_destroy(yagbe_mutex* const mutex);
+void yagbe_mutex_lock(yagbe_mutex* const mutex);
+void yagbe_mutex_unlock(yagbe_mutex* const mutex);
+
+/** Gives the rest of the calling thread's time slice to other threads. */
+void yagbe_thread_yield(void);
+
+/** Suspends the calling thread.
+ *
+ * @param milliseconds How long to sleep for, at least.
+ */
+void yagbe_thread_sleep(const unsigned int milliseconds);
+
+/** @returns The number of processors available to this process, at least 1. */
+unsigned int yagbe_cpu_count(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* YAGBE_PLATFORM_THREAD_H */
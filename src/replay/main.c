@@ -0,0 +1,833 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* yagbereplay records and replays movies, and tracks down where two replays
+ * of one stop agreeing.
+ *
+ *   record  runs a ROM with the inputs from a script and saves the movie.
+ *   play    replays a movie, printing the hash at every checkpoint. The output
+ *           of two builds can be diffed to find the first checkpoint they
+ *           disagree on.
+ *   compare replays a movie on the interpreter and on the JIT or code cache
+ *           side by side, and once a checkpoint differs, bisects the frames
+ *           since the last one down to the first instruction that differs.
+ *   trace   writes the binary trace of the instructions leading up to one
+ *           checkpoint, for yagbetrace to diff against another build's.
+ *
+ * A script has one input per line: the frame to change the buttons on,
+ * followed by the buttons to hold from then on, joined by '+', or '-' for
+ * none. Blank lines and lines starting with '#' are ignored. For example:
+ *
+ *   120 start
+ *   180 a+right
+ *   200 -
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "exec_memory.h"
+#include "format.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/movie.h"
+#include "libyagbe/rom.h"
+#include "libyagbe/trace.h"
+
+/** How many ROM banks each code cache keeps decoded at once. */
+#define CODE_CACHE_BANKS 64
+
+/** How many bytes of host code each JIT can compile before it starts over. */
+#define JIT_CODE_SIZE (4UL * 1024UL * 1024UL)
+
+/** How many compiled blocks each JIT can look up at once. */
+#define JIT_BLOCKS 16384
+
+/** How many frames apart checkpoints are when recording, by default. */
+#define DEFAULT_INTERVAL 1
+
+/** How many frames to keep recording after the last input, by default. */
+#define DEFAULT_TAIL 60
+
+/** The most inputs a script can hold. */
+#define MAX_SCRIPT_INPUTS 65536
+
+/** The most checkpoints a recording can hold. */
+#define MAX_RECORDED_CHECKPOINTS 1048576
+
+/** Defines the settings given on the command line. */
+struct options {
+  /** Whether instances other than the reference one use the JIT. */
+  bool jit;
+
+  /** Whether instances other than the reference one use a code cache. */
+  bool code_cache;
+
+  /** How many frames apart checkpoints are when recording. */
+  unsigned long interval;
+
+  /** How many frames to keep recording after the last input. */
+  unsigned long tail;
+
+  /** The checkpoint to trace up to. */
+  unsigned long checkpoint;
+
+  /** What to start the names of written trace files with, or NULL to not
+   * write any. */
+  const char* trace_prefix;
+};
+
+/** Defines an emulated system along with everything it executes from. */
+struct instance {
+  struct libyagbe_system gb;
+  struct libyagbe_movie movie;
+
+  struct libyagbe_code_cache code_cache;
+  struct libyagbe_code_cache_bank* code_cache_banks;
+
+  struct libyagbe_jit jit;
+  struct libyagbe_jit_block* jit_blocks;
+  void* jit_code;
+};
+
+/** Defines the state of an instance at one point in time, so it can be
+ * returned to. */
+struct snapshot {
+  void* state;
+  size_t state_size;
+  struct libyagbe_movie movie;
+};
+
+static const struct {
+  const char* name;
+  uint8_t bit;
+} button_names[] = {
+    {"right", LIBYAGBE_JOYPAD_RIGHT}, {"left", LIBYAGBE_JOYPAD_LEFT},
+    {"up", LIBYAGBE_JOYPAD_UP},       {"down", LIBYAGBE_JOYPAD_DOWN},
+    {"a", LIBYAGBE_JOYPAD_A},         {"b", LIBYAGBE_JOYPAD_B},
+    {"select", LIBYAGBE_JOYPAD_SELECT}, {"start", LIBYAGBE_JOYPAD_START}};
+
+static void* checked_malloc(const size_t size) {
+  void* const ptr = malloc(size);
+
+  if (ptr == NULL) {
+    fprintf(stderr, "malloc() failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+/** Reads a whole file into memory, exiting if it can't be. */
+static uint8_t* read_file(const char* const path, size_t* const size) {
+  FILE* const file = fopen(path, "rb");
+  uint8_t* data;
+  long length;
+
+  if (file == NULL) {
+    fprintf(stderr, "unable to open %s: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  if ((fseek(file, 0, SEEK_END) != 0) || ((length = ftell(file)) < 0) ||
+      (fseek(file, 0, SEEK_SET) != 0)) {
+    fprintf(stderr, "unable to read %s: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  /* Never ask for 0 bytes, which malloc() may refuse. */
+  data = checked_malloc((size_t)length + 1);
+
+  if (fread(data, 1, (size_t)length, file) != (size_t)length) {
+    fprintf(stderr, "unable to read %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  fclose(file);
+  *size = (size_t)length;
+
+  return data;
+}
+
+/** Starts an instance on a ROM, from power on, executing from the JIT or a
+ * code cache if asked to. */
+static void start_instance(struct instance* const inst,
+                           const struct libyagbe_rom* const rom,
+                           const bool use_jit, const bool use_code_cache) {
+  inst->code_cache_banks = NULL;
+  inst->jit_blocks = NULL;
+  inst->jit_code = NULL;
+
+  if (!libyagbe_system_init(&inst->gb, rom->data, rom->size)) {
+    fprintf(stderr, "unsupported cartridge\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Nothing here looks at the screen. */
+  libyagbe_system_set_render(&inst->gb, false);
+
+  if (use_code_cache) {
+    inst->code_cache_banks = checked_malloc(
+        CODE_CACHE_BANKS * sizeof(struct libyagbe_code_cache_bank));
+    libyagbe_code_cache_init(&inst->code_cache, inst->code_cache_banks,
+                             CODE_CACHE_BANKS);
+    libyagbe_system_set_code_cache(&inst->gb, &inst->code_cache);
+  }
+
+  if (use_jit) {
+    inst->jit_code = yagbe_exec_memory_alloc(JIT_CODE_SIZE);
+    inst->jit_blocks =
+        checked_malloc(JIT_BLOCKS * sizeof(struct libyagbe_jit_block));
+
+    if ((inst->jit_code == NULL) ||
+        !libyagbe_jit_init(&inst->jit, inst->jit_code, JIT_CODE_SIZE,
+                           inst->jit_blocks, JIT_BLOCKS)) {
+      fprintf(stderr, "the JIT isn't supported on this host\n");
+      exit(EXIT_FAILURE);
+    }
+    libyagbe_system_set_jit(&inst->gb, &inst->jit);
+  }
+}
+
+static void stop_instance(struct instance* const inst) {
+  free(inst->code_cache_banks);
+  free(inst->jit_blocks);
+  yagbe_exec_memory_free(inst->jit_code, JIT_CODE_SIZE);
+}
+
+/** Loads a movie into an instance and starts playing it. The storage is
+ * sized for the largest movie a file of that size could hold. */
+static void load_movie(struct instance* const inst, const uint8_t* const data,
+                       const size_t size, const char* const path) {
+  const size_t max_inputs = size / LIBYAGBE_MOVIE_INPUT_SIZE;
+  const size_t max_checkpoints = size / LIBYAGBE_MOVIE_CHECKPOINT_SIZE;
+
+  libyagbe_movie_init(
+      &inst->movie,
+      checked_malloc((max_inputs + 1) * sizeof(struct libyagbe_movie_input)),
+      max_inputs,
+      checked_malloc((max_checkpoints + 1) *
+                     sizeof(struct libyagbe_movie_checkpoint)),
+      max_checkpoints);
+
+  if (!libyagbe_movie_load(&inst->movie, &inst->gb, data, size)) {
+    fprintf(stderr, "%s is not a movie of this ROM this version can play\n",
+            path);
+    exit(EXIT_FAILURE);
+  }
+  libyagbe_movie_play(&inst->movie, &inst->gb);
+}
+
+static void free_movie(struct instance* const inst) {
+  free(inst->movie.inputs);
+  free(inst->movie.checkpoints);
+}
+
+/** Returns when a checkpoint is due, relative to the start of the movie. */
+static uintmax_t get_checkpoint_due(const struct libyagbe_movie* const movie,
+                                    const size_t index) {
+  return (uintmax_t)(index + 1) * movie->interval *
+         LIBYAGBE_MOVIE_CYCLES_PER_FRAME;
+}
+
+/** Runs an instance until it reaches a checkpoint.
+ *
+ * @returns true once the checkpoint is reached, or false if the CPU locked up
+ * before it. */
+static bool run_to_checkpoint(struct instance* const inst, const size_t index) {
+  struct libyagbe_movie* const movie = &inst->movie;
+  const uintmax_t due = movie->start + get_checkpoint_due(movie, index);
+
+  while (movie->checkpoints_reached <= index) {
+    libyagbe_movie_run(movie, &inst->gb,
+                       due - inst->gb.sched.current_timestamp);
+
+    if (inst->gb.cpu.state == LIBYAGBE_CPU_STATE_LOCKED) {
+      return movie->checkpoints_reached > index;
+    }
+  }
+  return true;
+}
+
+/** Runs an instance for a single instruction, or what it spends halted. */
+static void step_instance(struct instance* const inst) {
+  libyagbe_movie_run(&inst->movie, &inst->gb, 1);
+}
+
+static void take_snapshot(struct snapshot* const snapshot,
+                          const struct instance* const inst) {
+  libyagbe_system_save_state(&inst->gb, snapshot->state, snapshot->state_size);
+  snapshot->movie = inst->movie;
+}
+
+static void restore_snapshot(const struct snapshot* const snapshot,
+                             struct instance* const inst) {
+  if (!libyagbe_system_load_state(&inst->gb, snapshot->state,
+                                  snapshot->state_size)) {
+    fprintf(stderr, "unable to restore a snapshot\n");
+    exit(EXIT_FAILURE);
+  }
+  inst->movie = snapshot->movie;
+}
+
+static void init_snapshot(struct snapshot* const snapshot,
+                          const struct instance* const inst) {
+  snapshot->state_size = libyagbe_system_get_state_size(&inst->gb);
+  snapshot->state = checked_malloc(snapshot->state_size);
+  take_snapshot(snapshot, inst);
+}
+
+/** Parses the buttons of a script line.
+ *
+ * @returns true if every button named was recognized. */
+static bool parse_buttons(char* const str, uint8_t* const buttons) {
+  char* name;
+
+  *buttons = 0;
+
+  if (strcmp(str, "-") == 0) {
+    return true;
+  }
+
+  for (name = strtok(str, "+"); name != NULL; name = strtok(NULL, "+")) {
+    size_t i;
+
+    for (i = 0; i < sizeof(button_names) / sizeof(button_names[0]); ++i) {
+      if (strcmp(name, button_names[i].name) == 0) {
+        *buttons |= button_names[i].bit;
+        break;
+      }
+    }
+
+    if (i == sizeof(button_names) / sizeof(button_names[0])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Reads the inputs of a script, which are given in frames rather than
+ * T-cycles.
+ *
+ * @returns The number of inputs read. */
+static size_t read_script(const char* const path,
+                          struct libyagbe_movie_input* const inputs) {
+  FILE* const file = fopen(path, "r");
+  char line[256];
+  unsigned long line_number = 0;
+  size_t count = 0;
+
+  if (file == NULL) {
+    fprintf(stderr, "unable to open %s: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char buttons[128];
+    unsigned long frame;
+    int fields;
+
+    line_number++;
+
+    if ((line[0] == '#') || (strspn(line, " \t\r\n") == strlen(line))) {
+      continue;
+    }
+    fields = sscanf(line, "%lu %127s", &frame, buttons);
+
+    if ((fields != 2) || (count == MAX_SCRIPT_INPUTS) ||
+        ((count != 0) && (frame < inputs[count - 1].timestamp)) ||
+        !parse_buttons(buttons, &inputs[count].buttons)) {
+      fprintf(stderr, "%s:%lu: bad input\n", path, line_number);
+      exit(EXIT_FAILURE);
+    }
+    inputs[count++].timestamp = frame;
+  }
+
+  fclose(file);
+  return count;
+}
+
+static int do_record(const struct options* const options,
+                     const struct libyagbe_rom* const rom,
+                     const char* const script_path,
+                     const char* const movie_path) {
+  struct libyagbe_movie_input* script;
+  struct instance* inst;
+  unsigned long end_frame;
+  size_t num_script;
+  size_t i;
+  uint8_t* data;
+  size_t size;
+  FILE* file;
+
+  script = checked_malloc(MAX_SCRIPT_INPUTS *
+                          sizeof(struct libyagbe_movie_input));
+  num_script = read_script(script_path, script);
+  end_frame = ((num_script == 0) ? 0 : script[num_script - 1].timestamp) +
+              options->tail;
+
+  inst = checked_malloc(sizeof(struct instance));
+  start_instance(inst, rom, options->jit, options->code_cache);
+  libyagbe_movie_init(
+      &inst->movie,
+      checked_malloc(MAX_SCRIPT_INPUTS * sizeof(struct libyagbe_movie_input)),
+      MAX_SCRIPT_INPUTS,
+      checked_malloc(MAX_RECORDED_CHECKPOINTS *
+                     sizeof(struct libyagbe_movie_checkpoint)),
+      MAX_RECORDED_CHECKPOINTS);
+  libyagbe_movie_record(&inst->movie, &inst->gb, options->interval);
+
+  for (i = 0; i <= num_script; ++i) {
+    const unsigned long frame =
+        (i < num_script) ? (unsigned long)script[i].timestamp : end_frame;
+    const uintmax_t due = inst->movie.start +
+                          ((uintmax_t)frame * LIBYAGBE_MOVIE_CYCLES_PER_FRAME);
+
+    if (inst->gb.sched.current_timestamp < due) {
+      libyagbe_movie_run(&inst->movie, &inst->gb,
+                         due - inst->gb.sched.current_timestamp);
+    }
+
+    if (i < num_script) {
+      libyagbe_movie_set_buttons(&inst->movie, &inst->gb, script[i].buttons);
+    }
+  }
+
+  size = libyagbe_movie_get_size(&inst->movie);
+  data = checked_malloc(size);
+  libyagbe_movie_save(&inst->movie, &inst->gb, data, size);
+
+  file = fopen(movie_path, "wb");
+
+  if ((file == NULL) || (fwrite(data, 1, size, file) != size)) {
+    fprintf(stderr, "unable to write %s\n", movie_path);
+    return EXIT_FAILURE;
+  }
+  fclose(file);
+
+  printf("recorded %lu inputs and %lu checkpoints over %lu frames\n",
+         (unsigned long)inst->movie.num_inputs,
+         (unsigned long)inst->movie.num_checkpoints, end_frame);
+
+  free(data);
+  free_movie(inst);
+  stop_instance(inst);
+  free(inst);
+  free(script);
+
+  return EXIT_SUCCESS;
+}
+
+/** Prints a checkpoint in a form which can be diffed against the output of
+ * another build. */
+static void print_checkpoint(const size_t index, const uintmax_t timestamp,
+                             const uintmax_t hash) {
+  char timestamp_text[YAGBE_FORMAT_UINTMAX_SIZE];
+
+  printf("%lu %s %08lX%08lX\n", (unsigned long)index,
+         yagbe_format_uintmax(timestamp_text, timestamp),
+         (unsigned long)(hash >> 32), (unsigned long)(hash & 0xFFFFFFFFUL));
+}
+
+static int do_play(const struct options* const options,
+                   const struct libyagbe_rom* const rom,
+                   const uint8_t* const data, const size_t size,
+                   const char* const movie_path) {
+  struct instance* inst;
+  struct libyagbe_movie* movie;
+  size_t i;
+  int status = EXIT_SUCCESS;
+
+  inst = checked_malloc(sizeof(struct instance));
+  start_instance(inst, rom, options->jit, options->code_cache);
+  load_movie(inst, data, size, movie_path);
+  movie = &inst->movie;
+
+  for (i = 0; i < movie->num_checkpoints; ++i) {
+    if (!run_to_checkpoint(inst, i)) {
+      printf("locked up before checkpoint %lu\n", (unsigned long)i);
+      status = EXIT_FAILURE;
+      break;
+    }
+    print_checkpoint(i, inst->gb.sched.current_timestamp - movie->start,
+                     movie->last_hash);
+  }
+
+  /* Play out any inputs after the last checkpoint too. */
+  libyagbe_movie_run(movie, &inst->gb,
+                     (movie->start + libyagbe_movie_get_length(movie)) -
+                         inst->gb.sched.current_timestamp);
+
+  if (movie->mismatch != LIBYAGBE_MOVIE_NO_MISMATCH) {
+    printf("desync at checkpoint %lu\n", (unsigned long)movie->mismatch);
+    status = EXIT_FAILURE;
+  }
+
+  free_movie(inst);
+  stop_instance(inst);
+  free(inst);
+
+  return status;
+}
+
+/** Writes a binary trace file header, exiting if it can't be. */
+static FILE* create_trace(const char* const path) {
+  uint8_t header[LIBYAGBE_TRACE_HEADER_SIZE];
+  FILE* const file = fopen(path, "wb");
+
+  libyagbe_trace_encode_header(header);
+
+  if ((file == NULL) || (fwrite(header, sizeof(header), 1, file) != 1)) {
+    fprintf(stderr, "unable to create %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  return file;
+}
+
+/** Runs an instance for a single step, writing what it did to a trace. */
+static void trace_step(struct instance* const inst, FILE* const file) {
+  struct libyagbe_trace_record record;
+  uint8_t encoded[LIBYAGBE_TRACE_RECORD_SIZE];
+
+  libyagbe_trace_begin(&record, &inst->gb.cpu, &inst->gb.bus,
+                       inst->gb.sched.current_timestamp);
+  step_instance(inst);
+  libyagbe_trace_end(&record, &inst->gb.bus);
+
+  libyagbe_trace_encode(&record, encoded);
+  fwrite(encoded, sizeof(encoded), 1, file);
+}
+
+static int do_trace(const struct options* const options,
+                    const struct libyagbe_rom* const rom,
+                    const uint8_t* const data, const size_t size,
+                    const char* const movie_path,
+                    const char* const trace_path) {
+  struct instance* inst;
+  struct libyagbe_movie* movie;
+  FILE* file;
+  size_t index = (size_t)options->checkpoint;
+  unsigned long count = 0;
+
+  inst = checked_malloc(sizeof(struct instance));
+  start_instance(inst, rom, options->jit, options->code_cache);
+  load_movie(inst, data, size, movie_path);
+  movie = &inst->movie;
+
+  if ((movie->interval == 0) || (index >= movie->num_checkpoints)) {
+    fprintf(stderr, "the movie has no checkpoint %lu\n", options->checkpoint);
+    return EXIT_FAILURE;
+  }
+
+  if ((index != 0) && !run_to_checkpoint(inst, index - 1)) {
+    fprintf(stderr, "locked up before checkpoint %lu\n",
+            (unsigned long)(index - 1));
+    return EXIT_FAILURE;
+  }
+
+  file = create_trace(trace_path);
+
+  while ((movie->checkpoints_reached <= index) &&
+         (inst->gb.cpu.state != LIBYAGBE_CPU_STATE_LOCKED)) {
+    trace_step(inst, file);
+    count++;
+  }
+  fclose(file);
+
+  printf("traced %lu steps up to checkpoint %lu\n", count,
+         options->checkpoint);
+
+  free_movie(inst);
+  stop_instance(inst);
+  free(inst);
+
+  return EXIT_SUCCESS;
+}
+
+/** Determines whether two instances are in the same state. */
+static bool instances_match(const struct instance* const a,
+                            const struct instance* const b) {
+  return libyagbe_movie_hash(&a->gb) == libyagbe_movie_hash(&b->gb);
+}
+
+/** Returns both instances to a snapshot and runs them for a number of
+ * steps. */
+static void replay_steps(struct instance* const insts,
+                         const struct snapshot* const snapshots,
+                         const unsigned long steps) {
+  unsigned long i;
+  size_t j;
+
+  for (j = 0; j < 2; ++j) {
+    restore_snapshot(&snapshots[j], &insts[j]);
+
+    for (i = 0; i < steps; ++i) {
+      step_instance(&insts[j]);
+    }
+  }
+}
+
+/** Narrows a desync down to the first step after which the instances no
+ * longer match, starting from snapshots at which they did and ending by the
+ * checkpoint at which they didn't. */
+static void bisect(const struct options* const options,
+                   struct instance* const insts,
+                   const struct snapshot* const snapshots,
+                   const size_t checkpoint) {
+  struct libyagbe_trace_record records[2];
+  char timestamp[YAGBE_FORMAT_UINTMAX_SIZE];
+  unsigned long good = 0;
+  unsigned long bad = 0;
+  size_t j;
+
+  /* Count the steps to the checkpoint, which the instances no longer agree
+   * on, so go by the reference. */
+  restore_snapshot(&snapshots[0], &insts[0]);
+
+  while ((insts[0].movie.checkpoints_reached <= checkpoint) &&
+         (insts[0].gb.cpu.state != LIBYAGBE_CPU_STATE_LOCKED)) {
+    step_instance(&insts[0]);
+    bad++;
+  }
+
+  /* The instances match after `good` steps and don't after `bad`. */
+  while (bad - good > 1) {
+    const unsigned long middle = good + ((bad - good) / 2);
+
+    replay_steps(insts, snapshots, middle);
+
+    if (instances_match(&insts[0], &insts[1])) {
+      good = middle;
+    } else {
+      bad = middle;
+    }
+  }
+
+  replay_steps(insts, snapshots, good);
+
+  for (j = 0; j < 2; ++j) {
+    libyagbe_trace_begin(&records[j], &insts[j].gb.cpu, &insts[j].gb.bus,
+                         insts[j].gb.sched.current_timestamp);
+    step_instance(&insts[j]);
+    libyagbe_trace_end(&records[j], &insts[j].gb.bus);
+  }
+
+  if (checkpoint == 0) {
+    printf("first differing step is %lu from the start", bad);
+  } else {
+    printf("first differing step is %lu after checkpoint %lu", bad,
+           (unsigned long)(checkpoint - 1));
+  }
+  printf(", at timestamp %s\n",
+         yagbe_format_uintmax(timestamp, records[0].timestamp));
+
+  for (j = 0; j < 2; ++j) {
+    const struct libyagbe_cpu_registers* const reg = &insts[j].gb.cpu.reg;
+
+    printf("%s: PC=%04X %02X %02X %02X -> PC=%04X AF=%04X BC=%04X DE=%04X "
+           "HL=%04X SP=%04X\n",
+           (j == 0) ? "reference" : "test", records[j].pc, records[j].bytes[0],
+           records[j].bytes[1], records[j].bytes[2], reg->pc.value,
+           (reg->af.byte.hi << 8) | libyagbe_cpu_get_flags(&insts[j].gb.cpu),
+           reg->bc.value, reg->de.value, reg->hl.value, reg->sp.value);
+  }
+
+  if (options->trace_prefix != NULL) {
+    const size_t length = strlen(options->trace_prefix);
+    char* const path = checked_malloc(length + sizeof(".test.bin"));
+
+    for (j = 0; j < 2; ++j) {
+      unsigned long i;
+      FILE* file;
+
+      sprintf(path, "%s.%s.bin", options->trace_prefix,
+              (j == 0) ? "ref" : "test");
+      file = create_trace(path);
+      restore_snapshot(&snapshots[j], &insts[j]);
+
+      /* One step past the last one, so the trace ends with the first record
+       * of a state the two don't agree on. */
+      for (i = 0; i <= bad; ++i) {
+        trace_step(&insts[j], file);
+      }
+      fclose(file);
+      printf("wrote %s\n", path);
+    }
+    free(path);
+  }
+}
+
+static int do_compare(const struct options* const options,
+                      const struct libyagbe_rom* const rom,
+                      const uint8_t* const data, const size_t size,
+                      const char* const movie_path) {
+  struct instance* insts;
+  struct snapshot snapshots[2];
+  size_t num_checkpoints;
+  size_t i;
+  size_t j;
+  int status = EXIT_SUCCESS;
+
+  if (!options->jit && !options->code_cache) {
+    fprintf(stderr, "compare needs -J or -c to compare against\n");
+    return EXIT_FAILURE;
+  }
+
+  insts = checked_malloc(2 * sizeof(struct instance));
+  start_instance(&insts[0], rom, false, false);
+  start_instance(&insts[1], rom, options->jit, options->code_cache);
+
+  for (j = 0; j < 2; ++j) {
+    load_movie(&insts[j], data, size, movie_path);
+    init_snapshot(&snapshots[j], &insts[j]);
+  }
+  num_checkpoints = insts[0].movie.num_checkpoints;
+
+  for (i = 0; i < num_checkpoints; ++i) {
+    const bool reference_ok = run_to_checkpoint(&insts[0], i);
+    const bool test_ok = run_to_checkpoint(&insts[1], i);
+
+    if (!reference_ok || !test_ok || (insts[0].movie.last_hash != insts[1].movie.last_hash) ||
+        (insts[0].gb.sched.current_timestamp !=
+         insts[1].gb.sched.current_timestamp)) {
+      printf("checkpoint %lu differs\n", (unsigned long)i);
+      bisect(options, insts, snapshots, i);
+
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    for (j = 0; j < 2; ++j) {
+      take_snapshot(&snapshots[j], &insts[j]);
+    }
+  }
+
+  if (status == EXIT_SUCCESS) {
+    printf("all %lu checkpoints match\n", (unsigned long)num_checkpoints);
+
+    if (insts[0].movie.mismatch != LIBYAGBE_MOVIE_NO_MISMATCH) {
+      printf("but both desync from the recording at checkpoint %lu\n",
+             (unsigned long)insts[0].movie.mismatch);
+    }
+  }
+
+  for (j = 0; j < 2; ++j) {
+    free(snapshots[j].state);
+    free_movie(&insts[j]);
+    stop_instance(&insts[j]);
+  }
+  free(insts);
+
+  return status;
+}
+
+static void usage(const char* const argv0) {
+  fprintf(stderr,
+          "%s: Syntax: %s record [-J] [-c] [-i frames] [-t frames] rom script "
+          "movie\n"
+          "       %s play [-J] [-c] rom movie\n"
+          "       %s compare [-J] [-c] [-o prefix] rom movie\n"
+          "       %s trace [-J] [-c] -k checkpoint rom movie tracefile\n",
+          argv0, argv0, argv0, argv0, argv0);
+}
+
+int main(int argc, char* argv[]) {
+  struct options options;
+  struct libyagbe_rom rom;
+  const char* command;
+  const char* paths[3];
+  size_t num_paths = 0;
+  size_t num_needed;
+  uint8_t* data = NULL;
+  size_t size = 0;
+  int status;
+  int arg;
+
+  options.jit = false;
+  options.code_cache = false;
+  options.interval = DEFAULT_INTERVAL;
+  options.tail = DEFAULT_TAIL;
+  options.checkpoint = 0;
+  options.trace_prefix = NULL;
+
+  if (argc < 2) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  command = argv[1];
+
+  for (arg = 2; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "-J") == 0) {
+      options.jit = true;
+    } else if (strcmp(argv[arg], "-c") == 0) {
+      options.code_cache = true;
+    } else if ((strcmp(argv[arg], "-i") == 0) && (arg + 1 < argc)) {
+      options.interval = strtoul(argv[++arg], NULL, 10);
+    } else if ((strcmp(argv[arg], "-t") == 0) && (arg + 1 < argc)) {
+      options.tail = strtoul(argv[++arg], NULL, 10);
+    } else if ((strcmp(argv[arg], "-k") == 0) && (arg + 1 < argc)) {
+      options.checkpoint = strtoul(argv[++arg], NULL, 10);
+    } else if ((strcmp(argv[arg], "-o") == 0) && (arg + 1 < argc)) {
+      options.trace_prefix = argv[++arg];
+    } else if ((argv[arg][0] != '-') && (num_paths < 3)) {
+      paths[num_paths++] = argv[arg];
+    } else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  num_needed = ((strcmp(command, "record") == 0) ||
+                (strcmp(command, "trace") == 0))
+                   ? 3
+                   : 2;
+
+  if (num_paths != num_needed) {
+    fprintf(stderr, "%s: missing required argument.\n", argv[0]);
+    usage(argv[0]);
+
+    return EXIT_FAILURE;
+  }
+
+  if (!libyagbe_rom_open(&rom, paths[0])) {
+    fprintf(stderr, "%s: unable to load ROM %s\n", argv[0], paths[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (strcmp(command, "record") != 0) {
+    data = read_file(paths[1], &size);
+  }
+
+  if (strcmp(command, "record") == 0) {
+    status = do_record(&options, &rom, paths[1], paths[2]);
+  } else if (strcmp(command, "play") == 0) {
+    status = do_play(&options, &rom, data, size, paths[1]);
+  } else if (strcmp(command, "compare") == 0) {
+    status = do_compare(&options, &rom, data, size, paths[1]);
+  } else if (strcmp(command, "trace") == 0) {
+    status = do_trace(&options, &rom, data, size, paths[1], paths[2]);
+  } else {
+    usage(argv[0]);
+    status = EXIT_FAILURE;
+  }
+
+  free(data);
+  libyagbe_rom_close(&rom);
+
+  return status;
+}
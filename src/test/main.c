@@ -21,46 +21,83 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "libyagbe/disasm.h"
+#include "libyagbe/compat/compat_stdbool.h"
 #include "libyagbe/gb.h"
+#include "libyagbe/rom.h"
+#include "libyagbe/trace.h"
+#include "thread.h"
 
-static uint8_t* open_rom(const char* const file) {
-  FILE* const rom_file = fopen(file, "rb");
-  long rom_file_size;
-  uint8_t* data;
+/** The number of records the emulation thread can get ahead of the writer. */
+#define TRACE_RING_CAPACITY 65536
 
-  if (rom_file == NULL) {
-    fprintf(stderr, "unable to open ROM file %s: %s\n", file, strerror(errno));
-    exit(EXIT_FAILURE);
-  }
+/** The most records the writer handles at once. */
+#define TRACE_BATCH_SIZE 1024
+
+static void handle_serial_output(void* const userdata, const uint8_t data) {
+  (void)userdata;
+  putchar(data);
+}
 
-  if (fseek(rom_file, 0, SEEK_END) != 0) {
-    fprintf(stderr, "fseek() failed: %s", strerror(errno));
-    exit(EXIT_FAILURE);
+static void handle_unhandled_access(void* const userdata,
+                                    const enum libyagbe_diag_access access,
+                                    const uint16_t address, const uint8_t data,
+                                    const unsigned long hits) {
+  (void)userdata;
+
+  if (access == LIBYAGBE_DIAG_ACCESS_READ) {
+    fprintf(stderr, "Unhandled read: $%04X (%lu times)\n", address, hits);
+  } else {
+    fprintf(stderr, "Unhandled write: $%04X <- $%02X (%lu times)\n", address,
+            data, hits);
   }
+}
 
-  rom_file_size = ftell(rom_file);
-  fseek(rom_file, 0, SEEK_SET);
+/** Handles the trace file on behalf of the emulation thread. */
+struct trace_writer {
+  struct libyagbe_trace_ring ring;
+  FILE* file;
 
-  data = malloc(sizeof(uint8_t) * (size_t)rom_file_size);
+  /** Records being encoded, owned by the writer thread. */
+  struct libyagbe_trace_record batch[TRACE_BATCH_SIZE];
+  uint8_t encoded[TRACE_BATCH_SIZE * LIBYAGBE_TRACE_RECORD_SIZE];
+};
 
-  if (data == NULL) {
-    fprintf(stderr, "malloc() failed: %s\n", strerror(errno));
-    exit(EXIT_FAILURE);
-  }
+static void write_trace(void* const userdata) {
+  struct trace_writer* const writer = (struct trace_writer*)userdata;
 
-  fread(data, sizeof(uint8_t), (size_t)rom_file_size, rom_file);
+  for (;;) {
+    /* Anything pushed before the ring was closed is visible to the pop. */
+    const bool closed = libyagbe_trace_ring_is_closed(&writer->ring);
+    const size_t count = libyagbe_trace_ring_pop(&writer->ring, writer->batch,
+                                                 TRACE_BATCH_SIZE);
+    size_t i;
+
+    if (count == 0) {
+      if (closed) {
+        return;
+      }
+      yagbe_thread_sleep(1);
+      continue;
+    }
 
-  fclose(rom_file);
-  return data;
+    for (i = 0; i < count; ++i) {
+      libyagbe_trace_encode(&writer->batch[i],
+                            &writer->encoded[i * LIBYAGBE_TRACE_RECORD_SIZE]);
+    }
+    fwrite(writer->encoded, LIBYAGBE_TRACE_RECORD_SIZE, count, writer->file);
+  }
 }
 
 int main(int argc, char* argv[]) {
-  uint8_t* rom_data;
+  struct libyagbe_rom rom;
   struct libyagbe_system gb;
 
-  char* disasm;
-  FILE* trace_file;
+  struct trace_writer* writer;
+  struct libyagbe_trace_record* records;
+  struct libyagbe_trace_record record;
+  uint8_t header[LIBYAGBE_TRACE_HEADER_SIZE];
+  yagbe_thread writer_thread;
+  unsigned int cycles;
 
   if (argc < 2) {
     fprintf(stderr, "%s: missing required argument.\n", argv[0]);
@@ -69,25 +106,65 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
-  rom_data = open_rom(argv[1]);
-  libyagbe_system_init(&gb, rom_data);
+  if (!libyagbe_rom_open(&rom, argv[1])) {
+    fprintf(stderr, "%s: unable to open ROM file %s: %s\n", argv[0], argv[1],
+            strerror(errno));
+    return EXIT_FAILURE;
+  }
 
-  trace_file = fopen("trace.txt", "w");
+  if (!libyagbe_system_init(&gb, rom.data, rom.size)) {
+    fprintf(stderr, "%s: unsupported cartridge %s\n", argv[0], argv[1]);
+    libyagbe_rom_close(&rom);
 
-  for (;;) {
-    libyagbe_disasm_prepare(gb.cpu.reg.pc.value, &gb.cpu, &gb.bus);
+    return EXIT_FAILURE;
+  }
+  libyagbe_system_set_serial_cb(&gb, &handle_serial_output, NULL);
+  libyagbe_system_set_diag_cb(&gb, &handle_unhandled_access, NULL);
 
-    if (libyagbe_system_step(&gb) == 0) {
-      disasm = libyagbe_disasm_execute(&gb.cpu, &gb.bus);
-      fprintf(trace_file, "%s\n", disasm);
+  writer = malloc(sizeof(struct trace_writer));
+  records = malloc(sizeof(struct libyagbe_trace_record) * TRACE_RING_CAPACITY);
 
-      fflush(trace_file);
-      fclose(trace_file);
+  if ((writer == NULL) || (records == NULL)) {
+    fprintf(stderr, "%s: malloc() failed: %s\n", argv[0], strerror(errno));
+    return EXIT_FAILURE;
+  }
 
-      return EXIT_FAILURE;
-    }
+  writer->file = fopen("trace.bin", "wb");
+
+  if (writer->file == NULL) {
+    fprintf(stderr, "%s: unable to create trace.bin: %s\n", argv[0],
+            strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  libyagbe_trace_encode_header(header);
+  fwrite(header, sizeof(header), 1, writer->file);
+
+  libyagbe_trace_ring_init(&writer->ring, records, TRACE_RING_CAPACITY);
 
-    disasm = libyagbe_disasm_execute(&gb.cpu, &gb.bus);
-    fprintf(trace_file, "%s\n", disasm);
+  if (!yagbe_thread_create(&writer_thread, &write_trace, writer)) {
+    fprintf(stderr, "%s: unable to start the trace writer\n", argv[0]);
+    return EXIT_FAILURE;
   }
+
+  do {
+    libyagbe_trace_begin(&record, &gb.cpu, &gb.bus, gb.sched.current_timestamp);
+    cycles = libyagbe_system_step(&gb);
+    libyagbe_trace_end(&record, &gb.bus);
+
+    /* Never drop a record; wait for the writer to catch up instead. */
+    while (!libyagbe_trace_ring_push(&writer->ring, &record)) {
+      yagbe_thread_yield();
+    }
+  } while (cycles != 0);
+
+  libyagbe_trace_ring_close(&writer->ring);
+  yagbe_thread_join(&writer_thread);
+
+  fclose(writer->file);
+  free(records);
+  free(writer);
+  libyagbe_rom_close(&rom);
+
+  return EXIT_FAILURE;
 }
@@ -0,0 +1,176 @@
+/*
+ * yagbe - Yet Another Game Boy Emulator
+ *
+ * Copyright 2021 Michael Rodriguez aka kaichiuchu <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* yagbetrace turns the binary trace written by the emulator into text, one
+ * line per instruction. Nothing is formatted while the emulator runs; it's
+ * only done here, when somebody actually wants to read the trace.
+ *
+ * Given two traces, such as yagbereplay writes for the same checkpoint of a
+ * movie on two builds, it prints only the first record they differ in. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+#include "libyagbe/disasm.h"
+#include "libyagbe/trace.h"
+
+static void print_record(FILE* const out,
+                         const struct libyagbe_trace_record* const record) {
+  char instruction[LIBYAGBE_DISASM_INSTRUCTION_SIZE];
+  char timestamp[YAGBE_FORMAT_UINTMAX_SIZE];
+
+  libyagbe_disasm_format(instruction, record->pc, record->bytes);
+
+  fprintf(out, "%10s  PC=%04X AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X  ",
+          yagbe_format_uintmax(timestamp, record->timestamp), record->pc,
+          record->af, record->bc, record->de, record->hl, record->sp);
+
+  if (record->flags & LIBYAGBE_TRACE_FLAG_MEM) {
+    fprintf(out, "%-20s [$%04X]=$%02X", instruction, record->mem_address,
+            record->mem_data);
+  } else {
+    fputs(instruction, out);
+  }
+  fputc('\n', out);
+}
+
+/** Opens a trace file and checks its header.
+ *
+ * @returns The file, positioned at the first record, or NULL if it couldn't
+ * be opened or isn't a trace file, in which case the reason was printed. */
+static FILE* open_trace(const char* const argv0, const char* const path) {
+  uint8_t header[LIBYAGBE_TRACE_HEADER_SIZE];
+  FILE* const trace_file = fopen(path, "rb");
+
+  if (trace_file == NULL) {
+    fprintf(stderr, "%s: unable to open trace file %s: %s\n", argv0, path,
+            strerror(errno));
+    return NULL;
+  }
+
+  if ((fread(header, sizeof(header), 1, trace_file) != 1) ||
+      !libyagbe_trace_check_header(header)) {
+    fprintf(stderr, "%s: %s is not a trace file this version can read\n",
+            argv0, path);
+    fclose(trace_file);
+
+    return NULL;
+  }
+  return trace_file;
+}
+
+/** Finds the first record in which two traces differ, and prints it from
+ * both along with the record before it.
+ *
+ * @returns true if the traces are the same. */
+static bool compare_traces(FILE* const a, FILE* const b) {
+  uint8_t encoded[2][LIBYAGBE_TRACE_RECORD_SIZE];
+  struct libyagbe_trace_record record;
+  struct libyagbe_trace_record previous;
+  unsigned long index = 0;
+
+  for (;;) {
+    const bool have_a = fread(encoded[0], sizeof(encoded[0]), 1, a) == 1;
+    const bool have_b = fread(encoded[1], sizeof(encoded[1]), 1, b) == 1;
+
+    if (!have_a && !have_b) {
+      printf("the traces are the same, %lu records\n", index);
+      return true;
+    }
+
+    if (have_a && have_b &&
+        (memcmp(encoded[0], encoded[1], sizeof(encoded[0])) == 0)) {
+      libyagbe_trace_decode(&previous, encoded[0]);
+      index++;
+
+      continue;
+    }
+
+    printf("the traces differ at record %lu\n", index);
+
+    if (index != 0) {
+      printf("  ");
+      print_record(stdout, &previous);
+    }
+
+    if (have_a) {
+      libyagbe_trace_decode(&record, encoded[0]);
+      printf("< ");
+      print_record(stdout, &record);
+    } else {
+      printf("< (end of trace)\n");
+    }
+
+    if (have_b) {
+      libyagbe_trace_decode(&record, encoded[1]);
+      printf("> ");
+      print_record(stdout, &record);
+    } else {
+      printf("> (end of trace)\n");
+    }
+    return false;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  uint8_t encoded[LIBYAGBE_TRACE_RECORD_SIZE];
+  struct libyagbe_trace_record record;
+  FILE* trace_file;
+
+  if (argc < 2) {
+    fprintf(stderr, "%s: missing required argument.\n", argv[0]);
+    fprintf(stderr, "%s: Syntax: %s tracefile [othertracefile]\n", argv[0],
+            argv[0]);
+
+    return EXIT_FAILURE;
+  }
+
+  trace_file = open_trace(argv[0], argv[1]);
+
+  if (trace_file == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  /* Given two traces, only say where they start to differ. */
+  if (argc > 2) {
+    FILE* const other_file = open_trace(argv[0], argv[2]);
+    bool same;
+
+    if (other_file == NULL) {
+      fclose(trace_file);
+      return EXIT_FAILURE;
+    }
+    same = compare_traces(trace_file, other_file);
+
+    fclose(other_file);
+    fclose(trace_file);
+
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  while (fread(encoded, sizeof(encoded), 1, trace_file) == 1) {
+    libyagbe_trace_decode(&record, encoded);
+    print_record(stdout, &record);
+  }
+
+  fclose(trace_file);
+  return EXIT_SUCCESS;
+}